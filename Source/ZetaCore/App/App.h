@@ -12,6 +12,7 @@ namespace ZetaRay::Support
     struct alignas(64) Task;
     struct ParamVariant;
     struct Stat;
+    class TaskProfiler;
 
     static constexpr int MAX_NUM_THREADS = 16;
     inline thread_local int g_threadIdx = -1;
@@ -68,7 +69,8 @@ namespace ZetaRay::Scene::Renderer
 
 namespace ZetaRay::App
 {
-    static constexpr int FRAME_ALLOCATOR_MAX_ALLOCATION_SIZE = 512 * 1024;
+    // Larger frame allocations are served separately, see Support/FrameMemory.h
+    static constexpr int FRAME_ALLOCATOR_BLOCK_SIZE = 512 * 1024;
 
     struct ShaderReloadHandler
     {
@@ -111,14 +113,28 @@ namespace ZetaRay::App
         BACKGROUND
     };
 
+    struct ThreadPoolStats
+    {
+        uint32_t NumTasksExecuted;
+        // Number of tasks that were executed by a thread other than the one that inserted them
+        uint32_t NumSteals;
+        // Number of times a worker ran out of tasks and went to sleep
+        uint32_t NumSleeps;
+    };
+
     CpuInfo GetProcessorInfo();
     void SetThreadPriority(void* handle, THREAD_PRIORITY priority);
     void SetThreadDesc(void* handle, wchar_t* buffer);
 
     void Init(Scene::Renderer::Interface& rendererInterface, 
         const char* name = nullptr);
-    void InitBasic();
+    // Thread pool, task system and frame memory without a window. With createDevice = false,
+    // no D3D12 device is created, so nothing that touches the GPU may be called.
+    void InitBasic(bool createDevice = true);
     void ShutdownBasic();
+    // For usage with InitBasic() -- releases per-frame state (task handles and frame 
+    // allocations). All the previously submitted tasks must have finished.
+    void ResetFrameBasic();
     int Run();
     void Abort();
 
@@ -127,7 +143,9 @@ namespace ZetaRay::App
 
     int RegisterTask();
     void TaskFinalizedCallback(int handle, int indegree);
-    void WaitForAdjacentHeadNodes(int handle);
+    // Holds on to the given task until its last dependency has finished, after which 
+    // it's inserted into the worker thread pool's queue
+    void DeferTask(Support::Task&& t);
     void SignalAdjacentTailNodes(Util::Span<int> taskIDs);
 
     // Submits task to priority thread pool
@@ -141,6 +159,9 @@ namespace ZetaRay::App
     Scene::SceneCore& GetScene();
     const Scene::Camera& GetCamera();
     int GetNumWorkerThreads();
+    // Returns the worker thread pool's counters accumulated since the last call and resets 
+    // them. Note that App::Run() consumes these every frame for the frame stats.
+    ThreadPoolStats GetAndResetWorkerStats();
     int GetNumBackgroundThreads();
     uint32_t GetDPI();
     float GetDPIScaling();
@@ -168,6 +189,8 @@ namespace ZetaRay::App
     void AddFrameStat(const char* group, const char* name, uint32_t num, 
         uint32_t total);
     Util::SynchronizedSpan<Support::Stat> GetStats();
+    // Records task executions while enabled, can be exported as a Chrome trace
+    Support::TaskProfiler& GetTaskProfiler();
     Util::Span<float> GetFrameTimeHistory();
 
     const char* GetPSOCacheDir();
@@ -195,31 +218,4 @@ namespace ZetaRay::App
         ZetaInline void FreeAligned(void* mem, size_t size, 
             size_t alignment) {}
     };
-
-    struct OneTimeFrameAllocatorWithFallback
-    {
-        ZetaInline void* AllocateAligned(size_t size, size_t alignment = alignof(std::max_align_t))
-        {
-#ifndef NDEBUG
-            Assert(m_numAllocs++ == 0, "This allocator can't be used more than once.");
-#endif
-            if (size + alignment - 1 < App::FRAME_ALLOCATOR_MAX_ALLOCATION_SIZE)
-                return App::AllocateFrameAllocator(size, alignment);
-
-            m_usedFallback = true;
-            return _aligned_malloc(size, alignment);
-        }
-
-        ZetaInline void FreeAligned(void* mem, size_t size, size_t alignment = alignof(std::max_align_t))
-        {
-            if(m_usedFallback)
-                _aligned_free(mem);
-        }
-
-    private:
-#ifndef NDEBUG
-        int m_numAllocs = 0;
-#endif
-        bool m_usedFallback = false;
-    };
 }
@@ -13,7 +13,61 @@ namespace ZetaRay::App::Filesystem
     void RemoveFile(const char* path);
     bool Exists(const char* path);
     size_t GetFileSize(const char* path);
+    // Returns zero if the file doesn't exist
+    uint64_t GetLastWriteTime(const char* path);
     void CreateDirectoryIfNotExists(const char* path);
     bool Copy(const char* srcPath, const char* dstPath, bool overwrite = false);
     bool IsDirectory(const char* path);
+    // Calls f with the full path of every file in the given directory (not recursive)
+    void ForEachFile(const char* directory, void(*f)(void* param, const char* path), void* param);
+
+    // Read-only view of a file's contents that is backed by a memory mapping, so pages are
+    // read from disk on first access rather than copied into a separate buffer upfront
+    struct MappedFile
+    {
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Returns false if the file couldn't be opened or mapped
+        bool Open(const char* path);
+        void Close();
+        ZetaInline bool IsOpen() const { return m_data != nullptr; }
+        ZetaInline Util::Span<uint8_t> Data() const { return Util::Span<uint8_t>(m_data, m_sizeInBytes); }
+
+    private:
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+        const uint8_t* m_data = nullptr;
+        size_t m_sizeInBytes = 0;
+    };
+
+    // Reads whole files with overlapped I/O, so that several reads are in flight at the same
+    // time and each file can be processed as soon as its read finishes rather than after all
+    // of them. Meant to be used by one thread at a time.
+    struct AsyncFileReader
+    {
+        // Called once per file, in order of completion, on the thread that called ReadAll().
+        // Data is empty if the file is empty or couldn't be read.
+        using CompletionFunc = void(*)(void* param, size_t fileIdx, Util::Span<uint8_t> data);
+
+        // Number of reads that are issued at once
+        static constexpr int MAX_NUM_IN_FLIGHT = 16;
+
+        AsyncFileReader();
+        ~AsyncFileReader();
+
+        AsyncFileReader(const AsyncFileReader&) = delete;
+        AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+        // Reads the given files into memory from the given allocator and returns after all of
+        // them have completed. Files larger than 4 GB aren't supported.
+        void ReadAll(Util::Span<const char*> paths, Support::ArenaAllocator allocator,
+            CompletionFunc onCompletion, void* param);
+
+    private:
+        void* m_completionPort;
+    };
 }
\ No newline at end of file
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "../Utility/DirtyRanges.h"
+
+namespace ZetaRay::Core
+{
+    // Copies CPU data into some destination buffer. Kept free of graphics API types so that
+    // code that decides what to upload doesn't depend on the backend (e.g. it can be tested
+    // with a destination that is plain memory). See GpuMemory::GetDefaultHeapUploader() for
+    // uploading to a GPU buffer.
+    struct BufferUploader
+    {
+        using UploadFunc = void(*)(void* param, const void* data, uint32_t sizeInBytes,
+            uint32_t destOffsetInBytes);
+
+        ZetaInline void Upload(const void* data, uint32_t sizeInBytes, uint32_t destOffsetInBytes) const
+        {
+            Func(Param, data, sizeInBytes, destOffsetInBytes);
+        }
+
+        UploadFunc Func = nullptr;
+        // Passed to Func as is, e.g. the destination buffer
+        void* Param = nullptr;
+    };
+
+    // Uploads elements of "data" that are marked as modified, one copy per range, so that
+    // element i ends up at byte offset i * sizeof(T) in the destination. Ranges are cleared
+    // afterwards. Returns the number of uploaded bytes.
+    template<typename T>
+    size_t UploadDirtyRanges(const T* data, Util::DirtyRanges& ranges, const BufferUploader& uploader)
+    {
+        size_t numBytes = 0;
+
+        for (auto& r : ranges.Ranges())
+        {
+            const uint32_t sizeInBytes = r.Count * sizeof(T);
+            uploader.Upload(data + r.Base, sizeInBytes, r.Base * sizeof(T));
+            numBytes += sizeInBytes;
+        }
+
+        ranges.clear();
+
+        return numBytes;
+    }
+}
@@ -521,6 +521,47 @@ namespace
             subresources));
     }
 
+    // Validates the header of DDS data that's been loaded into memory and returns pointers
+    // into it
+    LOAD_DDS_RESULT ParseDDSData(const uint8_t* ddsData, size_t sizeInBytes, const DDS_HEADER** header,
+        const uint8_t** bitData, size_t* bitSize)
+    {
+        // Need at least enough data to fill the header and magic number to be a valid DDS
+        if (sizeInBytes < (sizeof(DDS_HEADER) + sizeof(uint32_t)))
+            return LOAD_DDS_RESULT::INVALID_DDS;
+
+        // DDS files always start with the same magic number ("DDS ")
+        uint32_t dwMagicNumber = *reinterpret_cast<const uint32_t*>(ddsData);
+        if (dwMagicNumber != DDS_MAGIC)
+            return LOAD_DDS_RESULT::INVALID_DDS_HEADER;
+
+        auto hdr = reinterpret_cast<const DDS_HEADER*>(reinterpret_cast<uintptr_t>(ddsData) + sizeof(uint32_t));
+
+        // Verify header to validate DDS file
+        if (hdr->size != sizeof(DDS_HEADER) || hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
+            return LOAD_DDS_RESULT::INVALID_DDS_HEADER;
+
+        // Check for DX10 extension
+        bool bDXT10Header = false;
+        if ((hdr->ddspf.flags & DDS_FOURCC) &&
+            (MAKEFOURCC('D', 'X', '1', '0') == hdr->ddspf.fourCC))
+        {
+            // Must be long enough for both headers and magic value
+            if (sizeInBytes < (sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10)))
+                return LOAD_DDS_RESULT::INVALID_DDS_HEADER;
+
+            bDXT10Header = true;
+        }
+
+        // setup the pointers in the process request
+        *header = hdr;
+        ptrdiff_t offset = sizeof(uint32_t) + sizeof(DDS_HEADER) + (bDXT10Header ? sizeof(DDS_HEADER_DXT10) : 0);
+        *bitData = ddsData + offset;
+        *bitSize = sizeInBytes - offset;
+
+        return LOAD_DDS_RESULT::SUCCESS;
+    }
+
     LOAD_DDS_RESULT LoadTextureDataFromFile(const char* fileName, ArenaAllocator allocator,
         const DDS_HEADER** header, const uint8_t** bitData, size_t* bitSize)
     {
@@ -590,47 +631,10 @@ namespace
             return LOAD_DDS_RESULT::UNKNOWN;
         }
 
-        // DDS files always start with the same magic number ("DDS ")
-        uint32_t dwMagicNumber = *reinterpret_cast<const uint32_t*>(ddsData);
-        if (dwMagicNumber != DDS_MAGIC)
-        {
-            CloseHandle(hFile);
-            return LOAD_DDS_RESULT::INVALID_DDS_HEADER;
-        }
-
-        auto hdr = reinterpret_cast<const DDS_HEADER*>(reinterpret_cast<uintptr_t>(ddsData) + sizeof(uint32_t));
-
-        // Verify header to validate DDS file
-        if (hdr->size != sizeof(DDS_HEADER) || hdr->ddspf.size != sizeof(DDS_PIXELFORMAT))
-        {
-            CloseHandle(hFile);
-            return LOAD_DDS_RESULT::INVALID_DDS_HEADER;
-        }
-
-        // Check for DX10 extension
-        bool bDXT10Header = false;
-        if ((hdr->ddspf.flags & DDS_FOURCC) &&
-            (MAKEFOURCC('D', 'X', '1', '0') == hdr->ddspf.fourCC))
-        {
-            // Must be long enough for both headers and magic value
-            if (fileInfo.EndOfFile.LowPart < (sizeof(DDS_HEADER) + sizeof(uint32_t) + sizeof(DDS_HEADER_DXT10)))
-            {
-                CloseHandle(hFile);
-                return LOAD_DDS_RESULT::INVALID_DDS_HEADER;
-            }
-
-            bDXT10Header = true;
-        }
-
-        // setup the pointers in the process request
-        *header = hdr;
-        ptrdiff_t offset = sizeof(uint32_t) + sizeof(DDS_HEADER) + (bDXT10Header ? sizeof(DDS_HEADER_DXT10) : 0);
-        *bitData = reinterpret_cast<uint8_t*>(ddsData) + offset;
-        *bitSize = fileInfo.EndOfFile.LowPart - offset;
-
         CloseHandle(hFile);
 
-        return LOAD_DDS_RESULT::SUCCESS;
+        return ParseDDSData(reinterpret_cast<const uint8_t*>(ddsData), fileInfo.EndOfFile.LowPart, 
+            header, bitData, bitSize);
     }
 }
 
@@ -986,6 +990,29 @@ LOAD_DDS_RESULT Direct3DUtil::LoadDDSFromFile(const char* path,
     return LOAD_DDS_RESULT::SUCCESS;
 }
 
+LOAD_DDS_RESULT Direct3DUtil::LoadDDSFromMemory(Span<uint8_t> ddsData,
+    MutableSpan<D3D12_SUBRESOURCE_DATA> subresources,
+    DXGI_FORMAT& format,
+    uint32_t& width,
+    uint32_t& height,
+    uint32_t& depth,
+    uint16_t& mipCount,
+    uint32_t& numSubresources)
+{
+    const DDS_HEADER* header = nullptr;
+    const uint8_t* bitData = nullptr;
+    size_t bitSize = 0;
+
+    auto res = ParseDDSData(ddsData.data(), ddsData.size(), &header, &bitData, &bitSize);
+    if (res != LOAD_DDS_RESULT::SUCCESS)
+        return res;
+
+    FillSubresourceData(header, subresources, bitData, bitSize, width, height,
+        depth, mipCount, numSubresources, format);
+
+    return LOAD_DDS_RESULT::SUCCESS;
+}
+
 D3D12_GRAPHICS_PIPELINE_STATE_DESC Direct3DUtil::GetPSODesc(const D3D12_INPUT_LAYOUT_DESC* inputLayout,
     int numRenderTargets, 
     DXGI_FORMAT* rtvFormats, 
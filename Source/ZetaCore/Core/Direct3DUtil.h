@@ -577,6 +577,15 @@ namespace ZetaRay::Core::Direct3DUtil
         uint32_t& depth,
         uint16_t& mipCount,
         uint32_t& numSubresources);
+    // Subresources point into ddsData, which must outlive them
+    LOAD_DDS_RESULT LoadDDSFromMemory(Util::Span<uint8_t> ddsData,
+        Util::MutableSpan<D3D12_SUBRESOURCE_DATA> subresources,
+        DXGI_FORMAT& format,
+        uint32_t& width,
+        uint32_t& height,
+        uint32_t& depth,
+        uint16_t& mipCount,
+        uint32_t& numSubresources);
 
     D3D12_GRAPHICS_PIPELINE_STATE_DESC GetPSODesc(const D3D12_INPUT_LAYOUT_DESC* inputLayout,
         int numRenderTargets,
@@ -1160,6 +1160,17 @@ void GpuMemory::UploadToDefaultHeapBuffer(Buffer& buffer, uint32_t sizeInBytes,
         destOffsetInBytes);
 }
 
+BufferUploader GpuMemory::GetDefaultHeapUploader(Buffer& buffer)
+{
+    return BufferUploader{ .Func = [](void* param, const void* data, uint32_t sizeInBytes, uint32_t destOffsetInBytes)
+        {
+            UploadToDefaultHeapBuffer(*reinterpret_cast<Buffer*>(param), sizeInBytes,
+                MemoryRegion{ .Data = const_cast<void*>(data), .SizeInBytes = sizeInBytes },
+                destOffsetInBytes);
+        },
+        .Param = &buffer };
+}
+
 ResourceHeap GpuMemory::GetResourceHeap(uint64_t sizeInBytes, uint64_t alignment, 
     bool createZeroed)
 {
@@ -1473,6 +1484,12 @@ LOAD_DDS_RESULT GpuMemory::GetDDSDataFromDisk(const char* texPath,
         dds.numSubresources);
 }
 
+LOAD_DDS_RESULT GpuMemory::GetDDSDataFromMemory(Span<uint8_t> ddsData, DDS_Data& dds)
+{
+    return Direct3DUtil::LoadDDSFromMemory(ddsData, dds.subresources, dds.format, 
+        dds.width, dds.height, dds.depth, dds.mipCount, dds.numSubresources);
+}
+
 LOAD_DDS_RESULT GpuMemory::GetTexture3DFromDisk(const char* texPath, Texture& tex)
 {
     // TODO MAX_NUM_SUBRESOURCES is not enough for 3D textures with mipmaps, though 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Direct3DUtil.h"
+#include "BufferUpload.h"
 #include "../Utility/Span.h"
 #include "../Support/OffsetAllocator.h"
 
@@ -306,6 +307,9 @@ namespace ZetaRay::Core::GpuMemory
         bool forceSeparateUploadBuffer = false);
     void UploadToDefaultHeapBuffer(Buffer& buffer, uint32_t sizeInBytes, 
         Util::MemoryRegion sourceData, uint32_t destOffsetInBytes = 0);
+    // Returned uploader calls UploadToDefaultHeapBuffer() on the given buffer, which must
+    // outlive it
+    BufferUploader GetDefaultHeapUploader(Buffer& buffer);
     ResourceHeap GetResourceHeap(uint64_t sizeInBytes, 
         uint64_t alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT,
         bool createZeroed = false);
@@ -356,6 +360,8 @@ namespace ZetaRay::Core::GpuMemory
         Texture::ID_TYPE ID, Texture& tex, UploadHeapArena& heapArena, Support::ArenaAllocator allocator);
     Core::Direct3DUtil::LOAD_DDS_RESULT GetDDSDataFromDisk(const char* texPath,
         DDS_Data& dds, UploadHeapArena& heapArena, Support::ArenaAllocator allocator);
+    // Subresources point into ddsData, which must outlive them
+    Core::Direct3DUtil::LOAD_DDS_RESULT GetDDSDataFromMemory(Util::Span<uint8_t> ddsData, DDS_Data& dds);
     Core::Direct3DUtil::LOAD_DDS_RESULT GetTexture3DFromDisk(const char* texPath,
         Texture& tex);
     Texture GetTexture2DAndInit(const char* name, uint64_t width, uint32_t height, DXGI_FORMAT format,
@@ -1,62 +1,625 @@
 #include "BVH.h"
 #include "../Math/CollisionFuncs.h"
 #include "../Utility/Error.h"
-#include "../App/Log.h"
 #include "../Scene/SceneCommon.h"
+#include "../Support/ParallelFor.h"
 #include <algorithm>
+#include <atomic>
+#include <string.h>
 
+using namespace ZetaRay;
 using namespace ZetaRay::Util;
 using namespace ZetaRay::Math;
+using namespace ZetaRay::Support;
 
 namespace
 {
+    static constexpr int NUM_SAH_BINS = 16;
+    static constexpr size_t PARALLEL_SPLIT_GRAIN = 4096;
+    static constexpr size_t PARTITION_BLOCK_SIZE = 4096;
+    static constexpr size_t UPDATE_GRAIN = 256;
+    static constexpr size_t REFIT_GRAIN = 64;
+    // Marks nodes that don't need to be refit
+    static constexpr uint32_t CLEAN_NODE = UINT32_MAX;
+
+    ZetaInline void __vectorcall LoadInstance(const BVH::BVHInput& instance, __m128& vMin, 
+        __m128& vMax, __m128& vCentroid)
+    {
+        const v_AABB vBox(instance.BoundingBox);
+        vMin = _mm_sub_ps(vBox.vCenter, vBox.vExtents);
+        vMax = _mm_add_ps(vBox.vCenter, vBox.vExtents);
+        vCentroid = vBox.vCenter;
+    }
+
+    // Bin index of the given centroid along each axis. Axes with (almost) zero centroid 
+    // extent have a scale of zero and always map to the first bin.
+    ZetaInline __m128i __vectorcall BinIndices(__m128 vCentroid, __m128 vCentroidMin, __m128 vScale)
+    {
+        const __m128 vIdx = _mm_mul_ps(_mm_sub_ps(vCentroid, vCentroidMin), vScale);
+        return _mm_min_epi32(_mm_cvttps_epi32(vIdx), _mm_set1_epi32(NUM_SAH_BINS - 1));
+    }
+
+    // AABBs are tracked as min & max points during the build -- unlike unionAABB(), which 
+    // goes through center & extents, the result is exact and independent of the order in 
+    // which instances are visited
+    struct Bounds
+    {
+        ZetaInline void __vectorcall Extend(__m128 vMin, __m128 vMax, __m128 vCentroid)
+        {
+            vBoxMin = _mm_min_ps(vBoxMin, vMin);
+            vBoxMax = _mm_max_ps(vBoxMax, vMax);
+            vCentroidMin = _mm_min_ps(vCentroidMin, vCentroid);
+            vCentroidMax = _mm_max_ps(vCentroidMax, vCentroid);
+        }
+
+        ZetaInline void Extend(const Bounds& other)
+        {
+            vBoxMin = _mm_min_ps(vBoxMin, other.vBoxMin);
+            vBoxMax = _mm_max_ps(vBoxMax, other.vBoxMax);
+            vCentroidMin = _mm_min_ps(vCentroidMin, other.vCentroidMin);
+            vCentroidMax = _mm_max_ps(vCentroidMax, other.vCentroidMax);
+        }
+
+        __m128 vBoxMin = _mm_set1_ps(FLT_MAX);
+        __m128 vBoxMax = _mm_set1_ps(-FLT_MAX);
+        __m128 vCentroidMin = _mm_set1_ps(FLT_MAX);
+        __m128 vCentroidMax = _mm_set1_ps(-FLT_MAX);
+    };
+
     struct alignas(16) Bin
     {
-        ZetaInline void __vectorcall Extend(v_AABB box)
+        ZetaInline void __vectorcall Extend(__m128 vMin, __m128 vMax)
         {
-            Box = NumEntries > 0 ? unionAABB(Box, box) : box;
+            vBoxMin = _mm_min_ps(vBoxMin, vMin);
+            vBoxMax = _mm_max_ps(vBoxMax, vMax);
             NumEntries++;
         }
 
-        ZetaInline void __vectorcall Extend(Bin bin)
+        ZetaInline void Extend(const Bin& bin)
         {
-            Box = NumEntries > 0 ? unionAABB(Box, bin.Box) : bin.Box;
+            vBoxMin = _mm_min_ps(vBoxMin, bin.vBoxMin);
+            vBoxMax = _mm_max_ps(vBoxMax, bin.vBoxMax);
             NumEntries += bin.NumEntries;
         }
 
-        v_AABB Box = v_AABB(float3(0.0f), float3(-FLT_MAX));
+        ZetaInline float SurfaceArea() const
+        {
+            if (NumEntries == 0)
+                return 0.0f;
+
+            v_AABB vBox;
+            vBox.Reset(vBoxMin, vBoxMax);
+
+            return AABBSurfaceArea(vBox);
+        }
+
+        __m128 vBoxMin = _mm_set1_ps(FLT_MAX);
+        __m128 vBoxMax = _mm_set1_ps(-FLT_MAX);
         uint32_t NumEntries = 0;
     };
+
+    // Bins along each axis
+    struct BinSet
+    {
+        void Extend(const BinSet& other)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                for (int i = 0; i < NUM_SAH_BINS; i++)
+                    Bins[axis][i].Extend(other.Bins[axis][i]);
+            }
+        }
+
+        Bin Bins[3][NUM_SAH_BINS];
+    };
+
+    struct Split
+    {
+        // Instances in bins [0, Plane] along Axis go to the left child
+        int Axis = -1;
+        int Plane = -1;
+        uint32_t NumLeft = 0;
+        float Cost = FLT_MAX;
+    };
+
+    Bounds ComputeBounds(const BVH::BVHInput* instances, size_t begin, size_t end)
+    {
+        Bounds bounds;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            __m128 vMin, vMax, vCentroid;
+            LoadInstance(instances[i], vMin, vMax, vCentroid);
+            bounds.Extend(vMin, vMax, vCentroid);
+        }
+
+        return bounds;
+    }
+
+    BinSet ComputeBins(const BVH::BVHInput* instances, size_t begin, size_t end, 
+        __m128 vCentroidMin, __m128 vScale)
+    {
+        BinSet binSet;
+
+        for (size_t i = begin; i < end; i++)
+        {
+            __m128 vMin, vMax, vCentroid;
+            LoadInstance(instances[i], vMin, vMax, vCentroid);
+
+            alignas(16) int idx[4];
+            _mm_store_si128(reinterpret_cast<__m128i*>(idx), BinIndices(vCentroid, vCentroidMin, vScale));
+
+            binSet.Bins[0][idx[0]].Extend(vMin, vMax);
+            binSet.Bins[1][idx[1]].Extend(vMin, vMax);
+            binSet.Bins[2][idx[2]].Extend(vMin, vMax);
+        }
+
+        return binSet;
+    }
+
+    // Evaluates SAH for the split planes between consecutive bins along every axis, e.g. 
+    // for 4 bins there are 3 planes per axis
+    //        bin 0 | bin 1 | bin 2 | bin 3 
+    Split FindBestSplit(const BinSet& binSet, float parentSurfaceArea)
+    {
+        // When all the boxes are degenerate (e.g. points on a line), every split costs 
+        // zero, which is still better than not splitting
+        const float rcpParentArea = parentSurfaceArea > 0.0f ? 1.0f / parentSurfaceArea : 0.0f;
+        Split best;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const Bin* bins = binSet.Bins[axis];
+            float rightSurfaceArea[NUM_SAH_BINS - 1];
+            uint32_t rightCount[NUM_SAH_BINS - 1];
+            Bin curr;
+
+            for (int plane = NUM_SAH_BINS - 2; plane >= 0; plane--)
+            {
+                curr.Extend(bins[plane + 1]);
+                rightSurfaceArea[plane] = curr.SurfaceArea();
+                rightCount[plane] = curr.NumEntries;
+            }
+
+            curr = Bin();
+
+            for (int plane = 0; plane < NUM_SAH_BINS - 1; plane++)
+            {
+                curr.Extend(bins[plane]);
+
+                if (curr.NumEntries == 0 || rightCount[plane] == 0)
+                    continue;
+
+                const float cost = (curr.NumEntries * curr.SurfaceArea() +
+                    rightCount[plane] * rightSurfaceArea[plane]) * rcpParentArea;
+
+                if (cost < best.Cost)
+                {
+                    best.Axis = axis;
+                    best.Plane = plane;
+                    best.NumLeft = curr.NumEntries;
+                    best.Cost = cost;
+                }
+            }
+        }
+
+        return best;
+    }
+
+    // Moves the instances for which isLeft() returns true to the front of the range, 
+    // while keeping the relative order in each part. Returns the number of such instances.
+    template<typename P>
+    uint32_t ParallelPartition(BVH::BVHInput* instances, size_t begin, size_t end, P isLeft, 
+        int maxNumThreads)
+    {
+        const size_t n = end - begin;
+        const size_t numBlocks = CeilUnsignedIntDiv(n, PARTITION_BLOCK_SIZE);
+
+        SmallVector<uint32_t, App::FrameAllocator> leftOffsets;
+        SmallVector<uint32_t, App::FrameAllocator> rightOffsets;
+        leftOffsets.resize(numBlocks);
+        rightOffsets.resize(numBlocks);
+
+        // Count the left instances in each block
+        ParallelFor(0, numBlocks, 1, [instances, begin, end, &isLeft, &leftOffsets](size_t b, size_t e)
+            {
+                for (size_t blockIdx = b; blockIdx < e; blockIdx++)
+                {
+                    const size_t blockBeg = begin + blockIdx * PARTITION_BLOCK_SIZE;
+                    const size_t blockEnd = Min(blockBeg + PARTITION_BLOCK_SIZE, end);
+                    uint32_t numLeft = 0;
+
+                    for (size_t i = blockBeg; i < blockEnd; i++)
+                        numLeft += isLeft(instances[i]);
+
+                    leftOffsets[blockIdx] = numLeft;
+                }
+            }, maxNumThreads);
+
+        // Exclusive prefix sums give the destination of each block's instances
+        uint32_t numLeft = 0;
+
+        for (size_t blockIdx = 0; blockIdx < numBlocks; blockIdx++)
+        {
+            const uint32_t blockNumLeft = leftOffsets[blockIdx];
+            leftOffsets[blockIdx] = numLeft;
+            numLeft += blockNumLeft;
+        }
+
+        for (size_t blockIdx = 0; blockIdx < numBlocks; blockIdx++)
+        {
+            const uint32_t numInstancesBefore = (uint32_t)(blockIdx * PARTITION_BLOCK_SIZE);
+            rightOffsets[blockIdx] = numLeft + numInstancesBefore - leftOffsets[blockIdx];
+        }
+
+        SmallVector<BVH::BVHInput> partitioned;
+        partitioned.resize(n);
+
+        ParallelFor(0, numBlocks, 1, [instances, begin, end, &isLeft, &leftOffsets, &rightOffsets,
+            &partitioned](size_t b, size_t e)
+            {
+                for (size_t blockIdx = b; blockIdx < e; blockIdx++)
+                {
+                    const size_t blockBeg = begin + blockIdx * PARTITION_BLOCK_SIZE;
+                    const size_t blockEnd = Min(blockBeg + PARTITION_BLOCK_SIZE, end);
+                    uint32_t nextLeft = leftOffsets[blockIdx];
+                    uint32_t nextRight = rightOffsets[blockIdx];
+
+                    for (size_t i = blockBeg; i < blockEnd; i++)
+                    {
+                        const uint32_t dst = isLeft(instances[i]) ? nextLeft++ : nextRight++;
+                        partitioned[dst] = instances[i];
+                    }
+                }
+            }, maxNumThreads);
+
+        ParallelFor(0, n, PARTITION_BLOCK_SIZE, [instances, begin, &partitioned](size_t b, size_t e)
+            {
+                memcpy(instances + begin + b, partitioned.data() + b, (e - b) * sizeof(BVH::BVHInput));
+            }, maxNumThreads);
+
+        return numLeft;
+    }
+    // Frustum planes, each component broadcast to all lanes
+    struct FrustumPlanes
+    {
+        explicit FrustumPlanes(const v_ViewFrustum& vFrustum)
+        {
+            alignas(32) float N_x[8];
+            alignas(32) float N_y[8];
+            alignas(32) float N_z[8];
+            alignas(32) float d[8];
+            _mm256_store_ps(N_x, vFrustum.vN_x);
+            _mm256_store_ps(N_y, vFrustum.vN_y);
+            _mm256_store_ps(N_z, vFrustum.vN_z);
+            _mm256_store_ps(d, vFrustum.vd);
+
+            for (int p = 0; p < 6; p++)
+            {
+                vN_x[p] = _mm_set1_ps(N_x[p]);
+                vN_y[p] = _mm_set1_ps(N_y[p]);
+                vN_z[p] = _mm_set1_ps(N_z[p]);
+                vd[p] = _mm_set1_ps(d[p]);
+            }
+        }
+
+        __m128 vN_x[6];
+        __m128 vN_y[6];
+        __m128 vN_z[6];
+        __m128 vd[6];
+    };
+
+    // Tests four AABBs (in SoA layout) against the frustum. Same computation as 
+    // instersectFrustumVsAABB(), except that each lane is a different AABB rather than 
+    // a different plane. Also returns which AABBs are completely inside the frustum.
+    ZetaInline int FrustumVsAABBx4(const FrustumPlanes& planes, const float* center, 
+        const float* extents, int& insideMask)
+    {
+        const __m128 vCx = _mm_load_ps(center);
+        const __m128 vCy = _mm_load_ps(center + 4);
+        const __m128 vCz = _mm_load_ps(center + 8);
+        const __m128 vEx = _mm_load_ps(extents);
+        const __m128 vEy = _mm_load_ps(extents + 4);
+        const __m128 vEz = _mm_load_ps(extents + 8);
+        __m128 vIntersects = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 vInside = vIntersects;
+
+        for (int p = 0; p < 6; p++)
+        {
+            // Projection of farthest corner on the axis
+            __m128 vLargestProjLengthAlongAxis = _mm_mul_ps(vEx, abs(planes.vN_x[p]));
+            vLargestProjLengthAlongAxis = _mm_fmadd_ps(vEy, abs(planes.vN_y[p]), vLargestProjLengthAlongAxis);
+            vLargestProjLengthAlongAxis = _mm_fmadd_ps(vEz, abs(planes.vN_z[p]), vLargestProjLengthAlongAxis);
+
+            // Distance of the AABB center from the plane
+            __m128 vCenterDistFromPlane = _mm_mul_ps(vCx, planes.vN_x[p]);
+            vCenterDistFromPlane = _mm_fmadd_ps(vCy, planes.vN_y[p], vCenterDistFromPlane);
+            vCenterDistFromPlane = _mm_fmadd_ps(vCz, planes.vN_z[p], vCenterDistFromPlane);
+            vCenterDistFromPlane = _mm_add_ps(planes.vd[p], vCenterDistFromPlane);
+
+            // AABB is (at least partially) in the positive half space of the plane or 
+            // intersects the plane
+            const __m128 vIntersects1 = _mm_cmpge_ps(vCenterDistFromPlane, _mm_setzero_ps());
+            const __m128 vIntersects2 = _mm_cmpge_ps(vLargestProjLengthAlongAxis, abs(vCenterDistFromPlane));
+            vIntersects = _mm_and_ps(vIntersects, _mm_or_ps(vIntersects1, vIntersects2));
+
+            // AABB is completely in the positive half space of the plane
+            vInside = _mm_and_ps(vInside, _mm_cmpge_ps(vCenterDistFromPlane, vLargestProjLengthAlongAxis));
+        }
+
+        const int intersectMask = _mm_movemask_ps(vIntersects);
+        insideMask = intersectMask & _mm_movemask_ps(vInside);
+
+        return intersectMask;
+    }
+
+    // Ray data that's shared by all the tests, each component broadcast to all lanes
+    struct RayData
+    {
+        RayData(const v_Ray& vRay, __m128 vRayDirRcp, __m128 vRayDirIsPos, __m128 vRayIsParallel)
+        {
+            alignas(16) float origin[4];
+            alignas(16) float dirRcp[4];
+            alignas(16) int dirIsPos[4];
+            alignas(16) int isParallel[4];
+            _mm_store_ps(origin, vRay.vOrigin);
+            _mm_store_ps(dirRcp, vRayDirRcp);
+            _mm_store_ps(reinterpret_cast<float*>(dirIsPos), vRayDirIsPos);
+            _mm_store_ps(reinterpret_cast<float*>(isParallel), vRayIsParallel);
+
+            for (int axis = 0; axis < 3; axis++)
+            {
+                vOrigin[axis] = _mm_set1_ps(origin[axis]);
+                vDirRcp[axis] = _mm_set1_ps(dirRcp[axis]);
+                DirIsPos[axis] = dirIsPos[axis] != 0;
+                IsParallel[axis] = isParallel[axis] != 0;
+            }
+        }
+
+        __m128 vOrigin[3];
+        __m128 vDirRcp[3];
+        bool DirIsPos[3];
+        bool IsParallel[3];
+    };
+
+    // Tests four AABBs (in SoA layout) against the ray and returns a bitmask of the ones 
+    // that were hit. Same computation as intersectRayVsAABB(), except that each lane is 
+    // a different AABB rather than a different axis. For each AABB, t is set to the 
+    // entry distance or to the exit distance when ray origin is inside the AABB (same as
+    // intersectRayVsAABB()), while tNear is the entry distance clamped to zero.
+    ZetaInline int RayVsAABBx4(const RayData& ray, const float* center, const float* extents,
+        __m128& vT, __m128& vTNear)
+    {
+        const __m128 vZero = _mm_setzero_ps();
+        __m128 vTFarthestEntry = _mm_set1_ps(-FLT_MAX);
+        __m128 vTNearestExit = _mm_set1_ps(FLT_MAX);
+        __m128 vOriginOutsideAABB = vZero;
+        __m128 vResParallel = vZero;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            // For better numerical robustness, translate the ray center to origin and do
+            // the same for AABB
+            const __m128 vCenterTranslatedToOrigin = _mm_sub_ps(_mm_load_ps(center + axis * 4), ray.vOrigin[axis]);
+            const __m128 vExtents = _mm_load_ps(extents + axis * 4);
+            const __m128 vMin = _mm_sub_ps(vCenterTranslatedToOrigin, vExtents);
+            const __m128 vMax = _mm_add_ps(vCenterTranslatedToOrigin, vExtents);
+
+            const __m128 vOutside = _mm_or_ps(_mm_cmpge_ps(vZero, vMax), _mm_cmpge_ps(vMin, vZero));
+            vOriginOutsideAABB = _mm_or_ps(vOriginOutsideAABB, vOutside);
+
+            // If ray and AABB are parallel, then the ray origin must be inside the AABB
+            if (ray.IsParallel[axis])
+            {
+                vResParallel = _mm_or_ps(vResParallel, vOutside);
+                continue;
+            }
+
+            const __m128 vTminTemp = _mm_mul_ps(vMin, ray.vDirRcp[axis]);
+            const __m128 vTmaxTemp = _mm_mul_ps(vMax, ray.vDirRcp[axis]);
+
+            vTFarthestEntry = _mm_max_ps(vTFarthestEntry, ray.DirIsPos[axis] ? vTminTemp : vTmaxTemp);
+            vTNearestExit = _mm_min_ps(vTNearestExit, ray.DirIsPos[axis] ? vTmaxTemp : vTminTemp);
+        }
+
+        // If t1 is less than zero, then there's no intersection
+        const __m128 vT1IsNegative = _mm_cmpgt_ps(vZero, vTNearestExit);
+        const __m128 vResNotParallel = _mm_or_ps(_mm_cmpgt_ps(vTFarthestEntry, vTNearestExit), vT1IsNegative);
+        const __m128 vMiss = _mm_or_ps(vResNotParallel, vResParallel);
+
+        // When ray is inside the AABB, entry hit is behind the origin, use exit hit instead
+        vT = _mm_blendv_ps(vTNearestExit, vTFarthestEntry, vOriginOutsideAABB);
+        vTNear = _mm_max_ps(vTFarthestEntry, vZero);
+
+        return ~_mm_movemask_ps(vMiss) & 0xf;
+    }
+
+    // Copies up to four instance AABBs to SoA layout. Returns bitmask of the valid lanes.
+    ZetaInline int LoadInstancesSoA(const BVH::BVHInput* instances, int num, float* center, 
+        float* extents)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            const AABB& box = instances[Min(i, num - 1)].BoundingBox;
+            center[i] = box.Center.x;
+            center[4 + i] = box.Center.y;
+            center[8 + i] = box.Center.z;
+            extents[i] = box.Extents.x;
+            extents[4 + i] = box.Extents.y;
+            extents[8 + i] = box.Extents.z;
+        }
+
+        return (1 << num) - 1;
+    }
+
+    static_assert(BVH::RAY_PACKET_SIZE == 8, "Ray packets assume one ray per AVX lane.");
+    static constexpr size_t RAY_PACKET_GRAIN = 64;
+
+    // Rays in SoA layout -- each lane is a different ray. Unused lanes duplicate the 
+    // last ray.
+    struct RayPacket
+    {
+        RayPacket(const Ray* rays, int numRays)
+        {
+            alignas(32) float origin[3][8];
+            alignas(32) float dir[3][8];
+
+            for (int i = 0; i < 8; i++)
+            {
+                const Ray& r = rays[Min(i, numRays - 1)];
+                origin[0][i] = r.Origin.x;
+                origin[1][i] = r.Origin.y;
+                origin[2][i] = r.Origin.z;
+                dir[0][i] = r.Dir.x;
+                dir[1][i] = r.Dir.y;
+                dir[2][i] = r.Dir.z;
+            }
+
+            const __m256 vAbsMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+            // Same as in CastRay()
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const __m256 vDir = _mm256_load_ps(dir[axis]);
+                vOrigin[axis] = _mm256_load_ps(origin[axis]);
+                vDirRcp[axis] = _mm256_div_ps(_mm256_set1_ps(1.0f), vDir);
+                vDirIsPos[axis] = _mm256_cmp_ps(vDir, _mm256_setzero_ps(), _CMP_GE_OQ);
+                vIsParallel[axis] = _mm256_cmp_ps(_mm256_set1_ps(FLT_EPSILON), 
+                    _mm256_and_ps(vDir, vAbsMask), _CMP_GE_OQ);
+            }
+
+            ValidMask = (1 << numRays) - 1;
+        }
+
+        __m256 vOrigin[3];
+        __m256 vDirRcp[3];
+        __m256 vDirIsPos[3];
+        __m256 vIsParallel[3];
+        int ValidMask;
+    };
+
+    // Tests one AABB against all the rays in the packet and returns a bitmask of the rays 
+    // that hit it. Center & extents are read with a stride of four floats (i.e. one lane 
+    // of WideNode or LoadInstancesSoA() output). Computes the exact same t & tNear as 
+    // RayVsAABBx4() for every ray.
+    ZetaInline int PacketVsAABB(const RayPacket& packet, const float* center, const float* extents,
+        __m256& vT, __m256& vTNear)
+    {
+        const __m256 vZero = _mm256_setzero_ps();
+        __m256 vTFarthestEntry = _mm256_set1_ps(-FLT_MAX);
+        __m256 vTNearestExit = _mm256_set1_ps(FLT_MAX);
+        __m256 vOriginOutsideAABB = vZero;
+        __m256 vResParallel = vZero;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            const __m256 vCenterTranslatedToOrigin = _mm256_sub_ps(_mm256_set1_ps(center[axis * 4]), 
+                packet.vOrigin[axis]);
+            const __m256 vExtents = _mm256_set1_ps(extents[axis * 4]);
+            const __m256 vMin = _mm256_sub_ps(vCenterTranslatedToOrigin, vExtents);
+            const __m256 vMax = _mm256_add_ps(vCenterTranslatedToOrigin, vExtents);
+
+            const __m256 vOutside = _mm256_or_ps(_mm256_cmp_ps(vZero, vMax, _CMP_GE_OQ), 
+                _mm256_cmp_ps(vMin, vZero, _CMP_GE_OQ));
+            vOriginOutsideAABB = _mm256_or_ps(vOriginOutsideAABB, vOutside);
+
+            // If ray and AABB are parallel, then the ray origin must be inside the AABB. 
+            // t values of parallel rays are ignored.
+            vResParallel = _mm256_or_ps(vResParallel, _mm256_and_ps(vOutside, packet.vIsParallel[axis]));
+
+            const __m256 vTminTemp = _mm256_mul_ps(vMin, packet.vDirRcp[axis]);
+            const __m256 vTmaxTemp = _mm256_mul_ps(vMax, packet.vDirRcp[axis]);
+            const __m256 vEntry = _mm256_blendv_ps(vTmaxTemp, vTminTemp, packet.vDirIsPos[axis]);
+            const __m256 vExit = _mm256_blendv_ps(vTminTemp, vTmaxTemp, packet.vDirIsPos[axis]);
+
+            vTFarthestEntry = _mm256_blendv_ps(_mm256_max_ps(vTFarthestEntry, vEntry), vTFarthestEntry, 
+                packet.vIsParallel[axis]);
+            vTNearestExit = _mm256_blendv_ps(_mm256_min_ps(vTNearestExit, vExit), vTNearestExit, 
+                packet.vIsParallel[axis]);
+        }
+
+        const __m256 vT1IsNegative = _mm256_cmp_ps(vZero, vTNearestExit, _CMP_GT_OQ);
+        const __m256 vResNotParallel = _mm256_or_ps(_mm256_cmp_ps(vTFarthestEntry, vTNearestExit, _CMP_GT_OQ), 
+            vT1IsNegative);
+        const __m256 vMiss = _mm256_or_ps(vResNotParallel, vResParallel);
+
+        vT = _mm256_blendv_ps(vTNearestExit, vTFarthestEntry, vOriginOutsideAABB);
+        vTNear = _mm256_max_ps(vTFarthestEntry, vZero);
+
+        return ~_mm256_movemask_ps(vMiss) & packet.ValidMask;
+    }
+
+    // Smallest element among the lanes in mask
+    ZetaInline float MinLane(__m256 v, int mask)
+    {
+        alignas(32) float vals[8];
+        _mm256_store_ps(vals, v);
+        float ret = FLT_MAX;
+
+        while (mask)
+        {
+            const int i = (int)_tzcnt_u32(mask);
+            mask &= mask - 1;
+            ret = Min(ret, vals[i]);
+        }
+
+        return ret;
+    }
 }
 
 //--------------------------------------------------------------------------------------
 // Node
 //--------------------------------------------------------------------------------------
 
-void BVH::Node::InitAsLeaf(int base, int count, int parent)
+void BVH::Node::InitAsLeaf(const Math::AABB& box, int base, int count, int parent)
 {
     Assert(count, "Invalid count");
+    BoundingBox = box;
     Base = base;
     Count = count;
-//    AABB.Extents = float3(0.0f, 0.0f, 0.0f);
     RightChild = -1;
     Parent = parent;
+    BuildSurfaceArea = AABBSurfaceArea(v_AABB(box));
 }
 
-void BVH::Node::InitAsInternal(Span<BVH::BVHInput> instances, int base, int count,
-    int right, int parent)
+void BVH::Node::InitAsInternal(const Math::AABB& box, int right, int parent)
 {
-    Assert(count, "Invalid count");
-    Assert(base + count <= instances.size(), "Invalid base/count.");
+    BoundingBox = box;
+    RightChild = right;
+    Parent = parent;
+    BuildSurfaceArea = AABBSurfaceArea(v_AABB(box));
+}
+
+//--------------------------------------------------------------------------------------
+// WideNode
+//--------------------------------------------------------------------------------------
 
-    v_AABB vBox(instances[base].BoundingBox);
+void BVH::WideNode::Init(const Node* nodes, const int* children, int numChildren)
+{
+    Assert(numChildren > 0 && numChildren <= 4, "Invalid number of children.");
 
-    for (int i = base + 1; i < base + count; i++)
-        vBox = unionAABB(vBox, v_AABB(instances[i].BoundingBox));
+    for (int i = 0; i < 4; i++)
+    {
+        if (i < numChildren)
+        {
+            const AABB& box = nodes[children[i]].BoundingBox;
+            CenterX[i] = box.Center.x;
+            CenterY[i] = box.Center.y;
+            CenterZ[i] = box.Center.z;
+            ExtentsX[i] = box.Extents.x;
+            ExtentsY[i] = box.Extents.y;
+            ExtentsZ[i] = box.Extents.z;
+            BinaryNode[i] = children[i];
+        }
+        else
+        {
+            CenterX[i] = CenterY[i] = CenterZ[i] = 0.0f;
+            ExtentsX[i] = ExtentsY[i] = ExtentsZ[i] = 0.0f;
+            BinaryNode[i] = -1;
+        }
 
-    BoundingBox = store(vBox);
-    RightChild = right;
-    Parent = parent;
+        Child[i] = -1;
+    }
 }
 
 //--------------------------------------------------------------------------------------
@@ -64,219 +627,571 @@ void BVH::Node::InitAsInternal(Span<BVH::BVHInput> instances, int base, int coun
 //--------------------------------------------------------------------------------------
 
 BVH::BVH()
-    : m_arena(4 * 1096),
+    : m_arena(4 * 1024),
     m_instances(m_arena),
-    m_nodes(m_arena)
+    m_nodes(m_arena),
+    m_wideNodes(m_arena)
 {}
 
-void BVH::Build(Span<BVHInput> instances)
+void BVH::Build(Span<BVHInput> instances, int maxNumThreads)
 {
+    // Previous tree (if any) is discarded
+    m_nodes.free_memory();
+    m_wideNodes.free_memory();
+    m_instances.free_memory();
+    m_arena.Reset();
+
     if (instances.size() == 0)
         return;
 
     //m_instances.swap(instances);
     m_instances.append_range(instances.begin(), instances.end(), true);
-    Check(m_instances.size() < UINT32_MAX, "#Instances can't exceed UINT32_MAX.");
+    Check(m_instances.size() < INT32_MAX, "#Instances can't exceed INT32_MAX.");
     const uint32_t numInstances = (uint32_t)m_instances.size();
+    m_maxNumBuildThreads = maxNumThreads;
+
+    // Binary tree with at least one instance per leaf has at most 2n - 1 nodes. Reserving
+    // for the worst case avoids reallocating partway through the build.
+    m_nodes.reserve(2 * (size_t)numInstances - 1);
+
+    BuildSubtree(0, numInstances, -1, m_nodes);
+
+    // Every wide node replaces at least one binary internal node
+    m_wideNodes.reserve(m_nodes.size() / 2 + 1);
+    CollapseSubtree(0);
+
+    m_sahSum = ComputeSAHSum();
+    m_builtSAHCost = ComputeSAHCost();
+}
+
+template<Support::AllocatorType Allocator>
+void BVH::BuildSubtree(int base, int count, int parent, Vector<Node, Allocator>& nodes)
+{
+    Assert(count > 0, "Number of nodes to build a subtree for must be greater than 0.");
+    const int currNodeIdx = (int)nodes.size();
+    nodes.emplace_back();
+
+    const bool parallelSplit = count >= MIN_NUM_INSTANCES_PARALLEL_SPLIT;
+    const BVHInput* instances = m_instances.data();
+
+    // Union AABB of all instances and all centroids
+    const Bounds bounds = parallelSplit ?
+        ParallelReduce(base, base + count, PARALLEL_SPLIT_GRAIN, Bounds(),
+            [instances](size_t b, size_t e)
+            {
+                return ComputeBounds(instances, b, e);
+            },
+            [](Bounds lhs, const Bounds& rhs)
+            {
+                lhs.Extend(rhs);
+                return lhs;
+            }, m_maxNumBuildThreads) :
+        ComputeBounds(instances, base, base + count);
+
+    v_AABB vNodeBox;
+    vNodeBox.Reset(bounds.vBoxMin, bounds.vBoxMax);
+    const AABB nodeBox = store(vNodeBox);
+
+    // Create a leaf node and return
+    if (count <= MAX_NUM_INSTANCES_PER_LEAF)
+    {
+        nodes[currNodeIdx].InitAsLeaf(nodeBox, base, count, parent);
+        return;
+    }
+
+    const __m128 vCentroidExtents = _mm_sub_ps(bounds.vCentroidMax, bounds.vCentroidMin);
+    const float3 centroidExtents = storeFloat3(vCentroidExtents);
+
+    // All centroids are (almost) the same point, no point in splitting further
+    if (centroidExtents.x + centroidExtents.y + centroidExtents.z <= 2e-5f)
+    {
+        nodes[currNodeIdx].InitAsLeaf(nodeBox, base, count, parent);
+        return;
+    }
+
+    uint32_t splitCount;
+
+    // Split using SAH
+    if (count >= MIN_NUM_INSTANCES_SPLIT_SAH)
+    {
+        const __m128 vCentroidMin = bounds.vCentroidMin;
+        const __m128 vIsDegenerate = _mm_cmple_ps(vCentroidExtents, _mm_set1_ps(1e-6f));
+        const __m128 vScale = _mm_andnot_ps(vIsDegenerate, 
+            _mm_div_ps(_mm_set1_ps((float)NUM_SAH_BINS), vCentroidExtents));
+
+        // Assign each instance to one bin along each axis
+        const BinSet binSet = parallelSplit ?
+            ParallelReduce(base, base + count, PARALLEL_SPLIT_GRAIN, BinSet(),
+                [instances, vCentroidMin, vScale](size_t b, size_t e)
+                {
+                    return ComputeBins(instances, b, e, vCentroidMin, vScale);
+                },
+                [](BinSet lhs, const BinSet& rhs)
+                {
+                    lhs.Extend(rhs);
+                    return lhs;
+                }, m_maxNumBuildThreads) :
+            ComputeBins(instances, base, base + count, vCentroidMin, vScale);
+
+        const Split split = FindBestSplit(binSet, AABBSurfaceArea(vNodeBox));
+
+        const float noSplitCost = (float)count;
+        if (split.Axis == -1 || noSplitCost <= split.Cost)
+        {
+            nodes[currNodeIdx].InitAsLeaf(nodeBox, base, count, parent);
+            return;
+        }
+
+        // Uses the exact same computation as binning, so instances always end up on the
+        // same side of the split plane as their bin
+        auto isLeft = [vCentroidMin, vScale, split](const BVHInput& instance)
+            {
+                __m128 vMin, vMax, vCentroid;
+                LoadInstance(instance, vMin, vMax, vCentroid);
+
+                alignas(16) int idx[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(idx), BinIndices(vCentroid, vCentroidMin, vScale));
+
+                return idx[split.Axis] <= split.Plane;
+            };
+
+        if (parallelSplit)
+            splitCount = ParallelPartition(m_instances.data(), base, base + count, isLeft, m_maxNumBuildThreads);
+        else
+        {
+            auto it = std::partition(m_instances.begin() + base, m_instances.begin() + base + count, isLeft);
+            splitCount = (uint32_t)(it - m_instances.begin() - base);
+        }
+
+        Assert(splitCount == split.NumLeft, "Partitioning doesn't match binning.");
+    }
+    else
+    {
+        // Split along the longest axis
+        const float* extArr = reinterpret_cast<const float*>(&centroidExtents);
+        int splitAxis = 0;
+        float maxExtent = extArr[0];
+
+        for (int i = 1; i < 3; i++)
+        {
+            if (extArr[i] > maxExtent)
+            {
+                maxExtent = extArr[i];
+                splitAxis = i;
+            }
+        }
+
+        // Split into two subtrees such that each subtree has an equal number of nodes (i.e. find the median)
+        const uint32_t countDiv2 = (count >> 1);
+        auto begIt = m_instances.begin() + base;
+        auto midIt = m_instances.begin() + base + countDiv2;
+        auto endIt = m_instances.begin() + base + count;
+        std::nth_element(begIt, midIt, endIt,
+            [splitAxis](BVHInput& b1, BVHInput& b2)
+            {
+                float* box1 = reinterpret_cast<float*>(&b1.BoundingBox);
+                float* box2 = reinterpret_cast<float*>(&b2.BoundingBox);
+                // compare AABB centers along the split axis
+                return box1[splitAxis] < box2[splitAxis];
+            });
+
+        splitCount = countDiv2;
+    }
+
+    Assert(splitCount > 0 && splitCount < (uint32_t)count, "bug");
+    int right;
+
+    if (count >= MIN_NUM_INSTANCES_PARALLEL_SUBTREE)
+    {
+        // Left subtree is appended to "nodes" as usual, while right subtree is built 
+        // into a separate array (with indices relative to that array) and appended 
+        // afterwards. Calling thread takes one of the two "iterations" and a worker 
+        // thread the other one.
+        SmallVector<Node> rightNodes;
+
+        ParallelFor(0, 2, 1, [this, base, count, splitCount, currNodeIdx, &nodes, &rightNodes]
+            (size_t b, size_t e)
+            {
+                for (size_t i = b; i < e; i++)
+                {
+                    if (i == 0)
+                        BuildSubtree(base, splitCount, currNodeIdx, nodes);
+                    else
+                        BuildSubtree(base + splitCount, count - splitCount, -1, rightNodes);
+                }
+            }, m_maxNumBuildThreads);
+
+        right = (int)nodes.size();
+        nodes.reserve(right + rightNodes.size());
+
+        for (auto& node : rightNodes)
+        {
+            node.RightChild = node.RightChild != -1 ? node.RightChild + right : -1;
+            node.Parent = node.Parent != -1 ? node.Parent + right : currNodeIdx;
+            nodes.push_back(node);
+        }
+    }
+    else
+    {
+        BuildSubtree(base, splitCount, currNodeIdx, nodes);
+        right = (int)nodes.size();
+        BuildSubtree(base + splitCount, count - splitCount, currNodeIdx, nodes);
+    }
+
+    Assert(nodes[currNodeIdx + 1].Parent == currNodeIdx, "Left child should come right after its parent.");
+    nodes[currNodeIdx].InitAsInternal(nodeBox, right, parent);
+}
+
+int BVH::CollapseSubtree(int binaryNodeIdx)
+{
+    const int wideNodeIdx = (int)m_wideNodes.size();
+    m_wideNodes.emplace_back();
 
-    // Special case when there's less than MAX_NUM_MODELS_PER_LEAF instances
-    if (m_instances.size() <= MAX_NUM_INSTANCES_PER_LEAF)
+    int children[4] = { binaryNodeIdx };
+    int numChildren = 1;
+
+    // Keep replacing the internal child with the largest surface area with its two 
+    // children until there are four children or all of them are leaves. Starts by 
+    // opening the given node itself (unless it's a leaf, which only happens when the 
+    // whole tree is a single leaf).
+    while (numChildren < 4)
     {
-        m_nodes.resize(1);
+        int toOpen = -1;
+        float largestArea = -1.0f;
 
-        v_AABB vBox(m_instances[0].BoundingBox);
+        for (int i = 0; i < numChildren; i++)
+        {
+            const Node& node = m_nodes[children[i]];
+            if (node.IsLeaf())
+                continue;
 
-        for (int i = 1; i < m_instances.size(); i++)
-            vBox = unionAABB(vBox, v_AABB(m_instances[i].BoundingBox));
+            const float area = AABBSurfaceArea(v_AABB(node.BoundingBox));
+            if (area > largestArea)
+            {
+                largestArea = area;
+                toOpen = i;
+            }
+        }
 
-        m_nodes[0].BoundingBox = store(vBox);
-        m_nodes[0].Base = 0;
-        m_nodes[0].Count = (int)m_instances.size();
-        m_nodes[0].RightChild = -1;
+        if (toOpen == -1)
+            break;
 
-        return;
+        const int opened = children[toOpen];
+        children[toOpen] = opened + 1;
+        children[numChildren++] = m_nodes[opened].RightChild;
     }
 
-    // TODO check this computation
-    const uint32_t MAX_NUM_NODES = Math::CeilUnsignedIntDiv(4 * numInstances, MAX_NUM_INSTANCES_PER_LEAF) + 1;
-    m_nodes.resize(MAX_NUM_NODES);
+    m_wideNodes[wideNodeIdx].Init(m_nodes.data(), children, numChildren);
+
+    for (int i = 0; i < numChildren; i++)
+    {
+        if (m_nodes[children[i]].IsLeaf())
+            continue;
+
+        // May reallocate m_wideNodes
+        const int child = CollapseSubtree(children[i]);
+        m_wideNodes[wideNodeIdx].Child[i] = child;
+    }
 
-    BuildSubtree(0, numInstances, -1);
+    return wideNodeIdx;
 }
 
-int BVH::BuildSubtree(int base, int count, int parent)
+void BVH::UpdateWideNodes(const uint32_t* nodeState)
 {
-    Assert(count > 0, "Number of nodes to build a subtree for must be greater than 0.");
-    const uint32_t currNodeIdx = m_numNodes++;
-    Assert(!m_nodes[currNodeIdx].IsInitialized(), "invalid index");
+    ParallelFor(0, m_wideNodes.size(), UPDATE_GRAIN, [this, nodeState](size_t begin, size_t end)
+        {
+            for (size_t w = begin; w < end; w++)
+            {
+                WideNode& wideNode = m_wideNodes[w];
 
-    // Create a leaf node and return
-    if (count <= MAX_NUM_INSTANCES_PER_LEAF)
+                for (int i = 0; i < 4; i++)
+                {
+                    if (wideNode.BinaryNode[i] == -1 || nodeState[wideNode.BinaryNode[i]] == CLEAN_NODE)
+                        continue;
+
+                    const AABB& box = m_nodes[wideNode.BinaryNode[i]].BoundingBox;
+                    wideNode.CenterX[i] = box.Center.x;
+                    wideNode.CenterY[i] = box.Center.y;
+                    wideNode.CenterZ[i] = box.Center.z;
+                    wideNode.ExtentsX[i] = box.Extents.x;
+                    wideNode.ExtentsY[i] = box.Extents.y;
+                    wideNode.ExtentsZ[i] = box.Extents.z;
+                }
+            }
+        });
+}
+
+double BVH::RefitNode(int nodeIdx)
+{
+    Node& node = m_nodes[nodeIdx];
+    __m128 vMin = _mm_set1_ps(FLT_MAX);
+    __m128 vMax = _mm_set1_ps(-FLT_MAX);
+
+    if (node.IsLeaf())
+    {
+        // Every instance was removed -- keep the old box, it doesn't contribute to SAH
+        if (node.Count == 0)
+            return 0.0;
+
+        for (int i = node.Base; i < node.Base + node.Count; i++)
+        {
+            __m128 vInstanceMin, vInstanceMax, vCentroid;
+            LoadInstance(m_instances[i], vInstanceMin, vInstanceMax, vCentroid);
+            vMin = _mm_min_ps(vMin, vInstanceMin);
+            vMax = _mm_max_ps(vMax, vInstanceMax);
+        }
+    }
+    else
     {
-        m_nodes[currNodeIdx].InitAsLeaf(base, count, parent);
-        return currNodeIdx;
+        const v_AABB vLeft(m_nodes[nodeIdx + 1].BoundingBox);
+        const v_AABB vRight(m_nodes[node.RightChild].BoundingBox);
+        vMin = _mm_min_ps(_mm_sub_ps(vLeft.vCenter, vLeft.vExtents), _mm_sub_ps(vRight.vCenter, vRight.vExtents));
+        vMax = _mm_max_ps(_mm_add_ps(vLeft.vCenter, vLeft.vExtents), _mm_add_ps(vRight.vCenter, vRight.vExtents));
     }
 
-    // Compute union AABB of all centroids
-    __m128 vMinPoint = _mm_set_ps1(FLT_MAX);
-    __m128 vMaxPoint = _mm_set_ps1(-FLT_MAX);
-    // Union AABB of all nodes in this subtree
-    v_AABB vNodeBox(m_instances[base].BoundingBox);
+    v_AABB vBox;
+    vBox.Reset(vMin, vMax);
 
-    for (int i = base; i < base + count; i++)
-    {
-        v_AABB vInstanceBox(m_instances[i].BoundingBox);
+    const float oldArea = AABBSurfaceArea(v_AABB(node.BoundingBox));
+    node.BoundingBox = store(vBox);
+    const float newArea = AABBSurfaceArea(v_AABB(node.BoundingBox));
+    const double weight = node.IsLeaf() ? (double)node.Count : 2.0;
 
-        vMinPoint = _mm_min_ps(vMinPoint, vInstanceBox.vCenter);
-        vMaxPoint = _mm_max_ps(vMaxPoint, vInstanceBox.vCenter);
+    return weight * ((double)newArea - (double)oldArea);
+}
 
-        vNodeBox = unionAABB(vNodeBox, v_AABB(m_instances[i].BoundingBox));
-    }
+void BVH::GetInstanceRange(int nodeIdx, int& base, int& count)
+{
+    // Leftmost leaf is reached by following the left children and the rightmost one 
+    // by following the right children
+    int first = nodeIdx;
+    while (!m_nodes[first].IsLeaf())
+        first++;
 
-    v_AABB vCentroidAABB;
-    vCentroidAABB.Reset(vMinPoint, vMaxPoint);
-    AABB centroidAABB;
-    centroidAABB = store(vCentroidAABB);
+    int last = nodeIdx;
+    while (!m_nodes[last].IsLeaf())
+        last = m_nodes[last].RightChild;
 
-    // All centroids are (almost) the same point, no point in splitting further
-    if (centroidAABB.Extents.x + centroidAABB.Extents.y + centroidAABB.Extents.z <= 1e-5f)
+    // Removed instances of the rightmost leaf come after its Count, so the range ends 
+    // where the subtree that follows this one (in depth-first order) begins
+    int end = (int)m_instances.size();
+
+    if (last + 1 < (int)m_nodes.size())
     {
-        m_nodes[currNodeIdx].InitAsLeaf(base, count, parent);
-        return currNodeIdx;
+        int next = last + 1;
+        while (!m_nodes[next].IsLeaf())
+            next++;
+
+        end = m_nodes[next].Base;
     }
 
-    // Axis along which partitioning should be performed
-    const float* extArr = reinterpret_cast<float*>(&centroidAABB.Extents);
-    int splitAxis = 0;
-    float maxExtent = extArr[0];
+    base = m_nodes[first].Base;
+    count = end - base;
+}
+
+template<Support::AllocatorType Allocator>
+void BVH::CopyOrRebuildSubtree(int nodeIdx, int parent, const int* rebuiltIdx, 
+    const SmallVector<Node>* rebuilt, Vector<Node, Allocator>& nodes)
+{
+    const int currNodeIdx = (int)nodes.size();
 
-    // Find the longest axis
-    for (int i = 1; i < 3; i++)
+    if (rebuiltIdx[nodeIdx] != -1)
     {
-        if (extArr[i] > maxExtent)
+        const SmallVector<Node>& subtree = rebuilt[rebuiltIdx[nodeIdx]];
+
+        // Every instance in this subtree was removed
+        if (subtree.empty())
         {
-            maxExtent = extArr[i];
-            splitAxis = i;
+            int base;
+            int count;
+            GetInstanceRange(nodeIdx, base, count);
+
+            Node leaf = m_nodes[nodeIdx];
+            leaf.Base = base;
+            leaf.Count = 0;
+            leaf.RightChild = -1;
+            leaf.Parent = parent;
+            nodes.push_back(leaf);
+
+            return;
         }
+
+        // Same as appending the right subtree in BuildSubtree()
+        for (Node node : subtree)
+        {
+            node.RightChild = node.RightChild != -1 ? node.RightChild + currNodeIdx : -1;
+            node.Parent = node.Parent != -1 ? node.Parent + currNodeIdx : parent;
+            nodes.push_back(node);
+        }
+
+        return;
     }
 
-    uint32_t splitCount;
+    nodes.push_back(m_nodes[nodeIdx]);
+    nodes[currNodeIdx].Parent = parent;
 
-    // Split using SAH
-    if (count >= MIN_NUM_INSTANCES_SPLIT_SAH)
-    {
-        Bin bins[NUM_SAH_BINS];
-        const float leftMostPlane = reinterpret_cast<float*>(&centroidAABB.Center)[splitAxis] - maxExtent;
-        const float rcpStepSize = NUM_SAH_BINS / (2.0f * maxExtent);
+    if (m_nodes[nodeIdx].IsLeaf())
+        return;
 
-        // Assign each instance to one bin
-        for (int i = base; i < base + count; i++)
-        {
-            const float* center = reinterpret_cast<float*>(&m_instances[i].BoundingBox.Center);
-            float numBinWidthsFromLeftMostPlane = (center[splitAxis] - leftMostPlane) * rcpStepSize;
-            int bin = Math::Min((int)numBinWidthsFromLeftMostPlane, (int)NUM_SAH_BINS - 1);
+    CopyOrRebuildSubtree(nodeIdx + 1, currNodeIdx, rebuiltIdx, rebuilt, nodes);
+    const int right = (int)nodes.size();
+    CopyOrRebuildSubtree(m_nodes[nodeIdx].RightChild, currNodeIdx, rebuiltIdx, rebuilt, nodes);
+    nodes[currNodeIdx].RightChild = right;
+}
 
-            v_AABB box(m_instances[i].BoundingBox);
-            bins[bin].Extend(box);
-        }
+void BVH::RebuildDegradedSubtrees()
+{
+    const int maxNumInstances = (int)(MAX_PARTIAL_REBUILD_FRACTION * m_instances.size());
+
+    // Index into "selected" for the roots of subtrees that are rebuilt, -1 otherwise
+    SmallVector<int, App::FrameAllocator> rebuiltIdx;
+    rebuiltIdx.resize(m_nodes.size(), -1);
+    SmallVector<int, App::FrameAllocator> selected;
+
+    // Going top-down, select the largest subtrees whose bounds have grown too much. 
+    // Children of a subtree that hasn't grown might have, e.g. when two instances swap 
+    // places, so the search continues below those as well.
+    SmallVector<int, App::FrameAllocator> stack;
+    stack.push_back(0);
 
-        Assert(bins[0].NumEntries > 0 && bins[NUM_SAH_BINS - 1].NumEntries > 0, "first & last bin must contain at least 1 instance.");
+    while (!stack.empty())
+    {
+        const int nodeIdx = stack.back();
+        stack.pop_back();
+        const Node& node = m_nodes[nodeIdx];
+
+        // Leaf boxes are always exact
+        if (node.IsLeaf())
+            continue;
 
-        // N bins correspond to N - 1 split planes, e.g. for N = 4
-        //        bin 0 | bin 1 | bin 2 | bin 3 
-        float leftSurfaceArea[NUM_SAH_BINS - 1];
-        float rightSurfaceArea[NUM_SAH_BINS - 1];
-        uint32_t leftCount[NUM_SAH_BINS - 1];
-        uint32_t rightCount[NUM_SAH_BINS - 1];
+        const float area = AABBSurfaceArea(v_AABB(node.BoundingBox));
 
+        if (area > node.BuildSurfaceArea * MAX_NODE_AREA_INCREASE)
         {
-            // For each split plane corresponding to each bin, compute surface area of nodes
-            // to its left and right
-            v_AABB currLeftBox = bins[0].Box;
-            v_AABB currRightBox = bins[NUM_SAH_BINS - 1].Box;
-            uint32_t currLeftSum = 0;
-            uint32_t currRightSum = 0;
+            int base;
+            int count;
+            GetInstanceRange(nodeIdx, base, count);
 
-            for (int plane = 0; plane < NUM_SAH_BINS - 1; plane++)
+            if (count <= maxNumInstances)
             {
-                currLeftSum += bins[plane].NumEntries;
-                leftCount[plane] = currLeftSum;
-
-                currLeftBox = unionAABB(bins[plane].Box, currLeftBox);
-                leftSurfaceArea[plane] = AABBSurfaceArea(currLeftBox);
-                currRightSum += bins[NUM_SAH_BINS - 1 - plane].NumEntries;
-                rightCount[NUM_SAH_BINS - 2 - plane] = currRightSum;
+                rebuiltIdx[nodeIdx] = (int)selected.size();
+                selected.push_back(nodeIdx);
 
-                currRightBox = unionAABB(bins[NUM_SAH_BINS - 1 - plane].Box, currRightBox);
-                rightSurfaceArea[NUM_SAH_BINS - 2 - plane] = AABBSurfaceArea(currRightBox);
+                continue;
             }
         }
 
-        int lowestCostPlane = -1;
-        float lowestCost = FLT_MAX;
-        const float parentSurfaceArea = AABBSurfaceArea(vNodeBox);
+        stack.push_back(node.RightChild);
+        stack.push_back(nodeIdx + 1);
+    }
 
-        // Cost of split along each split plane
-        for (int i = 0; i < NUM_SAH_BINS - 1; i++)
-        {
-            const float splitCost = leftCount[i] * leftSurfaceArea[i] / parentSurfaceArea +
-                rightCount[i] * rightSurfaceArea[i] / parentSurfaceArea;
+    if (!selected.empty())
+    {
+        // Every subtree covers a disjoint range of instances, so they can be rebuilt 
+        // in parallel. Each one is built into a separate array (with indices relative 
+        // to that array) and spliced into the new tree afterwards.
+        SmallVector<SmallVector<Node>> rebuilt;
+        rebuilt.resize(selected.size());
 
-            if (splitCost < lowestCost)
+        ParallelFor(0, selected.size(), 1, [this, &selected, &rebuilt](size_t begin, size_t end)
             {
-                lowestCost = splitCost;
-                lowestCostPlane = i;
-            }
-        }
+                for (size_t i = begin; i < end; i++)
+                {
+                    int base;
+                    int count;
+                    GetInstanceRange(selected[i], base, count);
+
+                    // Removed instances are dropped from the rebuilt subtree
+                    auto it = std::partition(m_instances.begin() + base, m_instances.begin() + base + count,
+                        [](const BVHInput& instance)
+                        {
+                            return instance.InstanceID != Scene::INVALID_INSTANCE;
+                        });
+
+                    const int numValid = (int)(it - m_instances.begin() - base);
+                    if (numValid > 0)
+                        BuildSubtree(base, numValid, -1, rebuilt[i]);
+                }
+            }, m_maxNumBuildThreads);
 
-        const float noSplitCost = (float)count;
-        if (noSplitCost <= lowestCost)
+        SmallVector<Node, App::FrameAllocator> nodes;
+        nodes.reserve(m_nodes.size() + m_nodes.size() / 4);
+        CopyOrRebuildSubtree(0, -1, rebuiltIdx.data(), rebuilt.data(), nodes);
+
+        m_nodes.clear();
+        m_nodes.append_range(nodes.begin(), nodes.end());
+
+        // Bounds of the rebuilt subtrees might have shrunk -- refit their ancestors. 
+        // Children always come after their parent.
+        for (int i = (int)m_nodes.size() - 1; i >= 0; i--)
         {
-            m_nodes[currNodeIdx].InitAsLeaf(base, count, parent);
-            return currNodeIdx;
+            if (!m_nodes[i].IsLeaf())
+                RefitNode(i);
         }
 
-        Assert(lowestCostPlane != -1, "bug");
-        const float splitPlane = leftMostPlane + (lowestCostPlane + 1) / rcpStepSize;    // == * StepSize
+        m_wideNodes.clear();
+        CollapseSubtree(0);
+        m_sahSum = ComputeSAHSum();
 
-        auto it = std::partition(m_instances.begin() + base, m_instances.begin() + base + count,
-            [splitPlane, splitAxis](BVHInput& box)
-            {
-                float c = reinterpret_cast<float*>(&box.BoundingBox.Center)[splitAxis];
-                return c <= splitPlane;
-            });
+        if (GetSAHCostIncrease() <= MAX_SAH_COST_INCREASE)
+            return;
+    }
+
+    // Degradation isn't localized -- rebuild the whole tree
+    SmallVector<BVHInput, App::FrameAllocator> instances;
+    instances.reserve(m_instances.size());
 
-        splitCount = (uint32_t)(it - m_instances.begin() - base);
-        if (splitCount != leftCount[lowestCostPlane])
-            LOG_UI_WARNING("BVH::Build(): floating-point imprecision detected.");
+    for (auto& instance : m_instances)
+    {
+        if (instance.InstanceID != Scene::INVALID_INSTANCE)
+            instances.push_back(instance);
     }
-    else
+
+    Build(instances, m_maxNumBuildThreads);
+}
+
+double BVH::ComputeSAHSum()
+{
+    double sum = 0.0;
+
+    for (auto& node : m_nodes)
     {
-        // Split into two subtrees such that each subtree has an equal number of nodes (i.e. find the median)
-        const uint32_t countDiv2 = (count >> 1);
-        auto begIt = m_instances.begin() + base;
-        auto midIt = m_instances.begin() + base + countDiv2;
-        auto endIt = m_instances.begin() + base + count;
-        std::nth_element(begIt, midIt, endIt,
-            [splitAxis](BVHInput& b1, BVHInput& b2)
-            {
-                float* box1 = reinterpret_cast<float*>(&b1.BoundingBox);
-                float* box2 = reinterpret_cast<float*>(&b2.BoundingBox);
-                // compare AABB centers along the split axis
-                return box1[splitAxis] < box2[splitAxis];
-            });
+        const double area = AABBSurfaceArea(v_AABB(node.BoundingBox));
 
-        splitCount = countDiv2;
+        // Internal nodes -- both children are tested
+        // Leaves -- every instance is tested
+        sum += node.IsLeaf() ? area * node.Count : area * 2.0;
     }
 
-    Assert(splitCount > 0, "bug");
-    uint32_t left = BuildSubtree(base, splitCount, currNodeIdx);
-    uint32_t right = BuildSubtree(base + splitCount, count - splitCount, currNodeIdx);
-    Assert(left == currNodeIdx + 1, "Index of left child should be equal to current parent's index plus one");
+    return sum;
+}
 
-    m_nodes[currNodeIdx].InitAsInternal(m_instances, base, count, right, parent);
+float BVH::ComputeSAHCost()
+{
+    if (m_nodes.empty())
+        return 0.0f;
 
-    return currNodeIdx;
+    const float rootArea = AABBSurfaceArea(v_AABB(m_nodes[0].BoundingBox));
+    if (rootArea <= 0.0f)
+        return 0.0f;
+
+    // Probability of a ray that hits the root also hitting some node is proportional 
+    // to the node's surface area. Root is always tested.
+    return (float)(1.0 + ComputeSAHSum() / rootArea);
+}
+
+float BVH::GetSAHCostIncrease() const
+{
+    if (m_nodes.empty() || m_builtSAHCost <= 0.0f)
+        return 1.0f;
+
+    const float rootArea = AABBSurfaceArea(v_AABB(m_nodes[0].BoundingBox));
+    if (rootArea <= 0.0f)
+        return 1.0f;
+
+    const double cost = 1.0 + m_sahSum / rootArea;
+
+    return (float)(cost / m_builtSAHCost);
 }
 
 int BVH::Find(uint64_t instanceID, const Math::AABB& queryBox, int& nodeIdx)
@@ -357,48 +1272,91 @@ int BVH::Find(uint64_t instanceID, const Math::AABB& queryBox, int& nodeIdx)
 
 void BVH::Update(Span<BVHUpdateInput> instances)
 {
-    for (auto& [oldBox, newBox, id] : instances)
+    if (instances.empty() || m_nodes.empty())
+        return;
+
+    // Find the leaf that contains each instance and update its bounding box. Nodes 
+    // aren't modified here, so lookups can run in parallel.
+    SmallVector<int, App::FrameAllocator> leaves;
+    leaves.resize(instances.size());
+
+    ParallelFor(0, instances.size(), UPDATE_GRAIN, [this, &instances, &leaves](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                auto& [oldBox, newBox, id] = instances[i];
+
+                int nodeIdx;
+                const int instanceIdx = Find(id, oldBox, nodeIdx);
+                // leaves[i] is used as an index below, so this has to be checked in release 
+                // builds as well
+                Check(instanceIdx != -1, "Instance with ID %llu was not found.", id);
+
+                m_instances[instanceIdx].BoundingBox = newBox;
+                leaves[i] = nodeIdx;
+            }
+        });
+
+    // For every node that needs to be refit, count its children that need to be refit 
+    // as well. Walking up from each leaf stops at the first node that was already 
+    // reached from another leaf.
+    SmallVector<uint32_t, App::FrameAllocator> pending;
+    pending.resize(m_nodes.size(), CLEAN_NODE);
+    SmallVector<int, App::FrameAllocator> dirtyLeaves;
+
+    for (auto leaf : leaves)
     {
-        // Find the leaf node that contains it
-        int nodeIdx;
-        int instanceIdx = Find(id, oldBox, nodeIdx);
-        Assert(instanceIdx != -1, "Instance with ID %u was not found.", id);
+        if (pending[leaf] != CLEAN_NODE)
+            continue;
 
-        // Update the bounding box
-        Node& node = m_nodes[nodeIdx];
-        m_instances[instanceIdx].BoundingBox = newBox;
+        pending[leaf] = 0;
+        dirtyLeaves.push_back(leaf);
 
-        const v_AABB vOldBox(oldBox);
-        const v_AABB vNewBox(newBox);
+        for (int p = m_nodes[leaf].Parent; p != -1; p = m_nodes[p].Parent)
+        {
+            if (pending[p] != CLEAN_NODE)
+            {
+                pending[p]++;
+                break;
+            }
 
-        Math::COLLISION_TYPE res = Math::intersectAABBvsAABB(vOldBox, vNewBox);
+            pending[p] = 1;
+        }
+    }
 
-        // If the old AABB contains the new one, keep using the old one
-        if (res != COLLISION_TYPE::CONTAINS)
+    // Refit bottom-up. Whichever thread finishes the last child of a node refits that 
+    // node, so every node is refit exactly once after both of its children.
+    const double sahDelta = ParallelReduce(0, dirtyLeaves.size(), REFIT_GRAIN, 0.0,
+        [this, &dirtyLeaves, &pending](size_t begin, size_t end)
         {
-            int currParent = node.Parent;
+            double delta = 0.0;
 
-            // Following the parent indices, keep going up the tree and merge the AABBs. Break once a parent node's
-            // AABB contains the new one
-            while (currParent != -1)
+            for (size_t i = begin; i < end; i++)
             {
-                Node& parentNode = m_nodes[currParent];
-
-                v_AABB vParentBox(parentNode.BoundingBox);
-                if (Math::intersectAABBvsAABB(vParentBox, vNewBox) == COLLISION_TYPE::CONTAINS)
-                    break;
+                const int leaf = dirtyLeaves[i];
+                delta += RefitNode(leaf);
 
-                vParentBox = Math::unionAABB(vParentBox, vNewBox);
-                parentNode.BoundingBox = Math::store(vParentBox);
+                for (int p = m_nodes[leaf].Parent; p != -1; p = m_nodes[p].Parent)
+                {
+                    if (std::atomic_ref<uint32_t>(pending[p]).fetch_sub(1, std::memory_order_acq_rel) != 1)
+                        break;
 
-                currParent = m_nodes[currParent].Parent;
+                    delta += RefitNode(p);
+                }
             }
-        }
 
-        // Note: when the new AABB and the old AABB are disjoint, it'd be better to
-        // remove and then reinsert the update Node. That requires modifying the range of
-        // all the leaves, which is expensive
-    }
+            return delta;
+        },
+        [](double a, double b)
+        {
+            return a + b;
+        });
+
+    m_sahSum += sahDelta;
+    UpdateWideNodes(pending.data());
+
+    if (GetSAHCostIncrease() > MAX_SAH_COST_INCREASE)
+        RebuildDegradedSubtrees();
 }
 
 void BVH::Remove(uint64_t ID, const Math::AABB& box)
@@ -406,7 +1364,7 @@ void BVH::Remove(uint64_t ID, const Math::AABB& box)
     // Find the leaf node that contains it
     int nodeIdx;
     const int instanceIdx = Find(ID, box, nodeIdx);
-    Assert(instanceIdx != -1, "Instance with ID %u was not found.", ID);
+    Check(instanceIdx != -1, "Instance with ID %llu was not found.", ID);
 
     m_instances[instanceIdx].InstanceID = Scene::INVALID_INSTANCE;
     m_instances[instanceIdx].BoundingBox.Extents = float3(-1.0f, -1.0f, -1.0f);
@@ -416,198 +1374,363 @@ void BVH::Remove(uint64_t ID, const Math::AABB& box)
     const uint32_t swapIdx = m_nodes[nodeIdx].Base + m_nodes[nodeIdx].Count - 1;
     std::swap(m_instances[instanceIdx], m_instances[swapIdx]);
     m_nodes[nodeIdx].Count--;
+
+    // Leaf's box isn't shrunk, but one less instance is tested when it's hit
+    m_sahSum -= AABBSurfaceArea(v_AABB(m_nodes[nodeIdx].BoundingBox));
 }
 
-void BVH::DoFrustumCulling(const Math::ViewFrustum& viewFrustum, 
-    const Math::float4x4a& viewToWorld, 
-    Vector<uint64_t, App::FrameAllocator>& visibleInstanceIDs)
+template<typename F>
+void BVH::FrustumCull(const Math::ViewFrustum& viewFrustum, const Math::float4x4a& viewToWorld, F f)
 {
+    if (m_wideNodes.empty())
+        return;
+
     // Transform view frustum from view space into world space
     v_float4x4 vM = load4x4(const_cast<float4x4a&>(viewToWorld));
     v_ViewFrustum vFrustum(const_cast<ViewFrustum&>(viewFrustum));
     vFrustum = Math::transform(vM, vFrustum);
+    const FrustumPlanes planes(vFrustum);
 
-    v_AABB vBox(m_nodes[0].BoundingBox);
-
-    // root doesn't intersect camera
-    if (Math::instersectFrustumVsAABB(vFrustum, vBox) == COLLISION_TYPE::DISJOINT)
-        return;
-
-    // Manual stack
-    constexpr int STACK_SIZE = 64;
+    // Manual stack. Subtrees that are completely inside the frustum are pushed as ~index
+    // (i.e. negative) -- all their instances are visible and no further tests are needed.
+    constexpr int STACK_SIZE = 128;
     int stack[STACK_SIZE];
     int currStackIdx = 0;
 
     // Insert root
     stack[currStackIdx] = 0;
-    int currNode = -1;
 
     while (currStackIdx >= 0)
     {
-        Assert(currStackIdx < 64, "Stack size exceeded maximum allowed.");
+        Assert(currStackIdx < STACK_SIZE, "Stack size exceeded maximum allowed.");
 
-        currNode = stack[currStackIdx--];
-        const Node& node = m_nodes[currNode];
+        const int entry = stack[currStackIdx--];
+        const bool isInside = entry < 0;
+        const WideNode& node = m_wideNodes[isInside ? ~entry : entry];
 
-        if (node.IsLeaf())
+        int intersectMask = node.ValidMask();
+        int insideMask = intersectMask;
+
+        if (!isInside)
+            intersectMask &= FrustumVsAABBx4(planes, node.CenterX, node.ExtentsX, insideMask);
+
+        while (intersectMask)
         {
-            for (int i = node.Base; i < node.Base + node.Count; i++)
+            const int i = (int)_tzcnt_u32(intersectMask);
+            intersectMask &= intersectMask - 1;
+            const bool childIsInside = insideMask & (1 << i);
+
+            if (!node.IsLeaf(i))
+            {
+                stack[++currStackIdx] = childIsInside ? ~node.Child[i] : node.Child[i];
+                continue;
+            }
+
+            const Node& leaf = m_nodes[node.BinaryNode[i]];
+
+            if (childIsInside)
             {
-                vBox.Reset(m_instances[i].BoundingBox);
+                for (int j = leaf.Base; j < leaf.Base + leaf.Count; j++)
+                    f(m_instances[j]);
 
-                if (Math::instersectFrustumVsAABB(vFrustum, vBox) != COLLISION_TYPE::DISJOINT)
-                    visibleInstanceIDs.push_back(m_instances[i].InstanceID);
+                continue;
             }
-        }
-        else
-        {
-            vBox.Reset(node.BoundingBox);
 
-            if (Math::instersectFrustumVsAABB(vFrustum, vBox) != COLLISION_TYPE::DISJOINT)
+            // Test the instances four at a time
+            for (int j = leaf.Base; j < leaf.Base + leaf.Count; j += 4)
             {
-                stack[++currStackIdx] = node.RightChild;
-                stack[++currStackIdx] = currNode + 1;
+                alignas(16) float center[12];
+                alignas(16) float extents[12];
+                const int num = Min(leaf.Base + leaf.Count - j, 4);
+                int visibleMask = LoadInstancesSoA(m_instances.data() + j, num, center, extents);
+                int unused;
+                visibleMask &= FrustumVsAABBx4(planes, center, extents, unused);
+
+                while (visibleMask)
+                {
+                    const int k = (int)_tzcnt_u32(visibleMask);
+                    visibleMask &= visibleMask - 1;
+
+                    f(m_instances[j + k]);
+                }
             }
         }
     }
 }
 
+void BVH::DoFrustumCulling(const Math::ViewFrustum& viewFrustum, 
+    const Math::float4x4a& viewToWorld, 
+    Vector<uint64_t, App::FrameAllocator>& visibleInstanceIDs)
+{
+    FrustumCull(viewFrustum, viewToWorld, [&visibleInstanceIDs](const BVHInput& instance)
+        {
+            visibleInstanceIDs.push_back(instance.InstanceID);
+        });
+}
+
 void BVH::DoFrustumCulling(const Math::ViewFrustum& viewFrustum,
     const Math::float4x4a& viewToWorld,
     Vector<BVHInput, App::FrameAllocator>& visibleInstanceIDs)
 {
-    // Transform view frustum from view space into world space
-    v_float4x4 vM = load4x4(const_cast<float4x4a&>(viewToWorld));
-    v_ViewFrustum vFrustum(const_cast<ViewFrustum&>(viewFrustum));
-    vFrustum = Math::transform(vM, vFrustum);
+    FrustumCull(viewFrustum, viewToWorld, [&visibleInstanceIDs](const BVHInput& instance)
+        {
+            visibleInstanceIDs.emplace_back(BVH::BVHInput{
+                .BoundingBox = instance.BoundingBox,
+                .InstanceID = instance.InstanceID });
+        });
+}
 
-    v_AABB vBox(m_nodes[0].BoundingBox);
+uint64_t BVH::CastRay(v_Ray& vRay)
+{
+    if (m_wideNodes.empty())
+        return Scene::INVALID_INSTANCE;
 
-    // Root doesn't intersect camera
-    if (Math::instersectFrustumVsAABB(vFrustum, vBox) == COLLISION_TYPE::DISJOINT)
-        return;
+    const __m128 vIsParallel = _mm_cmpge_ps(_mm_set1_ps(FLT_EPSILON), abs(vRay.vDir));
+    const __m128 vDirRcp = _mm_div_ps(_mm_set1_ps(1.0f), vRay.vDir);
+    const __m128 vDirIsPos = _mm_cmpge_ps(vRay.vDir, _mm_setzero_ps());
+    const RayData ray(vRay, vDirRcp, vDirIsPos, vIsParallel);
+
+    struct StackEntry
+    {
+        int Node;
+        // Distance to the entry point (zero if ray origin is inside the node)
+        float tNear;
+    };
 
     // Manual stack
-    constexpr int STACK_SIZE = 64;
-    int stack[STACK_SIZE];
+    constexpr int STACK_SIZE = 128;
+    StackEntry stack[STACK_SIZE];
     int currStackIdx = 0;
 
     // Insert root
-    stack[currStackIdx] = 0;
-    int currNode = -1;
+    stack[currStackIdx] = StackEntry{ .Node = 0, .tNear = 0.0f };
+    float minT = FLT_MAX;
+    uint64_t closestID = Scene::INVALID_INSTANCE;
 
     while (currStackIdx >= 0)
     {
-        Assert(currStackIdx < 64, "Stack size exceeded maximum allowed.");
+        Assert(currStackIdx < STACK_SIZE, "Stack size exceeded maximum allowed.");
+        const StackEntry entry = stack[currStackIdx--];
+
+        // No need to search this subtree as earlier hits are necessarily closer to camera
+        if (entry.tNear >= minT)
+            continue;
 
-        currNode = stack[currStackIdx--];
-        const Node& node = m_nodes[currNode];
+        const WideNode& node = m_wideNodes[entry.Node];
+        __m128 vT;
+        __m128 vTNear;
+        int hitMask = node.ValidMask() & RayVsAABBx4(ray, node.CenterX, node.ExtentsX, vT, vTNear);
 
-        if (node.IsLeaf())
+        // Descendants of a child can't be hit before the child's entry point (or the 
+        // ray origin when it's inside the child)
+        alignas(16) float tNear[4];
+        _mm_store_ps(tNear, vTNear);
+
+        // Internal children that were hit, sorted by distance (farthest first)
+        StackEntry toPush[4];
+        int numToPush = 0;
+
+        while (hitMask)
         {
-            for (int i = node.Base; i < node.Base + node.Count; i++)
+            const int i = (int)_tzcnt_u32(hitMask);
+            hitMask &= hitMask - 1;
+
+            if (!node.IsLeaf(i))
             {
-                vBox.Reset(m_instances[i].BoundingBox);
+                int j = numToPush++;
+                for (; j > 0 && toPush[j - 1].tNear < tNear[i]; j--)
+                    toPush[j] = toPush[j - 1];
 
-                if (Math::instersectFrustumVsAABB(vFrustum, vBox) != COLLISION_TYPE::DISJOINT)
-                {
-                    visibleInstanceIDs.emplace_back(BVH::BVHInput{
-                        .BoundingBox = m_instances[i].BoundingBox,
-                        .InstanceID = m_instances[i].InstanceID });
-                }
+                toPush[j] = StackEntry{ .Node = node.Child[i], .tNear = tNear[i] };
+                continue;
             }
-        }
-        else
-        {
-            vBox.Reset(node.BoundingBox);
 
-            if (Math::instersectFrustumVsAABB(vFrustum, vBox) != COLLISION_TYPE::DISJOINT)
+            if (tNear[i] >= minT)
+                continue;
+
+            const Node& leaf = m_nodes[node.BinaryNode[i]];
+
+            // Test the instances four at a time
+            for (int j = leaf.Base; j < leaf.Base + leaf.Count; j += 4)
             {
-                stack[++currStackIdx] = node.RightChild;
-                stack[++currStackIdx] = currNode + 1;
+                alignas(16) float center[12];
+                alignas(16) float extents[12];
+                alignas(16) float t[4];
+                const int num = Min(leaf.Base + leaf.Count - j, 4);
+                int instanceHitMask = LoadInstancesSoA(m_instances.data() + j, num, center, extents);
+                __m128 vInstanceT;
+                __m128 vInstanceTNear;
+                instanceHitMask &= RayVsAABBx4(ray, center, extents, vInstanceT, vInstanceTNear);
+                _mm_store_ps(t, vInstanceT);
+
+                while (instanceHitMask)
+                {
+                    const int k = (int)_tzcnt_u32(instanceHitMask);
+                    instanceHitMask &= instanceHitMask - 1;
+
+                    const bool tLtTmin = t[k] < minT;
+                    minT = tLtTmin ? t[k] : minT;
+                    closestID = tLtTmin ? m_instances[j + k].InstanceID : closestID;
+                }
             }
         }
+
+        // Closest child is searched first
+        for (int c = 0; c < numToPush; c++)
+            stack[++currStackIdx] = toPush[c];
     }
+
+    return closestID;
 }
 
-uint64_t BVH::CastRay(v_Ray& vRay)
+uint64_t BVH::CastRay(Math::Ray& r)
 {
-    v_AABB vBox(m_nodes[0].BoundingBox);
-    float t;
+    v_Ray vRay(r);
+    return CastRay(vRay);
+}
 
-    const __m128 vIsParallel = _mm_cmpge_ps(_mm_set1_ps(FLT_EPSILON), abs(vRay.vDir));
-     const __m128 vDirRcp = _mm_div_ps(_mm_set1_ps(1.0f), vRay.vDir);
-    const __m128 vDirIsPos = _mm_cmpge_ps(vRay.vDir, _mm_setzero_ps());
+void BVH::CastRayPacket(const Math::Ray* rays, int numRays, uint64_t* hits)
+{
+    const RayPacket packet(rays, numRays);
 
-    // Can return early if ray doesn't intersect root AABB
-    if (!Math::intersectRayVsAABB(vRay, vDirRcp, vDirIsPos, vIsParallel, vBox, t))
-        return Scene::INVALID_INSTANCE;
+    struct alignas(32) StackEntry
+    {
+        // Per-ray distance to the entry point
+        __m256 vTNear;
+        int Node;
+        // Rays that hit this node
+        int RayMask;
+    };
 
-    // Manual stack
-    constexpr int STACK_SIZE = 64;
-    int stack[STACK_SIZE];
+    constexpr int STACK_SIZE = 128;
+    StackEntry stack[STACK_SIZE];
     int currStackIdx = 0;
 
     // Insert root
-    stack[currStackIdx] = 0;
-    int currNode = -1;
-    float minT = FLT_MAX;
-    uint64_t closestID = Scene::INVALID_INSTANCE;
+    stack[currStackIdx] = StackEntry{ .vTNear = _mm256_setzero_ps(), .Node = 0, .RayMask = packet.ValidMask };
+    __m256 vMinT = _mm256_set1_ps(FLT_MAX);
+    alignas(32) uint64_t closestID[8];
+
+    for (int i = 0; i < 8; i++)
+        closestID[i] = Scene::INVALID_INSTANCE;
 
     while (currStackIdx >= 0)
     {
-        Assert(currStackIdx < STACK_SIZE, "Stack size exceeded 64.");
+        Assert(currStackIdx < STACK_SIZE, "Stack size exceeded maximum allowed.");
+        const StackEntry entry = stack[currStackIdx--];
 
-        currNode = stack[currStackIdx--];
-        const Node& node = m_nodes[currNode];
+        // Rays that have already found a closer hit don't need to search this subtree
+        const int rayMask = entry.RayMask & _mm256_movemask_ps(_mm256_cmp_ps(entry.vTNear, vMinT, _CMP_LT_OQ));
+        if (!rayMask)
+            continue;
 
-        if (node.IsLeaf())
+        const WideNode& node = m_wideNodes[entry.Node];
+        int validMask = node.ValidMask();
+
+        // Internal children that were hit, sorted by the smallest tNear among the rays 
+        // that hit them (farthest first)
+        StackEntry toPush[4];
+        float toPushTNear[4];
+        int numToPush = 0;
+
+        while (validMask)
         {
-            for (int i = node.Base; i < node.Base + node.Count; i++)
+            const int i = (int)_tzcnt_u32(validMask);
+            validMask &= validMask - 1;
+
+            __m256 vT;
+            __m256 vTNear;
+            int hitMask = rayMask & PacketVsAABB(packet, &node.CenterX[i], &node.ExtentsX[i], vT, vTNear);
+            hitMask &= _mm256_movemask_ps(_mm256_cmp_ps(vTNear, vMinT, _CMP_LT_OQ));
+
+            if (!hitMask)
+                continue;
+
+            if (!node.IsLeaf(i))
             {
-                vBox.Reset(m_instances[i].BoundingBox);
+                const float tNear = MinLane(vTNear, hitMask);
 
-                if (Math::intersectRayVsAABB(vRay, vDirRcp, vDirIsPos, vIsParallel, vBox, t))
+                int j = numToPush++;
+                for (; j > 0 && toPushTNear[j - 1] < tNear; j--)
                 {
-                    const bool tLtTmin = t < minT;
-                    minT = tLtTmin ? t : minT;
-                    closestID = tLtTmin ? m_instances[i].InstanceID : closestID;
+                    toPush[j] = toPush[j - 1];
+                    toPushTNear[j] = toPushTNear[j - 1];
                 }
-            }
-        }
-        else
-        {
-            const Node& leftChild = m_nodes[currNode + 1];
-            const Node& rightChild = m_nodes[node.RightChild];
-            const v_AABB vLeftBox(leftChild.BoundingBox);
-            const v_AABB vRightBox(rightChild.BoundingBox);
-            float leftT;
-            float rightT;
 
-            const bool hitLeftChild = Math::intersectRayVsAABB(vRay, vDirRcp, vDirIsPos, vIsParallel, vLeftBox, leftT);
-            const bool hitRightChild = Math::intersectRayVsAABB(vRay, vDirRcp, vDirIsPos, vIsParallel, vRightBox, rightT);
+                toPush[j] = StackEntry{ .vTNear = vTNear, .Node = node.Child[i], .RayMask = hitMask };
+                toPushTNear[j] = tNear;
 
-            int sortedByT[2] = { currNode + 1, node.RightChild };
-            const int numChildren = hitLeftChild + hitRightChild;
+                continue;
+            }
 
-            // Make sure subtree closer to camera is searched first
-            if (numChildren == 2 && leftT < rightT)
-                std::swap(sortedByT[0], sortedByT[1]);
+            const Node& leaf = m_nodes[node.BinaryNode[i]];
 
-            for (int c = 0; c < numChildren; c++)
+            // Test each instance against the rays that hit the leaf
+            for (int j = leaf.Base; j < leaf.Base + leaf.Count; j += 4)
             {
-                // No need to search this subtree as earlier hits are necessarily closer to camera
-                if(sortedByT[c] < minT)
-                    stack[++currStackIdx] = sortedByT[c];
+                alignas(16) float center[12];
+                alignas(16) float extents[12];
+                const int num = Min(leaf.Base + leaf.Count - j, 4);
+                LoadInstancesSoA(m_instances.data() + j, num, center, extents);
+
+                for (int k = 0; k < num; k++)
+                {
+                    __m256 vInstanceT;
+                    __m256 vInstanceTNear;
+                    int closerMask = hitMask & PacketVsAABB(packet, center + k, extents + k, 
+                        vInstanceT, vInstanceTNear);
+                    closerMask &= _mm256_movemask_ps(_mm256_cmp_ps(vInstanceT, vMinT, _CMP_LT_OQ));
+
+                    if (!closerMask)
+                        continue;
+
+                    const __m256 vCloser = _mm256_castsi256_ps(_mm256_cmpgt_epi32(
+                        _mm256_and_si256(_mm256_set1_epi32(closerMask), _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)),
+                        _mm256_setzero_si256()));
+                    vMinT = _mm256_blendv_ps(vMinT, vInstanceT, vCloser);
+
+                    while (closerMask)
+                    {
+                        const int r = (int)_tzcnt_u32(closerMask);
+                        closerMask &= closerMask - 1;
+                        closestID[r] = m_instances[j + k].InstanceID;
+                    }
+                }
             }
         }
+
+        // Closest child is searched first
+        for (int c = 0; c < numToPush; c++)
+            stack[++currStackIdx] = toPush[c];
     }
 
-    return closestID;
+    for (int i = 0; i < numRays; i++)
+        hits[i] = closestID[i];
 }
 
-uint64_t BVH::CastRay(Math::Ray& r)
+void BVH::CastRays(Span<Math::Ray> rays, MutableSpan<uint64_t> hits, int maxNumThreads)
 {
-    v_Ray vRay(r);
-    return CastRay(vRay);
+    Assert(hits.size() >= rays.size(), "Output span is too small.");
+
+    if (m_wideNodes.empty())
+    {
+        for (size_t i = 0; i < rays.size(); i++)
+            hits[i] = Scene::INVALID_INSTANCE;
+
+        return;
+    }
+
+    const size_t numPackets = CeilUnsignedIntDiv(rays.size(), (size_t)RAY_PACKET_SIZE);
+    if (numPackets == 0)
+        return;
+
+    ParallelFor(0, numPackets, RAY_PACKET_GRAIN, [this, rays, hits](size_t begin, size_t end)
+        {
+            for (size_t p = begin; p < end; p++)
+            {
+                const size_t first = p * RAY_PACKET_SIZE;
+                const int num = (int)Min(rays.size() - first, (size_t)RAY_PACKET_SIZE);
+                CastRayPacket(rays.data() + first, num, hits.data() + first);
+            }
+        }, maxNumThreads);
 }
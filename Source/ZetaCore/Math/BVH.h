@@ -36,7 +36,12 @@ namespace ZetaRay::Math
         BVH& operator=(BVH&&) = delete;
 
         bool IsBuilt() { return m_nodes.size() != 0; }
-        void Build(Util::Span<BVHInput> instances);
+        // Subtrees are built in parallel using up to maxNumThreads threads (<= 0 uses 
+        // all the worker threads). The resulting tree doesn't depend on the thread count.
+        void Build(Util::Span<BVHInput> instances, int maxNumThreads = 0);
+        // Refits the nodes that contain the given instances bottom-up (in parallel). As 
+        // instances move, tree quality degrades -- once SAH cost has increased by more than 
+        // MAX_SAH_COST_INCREASE, subtrees whose bounds have grown the most are rebuilt.
         void Update(Util::Span<BVHUpdateInput> instances);
         void Remove(uint64_t ID, const Math::AABB& AABB);
 
@@ -56,6 +61,21 @@ namespace ZetaRay::Math
         // be in world space.
         uint64_t CastRay(Math::Ray& r);
         uint64_t CastRay(Math::v_Ray& r);
+        // Casts the rays in packets of RAY_PACKET_SIZE consecutive rays. Rays in a packet 
+        // traverse the tree together and each AABB is tested against all of them at once, 
+        // so coherent rays (e.g. from neighboring pixels) should be next to each other. 
+        // For each ray, ID of the closest instance that was hit (or INVALID_INSTANCE) is 
+        // written to the corresponding element of hits. Large batches are split across up 
+        // to maxNumThreads threads (<= 0 uses all the worker threads).
+        void CastRays(Util::Span<Math::Ray> rays, Util::MutableSpan<uint64_t> hits, 
+            int maxNumThreads = 0);
+
+        // Returns the SAH cost of the tree -- expected number of node and instance AABB 
+        // tests for a random ray that hits the root. Can be used to compare the quality 
+        // of trees built for the same instances.
+        float ComputeSAHCost();
+        // Ratio of the current SAH cost to the SAH cost right after the last full build
+        float GetSAHCostIncrease() const;
 
         // Returns AABB that contains the scene
         Math::AABB GetWorldAABB() 
@@ -64,18 +84,29 @@ namespace ZetaRay::Math
             return m_nodes[0].BoundingBox; 
         }
 
+        static constexpr int RAY_PACKET_SIZE = 8;
+
     private:
         // Maximum number of instances that can be included in a leaf node
         static constexpr uint32_t MAX_NUM_INSTANCES_PER_LEAF = 8;
         static constexpr uint32_t MIN_NUM_INSTANCES_SPLIT_SAH = 10;
-        static constexpr uint32_t NUM_SAH_BINS = 6;
+        // Subtrees with at least this many instances build their two children in parallel
+        static constexpr uint32_t MIN_NUM_INSTANCES_PARALLEL_SUBTREE = 2048;
+        // Nodes with at least this many instances are binned and partitioned in parallel
+        static constexpr uint32_t MIN_NUM_INSTANCES_PARALLEL_SPLIT = 32 * 1024;
+        // SAH cost increase (relative to the last full build) that triggers a rebuild
+        static constexpr float MAX_SAH_COST_INCREASE = 1.2f;
+        // Subtrees whose surface area has grown by more than this factor since they were 
+        // built are rebuilt
+        static constexpr float MAX_NODE_AREA_INCREASE = 1.5f;
+        // Subtrees with more than this fraction of all the instances aren't rebuilt on 
+        // their own -- their children are considered instead
+        static constexpr float MAX_PARTIAL_REBUILD_FRACTION = 0.25f;
 
         struct alignas(64) Node
         {
-            bool IsInitialized() { return Parent != -1; }
-            void InitAsLeaf(int base, int count, int parent);
-            void InitAsInternal(Util::Span<BVH::BVHInput> instances, int base, int count,
-                int right, int parent);
+            void InitAsLeaf(const Math::AABB& box, int base, int count, int parent);
+            void InitAsInternal(const Math::AABB& box, int right, int parent);
             bool IsLeaf() const { return RightChild == -1; }
 
             // Union AABB of all the child nodes for internal nodes
@@ -103,10 +134,76 @@ namespace ZetaRay::Math
             int RightChild;
 
             int Parent = -1;
+
+            // Surface area of BoundingBox when this node was built. Refitting may grow the
+            // bounding box, which is used to find the subtrees that need to be rebuilt.
+            float BuildSurfaceArea;
         };
 
-        // Recursively builds a BVH (subtree) for the given range
-        int BuildSubtree(int base, int count, int parent);
+        // 4-wide node that's collapsed from the binary tree after build. Queries traverse 
+        // this tree and test all four child AABBs at once. Child AABBs are stored in SoA 
+        // layout as center & extents (same as Math::AABB), so that the results of the SIMD 
+        // tests match intersectRayVsAABB() and instersectFrustumVsAABB() exactly.
+        struct alignas(64) WideNode
+        {
+            void Init(const Node* nodes, const int* children, int numChildren);
+            ZetaInline bool IsLeaf(int i) const { return Child[i] == -1; }
+            // Bitmask of non-empty child slots
+            ZetaInline int ValidMask() const
+            {
+                const __m128i vBinaryNode = _mm_load_si128(reinterpret_cast<const __m128i*>(BinaryNode));
+                return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(vBinaryNode, _mm_set1_epi32(-1))));
+            }
+
+            float CenterX[4];
+            float CenterY[4];
+            float CenterZ[4];
+            float ExtentsX[4];
+            float ExtentsY[4];
+            float ExtentsZ[4];
+
+            // Index of the WideNode for internal children, -1 for leaves & empty slots
+            int Child[4];
+            // Binary node that each child corresponds to (-1 for empty slots). For leaves, 
+            // instance range is read from the binary node, so that Remove() doesn't need 
+            // to update the wide tree.
+            int BinaryNode[4];
+        };
+
+        // Recursively builds a BVH (subtree) for the given range and appends its nodes 
+        // to "nodes" in depth-first order (left child always comes right after its parent)
+        template<Support::AllocatorType Allocator>
+        void BuildSubtree(int base, int count, int parent, Util::Vector<Node, Allocator>& nodes);
+
+        // Collapses the binary subtree rooted at the given node into 4-wide nodes. Returns 
+        // index of the WideNode for that subtree.
+        int CollapseSubtree(int binaryNodeIdx);
+        // Reloads the child AABBs of wide nodes from the binary nodes that were refit
+        void UpdateWideNodes(const uint32_t* nodeState);
+
+        // Recomputes the bounding box of the given node from its children (or its 
+        // instances for leaves). Returns the resulting change in SAH sum.
+        double RefitNode(int nodeIdx);
+        // Rebuilds the subtrees whose bounds have grown too much and copies the rest
+        void RebuildDegradedSubtrees();
+        // Appends the given subtree to "nodes" in depth-first order. Subtrees with 
+        // rebuiltIdx[node] != -1 are replaced with rebuilt[rebuiltIdx[node]].
+        template<Support::AllocatorType Allocator>
+        void CopyOrRebuildSubtree(int nodeIdx, int parent, const int* rebuiltIdx, 
+            const Util::SmallVector<Node>* rebuilt, Util::Vector<Node, Allocator>& nodes);
+        // Range of instances covered by the given subtree (including removed ones)
+        void GetInstanceRange(int nodeIdx, int& base, int& count);
+        // Sum of (surface area x number of tests) over all nodes -- SAH cost without 
+        // normalization by the root surface area
+        double ComputeSAHSum();
+
+        // Calls f(instance) for every instance that at least partially overlaps the 
+        // view frustum
+        template<typename F>
+        void FrustumCull(const Math::ViewFrustum& viewFrustum, const Math::float4x4a& viewToWorld, F f);
+
+        // Casts up to RAY_PACKET_SIZE rays together
+        void CastRayPacket(const Math::Ray* rays, int numRays, uint64_t* hits);
 
         // Finds the leaf node that contains the given instance. Returns -1 otherwise.
         int Find(uint64_t instanceID, const Math::AABB& AABB, int& modelIdx);
@@ -116,9 +213,15 @@ namespace ZetaRay::Math
         // Tree hierarchy is stored as an array
         Util::SmallVector<Node, Support::ArenaAllocator> m_nodes;
 
+        // 4-wide tree that's used for queries. Root is at index 0.
+        Util::SmallVector<WideNode, Support::ArenaAllocator> m_wideNodes;
+
         // Array of inputs to build a BVH for. During BVH build, elements are moved around.
         Util::SmallVector<BVHInput, Support::ArenaAllocator> m_instances;
 
-        uint32_t m_numNodes = 0;
+        int m_maxNumBuildThreads = 0;
+        // Kept up to date by Update() & Remove()
+        double m_sahSum = 0.0;
+        float m_builtSAHCost = 0.0f;
     };
 }
@@ -0,0 +1,122 @@
+#include "BatchConversion.h"
+
+using namespace ZetaRay;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    // Converts n floats to 16-bit floats
+    void ConvertToHalf(const float* in, uint16_t* out, size_t n)
+    {
+        size_t i = 0;
+
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256 vF = _mm256_loadu_ps(in + i);
+            // Round to nearest, same as the scalar conversions
+            const __m128i vH = _mm256_cvtps_ph(vF, 0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), vH);
+        }
+
+        for (; i < n; i++)
+            out[i] = Math::FloatToHalf(in[i]);
+    }
+}
+
+void Math::Float3ToOct32(Span<float3> in, MutableSpan<oct32> out)
+{
+    Assert(in.size() == out.size(), "Input and output sizes don't match.");
+    static_assert(sizeof(oct32) == sizeof(uint32_t));
+
+    const float* src = reinterpret_cast<const float*>(in.data());
+    size_t i = 0;
+
+    for (; i + 8 <= in.size(); i += 8)
+    {
+        __m256 vX, vY, vZ;
+        loadFloat3x8(src + i * 3, vX, vY, vZ);
+
+        const __m256i vEncoded = encode_oct32x8(vX, vY, vZ);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out.data() + i), vEncoded);
+    }
+
+    for (; i < in.size(); i++)
+        out[i] = oct32(in[i]);
+}
+
+void Math::Oct32ToFloat3(Span<oct32> in, MutableSpan<float3> out)
+{
+    Assert(in.size() == out.size(), "Input and output sizes don't match.");
+
+    float* dst = reinterpret_cast<float*>(out.data());
+    size_t i = 0;
+
+    for (; i + 8 <= in.size(); i += 8)
+    {
+        const __m256i vEncoded = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in.data() + i));
+
+        __m256 vX, vY, vZ;
+        decode_oct32x8(vEncoded, vX, vY, vZ);
+        storeFloat3x8(dst + i * 3, vX, vY, vZ);
+    }
+
+    for (; i < in.size(); i++)
+    {
+        oct32 encoded = in[i];
+        out[i] = encoded.decode();
+    }
+}
+
+void Math::Float2ToUNorm2(Span<float2> in, MutableSpan<unorm2> out)
+{
+    Assert(in.size() == out.size(), "Input and output sizes don't match.");
+    static_assert(sizeof(unorm2) == 2 * sizeof(uint16_t));
+
+    const float* src = reinterpret_cast<const float*>(in.data());
+    uint16_t* dst = reinterpret_cast<uint16_t*>(out.data());
+    const __m256 vHalf = _mm256_set1_ps(0.5f);
+    const __m256 vMax = _mm256_set1_ps((1 << 16) - 1);
+    const __m256i vMask = _mm256_set1_epi32(0xffff);
+    size_t i = 0;
+
+    // 8 float2s (16 floats) at a time
+    for (; i + 8 <= in.size(); i += 8)
+    {
+        // [-1, 1] -> [0, 1] -> UNORM16
+        __m256 vV0 = _mm256_loadu_ps(src + i * 2);
+        __m256 vV1 = _mm256_loadu_ps(src + i * 2 + 8);
+        vV0 = _mm256_mul_ps(_mm256_fmadd_ps(vV0, vHalf, vHalf), vMax);
+        vV1 = _mm256_mul_ps(_mm256_fmadd_ps(vV1, vHalf, vHalf), vMax);
+
+        // Truncate to 16 bits like the scalar version, so that packus doesn't saturate
+        const __m256i vE0 = _mm256_and_si256(_mm256_cvtps_epi32(vV0), vMask);
+        const __m256i vE1 = _mm256_and_si256(_mm256_cvtps_epi32(vV1), vMask);
+
+        // packus works on each 128-bit lane separately, move the 64-bit blocks back in order
+        __m256i vPacked = _mm256_packus_epi32(vE0, vE1);
+        vPacked = _mm256_permute4x64_epi64(vPacked, V_SHUFFLE_XYZW(0, 2, 1, 3));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 2), vPacked);
+    }
+
+    for (; i < in.size(); i++)
+        out[i] = unorm2::FromNormalized(in[i]);
+}
+
+void Math::Float2ToHalf2(Span<float2> in, MutableSpan<half2> out)
+{
+    Assert(in.size() == out.size(), "Input and output sizes don't match.");
+    static_assert(sizeof(half2) == 2 * sizeof(uint16_t));
+
+    ConvertToHalf(reinterpret_cast<const float*>(in.data()), reinterpret_cast<uint16_t*>(out.data()),
+        in.size() * 2);
+}
+
+void Math::Float3ToHalf3(Span<float3> in, MutableSpan<half3> out)
+{
+    Assert(in.size() == out.size(), "Input and output sizes don't match.");
+    static_assert(sizeof(half3) == 3 * sizeof(uint16_t));
+
+    ConvertToHalf(reinterpret_cast<const float*>(in.data()), reinterpret_cast<uint16_t*>(out.data()),
+        in.size() * 3);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "OctahedralVector.h"
+#include "../Utility/Span.h"
+
+// Conversions of many values at a time to and from the compact types that are used for
+// GPU data (vertex normals and tangents, emissive triangles, mesh instances, ...).
+// Results are identical to converting the values one at a time, except for decoding
+// octahedral vectors, which may differ in the last bit.
+
+namespace ZetaRay::Math
+{
+    //--------------------------------------------------------------------------------------
+    // 8-wide building blocks
+    //--------------------------------------------------------------------------------------
+
+    // Loads 8 consecutive float3s and transposes them to SoA form
+    ZetaInline void __vectorcall loadFloat3x8(const float* ptr, __m256& vX, __m256& vY, __m256& vZ)
+    {
+        // x0 y0 z0 x1 | x4 y4 z4 x5
+        const __m256 vM03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ptr)),
+            _mm_loadu_ps(ptr + 12), 1);
+        // y1 z1 x2 y2 | y5 z5 x6 y6
+        const __m256 vM14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ptr + 4)),
+            _mm_loadu_ps(ptr + 16), 1);
+        // z2 x3 y3 z3 | z6 x7 y7 z7
+        const __m256 vM25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ptr + 8)),
+            _mm_loadu_ps(ptr + 20), 1);
+
+        // x2 y2 x3 y3 | x6 y6 x7 y7
+        const __m256 vXY = _mm256_shuffle_ps(vM14, vM25, V_SHUFFLE_XYZW(2, 3, 1, 2));
+        // y0 z0 y1 z1 | y4 z4 y5 z5
+        const __m256 vYZ = _mm256_shuffle_ps(vM03, vM14, V_SHUFFLE_XYZW(1, 2, 0, 1));
+
+        vX = _mm256_shuffle_ps(vM03, vXY, V_SHUFFLE_XYZW(0, 3, 0, 2));
+        vY = _mm256_shuffle_ps(vYZ, vXY, V_SHUFFLE_XYZW(0, 2, 1, 3));
+        vZ = _mm256_shuffle_ps(vYZ, vM25, V_SHUFFLE_XYZW(1, 3, 0, 3));
+    }
+
+    // Loads xyz of 8 consecutive float4s in SoA form
+    ZetaInline void __vectorcall loadFloat4x8(const float* ptr, __m256& vX, __m256& vY, __m256& vZ)
+    {
+        const __m256 vT04 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ptr)),
+            _mm_loadu_ps(ptr + 16), 1);
+        const __m256 vT15 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ptr + 4)),
+            _mm_loadu_ps(ptr + 20), 1);
+        const __m256 vT26 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ptr + 8)),
+            _mm_loadu_ps(ptr + 24), 1);
+        const __m256 vT37 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(ptr + 12)),
+            _mm_loadu_ps(ptr + 28), 1);
+
+        // x0 x1 y0 y1 | x4 x5 y4 y5
+        const __m256 vXY01 = _mm256_unpacklo_ps(vT04, vT15);
+        // x2 x3 y2 y3 | x6 x7 y6 y7
+        const __m256 vXY23 = _mm256_unpacklo_ps(vT26, vT37);
+        // z0 z1 w0 w1 | z4 z5 w4 w5
+        const __m256 vZW01 = _mm256_unpackhi_ps(vT04, vT15);
+        // z2 z3 w2 w3 | z6 z7 w6 w7
+        const __m256 vZW23 = _mm256_unpackhi_ps(vT26, vT37);
+
+        vX = _mm256_shuffle_ps(vXY01, vXY23, V_SHUFFLE_XYZW(0, 1, 0, 1));
+        vY = _mm256_shuffle_ps(vXY01, vXY23, V_SHUFFLE_XYZW(2, 3, 2, 3));
+        vZ = _mm256_shuffle_ps(vZW01, vZW23, V_SHUFFLE_XYZW(0, 1, 0, 1));
+    }
+
+    // Inverse of loadFloat3x8()
+    ZetaInline void __vectorcall storeFloat3x8(float* ptr, __m256 vX, __m256 vY, __m256 vZ)
+    {
+        // x0 y0 x1 y1 | x4 y4 x5 y5
+        const __m256 vXY01 = _mm256_unpacklo_ps(vX, vY);
+        // x2 y2 x3 y3 | x6 y6 x7 y7
+        const __m256 vXY23 = _mm256_unpackhi_ps(vX, vY);
+
+        // z0 z0 x1 x1
+        const __m256 vZX = _mm256_shuffle_ps(vZ, vXY01, V_SHUFFLE_XYZW(0, 0, 2, 2));
+        // y1 y1 z1 z1
+        const __m256 vYZ = _mm256_shuffle_ps(vXY01, vZ, V_SHUFFLE_XYZW(3, 3, 1, 1));
+        // z2 z2 x3 x3
+        const __m256 vZX23 = _mm256_shuffle_ps(vZ, vXY23, V_SHUFFLE_XYZW(2, 2, 2, 2));
+        // y3 y3 z3 z3
+        const __m256 vYZ23 = _mm256_shuffle_ps(vXY23, vZ, V_SHUFFLE_XYZW(3, 3, 3, 3));
+
+        // x0 y0 z0 x1 | x4 y4 z4 x5
+        const __m256 vM03 = _mm256_shuffle_ps(vXY01, vZX, V_SHUFFLE_XYZW(0, 1, 0, 2));
+        // y1 z1 x2 y2 | y5 z5 x6 y6
+        const __m256 vM14 = _mm256_shuffle_ps(vYZ, vXY23, V_SHUFFLE_XYZW(0, 2, 0, 1));
+        // z2 x3 y3 z3 | z6 x7 y7 z7
+        const __m256 vM25 = _mm256_shuffle_ps(vZX23, vYZ23, V_SHUFFLE_XYZW(0, 2, 0, 2));
+
+        _mm_storeu_ps(ptr, _mm256_castps256_ps128(vM03));
+        _mm_storeu_ps(ptr + 4, _mm256_castps256_ps128(vM14));
+        _mm_storeu_ps(ptr + 8, _mm256_castps256_ps128(vM25));
+        _mm_storeu_ps(ptr + 12, _mm256_extractf128_ps(vM03, 1));
+        _mm_storeu_ps(ptr + 16, _mm256_extractf128_ps(vM14, 1));
+        _mm_storeu_ps(ptr + 20, _mm256_extractf128_ps(vM25, 1));
+    }
+
+    // Octahedral encoding of 8 unit vectors in SoA form. Follows the same sequence of
+    // operations as oct32(x, y, z), so results are identical. Returns the encoded values
+    // packed as 32-bit integers with x in the low half.
+    ZetaInline __m256i __vectorcall encode_oct32x8(__m256 vX, __m256 vY, __m256 vZ)
+    {
+        const __m256 vZero = _mm256_setzero_ps();
+        const __m256 vOne = _mm256_set1_ps(1.0f);
+        const __m256 vMinusOne = _mm256_set1_ps(-1.0f);
+        const __m256 vHalf = _mm256_set1_ps(0.5f);
+        const __m256 vMax = _mm256_set1_ps((1 << 16) - 1);
+
+        // Same order of summation as hadd_float3()
+        const __m256 vSum = _mm256_add_ps(_mm256_add_ps(abs(vX), abs(vZ)), abs(vY));
+        const __m256 vEncodedPosZ_x = _mm256_div_ps(vX, vSum);
+        const __m256 vEncodedPosZ_y = _mm256_div_ps(vY, vSum);
+
+        const __m256 vSign_x = _mm256_blendv_ps(vMinusOne, vOne, _mm256_cmp_ps(vX, vZero, _CMP_GE_OQ));
+        const __m256 vSign_y = _mm256_blendv_ps(vMinusOne, vOne, _mm256_cmp_ps(vY, vZero, _CMP_GE_OQ));
+        const __m256 vEncodedNegZ_x = _mm256_mul_ps(_mm256_sub_ps(vOne, abs(vEncodedPosZ_y)), vSign_x);
+        const __m256 vEncodedNegZ_y = _mm256_mul_ps(_mm256_sub_ps(vOne, abs(vEncodedPosZ_x)), vSign_y);
+
+        // v.z <= 0.0 ? 1.0 - abs(v.yx) * SignNotZero(v) : v
+        const __m256 vZLe0 = _mm256_cmp_ps(vZ, vZero, _CMP_LE_OQ);
+        __m256 vEncoded_x = _mm256_blendv_ps(vEncodedPosZ_x, vEncodedNegZ_x, vZLe0);
+        __m256 vEncoded_y = _mm256_blendv_ps(vEncodedPosZ_y, vEncodedNegZ_y, vZLe0);
+
+        // [-1, 1] -> [0, 1] -> UNORM16
+        vEncoded_x = _mm256_mul_ps(_mm256_fmadd_ps(vEncoded_x, vHalf, vHalf), vMax);
+        vEncoded_y = _mm256_mul_ps(_mm256_fmadd_ps(vEncoded_y, vHalf, vHalf), vMax);
+        const __m256i vX16 = _mm256_and_si256(_mm256_cvtps_epi32(vEncoded_x), _mm256_set1_epi32(0xffff));
+        const __m256i vY16 = _mm256_slli_epi32(_mm256_cvtps_epi32(vEncoded_y), 16);
+
+        return _mm256_or_si256(vX16, vY16);
+    }
+
+    // Inverse of encode_oct32x8(). Follows the same sequence of operations as oct32::decode().
+    ZetaInline void __vectorcall decode_oct32x8(__m256i vEncoded, __m256& vX, __m256& vY, __m256& vZ)
+    {
+        const __m256 vZero = _mm256_setzero_ps();
+        const __m256 vOne = _mm256_set1_ps(1.0f);
+        const __m256 vMax = _mm256_set1_ps((1 << 16) - 1);
+
+        // UNORM16 -> [0, 1] -> [-1, 1]
+        __m256 vU = _mm256_cvtepi32_ps(_mm256_and_si256(vEncoded, _mm256_set1_epi32(0xffff)));
+        __m256 vV = _mm256_cvtepi32_ps(_mm256_srli_epi32(vEncoded, 16));
+        vU = _mm256_fmadd_ps(_mm256_div_ps(vU, vMax), _mm256_set1_ps(2.0f), _mm256_set1_ps(-1.0f));
+        vV = _mm256_fmadd_ps(_mm256_div_ps(vV, vMax), _mm256_set1_ps(2.0f), _mm256_set1_ps(-1.0f));
+
+        const __m256 vDecodedZ = _mm256_sub_ps(vOne, _mm256_add_ps(abs(vU), abs(vV)));
+        const __m256 vPosT = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(vZero, vDecodedZ), vZero), vOne);
+        const __m256 vNegT = _mm256_sub_ps(vZero, vPosT);
+
+        // u >= 0 ? u - t : u + t
+        const __m256 vDecodedX = _mm256_add_ps(vU, _mm256_blendv_ps(vPosT, vNegT,
+            _mm256_cmp_ps(vU, vZero, _CMP_GE_OQ)));
+        const __m256 vDecodedY = _mm256_add_ps(vV, _mm256_blendv_ps(vPosT, vNegT,
+            _mm256_cmp_ps(vV, vZero, _CMP_GE_OQ)));
+
+        const __m256 vNorm2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vDecodedX, vDecodedX),
+            _mm256_mul_ps(vDecodedY, vDecodedY)), _mm256_mul_ps(vDecodedZ, vDecodedZ));
+        const __m256 vNorm = _mm256_sqrt_ps(vNorm2);
+
+        vX = _mm256_div_ps(vDecodedX, vNorm);
+        vY = _mm256_div_ps(vDecodedY, vNorm);
+        vZ = _mm256_div_ps(vDecodedZ, vNorm);
+    }
+
+    //--------------------------------------------------------------------------------------
+    // Batch conversions
+    //--------------------------------------------------------------------------------------
+
+    // Input and output must have the same number of elements
+
+    // Same as oct32(float3) for every element
+    void Float3ToOct32(Util::Span<float3> in, Util::MutableSpan<oct32> out);
+    // Same as oct32::decode() for every element
+    void Oct32ToFloat3(Util::Span<oct32> in, Util::MutableSpan<float3> out);
+    // Same as unorm2::FromNormalized(float2) for every element
+    void Float2ToUNorm2(Util::Span<float2> in, Util::MutableSpan<unorm2> out);
+    // Same as half2(float2) for every element
+    void Float2ToHalf2(Util::Span<float2> in, Util::MutableSpan<half2> out);
+    // Same as half3(float3) for every element
+    void Float3ToHalf3(Util::Span<float3> in, Util::MutableSpan<half3> out);
+}
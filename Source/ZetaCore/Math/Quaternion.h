@@ -118,6 +118,50 @@ namespace ZetaRay::Math
         return vRes;
     }
 
+    // Same as above, for 8 pairs of quaternions at once. Quaternions are in structure-of-arrays
+    // layout, i.e. vQ[0] holds the x components, vQ[1] the y components and so on. Result is
+    // written to vQ1.
+    ZetaInline void slerp(__m256 vQ1[4], const __m256 vQ2[4], const __m256 vT)
+    {
+        const __m256 vOne = _mm256_set1_ps(1.0f);
+        __m256 vCosTheta = _mm256_mul_ps(vQ1[0], vQ2[0]);
+        vCosTheta = _mm256_fmadd_ps(vQ1[1], vQ2[1], vCosTheta);
+        vCosTheta = _mm256_fmadd_ps(vQ1[2], vQ2[2], vCosTheta);
+        vCosTheta = _mm256_fmadd_ps(vQ1[3], vQ2[3], vCosTheta);
+
+        // Same hemisphere check as above -- flip sign of q2 where needed
+        const __m256 vSign = _mm256_and_ps(vCosTheta, _mm256_set1_ps(-0.0f));
+        vCosTheta = _mm256_xor_ps(vCosTheta, vSign);
+
+        __m256 vSinTheta = _mm256_sub_ps(vOne, _mm256_mul_ps(vCosTheta, vCosTheta));
+        vSinTheta = _mm256_sqrt_ps(_mm256_max_ps(vSinTheta, _mm256_setzero_ps()));
+
+        const __m256 vTheta = acos(vCosTheta);
+        const __m256 vRcpSinTheta = _mm256_div_ps(vOne, vSinTheta);
+        const __m256 vS1 = _mm256_mul_ps(sin(_mm256_mul_ps(_mm256_sub_ps(vOne, vT), vTheta)), vRcpSinTheta);
+        const __m256 vS2 = _mm256_mul_ps(sin(_mm256_mul_ps(vT, vTheta)), vRcpSinTheta);
+
+        // If theta is near zero, use linear interpolation followed by normalization
+        const __m256 vIsThetaNearZero = _mm256_cmp_ps(vCosTheta, _mm256_set1_ps(1.0f - FLT_EPSILON),
+            _CMP_GT_OQ);
+        __m256 vResLerp[4];
+        __m256 vNorm2 = _mm256_setzero_ps();
+
+        for (int i = 0; i < 4; i++)
+        {
+            const __m256 q2 = _mm256_xor_ps(vQ2[i], vSign);
+            vResLerp[i] = lerp(vQ1[i], q2, vT);
+            vNorm2 = _mm256_fmadd_ps(vResLerp[i], vResLerp[i], vNorm2);
+
+            vQ1[i] = _mm256_fmadd_ps(q2, vS2, _mm256_mul_ps(vQ1[i], vS1));
+        }
+
+        const __m256 vRcpNorm = _mm256_rsqrt_ps(vNorm2);
+
+        for (int i = 0; i < 4; i++)
+            vQ1[i] = _mm256_blendv_ps(vQ1[i], _mm256_mul_ps(vResLerp[i], vRcpNorm), vIsThetaNearZero);
+    }
+
     /* TODO
     // pitch: angle of rotation around the x-axis (radians)
     // yaw: angle of rotation around the y-axis (radians)
@@ -279,6 +279,65 @@ namespace ZetaRay::Math
         return Result;
     }
 
+    // Same as above, for 8 values at once
+    ZetaInline __m256 __vectorcall acos(const __m256 V)
+    {
+        const __m256 vZero = _mm256_setzero_ps();
+        const __m256 nonnegative = _mm256_cmp_ps(V, vZero, _CMP_GE_OQ);
+        const __m256 x = abs(V);
+
+        // Compute (1-|V|), clamp to zero to avoid sqrt of negative number.
+        const __m256 oneMValue = _mm256_sub_ps(_mm256_set1_ps(1.0f), x);
+        const __m256 root = _mm256_sqrt_ps(_mm256_max_ps(vZero, oneMValue));
+
+        // Compute polynomial approximation
+        __m256 t0 = _mm256_set1_ps(-0.0012624911f);
+        t0 = _mm256_fmadd_ps(t0, x, _mm256_set1_ps(0.0066700901f));
+        t0 = _mm256_fmadd_ps(t0, x, _mm256_set1_ps(-0.0170881256f));
+        t0 = _mm256_fmadd_ps(t0, x, _mm256_set1_ps(0.0308918810f));
+        t0 = _mm256_fmadd_ps(t0, x, _mm256_set1_ps(-0.0501743046f));
+        t0 = _mm256_fmadd_ps(t0, x, _mm256_set1_ps(0.0889789874f));
+        t0 = _mm256_fmadd_ps(t0, x, _mm256_set1_ps(-0.2145988016f));
+        t0 = _mm256_fmadd_ps(t0, x, _mm256_set1_ps(1.5707963050f));
+        t0 = _mm256_mul_ps(t0, root);
+
+        const __m256 t1 = _mm256_sub_ps(_mm256_set1_ps(PI), t0);
+
+        return _mm256_blendv_ps(t1, t0, nonnegative);
+    }
+
+    // Same as above, for 8 values at once
+    ZetaInline __m256 __vectorcall sin(__m256 vTheta)
+    {
+        // Map in [-pi/2,pi/2] with sin(y) = sin(x).
+        const __m256 sign = _mm256_and_ps(vTheta, _mm256_set1_ps(-0.0f));
+        const __m256 c = _mm256_or_ps(_mm256_set1_ps(PI), sign);  // pi when x >= 0, -pi when x < 0
+        const __m256 absx = _mm256_andnot_ps(sign, vTheta);  // |x|
+        const __m256 rflx = _mm256_sub_ps(c, vTheta);
+        const __m256 comp = _mm256_cmp_ps(absx, _mm256_set1_ps(PI_OVER_2), _CMP_LE_OQ);
+        vTheta = _mm256_blendv_ps(rflx, vTheta, comp);
+
+        const __m256 x2 = _mm256_mul_ps(vTheta, vTheta);
+
+        // Compute polynomial approximation
+        __m256 Result = _mm256_set1_ps(-2.3889859e-08f);
+        Result = _mm256_fmadd_ps(Result, x2, _mm256_set1_ps(+2.7525562e-06f));
+        Result = _mm256_fmadd_ps(Result, x2, _mm256_set1_ps(-0.00019840874f));
+        Result = _mm256_fmadd_ps(Result, x2, _mm256_set1_ps(+0.0083333310f));
+        Result = _mm256_fmadd_ps(Result, x2, _mm256_set1_ps(-0.16666667f));
+        Result = _mm256_fmadd_ps(Result, x2, _mm256_set1_ps(1.0f));
+        Result = _mm256_mul_ps(Result, vTheta);
+
+        return Result;
+    }
+
+    // Returns v1 + t * (v2 - v1)
+    ZetaInline __m256 __vectorcall lerp(const __m256 v0, const __m256 v1, __m256 vT)
+    {
+        // fma(t, v1, fma(-t, v0, v0));
+        return _mm256_fmadd_ps(vT, v1, _mm256_fnmadd_ps(vT, v0, v0));
+    }
+
     ZetaInline float4a __vectorcall store(__m128 v)
     {
         float4a f;
@@ -0,0 +1,510 @@
+#include "MeshOptimization.h"
+#include "../Utility/SmallVector.h"
+#include <algorithm>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Core;
+using namespace ZetaRay::Util;
+using namespace ZetaRay::Model;
+
+namespace
+{
+    // Simulates a FIFO post-transform cache. A vertex is in the cache if fewer than
+    // "size" vertices were inserted after it.
+    struct FifoCache
+    {
+        FifoCache(uint32_t numVertices, uint32_t size)
+            : Size(size),
+            Time(size + 1)
+        {
+            InsertedAt.resize(numVertices, 0);
+        }
+
+        // Returns 1 for a miss, 0 otherwise
+        ZetaInline uint32_t Access(uint32_t v)
+        {
+            if (Time - InsertedAt[v] <= Size)
+                return 0;
+
+            InsertedAt[v] = Time++;
+            return 1;
+        }
+
+        ZetaInline void Reset()
+        {
+            Time += Size + 1;
+        }
+
+        SmallVector<uint32_t> InsertedAt;
+        uint32_t Size;
+        uint32_t Time;
+    };
+
+    //--------------------------------------------------------------------------------------
+    // Vertex scoring from Forsyth's paper
+    //--------------------------------------------------------------------------------------
+
+    constexpr int FORSYTH_CACHE_SIZE = 32;
+    constexpr float CACHE_DECAY_POWER = 1.5f;
+    constexpr float LAST_TRI_SCORE = 0.75f;
+    constexpr float VALENCE_BOOST_SCALE = 2.0f;
+    constexpr float VALENCE_BOOST_POWER = 0.5f;
+    // Valence scores are precomputed up to this number of remaining triangles
+    constexpr uint32_t MAX_PRECOMPUTED_VALENCE = 64;
+
+    struct ScoreTables
+    {
+        ScoreTables()
+        {
+            for (int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+            {
+                // Vertices of the last triangle get a fixed score, so that the next
+                // triangle doesn't simply reuse the same edge
+                Cache[i] = i < 3 ? LAST_TRI_SCORE :
+                    powf(1.0f - float(i - 3) / (FORSYTH_CACHE_SIZE - 3), CACHE_DECAY_POWER);
+            }
+
+            Valence[0] = 0.0f;
+
+            for (uint32_t i = 1; i < MAX_PRECOMPUTED_VALENCE; i++)
+                Valence[i] = VALENCE_BOOST_SCALE * powf((float)i, -VALENCE_BOOST_POWER);
+        }
+
+        float Cache[FORSYTH_CACHE_SIZE];
+        float Valence[MAX_PRECOMPUTED_VALENCE];
+    };
+
+    ZetaInline float VertexScore(const ScoreTables& tables, int cachePos, uint32_t numRemainingTris)
+    {
+        // No triangles left to use this vertex
+        if (numRemainingTris == 0)
+            return -1.0f;
+
+        float score = cachePos >= 0 ? tables.Cache[cachePos] : 0.0f;
+        // Boost vertices with few triangles left, so that they're finished off quickly
+        score += numRemainingTris < MAX_PRECOMPUTED_VALENCE ? tables.Valence[numRemainingTris] :
+            VALENCE_BOOST_SCALE * powf((float)numRemainingTris, -VALENCE_BOOST_POWER);
+
+        return score;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// MeshOptimization
+//--------------------------------------------------------------------------------------
+
+MeshOptimization::VertexCacheStats MeshOptimization::AnalyzeVertexCache(Span<uint32_t> indices,
+    uint32_t numVertices, uint32_t cacheSize)
+{
+    FifoCache cache(numVertices, cacheSize);
+    uint64_t numMisses = 0;
+
+    for (auto idx : indices)
+    {
+        Assert(idx < numVertices, "Index out of bounds.");
+        numMisses += cache.Access(idx);
+    }
+
+    return VertexCacheStats{ .NumTransformed = numMisses,
+        .NumTriangles = indices.size() / 3,
+        .NumVertices = numVertices };
+}
+
+uint32_t MeshOptimization::DeduplicateVertices(MutableSpan<Vertex> vertices, MutableSpan<uint32_t> indices)
+{
+    static_assert(sizeof(Vertex) == 28, "Vertex has padding, which breaks bitwise comparisons.");
+
+    const uint32_t numVertices = (uint32_t)vertices.size();
+    if (numVertices == 0)
+        return 0;
+
+    // Sort so that identical vertices are next to each other, ties are broken by index so
+    // that the first occurrence comes first
+    SmallVector<uint32_t> sorted;
+    sorted.resize(numVertices);
+
+    for (uint32_t i = 0; i < numVertices; i++)
+        sorted[i] = i;
+
+    std::sort(sorted.begin(), sorted.end(), [&vertices](uint32_t lhs, uint32_t rhs)
+        {
+            const int c = memcmp(&vertices[lhs], &vertices[rhs], sizeof(Vertex));
+            return c < 0 || (c == 0 && lhs < rhs);
+        });
+
+    // First occurrence of every vertex
+    SmallVector<uint32_t> firstOccurrence;
+    firstOccurrence.resize(numVertices);
+    uint32_t first = sorted[0];
+
+    for (uint32_t i = 0; i < numVertices; i++)
+    {
+        const uint32_t v = sorted[i];
+        if (memcmp(&vertices[v], &vertices[first], sizeof(Vertex)) != 0)
+            first = v;
+
+        firstOccurrence[v] = first;
+    }
+
+    // Compact in place. First occurrences come before their duplicates, so every
+    // duplicate finds its new index already assigned.
+    SmallVector<uint32_t> remap;
+    remap.resize(numVertices);
+    uint32_t numUnique = 0;
+
+    for (uint32_t v = 0; v < numVertices; v++)
+    {
+        if (firstOccurrence[v] == v)
+        {
+            vertices[numUnique] = vertices[v];
+            remap[v] = numUnique++;
+        }
+        else
+            remap[v] = remap[firstOccurrence[v]];
+    }
+
+    for (auto& idx : indices)
+        idx = remap[idx];
+
+    return numUnique;
+}
+
+void MeshOptimization::OptimizeVertexCache(MutableSpan<uint32_t> indices, uint32_t numVertices)
+{
+    const uint32_t numTris = (uint32_t)(indices.size() / 3);
+    if (numTris < 2)
+        return;
+
+    static const ScoreTables tables;
+
+    // Triangles that use each vertex and haven't been added yet. Triangles of vertex v
+    // are adjTris[adjOffset[v], adjOffset[v] + numRemaining[v]).
+    SmallVector<uint32_t> numRemaining;
+    SmallVector<uint32_t> adjOffset;
+    SmallVector<uint32_t> adjTris;
+    numRemaining.resize(numVertices, 0);
+    adjOffset.resize(numVertices);
+    adjTris.resize(indices.size());
+
+    for (auto idx : indices)
+        numRemaining[idx]++;
+
+    uint32_t offset = 0;
+
+    for (uint32_t v = 0; v < numVertices; v++)
+    {
+        adjOffset[v] = offset;
+        offset += numRemaining[v];
+        numRemaining[v] = 0;
+    }
+
+    for (uint32_t i = 0; i < indices.size(); i++)
+    {
+        const uint32_t v = indices[i];
+        adjTris[adjOffset[v] + numRemaining[v]++] = i / 3;
+    }
+
+    SmallVector<int> cachePos;
+    SmallVector<float> vtxScore;
+    cachePos.resize(numVertices, -1);
+    vtxScore.resize(numVertices);
+
+    for (uint32_t v = 0; v < numVertices; v++)
+        vtxScore[v] = VertexScore(tables, -1, numRemaining[v]);
+
+    auto triScore = [&indices, &vtxScore](uint32_t t)
+        {
+            return vtxScore[indices[t * 3]] + vtxScore[indices[t * 3 + 1]] + vtxScore[indices[t * 3 + 2]];
+        };
+
+    SmallVector<uint8_t> added;
+    added.resize(numTris, 0);
+
+    int64_t bestTri = 0;
+    float bestScore = triScore(0);
+
+    for (uint32_t t = 1; t < numTris; t++)
+    {
+        const float score = triScore(t);
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestTri = t;
+        }
+    }
+
+    SmallVector<uint32_t> output;
+    output.resize(indices.size());
+
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    int cacheSize = 0;
+    // For when none of the triangles that use the cached vertices are left
+    uint32_t nextUnadded = 0;
+
+    for (uint32_t i = 0; i < numTris; i++)
+    {
+        if (bestTri == -1)
+        {
+            while (added[nextUnadded])
+                nextUnadded++;
+
+            bestTri = nextUnadded;
+        }
+
+        const uint32_t t = (uint32_t)bestTri;
+        const uint32_t tri[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+        added[t] = 1;
+        output[i * 3] = tri[0];
+        output[i * 3 + 1] = tri[1];
+        output[i * 3 + 2] = tri[2];
+
+        // Remove the triangle from its vertices
+        for (auto v : tri)
+        {
+            uint32_t* adj = adjTris.data() + adjOffset[v];
+            const uint32_t n = numRemaining[v];
+
+            for (uint32_t j = 0; j < n; j++)
+            {
+                if (adj[j] == t)
+                {
+                    adj[j] = adj[n - 1];
+                    break;
+                }
+            }
+
+            numRemaining[v]--;
+        }
+
+        // Move the triangle's vertices to the front of the LRU cache
+        uint32_t newCache[FORSYTH_CACHE_SIZE + 3];
+        int newCacheSize = 0;
+
+        for (auto v : tri)
+        {
+            if (std::find(newCache, newCache + newCacheSize, v) == newCache + newCacheSize)
+                newCache[newCacheSize++] = v;
+        }
+
+        for (int j = 0; j < cacheSize; j++)
+        {
+            const uint32_t v = cache[j];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCacheSize++] = v;
+        }
+
+        // Vertices past the cache size were evicted, but their scores still need updating
+        for (int j = 0; j < newCacheSize; j++)
+        {
+            const uint32_t v = newCache[j];
+            cachePos[v] = j < FORSYTH_CACHE_SIZE ? j : -1;
+            vtxScore[v] = VertexScore(tables, cachePos[v], numRemaining[v]);
+        }
+
+        cacheSize = Math::Min(newCacheSize, FORSYTH_CACHE_SIZE);
+        memcpy(cache, newCache, cacheSize * sizeof(uint32_t));
+
+        // Only triangles that use an updated vertex have new scores. Best triangle is
+        // searched among them.
+        bestTri = -1;
+        bestScore = -1.0f;
+
+        for (int j = 0; j < newCacheSize; j++)
+        {
+            const uint32_t v = newCache[j];
+            const uint32_t* adj = adjTris.data() + adjOffset[v];
+
+            for (uint32_t k = 0; k < numRemaining[v]; k++)
+            {
+                const float score = triScore(adj[k]);
+
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    bestTri = adj[k];
+                }
+            }
+        }
+    }
+
+    memcpy(indices.data(), output.data(), output.size() * sizeof(uint32_t));
+}
+
+void MeshOptimization::OptimizeOverdraw(MutableSpan<uint32_t> indices, Span<Vertex> vertices,
+    float threshold)
+{
+    const uint32_t numTris = (uint32_t)(indices.size() / 3);
+    if (numTris < 2)
+        return;
+
+    // Misses for a triangle, given the cache state
+    auto triMisses = [&indices](FifoCache& cache, uint32_t t)
+        {
+            return cache.Access(indices[t * 3]) + cache.Access(indices[t * 3 + 1]) +
+                cache.Access(indices[t * 3 + 2]);
+        };
+
+    FifoCache cache((uint32_t)vertices.size(), STATS_CACHE_SIZE);
+
+    // Hard boundaries -- where all the vertices of a triangle miss the cache, the order
+    // before it doesn't matter for the cache
+    SmallVector<uint32_t> hardBoundaries;
+    hardBoundaries.push_back(0);
+
+    for (uint32_t t = 0; t < numTris; t++)
+    {
+        if (triMisses(cache, t) == 3 && t > 0)
+            hardBoundaries.push_back(t);
+    }
+
+    hardBoundaries.push_back(numTris);
+
+    // Soft boundaries -- split each of the above further wherever the ACMR so far,
+    // starting with an empty cache, is close enough to the ACMR of the whole cluster
+    SmallVector<uint32_t> clusters;
+
+    for (size_t c = 0; c + 1 < hardBoundaries.size(); c++)
+    {
+        const uint32_t begin = hardBoundaries[c];
+        const uint32_t end = hardBoundaries[c + 1];
+
+        cache.Reset();
+        uint32_t clusterMisses = 0;
+
+        for (uint32_t t = begin; t < end; t++)
+            clusterMisses += triMisses(cache, t);
+
+        const float maxACMR = threshold * clusterMisses / (end - begin);
+        uint32_t start = begin;
+        uint32_t misses = 0;
+
+        cache.Reset();
+        clusters.push_back(begin);
+
+        for (uint32_t t = begin; t < end - 1; t++)
+        {
+            misses += triMisses(cache, t);
+
+            if ((float)misses / (t + 1 - start) <= maxACMR)
+            {
+                start = t + 1;
+                misses = 0;
+                cache.Reset();
+                clusters.push_back(start);
+            }
+        }
+    }
+
+    const uint32_t numClusters = (uint32_t)clusters.size();
+    clusters.push_back(numTris);
+
+    // Area-weighted centroid and normal of each cluster. With clockwise triangles, the
+    // following cross product points outward.
+    SmallVector<float3> clusterCentroid;
+    SmallVector<float3> clusterNormal;
+    SmallVector<float> clusterArea;
+    clusterCentroid.resize(numClusters, float3(0.0f));
+    clusterNormal.resize(numClusters, float3(0.0f));
+    clusterArea.resize(numClusters, 0.0f);
+    float3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+
+    for (uint32_t c = 0; c < numClusters; c++)
+    {
+        for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++)
+        {
+            const float3 p0 = vertices[indices[t * 3]].Position;
+            const float3 p1 = vertices[indices[t * 3 + 1]].Position;
+            const float3 p2 = vertices[indices[t * 3 + 2]].Position;
+
+            const float3 n = (p1 - p0).cross(p2 - p0);
+            const float area = n.length();
+            const float3 centroid = (p0 + p1 + p2) / 3.0f;
+
+            clusterCentroid[c] += centroid * area;
+            clusterNormal[c] += n;
+            clusterArea[c] += area;
+        }
+
+        meshCentroid += clusterCentroid[c];
+        meshArea += clusterArea[c];
+    }
+
+    if (meshArea == 0.0f)
+        return;
+
+    meshCentroid /= meshArea;
+
+    SmallVector<float> sortKey;
+    SmallVector<uint32_t> order;
+    sortKey.resize(numClusters, 0.0f);
+    order.resize(numClusters);
+
+    for (uint32_t c = 0; c < numClusters; c++)
+    {
+        order[c] = c;
+
+        if (clusterArea[c] == 0.0f)
+            continue;
+
+        float3 n = clusterNormal[c];
+        const float len = n.length();
+        if (len > 0.0f)
+            n /= len;
+
+        sortKey[c] = (clusterCentroid[c] / clusterArea[c] - meshCentroid).dot(n);
+    }
+
+    // Clusters facing away from the center and far from it are drawn first as they're
+    // most likely to occlude the rest
+    std::stable_sort(order.begin(), order.end(), [&sortKey](uint32_t lhs, uint32_t rhs)
+        {
+            return sortKey[lhs] > sortKey[rhs];
+        });
+
+    SmallVector<uint32_t> output;
+    output.reserve(indices.size());
+
+    for (auto c : order)
+        output.append_range(indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+
+    memcpy(indices.data(), output.data(), output.size() * sizeof(uint32_t));
+}
+
+uint32_t MeshOptimization::OptimizeVertexFetch(MutableSpan<Vertex> vertices, MutableSpan<uint32_t> indices)
+{
+    SmallVector<uint32_t> remap;
+    remap.resize(vertices.size(), UINT32_MAX);
+    uint32_t numReferenced = 0;
+
+    for (auto& idx : indices)
+    {
+        if (remap[idx] == UINT32_MAX)
+            remap[idx] = numReferenced++;
+
+        idx = remap[idx];
+    }
+
+    SmallVector<Vertex> reordered;
+    reordered.resize(numReferenced);
+
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        if (remap[v] != UINT32_MAX)
+            reordered[remap[v]] = vertices[v];
+    }
+
+    memcpy(vertices.data(), reordered.data(), numReferenced * sizeof(Vertex));
+
+    return numReferenced;
+}
+
+uint32_t MeshOptimization::Optimize(MutableSpan<Vertex> vertices, MutableSpan<uint32_t> indices)
+{
+    const uint32_t numUnique = DeduplicateVertices(vertices, indices);
+    OptimizeVertexCache(indices, numUnique);
+    OptimizeOverdraw(indices, Span<Vertex>(vertices.data(), numUnique));
+
+    return OptimizeVertexFetch(MutableSpan<Vertex>(vertices.data(), numUnique), indices);
+}
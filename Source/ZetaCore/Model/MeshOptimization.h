@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../Core/Vertex.h"
+#include "../Utility/Span.h"
+
+//--------------------------------------------------------------------------------------
+// Import-time reordering of triangle meshes for better locality. Indices are relative
+// to the first vertex of the mesh, three per triangle (clockwise).
+//--------------------------------------------------------------------------------------
+
+namespace ZetaRay::Model::MeshOptimization
+{
+    // Size of the FIFO cache that is simulated for AnalyzeVertexCache()
+    static constexpr uint32_t STATS_CACHE_SIZE = 16;
+
+    struct VertexCacheStats
+    {
+        // Average cache miss ratio -- transformed vertices per triangle, in [0.5, 3]
+        float ACMR() const
+        {
+            return NumTriangles ? (float)NumTransformed / NumTriangles : 0.0f;
+        }
+
+        // Average transformed vertex ratio -- transformed vertices per vertex, 1 is optimal
+        float ATVR() const
+        {
+            return NumVertices ? (float)NumTransformed / NumVertices : 0.0f;
+        }
+
+        // Number of cache misses
+        uint64_t NumTransformed;
+        uint64_t NumTriangles;
+        uint64_t NumVertices;
+    };
+
+    VertexCacheStats AnalyzeVertexCache(Util::Span<uint32_t> indices, uint32_t numVertices,
+        uint32_t cacheSize = STATS_CACHE_SIZE);
+
+    // Merges vertices that are bitwise identical. Unique vertices are moved to the front
+    // in order of their first occurrence and indices are remapped accordingly. Returns the
+    // number of unique vertices.
+    uint32_t DeduplicateVertices(Util::MutableSpan<Core::Vertex> vertices, Util::MutableSpan<uint32_t> indices);
+
+    // Reorders triangles for post-transform vertex cache locality.
+    // Ref: T. Forsyth, "Linear-Speed Vertex Cache Optimisation," 2006.
+    void OptimizeVertexCache(Util::MutableSpan<uint32_t> indices, uint32_t numVertices);
+
+    // Splits the (vertex cache optimized) triangles into clusters and sorts the clusters so
+    // that outward-facing ones that are farther from the center come first. Clusters only
+    // end where vertex cache efficiency stays within "threshold" of the input's.
+    // Ref: P. Sander, D. Nehab and J. Barczak, "Fast Triangle Reordering for Vertex Locality
+    // and Reduced Overdraw," SIGGRAPH 2007.
+    void OptimizeOverdraw(Util::MutableSpan<uint32_t> indices, Util::Span<Core::Vertex> vertices,
+        float threshold = 1.05f);
+
+    // Reorders vertices in the order that they're first referenced by indices. Unreferenced
+    // vertices are removed. Returns the new number of vertices.
+    uint32_t OptimizeVertexFetch(Util::MutableSpan<Core::Vertex> vertices, Util::MutableSpan<uint32_t> indices);
+
+    // Runs all of the above in order. Returns the new number of vertices.
+    uint32_t Optimize(Util::MutableSpan<Core::Vertex> vertices, Util::MutableSpan<uint32_t> indices);
+}
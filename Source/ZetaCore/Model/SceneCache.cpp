@@ -0,0 +1,95 @@
+#include "SceneCache.h"
+#include "../Math/Common.h"
+
+using namespace ZetaRay;
+using namespace ZetaRay::Model;
+using namespace ZetaRay::Util;
+
+//--------------------------------------------------------------------------------------
+// Writer
+//--------------------------------------------------------------------------------------
+
+SceneCache::Writer::Writer()
+{
+    static_assert(std::is_trivially_copyable_v<Header>);
+
+    m_blocks.resize(Math::CeilUnsignedIntDiv(sizeof(Header), SECTION_ALIGNMENT));
+    memset(m_blocks.data(), 0, m_blocks.size() * sizeof(Block));
+}
+
+void SceneCache::Writer::AddBytes(SECTION section, const void* data, size_t numElements,
+    size_t elementSize)
+{
+    Assert(section < SECTION::COUNT, "Invalid section.");
+    const size_t sizeInBytes = numElements * elementSize;
+    const size_t offset = m_blocks.size() * sizeof(Block);
+
+    Header& header = *reinterpret_cast<Header*>(m_blocks.data());
+    Assert(header.Sections[(int)section].NumElements == 0, "Section has already been added.");
+
+    header.Sections[(int)section] = SectionDesc{ .OffsetInBytes = offset,
+        .NumElements = numElements,
+        .ElementSizeInBytes = (uint32_t)elementSize,
+        .Reserved = 0 };
+
+    if (!sizeInBytes)
+        return;
+
+    // Zero the padding after the last element
+    const size_t numBlocks = Math::CeilUnsignedIntDiv(sizeInBytes, sizeof(Block));
+    m_blocks.resize(m_blocks.size() + numBlocks);
+    memset(m_blocks.end() - 1, 0, sizeof(Block));
+    memcpy(reinterpret_cast<uint8_t*>(m_blocks.data()) + offset, data, sizeInBytes);
+}
+
+Span<uint8_t> SceneCache::Writer::Finalize(uint32_t sceneID, uint64_t sourceHash,
+    uint64_t sourceSizeInBytes)
+{
+    Header& header = *reinterpret_cast<Header*>(m_blocks.data());
+    header.Magic = MAGIC;
+    header.Version = VERSION;
+    header.SceneID = sceneID;
+    header.SourceHash = sourceHash;
+    header.SourceSizeInBytes = sourceSizeInBytes;
+
+    return Span(reinterpret_cast<const uint8_t*>(m_blocks.data()), m_blocks.size() * sizeof(Block));
+}
+
+//--------------------------------------------------------------------------------------
+// Reader
+//--------------------------------------------------------------------------------------
+
+bool SceneCache::Reader::Init(Span<uint8_t> data)
+{
+    m_header = nullptr;
+    m_data = nullptr;
+
+    if (data.size() < sizeof(Header) || (reinterpret_cast<uintptr_t>(data.data()) & (SECTION_ALIGNMENT - 1)))
+        return false;
+
+    const Header& header = *reinterpret_cast<const Header*>(data.data());
+    if (header.Magic != MAGIC || header.Version != VERSION)
+        return false;
+
+    for (auto& s : header.Sections)
+    {
+        if (s.NumElements == 0)
+            continue;
+
+        // Guard against overflow of the section size
+        if (s.ElementSizeInBytes == 0 || s.NumElements > data.size() / s.ElementSizeInBytes)
+            return false;
+
+        if ((s.OffsetInBytes & (SECTION_ALIGNMENT - 1)) || s.OffsetInBytes < sizeof(Header) ||
+            s.OffsetInBytes > data.size() ||
+            s.NumElements * s.ElementSizeInBytes > data.size() - s.OffsetInBytes)
+        {
+            return false;
+        }
+    }
+
+    m_header = &header;
+    m_data = data.data();
+
+    return true;
+}
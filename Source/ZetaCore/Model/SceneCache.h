@@ -0,0 +1,154 @@
+#pragma once
+
+#include "../Utility/Optional.h"
+#include "../Utility/Span.h"
+
+//--------------------------------------------------------------------------------------
+// Binary container for scenes that have already been converted to the runtime formats
+// (".zscene"). Each section is a tightly packed array of one type, aligned so that it
+// can be used in place after the file is memory mapped.
+//--------------------------------------------------------------------------------------
+
+namespace ZetaRay::Model::SceneCache
+{
+    // "ZSCN"
+    static constexpr uint32_t MAGIC = 0x4e43535a;
+    // Bump whenever the layout of any stored type changes
+    static constexpr uint32_t VERSION = 2;
+    static constexpr size_t SECTION_ALIGNMENT = 64;
+
+    enum class SECTION : uint32_t
+    {
+        // Core::Vertex
+        VERTICES,
+        // uint32_t
+        INDICES,
+        // uint64_t, mesh IDs
+        MESH_IDS,
+        // Model::TriangleMesh, offsets are relative to VERTICES and INDICES
+        MESHES,
+        // uint32_t, number of instances in each scene graph level (excluding the root)
+        TREE_LEVELS,
+        // Following are one entry per instance, level by level
+        // uint64_t
+        INSTANCE_IDS,
+        // Math::AffineTransformation
+        LOCAL_TRANSFORMS,
+        // uint64_t
+        INSTANCE_MESH_IDS,
+        // uint32_t, index of parent in the previous level
+        PARENTS,
+        // uint8_t, Scene::RT_Flags
+        RT_FLAGS,
+        // Model::glTF::Asset::MaterialDesc
+        MATERIALS,
+        // char, null-terminated paths of DDS textures, relative to the scene file
+        IMAGE_PATHS,
+        // Model::glTF::Asset::EmissiveInstance
+        EMISSIVE_INSTANCES,
+        // RT::EmissiveTriangle
+        EMISSIVE_TRIANGLES,
+        // SceneCache::SourceFile, files that the scene was built from other than the glTF
+        // file itself (buffers and images)
+        SOURCE_FILES,
+        // char, null-terminated URIs of SOURCE_FILES in the same order, relative to the
+        // glTF file
+        SOURCE_FILE_PATHS,
+        COUNT
+    };
+
+    struct SectionDesc
+    {
+        uint64_t OffsetInBytes;
+        uint64_t NumElements;
+        uint32_t ElementSizeInBytes;
+        uint32_t Reserved;
+    };
+
+    // Size and last write time of a source file when the cache was written. Both are zero
+    // if the file didn't exist.
+    struct SourceFile
+    {
+        uint64_t SizeInBytes;
+        uint64_t LastWriteTime;
+    };
+
+    struct Header
+    {
+        uint32_t Magic;
+        uint32_t Version;
+        uint32_t SceneID;
+        uint32_t Reserved;
+        // Hash and size of the glTF file, for detecting stale caches. Files that it refers
+        // to are compared against SECTION::SOURCE_FILES instead, so that checking a cache
+        // doesn't require parsing the glTF file.
+        uint64_t SourceHash;
+        uint64_t SourceSizeInBytes;
+        SectionDesc Sections[(int)SECTION::COUNT];
+    };
+
+    // Serializes the sections into one contiguous buffer. Sections that aren't added are empty.
+    struct Writer
+    {
+        Writer();
+        ~Writer() = default;
+
+        Writer(const Writer&) = delete;
+        Writer& operator=(const Writer&) = delete;
+
+        template<typename T>
+        void Add(SECTION section, Util::Span<T> data)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Sections are copied as raw bytes.");
+            AddBytes(section, data.data(), data.size(), sizeof(T));
+        }
+
+        // Fills in the header and returns the serialized data. Writer retains ownership.
+        Util::Span<uint8_t> Finalize(uint32_t sceneID, uint64_t sourceHash, uint64_t sourceSizeInBytes);
+
+    private:
+        void AddBytes(SECTION section, const void* data, size_t numElements, size_t elementSize);
+
+        // Storage is allocated in aligned blocks, so that the serialized data can be read
+        // in place as well
+        struct alignas(SECTION_ALIGNMENT) Block
+        {
+            uint8_t Bytes[SECTION_ALIGNMENT];
+        };
+
+        Util::SmallVector<Block> m_blocks;
+    };
+
+    // Provides typed access to the sections of a serialized cache. Doesn't copy anything,
+    // so the data must outlive the reader.
+    struct Reader
+    {
+        Reader() = default;
+        ~Reader() = default;
+
+        // Returns false if data isn't a well-formed cache of the current version. Data must
+        // be aligned to SECTION_ALIGNMENT.
+        bool Init(Util::Span<uint8_t> data);
+        ZetaInline const Header& GetHeader() const { return *m_header; }
+
+        // Returns an empty Optional if the stored element size doesn't match T's (i.e.
+        // the layout of T has changed without a version bump)
+        template<typename T>
+        Util::Optional<Util::Span<T>> Get(SECTION section) const
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "Sections are copied as raw bytes.");
+            const SectionDesc& desc = m_header->Sections[(int)section];
+
+            if (desc.NumElements && desc.ElementSizeInBytes != sizeof(T))
+                return {};
+
+            static_assert(SECTION_ALIGNMENT % alignof(T) == 0, "Section alignment is insufficient.");
+            return Util::Span<T>(reinterpret_cast<const T*>(m_data + desc.OffsetInBytes),
+                desc.NumElements);
+        }
+
+    private:
+        const Header* m_header = nullptr;
+        const uint8_t* m_data = nullptr;
+    };
+}
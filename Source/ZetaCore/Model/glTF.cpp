@@ -1,10 +1,16 @@
 #include "glTF.h"
+#include "SceneCache.h"
+#include "MeshOptimization.h"
+#include "../Math/BatchConversion.h"
 #include "../Math/MatrixFuncs.h"
 #include "../Math/Surface.h"
 #include "../Math/Quaternion.h"
 #include "../Scene/SceneCore.h"
 #include "../Support/Task.h"
+#include "../Support/ParallelFor.h"
 #include "../App/Log.h"
+#include "../App/Filesystem.h"
+#include "../App/Timer.h"
 #include "../Utility/Utility.h"
 #include <algorithm>
 
@@ -87,167 +93,207 @@ namespace
         int MaterialIdx;
     };
 
+    // Where each mesh primitive is written to in the scene-wide vertex and index buffers.
+    // Offsets are prefix sums over primitive sizes, so primitives -- and ranges of
+    // vertices and faces inside them -- can be processed by any thread in any order.
+    struct MeshPrimRange
+    {
+        const cgltf_accessor* Positions;
+        const cgltf_accessor* Normals;
+        const cgltf_accessor* TexCoords;
+        const cgltf_accessor* Tangents;
+        const cgltf_accessor* Indices;
+        uint32_t BaseVtxOffset;
+        uint32_t BaseIdxOffset;
+        uint32_t NumVertices;
+        uint32_t NumIndices;
+        bool ComputeTangents;
+    };
+
+    // How many images are processed by each worker
+    constexpr size_t MAX_NUM_IMAGE_WORKERS = 5;
+    constexpr size_t MIN_IMAGES_PER_WORKER = 15;
+
     struct ThreadContext
     {
         const App::Filesystem::Path* glTFPath;
         uint32_t SceneID;
         cgltf_data* Model;
+        // Null when the scene cache shouldn't be written
+        SceneCache::Writer* Cache;
+        const App::Filesystem::Path* CachePath;
+        uint64_t SourceHash;
+        uint64_t SourceSizeInBytes;
 
         SmallVector<Vertex> Vertices;
         SmallVector<uint32_t> Indices;
         SmallVector<Mesh> Meshes;
+        SmallVector<glTF::Asset::MaterialDesc> Materials;
+        SmallVector<const char*> ImageURIs;
         // All unique textures that need to be loaded from disk
         SmallVector<Texture> DDSImages;
         SmallVector<EmissiveMeshPrim> EmissiveMeshPrims;
         SmallVector<EmissiveInstance> EmissiveInstances;
         SmallVector<RT::EmissiveTriangle> RTEmissives;
 
-        int NumMeshWorkers;
+        SmallVector<MeshPrimRange> MeshPrims;
+
         int NumImgWorkers;
-        size_t* MeshThreadOffsets;
-        size_t* MeshThreadSizes;
         size_t* ImgThreadOffsets;
         size_t* ImgThreadSizes;
-        uint32_t* EmissiveMeshPrimCountPerWorker;
 
-        std::atomic_uint32_t CurrVtxOffset = 0;
-        std::atomic_uint32_t CurrIdxOffset = 0;
-        std::atomic_uint32_t CurrMeshPrimOffset = 0;
-        int NumEmissiveMeshPrims = 0;
         int NumEmissiveInstances = 0;
         uint32_t NumEmissiveTris = 0;
     };
 
-    void ResetEmissiveSubsets(MutableSpan<EmissiveMeshPrim> subsets)
+    // Number of vertices or faces that are processed together by one thread
+    constexpr size_t VERTEX_GRAIN = 16 * 1024;
+    constexpr size_t FACE_GRAIN = 16 * 1024;
+
+    template<typename T>
+    ZetaInline const T* AccessorData(const cgltf_accessor& accessor)
     {
-        if (subsets.empty())
-            return;
+        const cgltf_buffer_view& bufferView = *accessor.buffer_view;
+        const cgltf_buffer& buffer = *bufferView.buffer;
 
-        const int numTotalBytes = (int)subsets.size() * sizeof(EmissiveMeshPrim);
-        const int numSimdBytes = numTotalBytes >> 5;
-        const int numRemainingBytes = numTotalBytes & 31;
-        int numToSetManually = numRemainingBytes > 0 ? Math::CeilUnsignedIntDiv(numRemainingBytes, 
-            (int)sizeof(EmissiveMeshPrim)) : 0;
+        return reinterpret_cast<const T*>(reinterpret_cast<uintptr_t>(buffer.data) + 
+            bufferView.offset + accessor.offset);
+    }
 
-        uintptr_t ptr = reinterpret_cast<uintptr_t>(subsets.data());
-        __m256i vVal = _mm256_set1_epi64x(Scene::INVALID_MESH);
+    ZetaInline void StoreOct32x8(__m256i vEncoded, Vertex* vertices, oct32 Vertex::* member)
+    {
+        static_assert(sizeof(oct32) == sizeof(uint32_t));
 
-        for (int i = 0; i < numSimdBytes; i++)
-        {
-            _mm256_storeu_si256((__m256i*) ptr, vVal);
-            ptr += 32;
-        }
+        alignas(32) uint32_t encoded[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(encoded), vEncoded);
 
-        for (int i = 0; i < numToSetManually; i++)
-            subsets[subsets.size() - 1 - i].MeshID = Scene::INVALID_MESH;
+        for (int j = 0; j < 8; j++)
+            memcpy(&(vertices[j].*member), &encoded[j], sizeof(uint32_t));
     }
 
-    void ProcessPositions(const cgltf_data& model, const cgltf_accessor& accessor, 
-        MutableSpan<Vertex> vertices, uint32_t baseOffset)
+    void ProcessPositions(const cgltf_accessor& accessor, size_t begin, size_t end,
+        MutableSpan<Vertex> vertices)
     {
         Check(accessor.type == cgltf_type_vec3, "Invalid type for POSITION attribute.");
         Check(accessor.component_type == cgltf_component_type_r_32f,
             "Invalid component type for POSITION attribute.");
-
-        const cgltf_buffer_view& bufferView = *accessor.buffer_view;
         Check(accessor.stride == sizeof(float3), "Invalid stride for POSITION attribute.");
 
-        const cgltf_buffer& buffer = *bufferView.buffer;
-        const float3* start = reinterpret_cast<float3*>(reinterpret_cast<uintptr_t>(
-            buffer.data) + bufferView.offset + accessor.offset);
+        const float3* start = AccessorData<float3>(accessor);
+        size_t i = begin;
+
+        // glTF uses a right-handed coordinate system with +Y as up. Flip the sign of z for
+        // 8 positions at a time -- every third float starting from the third one.
+        const __m256 vNegZ0 = _mm256_setr_ps(0, 0, -0.0f, 0, 0, -0.0f, 0, 0);
+        const __m256 vNegZ1 = _mm256_setr_ps(-0.0f, 0, 0, -0.0f, 0, 0, -0.0f, 0);
+        const __m256 vNegZ2 = _mm256_setr_ps(0, -0.0f, 0, 0, -0.0f, 0, 0, -0.0f);
 
-        for (size_t i = 0; i < accessor.count; i++)
+        for (; i + 8 <= end; i += 8)
         {
-            const float3* curr = start + i;
+            const float* curr = reinterpret_cast<const float*>(start + i);
 
-            // glTF uses a right-handed coordinate system with +Y as up
-            vertices[baseOffset + i].Position = float3(curr->x, curr->y, -curr->z);
+            alignas(32) float3 pos[8];
+            float* dst = reinterpret_cast<float*>(pos);
+            _mm256_store_ps(dst, _mm256_xor_ps(_mm256_loadu_ps(curr), vNegZ0));
+            _mm256_store_ps(dst + 8, _mm256_xor_ps(_mm256_loadu_ps(curr + 8), vNegZ1));
+            _mm256_store_ps(dst + 16, _mm256_xor_ps(_mm256_loadu_ps(curr + 16), vNegZ2));
+
+            for (int j = 0; j < 8; j++)
+                vertices[i + j].Position = pos[j];
+        }
+
+        for (; i < end; i++)
+        {
+            const float3* curr = start + i;
+            vertices[i].Position = float3(curr->x, curr->y, -curr->z);
         }
     }
 
-    void ProcessNormals(const cgltf_data& model, const cgltf_accessor& accessor, 
-        MutableSpan<Vertex> vertices, uint32_t baseOffset)
+    void ProcessNormals(const cgltf_accessor& accessor, size_t begin, size_t end,
+        MutableSpan<Vertex> vertices)
     {
         Check(accessor.type == cgltf_type_vec3, "Invalid type for NORMAL attribute.");
         Check(accessor.component_type == cgltf_component_type_r_32f,
             "Invalid component type for NORMAL attribute.");
-
-        const cgltf_buffer_view& bufferView = *accessor.buffer_view;
         Check(accessor.stride == sizeof(float3), "Invalid stride for NORMAL attribute.");
 
-        const cgltf_buffer& buffer = *bufferView.buffer;
-        const float3* start = reinterpret_cast<float3*>(reinterpret_cast<uintptr_t>(
-            buffer.data) + bufferView.offset + accessor.offset);
+        const float3* start = AccessorData<float3>(accessor);
+        const __m256 vMinusZero = _mm256_set1_ps(-0.0f);
+        size_t i = begin;
 
-        for (size_t i = 0; i < accessor.count; i++)
+        for (; i + 8 <= end; i += 8)
         {
-            const float3* curr = start + i;
+            __m256 vX, vY, vZ;
+            loadFloat3x8(reinterpret_cast<const float*>(start + i), vX, vY, vZ);
 
             // glTF uses a right-handed coordinate system with +Y as up
-            vertices[baseOffset + i].Normal = oct32(curr->x, curr->y, -curr->z);
+            vZ = _mm256_xor_ps(vZ, vMinusZero);
+            StoreOct32x8(encode_oct32x8(vX, vY, vZ), &vertices[i], &Vertex::Normal);
+        }
+
+        for (; i < end; i++)
+        {
+            const float3* curr = start + i;
+            vertices[i].Normal = oct32(curr->x, curr->y, -curr->z);
         }
     }
 
-    void ProcessTexCoords(const cgltf_data& model, const cgltf_accessor& accessor, 
-        MutableSpan<Vertex> vertices, uint32_t baseOffset)
+    void ProcessTexCoords(const cgltf_accessor& accessor, size_t begin, size_t end,
+        MutableSpan<Vertex> vertices)
     {
         Check(accessor.type == cgltf_type_vec2, "Invalid type for TEXCOORD_0 attribute.");
         Check(accessor.component_type == cgltf_component_type_r_32f,
             "Invalid component type for TEXCOORD_0 attribute.");
-
-        const cgltf_buffer_view& bufferView = *accessor.buffer_view;
         Check(accessor.stride == sizeof(float2), "Invalid stride for TEXCOORD_0 attribute.");
 
-        const cgltf_buffer& buffer = *bufferView.buffer;
-        const float2* start = reinterpret_cast<float2*>(reinterpret_cast<uintptr_t>(
-            buffer.data) + bufferView.offset + accessor.offset);
+        const float2* start = AccessorData<float2>(accessor);
 
-        for (size_t i = 0; i < accessor.count; i++)
-        {
-            const float2* curr = start + i;
-            vertices[baseOffset + i].TexUV = float2(curr->x, curr->y);
-        }
+        for (size_t i = begin; i < end; i++)
+            vertices[i].TexUV = start[i];
     }
 
-    void ProcessTangents(const cgltf_data& model, const cgltf_accessor& accessor, 
-        MutableSpan<Vertex> vertices, uint32_t baseOffset)
+    void ProcessTangents(const cgltf_accessor& accessor, size_t begin, size_t end,
+        MutableSpan<Vertex> vertices)
     {
         Check(accessor.type == cgltf_type_vec4, "Invalid type for TANGENT attribute.");
         Check(accessor.component_type == cgltf_component_type_r_32f,
             "Invalid component type for TANGENT attribute.");
+        Check(accessor.stride == sizeof(float4), "Invalid stride for TANGENT attribute.");
 
-        const cgltf_buffer_view& bufferView = *accessor.buffer_view;
+        const float4* start = AccessorData<float4>(accessor);
+        const __m256 vMinusZero = _mm256_set1_ps(-0.0f);
+        size_t i = begin;
 
-        const cgltf_buffer& buffer = *bufferView.buffer;
-        const float4* start = reinterpret_cast<float4*>(reinterpret_cast<uintptr_t>(
-            buffer.data) + bufferView.offset + accessor.offset);
-
-        for (size_t i = 0; i < accessor.count; i++)
+        for (; i + 8 <= end; i += 8)
         {
-            const float4* curr = start + i;
+            __m256 vX, vY, vZ;
+            loadFloat4x8(reinterpret_cast<const float*>(start + i), vX, vY, vZ);
 
             // glTF uses a right-handed coordinate system with +Y as up
-            vertices[baseOffset + i].Tangent = oct32(curr->x, curr->y, -curr->z);
+            vZ = _mm256_xor_ps(vZ, vMinusZero);
+            StoreOct32x8(encode_oct32x8(vX, vY, vZ), &vertices[i], &Vertex::Tangent);
+        }
+
+        for (; i < end; i++)
+        {
+            const float4* curr = start + i;
+            vertices[i].Tangent = oct32(curr->x, curr->y, -curr->z);
         }
     }
 
-    void ProcessIndices(const cgltf_data& model, const cgltf_accessor& accessor, 
-        MutableSpan<uint32_t> indices, uint32_t baseOffset)
+    // Processes faces [beginFace, endFace) of one mesh primitive
+    void ProcessIndices(const cgltf_accessor& accessor, size_t beginFace, size_t endFace,
+        MutableSpan<uint32_t> indices)
     {
         Check(accessor.type == cgltf_type_scalar, "Invalid index type.");
         Check(accessor.stride != -1, "Invalid index stride.");
         Check(accessor.count % 3 == 0, "Invalid number of indices.");
 
-        const cgltf_buffer_view& bufferView = *accessor.buffer_view;
-        const cgltf_buffer& buffer = *bufferView.buffer;
-
         // Populate the mesh indices
-        uint8_t* curr = reinterpret_cast<uint8_t*>(reinterpret_cast<uintptr_t>(buffer.data) + bufferView.offset + accessor.offset);
-        const size_t numFaces = accessor.count / 3;
         const size_t indexStrideInBytes = accessor.stride;
-        size_t currIdxOffset = 0;
+        const uint8_t* curr = AccessorData<uint8_t>(accessor) + beginFace * 3 * indexStrideInBytes;
 
-        for (size_t face = 0; face < numFaces; face++)
+        for (size_t face = beginFace; face < endFace; face++)
         {
             uint32_t i0 = 0;
             uint32_t i1 = 0;
@@ -261,80 +307,33 @@ namespace
             curr += indexStrideInBytes;
 
             // Use clockwise ordering
-            indices[baseOffset + currIdxOffset++] = i0;
-            indices[baseOffset + currIdxOffset++] = i2;
-            indices[baseOffset + currIdxOffset++] = i1;
+            indices[face * 3] = i0;
+            indices[face * 3 + 1] = i2;
+            indices[face * 3 + 2] = i1;
         }
     }
 
-    void ProcessMeshes(const cgltf_data& model, uint32_t sceneID, size_t offset, size_t size,
-        MutableSpan<Vertex> vertices, std::atomic_uint32_t& vertexCounter,
-        MutableSpan<uint32_t> indices, std::atomic_uint32_t& idxCounter,
-        MutableSpan<Mesh> meshes, std::atomic_uint32_t& meshCounter,
-        MutableSpan<EmissiveMeshPrim> emissivesPrims, uint32_t& emissivePrimCount)
+    // Serial pass over the mesh primitives that assigns each one its range of the vertex 
+    // and index buffers. Also fills in the Mesh entries and remembers every mesh primitive 
+    // with an emissive material assigned to it.
+    void ComputeMeshLayout(const cgltf_data& model, uint32_t sceneID, 
+        SmallVector<MeshPrimRange>& prims, SmallVector<Mesh>& meshes,
+        SmallVector<EmissiveMeshPrim>& emissivePrims, size_t& numVertices, size_t& numIndices)
     {
-        SceneCore& scene = App::GetScene();
-        uint32_t totalPrims = 0;
-        uint32_t totalVertices = 0;
-        uint32_t totalIndices = 0;
-        int numEmissiveMeshPrims = 0;
+        numVertices = 0;
+        numIndices = 0;
 
-        // Count total number of primitives, vertices, and indices.
-        for (size_t meshIdx = offset; meshIdx != offset + size; meshIdx++)
+        for (size_t meshIdx = 0; meshIdx != model.meshes_count; meshIdx++)
         {
-            Assert(meshIdx < model.meshes_count, "Out-of-bound access");
             const cgltf_mesh& mesh = model.meshes[meshIdx];
 
             for (int primIdx = 0; primIdx < mesh.primitives_count; primIdx++)
             {
                 const cgltf_primitive& prim = mesh.primitives[primIdx];
 
-                Check(prim.indices->count > 0, "Index buffer is required.");
+                Check(prim.indices && prim.indices->count > 0, "Index buffer is required.");
                 Check(prim.type == cgltf_primitive_type_triangles, "Non-triangle meshes are not supported.");
 
-                int posIt = -1;
-
-                for (int attrib = 0; attrib < prim.attributes_count; attrib++)
-                {
-                    if (strcmp(prim.attributes[attrib].name, "POSITION") == 0)
-                    {
-                        posIt = attrib;
-                        break;
-                    }
-                }
-
-                Check(posIt != -1, "POSITION was not found in the vertex attributes.");
-
-                const cgltf_accessor& accessor = *prim.attributes[posIt].data;
-                const uint32_t numVertices = (uint32_t)accessor.count;
-                totalVertices += numVertices;
-
-                const uint32_t numIndices = (uint32_t)prim.indices->count;
-                totalIndices += numIndices;
-            }
-
-            totalPrims += (uint32_t)mesh.primitives_count;
-        }
-
-        // (sub)allocate
-        const uint32_t workerBaseVtxOffset = vertexCounter.fetch_add(totalVertices, std::memory_order_relaxed);
-        const uint32_t workerBaseIdxOffset = idxCounter.fetch_add(totalIndices, std::memory_order_relaxed);
-        const uint32_t workerPrimBaseOffset = meshCounter.fetch_add(totalPrims, std::memory_order_relaxed);
-        const uint32_t workerBaseEmissiveOffset = workerPrimBaseOffset;
-
-        uint32_t currVtxOffset = workerBaseVtxOffset;
-        uint32_t currIdxOffset = workerBaseIdxOffset;
-        uint32_t currMeshPrimOffset = workerPrimBaseOffset;
-
-        // Now iterate again and populate the buffers
-        for (size_t meshIdx = offset; meshIdx != offset + size; meshIdx++)
-        {
-            const cgltf_mesh& mesh = model.meshes[meshIdx];
-
-            for (int primIdx = 0; primIdx < mesh.primitives_count; primIdx++)
-            {
-                const cgltf_primitive& prim = mesh.primitives[primIdx];
-
                 int posIt = -1;
                 int normalIt = -1;
                 int texIt = -1;
@@ -352,54 +351,45 @@ namespace
                         tangentIt = attrib;
                 }
 
+                Check(posIt != -1, "POSITION was not found in the vertex attributes.");
                 Check(normalIt != -1, "NORMAL was not found in the vertex attributes.");
 
-                // Populate the vertex attributes
-                const cgltf_accessor& accessor = *prim.attributes[posIt].data;
-                const uint32_t numVertices = (uint32_t)accessor.count;
+                const uint32_t numPrimVertices = (uint32_t)prim.attributes[posIt].data->count;
+                const uint32_t numPrimIndices = (uint32_t)prim.indices->count;
+                Check(numVertices + numPrimVertices <= UINT32_MAX && numIndices + numPrimIndices <= UINT32_MAX,
+                    "Number of vertices or indices exceeds the maximum supported.");
 
-                const cgltf_buffer_view& bufferView = *prim.indices->buffer_view;
-                const uint32_t numIndices = (uint32_t)prim.indices->count;
-
-                // POSITION
-                ProcessPositions(model, *prim.attributes[posIt].data, vertices, currVtxOffset);
-
-                // NORMAL
-                ProcessNormals(model, *prim.attributes[normalIt].data, vertices, currVtxOffset);
-
-                // indices
-                ProcessIndices(model, *prim.indices, indices, currIdxOffset);
-
-                // TEXCOORD_0
-                if (texIt != -1)
-                {
-                    ProcessTexCoords(model, *prim.attributes[texIt].data, vertices, currVtxOffset);
+                // Tangents are only used along with texture coordinates. If vertex tangents 
+                // aren't present, they're computed after vertex and index processing.
+                const bool hasTangents = texIt != -1 && tangentIt != -1;
 
-                    // If vertex tangents aren't present, compute them. Make sure the computation 
-                    // happens after vertex and index processing.
-                    if (tangentIt != -1)
-                        ProcessTangents(model, *prim.attributes[tangentIt].data, vertices, currVtxOffset);
-                    else if(prim.material->normal_texture.texture)
+                prims.push_back(MeshPrimRange
                     {
-                        Math::ComputeMeshTangentVectors(MutableSpan(vertices.begin() + currVtxOffset, numVertices),
-                            Span(indices.begin() + currIdxOffset, numIndices),
-                            false);
-                    }
-                }
-
-                meshes[currMeshPrimOffset++] = Mesh
+                        .Positions = prim.attributes[posIt].data,
+                        .Normals = prim.attributes[normalIt].data,
+                        .TexCoords = texIt != -1 ? prim.attributes[texIt].data : nullptr,
+                        .Tangents = hasTangents ? prim.attributes[tangentIt].data : nullptr,
+                        .Indices = prim.indices,
+                        .BaseVtxOffset = (uint32_t)numVertices,
+                        .BaseIdxOffset = (uint32_t)numIndices,
+                        .NumVertices = numPrimVertices,
+                        .NumIndices = numPrimIndices,
+                        .ComputeTangents = texIt != -1 && !hasTangents && prim.material &&
+                            prim.material->normal_texture.texture
+                    });
+
+                meshes.push_back(Mesh
                     {
                         .SceneID = sceneID,
                         .glTFMaterialIdx = prim.material ? (int)(prim.material - model.materials) : -1,
                         .MeshIdx = (int)meshIdx,
                         .MeshPrimIdx = primIdx,
-                        .BaseVtxOffset = currVtxOffset,
-                        .BaseIdxOffset = currIdxOffset,
-                        .NumVertices = numVertices,
-                        .NumIndices = numIndices
-                    };
+                        .BaseVtxOffset = (uint32_t)numVertices,
+                        .BaseIdxOffset = (uint32_t)numIndices,
+                        .NumVertices = numPrimVertices,
+                        .NumIndices = numPrimIndices
+                    });
 
-                // Remember every mesh with an emissive material assigned to it.
                 if (prim.material)
                 {
                     float emissiveFactDot1 = prim.material->emissive_factor[0] + 
@@ -409,32 +399,198 @@ namespace
                     if ((emissiveFactDot1 > 0 || prim.material->has_emissive_strength || 
                         prim.material->emissive_texture.texture))
                     {
-                        const uint64_t meshID = Scene::MeshID(sceneID, (int)meshIdx, primIdx);
-
-                        emissivesPrims[workerBaseEmissiveOffset + numEmissiveMeshPrims++] = EmissiveMeshPrim
+                        emissivePrims.push_back(EmissiveMeshPrim
                             {
-                                .MeshID = meshID,
-                                .BaseVtxOffset = currVtxOffset,
-                                .BaseIdxOffset = currIdxOffset,
-                                .NumIndices = numIndices,
+                                .MeshID = Scene::MeshID(sceneID, (int)meshIdx, primIdx),
+                                .BaseVtxOffset = (uint32_t)numVertices,
+                                .BaseIdxOffset = (uint32_t)numIndices,
+                                .NumIndices = numPrimIndices,
                                 .MaterialIdx = (int)(prim.material - model.materials)
-                            };
+                            });
                     }
                 }
 
-                currVtxOffset += numVertices;
-                currIdxOffset += numIndices;
+                numVertices += numPrimVertices;
+                numIndices += numPrimIndices;
+            }
+        }
+    }
+
+    // Returns the last mesh primitive that starts at or before the given vertex or face
+    template<typename Func>
+    const MeshPrimRange* FindMeshPrim(Span<MeshPrimRange> prims, size_t idx, Func primBase)
+    {
+        auto it = std::upper_bound(prims.begin(), prims.end(), idx,
+            [primBase](size_t i, const MeshPrimRange& p)
+            {
+                return i < primBase(p);
+            });
+
+        Assert(it != prims.begin(), "First mesh primitive should start at zero.");
+        return it - 1;
+    }
+
+    // Processes vertices [begin, end) of the scene-wide vertex buffer, which may span
+    // several mesh primitives or a part of one
+    void ProcessVertices(Span<MeshPrimRange> prims, MutableSpan<Vertex> vertices, 
+        size_t begin, size_t end)
+    {
+        auto vtxBase = [](const MeshPrimRange& p) { return (size_t)p.BaseVtxOffset; };
+
+        for (const MeshPrimRange* p = FindMeshPrim(prims, begin, vtxBase); 
+            p != prims.end() && p->BaseVtxOffset < end; p++)
+        {
+            const size_t b = Math::Max(begin, (size_t)p->BaseVtxOffset) - p->BaseVtxOffset;
+            const size_t e = Math::Min(end, (size_t)p->BaseVtxOffset + p->NumVertices) - p->BaseVtxOffset;
+            MutableSpan<Vertex> primVertices(vertices.data() + p->BaseVtxOffset, p->NumVertices);
+
+            ProcessPositions(*p->Positions, b, e, primVertices);
+            ProcessNormals(*p->Normals, b, e, primVertices);
+
+            if (p->TexCoords)
+                ProcessTexCoords(*p->TexCoords, b, e, primVertices);
+
+            if (p->Tangents)
+                ProcessTangents(*p->Tangents, b, e, primVertices);
+        }
+    }
+
+    // Same as above for faces [begin, end) of the scene-wide index buffer
+    void ProcessFaces(Span<MeshPrimRange> prims, MutableSpan<uint32_t> indices, 
+        size_t begin, size_t end)
+    {
+        auto faceBase = [](const MeshPrimRange& p) { return (size_t)p.BaseIdxOffset / 3; };
+
+        for (const MeshPrimRange* p = FindMeshPrim(prims, begin, faceBase); 
+            p != prims.end() && faceBase(*p) < end; p++)
+        {
+            const size_t b = Math::Max(begin, faceBase(*p)) - faceBase(*p);
+            const size_t e = Math::Min(end, faceBase(*p) + p->NumIndices / 3) - faceBase(*p);
+            MutableSpan<uint32_t> primIndices(indices.data() + p->BaseIdxOffset, p->NumIndices);
+
+            ProcessIndices(*p->Indices, b, e, primIndices);
+        }
+    }
+
+    void ProcessMeshes(Span<MeshPrimRange> prims, MutableSpan<Vertex> vertices, 
+        MutableSpan<uint32_t> indices)
+    {
+        ParallelFor(0, vertices.size(), VERTEX_GRAIN, [prims, vertices](size_t b, size_t e)
+            {
+                ProcessVertices(prims, vertices, b, e);
+            });
+
+        ParallelFor(0, indices.size() / 3, FACE_GRAIN, [prims, indices](size_t b, size_t e)
+            {
+                ProcessFaces(prims, indices, b, e);
+            });
+
+        // Tangent computation needs the other vertex attributes and indices. It accumulates
+        // over the triangles of each primitive, so the work is split by primitive.
+        SmallVector<const MeshPrimRange*> tangentPrims;
+
+        for (auto& p : prims)
+        {
+            if (p.ComputeTangents)
+                tangentPrims.push_back(&p);
+        }
+
+        ParallelFor(0, tangentPrims.size(), 1, [&tangentPrims, vertices, indices](size_t b, size_t e)
+            {
+                for (size_t i = b; i < e; i++)
+                {
+                    const MeshPrimRange& p = *tangentPrims[i];
+
+                    Math::ComputeMeshTangentVectors(MutableSpan(vertices.data() + p.BaseVtxOffset, p.NumVertices),
+                        Span(indices.data() + p.BaseIdxOffset, p.NumIndices),
+                        false);
+                }
+            });
+    }
+
+    // Optimizes each mesh primitive independently, then compacts the vertex buffer as
+    // deduplication leaves gaps behind. Index offsets don't change.
+    void OptimizeMeshes(ThreadContext& tc)
+    {
+        DeltaTimer timer;
+        timer.Start();
+
+        const size_t numPrims = tc.MeshPrims.size();
+        SmallVector<MeshOptimization::VertexCacheStats> before;
+        SmallVector<MeshOptimization::VertexCacheStats> after;
+        before.resize(numPrims);
+        after.resize(numPrims);
+
+        ParallelFor(0, numPrims, 1, [&tc, &before, &after](size_t b, size_t e)
+            {
+                for (size_t i = b; i < e; i++)
+                {
+                    MeshPrimRange& p = tc.MeshPrims[i];
+                    MutableSpan<Vertex> primVertices(tc.Vertices.data() + p.BaseVtxOffset, p.NumVertices);
+                    MutableSpan<uint32_t> primIndices(tc.Indices.data() + p.BaseIdxOffset, p.NumIndices);
+
+                    before[i] = MeshOptimization::AnalyzeVertexCache(primIndices, p.NumVertices);
+                    p.NumVertices = MeshOptimization::Optimize(primVertices, primIndices);
+                    after[i] = MeshOptimization::AnalyzeVertexCache(primIndices, p.NumVertices);
+                }
+            });
+
+        // Mesh primitives and meshes are in the same order. Emissive mesh primitives are a
+        // subset in that order as well, as they haven't been sorted yet.
+        Assert(tc.Meshes.size() == numPrims, "Every mesh primitive should have a mesh.");
+        const size_t numVerticesBefore = tc.Vertices.size();
+        uint32_t baseVtxOffset = 0;
+        size_t currEmissive = 0;
+
+        for (size_t i = 0; i < numPrims; i++)
+        {
+            MeshPrimRange& p = tc.MeshPrims[i];
+            memmove(tc.Vertices.data() + baseVtxOffset, tc.Vertices.data() + p.BaseVtxOffset,
+                p.NumVertices * sizeof(Vertex));
+
+            p.BaseVtxOffset = baseVtxOffset;
+            tc.Meshes[i].BaseVtxOffset = baseVtxOffset;
+            tc.Meshes[i].NumVertices = p.NumVertices;
+
+            if (currEmissive < tc.EmissiveMeshPrims.size() &&
+                tc.EmissiveMeshPrims[currEmissive].BaseIdxOffset == p.BaseIdxOffset)
+            {
+                tc.EmissiveMeshPrims[currEmissive++].BaseVtxOffset = baseVtxOffset;
             }
+
+            baseVtxOffset += p.NumVertices;
+        }
+
+        Assert(currEmissive == tc.EmissiveMeshPrims.size(), "Some emissive mesh primitives weren't found.");
+        tc.Vertices.resize(baseVtxOffset);
+
+        MeshOptimization::VertexCacheStats totalBefore{};
+        MeshOptimization::VertexCacheStats totalAfter{};
+
+        for (size_t i = 0; i < numPrims; i++)
+        {
+            totalBefore.NumTransformed += before[i].NumTransformed;
+            totalBefore.NumTriangles += before[i].NumTriangles;
+            totalBefore.NumVertices += before[i].NumVertices;
+            totalAfter.NumTransformed += after[i].NumTransformed;
+            totalAfter.NumTriangles += after[i].NumTriangles;
+            totalAfter.NumVertices += after[i].NumVertices;
         }
 
-        emissivePrimCount = numEmissiveMeshPrims;
+        timer.End();
+
+        LOG_UI_INFO("Mesh optimization: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, vertices %llu -> %llu (%u[ms])\n",
+            totalBefore.ACMR(), totalAfter.ACMR(), totalBefore.ATVR(), totalAfter.ATVR(),
+            (uint64_t)numVerticesBefore, (uint64_t)baseVtxOffset, (uint32_t)timer.DeltaMilli());
     }
 
-    void LoadDDSImages(uint32_t sceneID, const Filesystem::Path& modelDir, const cgltf_data& model,
+    // Image URIs are relative to modelDir
+    void LoadDDSImages(const Filesystem::Path& modelDir, Span<const char*> imageURIs,
         size_t offset, size_t num, MutableSpan<Texture> ddsImages)
     {
-        // For loading DDS data from disk
-        MemoryArena memArena(64 * 1024 * 1024);
+        // For loading DDS data from disk. Reserves enough address space for the largest
+        // scenes, only what's actually used is committed.
+        MemoryArena memArena(16 * 1024 * 1024, 32llu * 1024 * 1024 * 1024);
         // For uploading texture to GPU 
         UploadHeapArena heapArena(64 * 1024 * 1024);
 
@@ -443,7 +599,11 @@ namespace
             "DDS_Data is not trivially-default-constructible.");
         DDS_Data* ddsTextures = reinterpret_cast<DDS_Data*>(memArena.AllocateAligned(
             num * sizeof(DDS_Data)));
-        bool hasInvalid = false;
+
+        // Full paths of the DDS textures, in the same order as ddsTextures
+        const char** ddsPaths = reinterpret_cast<const char**>(memArena.AllocateAligned(
+            num * sizeof(const char*)));
+        size_t numValid = 0;
 
         // Two passes:
         // 1. Load DDS data from disk
@@ -452,12 +612,8 @@ namespace
 
         for (size_t m = offset; m != offset + num; m++)
         {
-            const cgltf_image& image = model.images[m];
-            const size_t idx = m - offset;
-            Check(image.uri, "Image has no URI.");
-
             Filesystem::Path path(modelDir.GetView());
-            path.Append(image.uri);
+            path.Append(imageURIs[m]);
 
             char ext[8];
             path.Extension(ext);
@@ -467,30 +623,42 @@ namespace
                     "Texture in path %s either hasn't been converted to DDS format or is not referenced by any materials. Skipping...\n",
                     path.Get());
 
-                ddsTextures[idx].ID = Texture::INVALID_ID;
-                hasInvalid = true;
-
                 continue;
             }
 
-            ddsTextures[idx].ID = IDFromTexturePath(path);
-            auto err = GpuMemory::GetDDSDataFromDisk(path.Get(), ddsTextures[idx], heapArena,
-                ArenaAllocator(memArena));
+            const size_t len = strlen(path.Get());
+            char* p = reinterpret_cast<char*>(memArena.AllocateAligned(len + 1, alignof(char)));
+            memcpy(p, path.Get(), len + 1);
 
-            Check(err == LOAD_DDS_RESULT::SUCCESS, "Error loading DDS texture from path %s: %d", path.Get(), err);
-        }
-
-        size_t numValid = num;
-        if (hasInvalid)
-        {
-            DDS_Data* firstInvalid = std::partition(ddsTextures, ddsTextures + num,
-                [](const DDS_Data& dds) {return dds.ID != Texture::INVALID_ID; });
-            numValid = firstInvalid - ddsTextures;
+            ddsTextures[numValid].ID = IDFromTexturePath(path);
+            ddsPaths[numValid++] = p;
         }
 
         if (!numValid)
             return;
 
+        struct DecodeContext
+        {
+            DDS_Data* Textures;
+            const char** Paths;
+        };
+
+        DecodeContext ctx{ .Textures = ddsTextures, .Paths = ddsPaths };
+
+        // Reads are issued in batches and each texture is decoded as soon as its read 
+        // finishes, while the remaining ones are still in flight
+        Filesystem::AsyncFileReader reader;
+        reader.ReadAll(Span(ddsPaths, numValid), ArenaAllocator(memArena),
+            [](void* param, size_t fileIdx, Span<uint8_t> data)
+            {
+                auto& ctx = *reinterpret_cast<DecodeContext*>(param);
+                Check(!data.empty(), "Error reading DDS texture from path %s.", ctx.Paths[fileIdx]);
+
+                auto err = GpuMemory::GetDDSDataFromMemory(data, ctx.Textures[fileIdx]);
+                Check(err == LOAD_DDS_RESULT::SUCCESS, "Error loading DDS texture from path %s: %d", 
+                    ctx.Paths[fileIdx], err);
+            }, &ctx);
+
         D3D12_RESOURCE_DESC1* texDescs = reinterpret_cast<D3D12_RESOURCE_DESC1*>(memArena.AllocateAligned(
             numValid * sizeof(D3D12_RESOURCE_DESC1)));
         D3D12_RESOURCE_ALLOCATION_INFO1* allocInfos = reinterpret_cast<D3D12_RESOURCE_ALLOCATION_INFO1*>(memArena.AllocateAligned(
@@ -521,7 +689,8 @@ namespace
     }
 
     void ProcessMaterials(uint32_t sceneID, const Filesystem::Path& modelDir, const cgltf_data& model,
-        int offset, int size, MutableSpan<Texture> ddsImages)
+        int offset, int size, MutableSpan<Texture> ddsImages, 
+        MutableSpan<glTF::Asset::MaterialDesc> descs)
     {
         auto getAlphaMode = [](cgltf_alpha_mode m)
             {
@@ -546,7 +715,7 @@ namespace
             const auto& mat = model.materials[m];
             Check(mat.has_pbr_metallic_roughness, "Material is not supported.");
 
-            glTF::Asset::MaterialDesc desc;
+            glTF::Asset::MaterialDesc& desc = descs[m];
             desc.ID = Scene::MaterialID(sceneID, m);
             desc.AlphaMode = getAlphaMode(mat.alpha_mode);
             desc.AlphaCutoff = (float)mat.alpha_cutoff;
@@ -719,7 +888,7 @@ namespace
                         const auto& meshPrimInfo = context.EmissiveMeshPrims[idx];
 
                         const uint32_t matID = Scene::MaterialID(context.SceneID, meshPrimInfo.MaterialIdx);
-                        const Material* mat = scene.GetMaterial(matID).value();
+                        const Material mat = scene.GetMaterial(matID).value();
 
                         const int nodeIdx = (int)(&node - context.Model->nodes);
                         const uint64_t currInstanceID = Scene::InstanceID(context.SceneID, nodeIdx, meshIdx, primIdx);
@@ -749,8 +918,8 @@ namespace
                             context.RTEmissives[currGlobalTriIdx++] = RT::EmissiveTriangle(
                                 v0.Position, v1.Position, v2.Position,
                                 v0.TexUV, v1.TexUV, v2.TexUV,
-                                emissiveFactorRGB, mat->GetEmissiveTex(), mat->GetEmissiveStrength(),
-                                currMeshTriIdx++, mat->DoubleSided());
+                                emissiveFactorRGB, mat.GetEmissiveTex(), mat.GetEmissiveStrength(),
+                                currMeshTriIdx++, mat.DoubleSided());
                         }
                     }
                 }
@@ -781,11 +950,8 @@ namespace
         Assert(rtEmissiveTriIdx == context.NumEmissiveTris, "these must match.");
     }
 
-    void ProcessNodeSubtree(const cgltf_node& node, uint32_t sceneID, const cgltf_data& model,
-        uint64_t parentId)
+    AffineTransformation NodeTransform(const cgltf_node& node)
     {
-        uint64_t currInstanceID = SceneCore::ROOT_ID;
-
         AffineTransformation transform = AffineTransformation::GetIdentity();
 
         if (node.has_matrix)
@@ -876,6 +1042,19 @@ namespace
             }
         }
 
+        return transform;
+    }
+
+    // Calls f with the description of each instance that the node introduces -- one for 
+    // every mesh primitive, or just one if it doesn't have a mesh. Returns ID of the last 
+    // one, which becomes the parent of the node's children.
+    template<typename Func>
+    uint64_t ProcessNodeInstances(const cgltf_node& node, uint32_t sceneID, const cgltf_data& model,
+        uint64_t parentId, Func f)
+    {
+        uint64_t currInstanceID = SceneCore::ROOT_ID;
+        AffineTransformation transform = NodeTransform(node);
+
         // Workaround for nodes without a name
         const int nodeIdx = (int)(&node - model.nodes);
         Assert(nodeIdx < model.nodes_count, "Invalid node index.");
@@ -921,8 +1100,7 @@ namespace
                     .RtInstanceMask = rtInsMask,
                     .IsOpaque = isOpaque };
 
-                SceneCore& scene = App::GetScene();
-                scene.AddInstance(desc, false);
+                f(desc);
             }
         }
         else
@@ -940,10 +1118,22 @@ namespace
                     .RtInstanceMask = RT_AS_SUBGROUP::NON_EMISSIVE,
                     .IsOpaque = true };
 
-            SceneCore& scene = App::GetScene();
-            scene.AddInstance(desc, false);
+            f(desc);
         }
 
+        return currInstanceID;
+    }
+
+    void ProcessNodeSubtree(const cgltf_node& node, uint32_t sceneID, const cgltf_data& model,
+        uint64_t parentId)
+    {
+        const uint64_t currInstanceID = ProcessNodeInstances(node, sceneID, model, parentId,
+            [](glTF::Asset::InstanceDesc& desc)
+            {
+                SceneCore& scene = App::GetScene();
+                scene.AddInstance(desc, false);
+            });
+
         for (int c = 0; c < node.children_count; c++)
         {
             const cgltf_node& childNode = *node.children[c];
@@ -1022,66 +1212,436 @@ namespace
         return height;
     }
 
-    void TotalNumVerticesAndIndices(cgltf_data* model, size_t& numVertices, size_t& numIndices, 
-        size_t& numMeshes)
+    // Writes the instances in the same level-by-level layout that SceneCore uses for its scene
+    // graph (see SceneCore::AddInstances()). Instances of each level are grouped by parent, with
+    // parents in the same order as the previous level.
+    void BakeSceneGraph(const cgltf_data& model, uint32_t sceneID, SceneCache::Writer& cache)
     {
-        numVertices = 0;
-        numIndices = 0;
-        numMeshes = 0;
+        struct PendingNode
+        {
+            const cgltf_node* Node;
+            uint32_t ParentIdx;
+        };
+
+        SmallVector<PendingNode> queue;
+        SmallVector<uint32_t> levelSizes;
+        SmallVector<uint64_t> IDs;
+        SmallVector<AffineTransformation> localTransforms;
+        SmallVector<uint64_t> meshIDs;
+        SmallVector<uint32_t> parents;
+        SmallVector<uint8_t> rtFlags;
+
+        for (size_t i = 0; i < model.scene->nodes_count; i++)
+            queue.push_back(PendingNode{ .Node = model.scene->nodes[i], .ParentIdx = 0 });
+
+        size_t levelBeg = 0;
 
-        for (size_t meshIdx = 0; meshIdx != model->meshes_count; meshIdx++)
+        while (levelBeg < queue.size())
         {
-            const auto& mesh = model->meshes[meshIdx];
-            numMeshes += mesh.primitives_count;
+            const size_t levelEnd = queue.size();
+            const size_t firstInstance = IDs.size();
 
-            for (size_t primIdx = 0; primIdx < mesh.primitives_count; primIdx++)
+            for (size_t n = levelBeg; n < levelEnd; n++)
             {
-                const auto& prim = mesh.primitives[primIdx];
+                // Copy as queue might be reallocated below
+                const PendingNode curr = queue[n];
 
-                if (prim.type != cgltf_primitive_type_triangles)
-                    continue;
-
-                for (int attrib = 0; attrib < prim.attributes_count; attrib++)
-                {
-                    if (strcmp("POSITION", prim.attributes[attrib].name) == 0)
+                ProcessNodeInstances(*curr.Node, sceneID, model, SceneCore::ROOT_ID,
+                    [&](glTF::Asset::InstanceDesc& desc)
                     {
-                        auto& accessor = prim.attributes[attrib].data;
-                        numVertices += accessor->count;
+                        IDs.push_back(desc.ID);
+                        localTransforms.push_back(desc.LocalTransform);
+                        meshIDs.push_back(desc.MeshIdx == -1 ? Scene::INVALID_MESH :
+                            Scene::MeshID(sceneID, desc.MeshIdx, desc.MeshPrimIdx));
+                        parents.push_back(curr.ParentIdx);
+                        // Same flags as a newly inserted instance
+                        rtFlags.push_back(RT_Flags::Encode(desc.RtMeshMode, desc.RtInstanceMask, 1, 0, 
+                            desc.IsOpaque));
+                    });
+
+                // Children are attached to the last instance of their parent node
+                const uint32_t parentIdx = (uint32_t)(IDs.size() - 1 - firstInstance);
+
+                for (size_t c = 0; c < curr.Node->children_count; c++)
+                    queue.push_back(PendingNode{ .Node = curr.Node->children[c], .ParentIdx = parentIdx });
+            }
 
-                        break;
-                    }
-                }
+            levelSizes.push_back((uint32_t)(IDs.size() - firstInstance));
+            levelBeg = levelEnd;
+        }
+
+        cache.Add(SceneCache::SECTION::TREE_LEVELS, Span(levelSizes));
+        cache.Add(SceneCache::SECTION::INSTANCE_IDS, Span(IDs));
+        cache.Add(SceneCache::SECTION::LOCAL_TRANSFORMS, Span(localTransforms));
+        cache.Add(SceneCache::SECTION::INSTANCE_MESH_IDS, Span(meshIDs));
+        cache.Add(SceneCache::SECTION::PARENTS, Span(parents));
+        cache.Add(SceneCache::SECTION::RT_FLAGS, Span(rtFlags));
+    }
+
+    // Called after all the other tasks are finished and before mesh buffers are moved. Emissives
+    // have already been added by the emissives task.
+    void WriteSceneCache(ThreadContext& tc)
+    {
+        SceneCache::Writer& cache = *tc.Cache;
+
+        SmallVector<uint64_t> meshIDs;
+        SmallVector<TriangleMesh> meshes;
+        meshIDs.resize(tc.Meshes.size());
+        meshes.resize(tc.Meshes.size());
+
+        // Same as MeshContainer::AddBatch(), so that loading from the cache doesn't need
+        // to go over the vertices again
+        for (size_t i = 0; i < tc.Meshes.size(); i++)
+        {
+            const Mesh& mesh = tc.Meshes[i];
+            const uint32_t matID = mesh.glTFMaterialIdx != -1 ?
+                Scene::MaterialID(mesh.SceneID, mesh.glTFMaterialIdx) :
+                Scene::DEFAULT_MATERIAL_ID;
+
+            meshIDs[i] = Scene::MeshID(mesh.SceneID, mesh.MeshIdx, mesh.MeshPrimIdx);
+            meshes[i] = TriangleMesh(Span(tc.Vertices.begin() + mesh.BaseVtxOffset, mesh.NumVertices),
+                mesh.BaseVtxOffset, mesh.BaseIdxOffset, mesh.NumIndices, matID);
+        }
+
+        cache.Add(SceneCache::SECTION::VERTICES, Span(tc.Vertices));
+        cache.Add(SceneCache::SECTION::INDICES, Span(tc.Indices));
+        cache.Add(SceneCache::SECTION::MESH_IDS, Span(meshIDs));
+        cache.Add(SceneCache::SECTION::MESHES, Span(meshes));
+        cache.Add(SceneCache::SECTION::MATERIALS, Span(tc.Materials));
+
+        SmallVector<char> imagePaths;
+        for (const char* uri : tc.ImageURIs)
+            imagePaths.append_range(uri, uri + strlen(uri) + 1);
+
+        cache.Add(SceneCache::SECTION::IMAGE_PATHS, Span(imagePaths));
+
+        BakeSceneGraph(*tc.Model, tc.SceneID, cache);
+
+        Span<uint8_t> data = cache.Finalize(tc.SceneID, tc.SourceHash, tc.SourceSizeInBytes);
+
+        if (data.size() > UINT32_MAX)
+        {
+            LOG_UI_WARNING("Scene cache for %s exceeds the maximum file size. Skipping...\n", 
+                tc.glTFPath->Get());
 
-                numIndices += prim.indices->count;
+            return;
+        }
+
+        Filesystem::WriteToFile(tc.CachePath->Get(), const_cast<uint8_t*>(data.data()), (uint32_t)data.size());
+        LOG_UI_INFO("Scene cache was written to %s.\n", tc.CachePath->Get());
+    }
+
+    SceneCache::SourceFile StampSourceFile(const Filesystem::Path& modelDir, const char* uri)
+    {
+        Filesystem::Path path(modelDir.GetView());
+        path.Append(uri);
+
+        // Missing files are stamped as zero, they're reported later when loading
+        const uint64_t writeTime = Filesystem::GetLastWriteTime(path.Get());
+
+        return SceneCache::SourceFile{ 
+            .SizeInBytes = writeTime ? (uint64_t)Filesystem::GetFileSize(path.Get()) : 0,
+            .LastWriteTime = writeTime };
+    }
+
+    // Records the size and last write time of the buffers and images that the glTF file refers
+    // to, so that re-exporting them invalidates the scene cache even when the glTF file itself
+    // is unchanged
+    void AddSourceFiles(const cgltf_data& model, const Filesystem::Path& modelDir, 
+        SceneCache::Writer& cache)
+    {
+        SmallVector<SceneCache::SourceFile> files;
+        SmallVector<char> paths;
+
+        auto add = [&modelDir, &files, &paths](const char* uri)
+            {
+                if (!uri)
+                    return;
+
+                files.push_back(StampSourceFile(modelDir, uri));
+                paths.append_range(uri, uri + strlen(uri) + 1);
+            };
+
+        for (size_t i = 0; i < model.buffers_count; i++)
+            add(model.buffers[i].uri);
+
+        for (size_t i = 0; i < model.images_count; i++)
+            add(model.images[i].uri);
+
+        cache.Add(SceneCache::SECTION::SOURCE_FILES, Span(files));
+        cache.Add(SceneCache::SECTION::SOURCE_FILE_PATHS, Span(paths));
+    }
+
+    // Returns true if every file recorded by AddSourceFiles() still has the same size and last
+    // write time
+    bool SourceFilesUnchanged(const SceneCache::Reader& reader, const Filesystem::Path& modelDir)
+    {
+        auto files = reader.Get<SceneCache::SourceFile>(SceneCache::SECTION::SOURCE_FILES);
+        auto paths = reader.Get<char>(SceneCache::SECTION::SOURCE_FILE_PATHS);
+
+        if (!files || !paths)
+            return false;
+
+        Span<char> p = paths.value();
+        if (!p.empty() && p[p.size() - 1] != '\0')
+            return false;
+
+        size_t numFiles = 0;
+
+        for (size_t i = 0; i < p.size(); i += strlen(p.data() + i) + 1)
+        {
+            if (numFiles == files.value().size())
+                return false;
+
+            const SceneCache::SourceFile expected = files.value()[numFiles++];
+            const SceneCache::SourceFile curr = StampSourceFile(modelDir, p.data() + i);
+
+            if (curr.SizeInBytes != expected.SizeInBytes || curr.LastWriteTime != expected.LastWriteTime)
+                return false;
+        }
+
+        return numFiles == files.value().size();
+    }
+
+    // Returns false if there isn't a usable cache for the scene, in which case it should be
+    // loaded from the glTF file instead
+    bool LoadFromCache(const Filesystem::Path& modelDir, const Filesystem::Path& cachePath,
+        uint32_t sceneID, uint64_t sourceHash, uint64_t sourceSizeInBytes)
+    {
+        // Sections are read in place, so the file has to remain mapped until all the
+        // tasks below are finished
+        Filesystem::MappedFile file;
+        if (!file.Open(cachePath.Get()))
+            return false;
+
+        SceneCache::Reader reader;
+        if (!reader.Init(file.Data()))
+        {
+            LOG_UI_WARNING("Scene cache %s is invalid or from an older version. Ignoring...\n", 
+                cachePath.Get());
+
+            return false;
+        }
+
+        const SceneCache::Header& header = reader.GetHeader();
+        if (header.SceneID != sceneID || header.SourceHash != sourceHash ||
+            header.SourceSizeInBytes != sourceSizeInBytes || !SourceFilesUnchanged(reader, modelDir))
+        {
+            LOG_UI_INFO("Scene cache %s is out of date. Ignoring...\n", cachePath.Get());
+            return false;
+        }
+
+        auto vertices = reader.Get<Vertex>(SceneCache::SECTION::VERTICES);
+        auto indices = reader.Get<uint32_t>(SceneCache::SECTION::INDICES);
+        auto meshIDs = reader.Get<uint64_t>(SceneCache::SECTION::MESH_IDS);
+        auto meshes = reader.Get<TriangleMesh>(SceneCache::SECTION::MESHES);
+        auto levelSizes = reader.Get<uint32_t>(SceneCache::SECTION::TREE_LEVELS);
+        auto IDs = reader.Get<uint64_t>(SceneCache::SECTION::INSTANCE_IDS);
+        auto localTransforms = reader.Get<AffineTransformation>(SceneCache::SECTION::LOCAL_TRANSFORMS);
+        auto instanceMeshIDs = reader.Get<uint64_t>(SceneCache::SECTION::INSTANCE_MESH_IDS);
+        auto parents = reader.Get<uint32_t>(SceneCache::SECTION::PARENTS);
+        auto rtFlags = reader.Get<uint8_t>(SceneCache::SECTION::RT_FLAGS);
+        auto materials = reader.Get<glTF::Asset::MaterialDesc>(SceneCache::SECTION::MATERIALS);
+        auto imagePaths = reader.Get<char>(SceneCache::SECTION::IMAGE_PATHS);
+        auto emissiveInstances = reader.Get<EmissiveInstance>(SceneCache::SECTION::EMISSIVE_INSTANCES);
+        auto rtEmissives = reader.Get<RT::EmissiveTriangle>(SceneCache::SECTION::EMISSIVE_TRIANGLES);
+
+        bool valid = vertices && indices && meshIDs && meshes && levelSizes && IDs && localTransforms &&
+            instanceMeshIDs && parents && rtFlags && materials && imagePaths && emissiveInstances && 
+            rtEmissives;
+
+        if (valid)
+        {
+            const size_t numInstances = IDs.value().size();
+            valid = meshIDs.value().size() == meshes.value().size() &&
+                localTransforms.value().size() == numInstances &&
+                instanceMeshIDs.value().size() == numInstances &&
+                parents.value().size() == numInstances &&
+                rtFlags.value().size() == numInstances &&
+                (imagePaths.value().empty() || imagePaths.value()[imagePaths.value().size() - 1] == '\0');
+
+            for (auto& instance : emissiveInstances.value())
+            {
+                valid = valid && 
+                    instance.BaseTriOffset + instance.NumTriangles <= rtEmissives.value().size();
             }
         }
+
+        if (!valid)
+        {
+            LOG_UI_WARNING("Scene cache %s doesn't match the expected layout. Ignoring...\n", 
+                cachePath.Get());
+
+            return false;
+        }
+
+        SmallVector<const char*> imageURIs;
+        Span<char> paths = imagePaths.value();
+
+        for (size_t i = 0; i < paths.size(); i += strlen(paths.data() + i) + 1)
+            imageURIs.push_back(paths.data() + i);
+
+        SceneCore& scene = App::GetScene();
+        scene.ResizeAdditionalMaterials((uint32_t)materials.value().size());
+
+        size_t imgWorkerOffset[MAX_NUM_IMAGE_WORKERS];
+        size_t imgWorkerCount[MAX_NUM_IMAGE_WORKERS];
+
+        const int numImgWorkers = (int)SubdivideRangeWithMin(imageURIs.size(),
+            MAX_NUM_IMAGE_WORKERS,
+            imgWorkerOffset,
+            imgWorkerCount,
+            MIN_IMAGES_PER_WORKER);
+
+        SmallVector<Texture> ddsImages;
+        ddsImages.resize(imageURIs.size());
+
+        const SceneCore::SceneGraphDesc sceneGraph{ .LevelSizes = levelSizes.value(),
+            .IDs = IDs.value(),
+            .LocalTransforms = localTransforms.value(),
+            .MeshIDs = instanceMeshIDs.value(),
+            .Parents = parents.value(),
+            .RtFlags = rtFlags.value() };
+
+        TaskSet ts;
+
+        auto procMats = ts.EmplaceTask("gltf::Materials", [&ddsImages, descs = materials.value()]()
+            {
+                // For binary search
+                std::sort(ddsImages.begin(), ddsImages.end(),
+                    [](const Texture& lhs, const Texture& rhs)
+                    {
+                        return lhs.ID() < rhs.ID();
+                    });
+
+                SceneCore& scene = App::GetScene();
+
+                for (auto& desc : descs)
+                    scene.AddMaterial(desc, ddsImages, false);
+            });
+
+        for (int i = 0; i < numImgWorkers; i++)
+        {
+            StackStr(tname, n, "gltf::Img_%d", i);
+
+            auto h = ts.EmplaceTask(tname, [&modelDir, &imageURIs, &ddsImages, 
+                offset = imgWorkerOffset[i], count = imgWorkerCount[i]]()
+                {
+                    LoadDDSImages(modelDir, imageURIs, offset, count, ddsImages);
+                });
+
+            ts.AddOutgoingEdge(h, procMats);
+        }
+
+        auto procEmissives = ts.EmplaceTask("gltf::Emissives", [sceneID, 
+            instances = emissiveInstances.value(), tris = rtEmissives.value()]()
+            {
+                SmallVector<EmissiveInstance> emissiveInstances;
+                SmallVector<RT::EmissiveTriangle> rtEmissives;
+                emissiveInstances.append_range(instances.begin(), instances.end(), true);
+                rtEmissives.append_range(tris.begin(), tris.end(), true);
+
+                SceneCore& scene = App::GetScene();
+
+                // Emissive textures are referenced by their descriptor table offset, which is 
+                // assigned at load time and may differ from when the cache was written
+                for (auto& instance : emissiveInstances)
+                {
+                    const uint32_t matID = Scene::MaterialID(sceneID, instance.MaterialIdx - 1);
+                    const uint32_t emissiveTex = scene.GetMaterial(matID).value().GetEmissiveTex();
+
+                    if (!instance.NumTriangles || rtEmissives[instance.BaseTriOffset].GetTex() == emissiveTex)
+                        continue;
+
+                    for (uint32_t t = instance.BaseTriOffset; t < instance.BaseTriOffset + instance.NumTriangles; t++)
+                        rtEmissives[t].SetTex(emissiveTex);
+                }
+
+                scene.AddEmissives(ZetaMove(emissiveInstances), ZetaMove(rtEmissives), false);
+            });
+
+        // Emissives need the materials
+        ts.AddOutgoingEdge(procMats, procEmissives);
+
+        ts.EmplaceTask("gltf::Meshes", [meshIDs = meshIDs.value(), meshes = meshes.value(), 
+            vertices = vertices.value(), indices = indices.value()]()
+            {
+                SceneCore& scene = App::GetScene();
+                scene.AddMeshes(meshIDs, meshes, vertices, indices, false);
+            });
+
+        ts.EmplaceTask("gltf::Nodes", [&sceneGraph]()
+            {
+                SceneCore& scene = App::GetScene();
+                scene.AddInstances(sceneGraph, false);
+            });
+
+        WaitObject waitObj;
+        ts.Sort();
+        ts.Finalize(&waitObj);
+        App::Submit(ZetaMove(ts));
+
+        App::FlushWorkerThreadPool();
+        waitObj.Wait();
+
+        LOG_UI_INFO("Scene was loaded from cache %s.\n", cachePath.Get());
+
+        return true;
     }
 }
 
-void glTF::Load(const App::Filesystem::Path& pathToglTF)
+void glTF::Load(const App::Filesystem::Path& pathToglTF, bool useSceneCache, bool optimizeMeshes)
 {
+    const uint32_t sceneID = XXH3_64_To_32(XXH3_64bits(pathToglTF.GetView().data(), pathToglTF.Length()));
+
+    // glTF file is hashed for detecting stale caches, so it's read once and then parsed 
+    // from memory. Parsed model may refer to this memory until it's freed.
+    SmallVector<uint8_t> glTFFile;
+    Filesystem::LoadFromFile(pathToglTF.GetView().data(), glTFFile);
+
+    Filesystem::Path modelDir(pathToglTF.GetView());
+    modelDir.Directory();
+
+    // "<scene>.gltf.zscene"
+    constexpr char CACHE_EXT[] = ".zscene";
+    Filesystem::Path cachePath(pathToglTF.GetView());
+    const size_t pathLen = strlen(cachePath.Get());
+    cachePath.Resize(pathLen + sizeof(CACHE_EXT));
+    memcpy(cachePath.Get() + pathLen, CACHE_EXT, sizeof(CACHE_EXT));
+
+    uint64_t sourceHash = 0;
+
+    // Checking the cache doesn't need the parsed json
+    if (useSceneCache)
+    {
+        // Caches written with and without mesh optimization aren't interchangeable
+        sourceHash = XXH3_64bits_withSeed(glTFFile.data(), glTFFile.size(), optimizeMeshes);
+
+        if (LoadFromCache(modelDir, cachePath, sceneID, sourceHash, glTFFile.size()))
+            return;
+    }
+
     // Parse json
     cgltf_options options{};
     cgltf_data* model = nullptr;
-    Checkgltf(cgltf_parse_file(&options, pathToglTF.GetView().data(), &model));
+    Checkgltf(cgltf_parse(&options, glTFFile.data(), glTFFile.size(), &model));
+
+    SceneCache::Writer cache;
+
+    // Referenced files are stamped before they're loaded, so that modifying them while the
+    // scene is loading leaves the cache out of date
+    if (useSceneCache)
+        AddSourceFiles(*model, modelDir, cache);
 
     // Load buffers
     Check(model->buffers_count == 1, "Invalid number of buffers.");
-    Filesystem::Path bufferPath(pathToglTF.GetView());
-    bufferPath.Directory();
+    Filesystem::Path bufferPath(modelDir.GetView());
     bufferPath.Append(model->buffers[0].uri);
     Checkgltf(cgltf_load_buffers(&options, model, bufferPath.Get()));
 
     Check(model->scene, "glTF model doesn't have a default scene: %s.", pathToglTF.GetView());
-    const uint32_t sceneID = XXH3_64_To_32(XXH3_64bits(pathToglTF.GetView().data(), pathToglTF.Length()));
     SceneCore& scene = App::GetScene();
 
-    // Figure out total number of vertices and indices
-    size_t totalNumVertices;
-    size_t totalNumIndices;
-    size_t totalNumMeshPrims;
-    TotalNumVerticesAndIndices(model, totalNumVertices, totalNumIndices, totalNumMeshPrims);
-
     // Height of the node hierarchy
     const int height = ComputeNodeHierarchyHeight(*model);
     constexpr int DEFAULT_NUM_LEVELS = 10;
@@ -1099,22 +1659,7 @@ void glTF::Load(const App::Filesystem::Path& pathToglTF)
     scene.ResizeAdditionalMaterials((uint32_t)model->materials_count);
     scene.ReserveInstances(levels, total);
 
-    // How many meshes are processed by each worker
-    constexpr size_t MAX_NUM_MESH_WORKERS = 4;
-    constexpr size_t MIN_MESHES_PER_WORKER = 20;
-    size_t meshWorkerOffset[MAX_NUM_MESH_WORKERS];
-    size_t meshWorkerCount[MAX_NUM_MESH_WORKERS];
-    uint32_t workerEmissiveCount[MAX_NUM_MESH_WORKERS];
-
-    const int numMeshWorkers = (int)SubdivideRangeWithMin(model->meshes_count,
-        MAX_NUM_MESH_WORKERS,
-        meshWorkerOffset,
-        meshWorkerCount,
-        MIN_MESHES_PER_WORKER);
-
     // How many images are processed by each worker
-    constexpr size_t MAX_NUM_IMAGE_WORKERS = 5;
-    constexpr size_t MIN_IMAGES_PER_WORKER = 15;
     size_t imgWorkerOffset[MAX_NUM_IMAGE_WORKERS];
     size_t imgWorkerCount[MAX_NUM_IMAGE_WORKERS];
 
@@ -1128,65 +1673,61 @@ void glTF::Load(const App::Filesystem::Path& pathToglTF)
     tc.glTFPath = &pathToglTF;
     tc.SceneID = sceneID;
     tc.Model = model;
-    tc.NumMeshWorkers = numMeshWorkers;
+    tc.Cache = useSceneCache ? &cache : nullptr;
+    tc.CachePath = &cachePath;
+    tc.SourceHash = sourceHash;
+    tc.SourceSizeInBytes = glTFFile.size();
     tc.NumImgWorkers = numImgWorkers;
-    tc.MeshThreadOffsets = meshWorkerOffset;
-    tc.MeshThreadSizes = meshWorkerCount;
     tc.ImgThreadOffsets = imgWorkerOffset;
     tc.ImgThreadSizes = imgWorkerCount;
-    tc.EmissiveMeshPrimCountPerWorker = workerEmissiveCount;
+
+    // Figure out where each mesh primitive goes in the vertex and index buffers
+    size_t totalNumVertices;
+    size_t totalNumIndices;
+    ComputeMeshLayout(*model, sceneID, tc.MeshPrims, tc.Meshes, tc.EmissiveMeshPrims, 
+        totalNumVertices, totalNumIndices);
 
     // Preallocate
     tc.Vertices.resize(totalNumVertices);
     tc.Indices.resize(totalNumIndices);
-    tc.Meshes.resize(totalNumMeshPrims);
+    tc.Materials.resize(model->materials_count);
+    tc.ImageURIs.resize(model->images_count);
     tc.DDSImages.resize(model->images_count);
-    tc.EmissiveMeshPrims.resize(totalNumMeshPrims);
-    ResetEmissiveSubsets(tc.EmissiveMeshPrims);
+
+    for (size_t i = 0; i < model->images_count; i++)
+    {
+        Check(model->images[i].uri, "Image has no URI.");
+        tc.ImageURIs[i] = model->images[i].uri;
+    }
 
     TaskSet ts;
 
+    // Only needs the mesh layout, so it runs alongside vertex and index processing
     auto procEmissiveMeshPrims = ts.EmplaceTask("gltf::EmissivePrims", [&tc]()
         {
-            // EmissiveMeshPrimCountPerWorker is filled in by mesh workers
-            for (int i = 0; i < tc.NumMeshWorkers; i++)
-                tc.NumEmissiveMeshPrims += tc.EmissiveMeshPrimCountPerWorker[i];
-
-            // For binary search. Also, since non-emissive meshes were assigned the INVALID
-            // ID (= UINT64_MAX), this also partitions the non-null entries before the null
-            // entries.
+            // For binary search
             std::sort(tc.EmissiveMeshPrims.begin(), tc.EmissiveMeshPrims.end(),
                 [](const EmissiveMeshPrim& lhs, const EmissiveMeshPrim& rhs)
                 {
                     return lhs.MeshID < rhs.MeshID;
                 });
 
-            // In order to do only one allocation, number of emissive mesh primitives was assumed
-            // to be the worst case -- total number of mesh primitives. As such, there may be a number 
-            // of "null" entries in the EmissiveMeshPrims. Now that the actual size is known, adjust 
-            // the size accordingly.
-            //tc.EmissiveMeshPrims = MutableSpan(tc.EmissiveMeshPrims.data(), tc.NumEmissiveMeshPrims);
-            tc.EmissiveMeshPrims.resize(tc.NumEmissiveMeshPrims);
             NumEmissiveInstancesAndTriangles(tc);
         });
 
-    for (int i = 0; i < tc.NumMeshWorkers; i++)
-    {
-        StackStr(tname, n, "gltf::Mesh_%d", i);
+    // Work is split by ranges of vertices and faces rather than by meshes, so that scenes 
+    // with a few large meshes are processed by all the threads
+    auto procMeshes = ts.EmplaceTask("gltf::Meshes", [&tc, optimizeMeshes]()
+        {
+            ProcessMeshes(tc.MeshPrims, tc.Vertices, tc.Indices);
 
-        auto procMesh = ts.EmplaceTask(tname, [&tc, workerIdx = i]()
-            {
-                ProcessMeshes(*tc.Model, tc.SceneID, tc.MeshThreadOffsets[workerIdx],
-                    tc.MeshThreadSizes[workerIdx],
-                    tc.Vertices, tc.CurrVtxOffset,
-                    tc.Indices, tc.CurrIdxOffset,
-                    tc.Meshes, tc.CurrMeshPrimOffset,
-                    tc.EmissiveMeshPrims, 
-                    tc.EmissiveMeshPrimCountPerWorker[workerIdx]);
-            });
+            if (optimizeMeshes)
+                OptimizeMeshes(tc);
+        });
 
-        ts.AddOutgoingEdge(procMesh, procEmissiveMeshPrims);
-    }
+    // Mesh optimization changes vertex offsets of emissive mesh primitives
+    if (optimizeMeshes)
+        ts.AddOutgoingEdge(procMeshes, procEmissiveMeshPrims);
 
     auto procMats = ts.EmplaceTask("gltf::Materials", [&tc]()
         {
@@ -1201,7 +1742,7 @@ void glTF::Load(const App::Filesystem::Path& pathToglTF)
             parent.ToParent();
 
             ProcessMaterials(tc.SceneID, parent, *tc.Model, 0, (int)tc.Model->materials_count, 
-                tc.DDSImages);
+                tc.DDSImages, tc.Materials);
         });
 
     for (int i = 0; i < numImgWorkers; i++)
@@ -1214,7 +1755,7 @@ void glTF::Load(const App::Filesystem::Path& pathToglTF)
                 Filesystem::Path parent(tc.glTFPath->GetView());
                 parent.ToParent();
 
-                LoadDDSImages(tc.SceneID, parent, *tc.Model, tc.ImgThreadOffsets[workerIdx], 
+                LoadDDSImages(parent, tc.ImageURIs, tc.ImgThreadOffsets[workerIdx], 
                     tc.ImgThreadSizes[workerIdx], tc.DDSImages);
             });
 
@@ -1231,14 +1772,21 @@ void glTF::Load(const App::Filesystem::Path& pathToglTF)
 
             ProcessEmissives(tc);
 
+            if (tc.Cache)
+            {
+                tc.Cache->Add(SceneCache::SECTION::EMISSIVE_INSTANCES, Span(tc.EmissiveInstances));
+                tc.Cache->Add(SceneCache::SECTION::EMISSIVE_TRIANGLES, Span(tc.RTEmissives));
+            }
+
             // Transfer ownership of emissives
             SceneCore& scene = App::GetScene();
             scene.AddEmissives(ZetaMove(tc.EmissiveInstances), ZetaMove(tc.RTEmissives), false);
         });
 
-    // Processing emissives starts after materials are loaded and emissive primitives 
-    // have been processed
+    // Processing emissives starts after materials are loaded and emissive primitives, 
+    // vertices and indices have been processed
     ts.AddOutgoingEdge(procEmissiveMeshPrims, procEmissives);
+    ts.AddOutgoingEdge(procMeshes, procEmissives);
     ts.AddOutgoingEdge(procMats, procEmissives);
 
     ts.EmplaceTask("gltf::Nodes", [&tc]()
@@ -1248,6 +1796,9 @@ void glTF::Load(const App::Filesystem::Path& pathToglTF)
 
     auto last = ts.EmplaceTask("gltf::Final", [&tc]()
         {
+            if (tc.Cache)
+                WriteSceneCache(tc);
+
             // Transfer ownership of mesh buffers
             SceneCore& scene = App::GetScene();
             scene.AddMeshes(ZetaMove(tc.Meshes), ZetaMove(tc.Vertices), ZetaMove(tc.Indices), false);
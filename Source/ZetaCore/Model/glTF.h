@@ -4,5 +4,12 @@
 
 namespace ZetaRay::Model::glTF
 {
-    void Load(const App::Filesystem::Path& p);
+    // When useSceneCache is true, the scene is loaded from "<path>.zscene" if it exists and 
+    // is up to date with the glTF file and the buffers and images that it refers to. 
+    // Otherwise, it's loaded from the glTF file and the cache is (re)written next to it 
+    // afterwards. Off by default, so that loading doesn't write to the asset directory 
+    // unless asked to.
+    // When optimizeMeshes is true, duplicate vertices are merged and triangles and vertices 
+    // of each mesh are reordered for vertex cache, overdraw and vertex fetch efficiency.
+    void Load(const App::Filesystem::Path& p, bool useSceneCache = false, bool optimizeMeshes = false);
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include "../Core/RenderGraph.h"
 #include "../App/Log.h"
 #include "../App/Timer.h"
+#include "../Support/ParallelFor.h"
 #include <algorithm>
 
 using namespace ZetaRay;
@@ -21,6 +22,8 @@ using namespace ZetaRay::Support;
 
 namespace
 {
+    static constexpr size_t MIN_INSTANCES_PER_CHUNK = 64;
+
     struct BLASTransform
     {
         float M[3][4];
@@ -149,7 +152,7 @@ void StaticBLAS::Rebuild(ComputeCmdList& cmdList)
                 if (meshID == Scene::INVALID_MESH)
                     continue;
 
-                const TriangleMesh* mesh = scene.GetMesh(meshID).value();
+                const TriangleMesh mesh = scene.GetMesh(meshID).value();
 
                 meshDescs[currInstance].Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
                 // Force mesh to be opaque when possible to avoid invoking any-hit shaders
@@ -162,12 +165,12 @@ void StaticBLAS::Rebuild(ComputeCmdList& cmdList)
                     currInstance * transformMatSize;
                 meshDescs[currInstance].Triangles.IndexFormat = DXGI_FORMAT_R32_UINT;
                 meshDescs[currInstance].Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-                meshDescs[currInstance].Triangles.IndexCount = mesh->m_numIndices;
-                meshDescs[currInstance].Triangles.VertexCount = mesh->m_numVertices;
+                meshDescs[currInstance].Triangles.IndexCount = mesh.m_numIndices;
+                meshDescs[currInstance].Triangles.VertexCount = mesh.m_numVertices;
                 meshDescs[currInstance].Triangles.IndexBuffer = sceneIBGpuVa + 
-                    mesh->m_idxBuffStartOffset * sizeof(uint32_t);
+                    mesh.m_idxBuffStartOffset * sizeof(uint32_t);
                 meshDescs[currInstance].Triangles.VertexBuffer.StartAddress = sceneVBGpuVa + 
-                    mesh->m_vtxBuffStartOffset * sizeof(Vertex);
+                    mesh.m_vtxBuffStartOffset * sizeof(Vertex);
                 meshDescs[currInstance].Triangles.VertexBuffer.StrideInBytes = sizeof(Vertex);
 
                 currTreeLevel.m_rtASInfo[i] = RT_AS_Info{
@@ -315,15 +318,15 @@ void StaticBLAS::CompactionCompletedCallback()
 // TLAS
 //--------------------------------------------------------------------------------------
 
-void TLAS::FillMeshInstanceData(uint64_t instanceID, uint64_t meshID, const float4x3& M,
+void TLAS::FillMeshInstanceData(uint64_t meshID, const float4x3& M, const float4x3& M_prev,
     uint32_t emissiveTriOffset, bool staticMesh, uint32_t currInstance)
 {
     Assert(meshID != Scene::INVALID_MESH, "Invalid call.");
 
     SceneCore& scene = App::GetScene();
-    const TriangleMesh* mesh = scene.GetMesh(meshID).value();
+    const TriangleMesh mesh = scene.GetMesh(meshID).value();
     uint32 matBufferIdx = UINT32_MAX;
-    const Material* mat = scene.GetMaterial(mesh->m_materialID, &matBufferIdx).value();
+    const Material mat = scene.GetMaterial(mesh.m_materialID, &matBufferIdx).value();
 
     v_float4x4 vM = load4x3(M);
 
@@ -340,25 +343,24 @@ void TLAS::FillMeshInstanceData(uint64_t instanceID, uint64_t meshID, const floa
     decomposeSRT(vM, s, r, t);
 
     m_frameInstanceData[currInstance].MatIdx = (uint16_t)matBufferIdx;
-    m_frameInstanceData[currInstance].BaseVtxOffset = mesh->m_vtxBuffStartOffset;
-    m_frameInstanceData[currInstance].BaseIdxOffset = mesh->m_idxBuffStartOffset;
+    m_frameInstanceData[currInstance].BaseVtxOffset = mesh.m_vtxBuffStartOffset;
+    m_frameInstanceData[currInstance].BaseIdxOffset = mesh.m_idxBuffStartOffset;
     m_frameInstanceData[currInstance].Rotation = unorm4::FromNormalized(r);
     m_frameInstanceData[currInstance].Scale = half3(s);
     m_frameInstanceData[currInstance].Translation = float3(t.x, t.y, t.z);
     m_frameInstanceData[currInstance].BaseEmissiveTriOffset = emissiveTriOffset;
 
-    const uint32_t texIdx = mat->GetBaseColorTex();
+    const uint32_t texIdx = mat.GetBaseColorTex();
     m_frameInstanceData[currInstance].BaseColorTex = texIdx == Material::INVALID_ID ?
         UINT16_MAX :
         (uint16_t)texIdx;
 
-    float alpha = float((mat->BaseColorFactor >> 24) & 0xff) / 255.0f;
+    float alpha = float((mat.BaseColorFactor >> 24) & 0xff) / 255.0f;
     m_frameInstanceData[currInstance].AlphaFactor_Cutoff =
-        Float2ToRG8(float2(alpha, mat->GetAlphaCutoff()));
+        Float2ToRG8(float2(alpha, mat.GetAlphaCutoff()));
 
     if (!staticMesh)
     {
-        const float4x3& M_prev = *scene.GetPrevToWorld(instanceID).value();
         v_float4x4 vM_prev = load4x3(M_prev);
         float4a t_prev;
         float4a r_prev;
@@ -404,75 +406,71 @@ void TLAS::RebuildFrameMeshInstanceData()
     //  - With this setup, every instance can use GeometryIndex() + InstanceID() to index 
     //    into the mesh instance buffer
 
-    // Static meshes
-    if (scene.m_numStaticInstances)
+    struct InstancePos
     {
-        for (size_t treeLevelIdx = 1; treeLevelIdx < scene.m_sceneGraph.size(); treeLevelIdx++)
-        {
-            auto& currTreeLevel = scene.m_sceneGraph[treeLevelIdx];
-            const auto& rtFlagVec = currTreeLevel.m_rtFlags;
+        uint32_t TreeLevel;
+        uint32_t Offset;
+    };
 
-            for (size_t i = 0; i < rtFlagVec.size(); i++)
+    // Scene graph position of every instance in the above order. Filling the mesh
+    // instance data is independent for each instance and is done in parallel afterwards.
+    SmallVector<InstancePos, App::FrameAllocator> instancePos;
+    instancePos.resize(numInstances);
+
+    auto findInstances = [&scene, &instancePos, &currInstance](RT_MESH_MODE mode)
+        {
+            for (size_t treeLevelIdx = 1; treeLevelIdx < scene.m_sceneGraph.size(); treeLevelIdx++)
             {
-                const auto rtFlags = RT_Flags::Decode(currTreeLevel.m_rtFlags[i]);
-                const uint64_t meshID = currTreeLevel.m_meshIDs[i];
-                if (meshID == Scene::INVALID_MESH)
-                    continue;
+                auto& currTreeLevel = scene.m_sceneGraph[treeLevelIdx];
+                const auto& rtFlagVec = currTreeLevel.m_rtFlags;
 
-                if (rtFlags.MeshMode == RT_MESH_MODE::STATIC)
+                for (size_t i = 0; i < rtFlagVec.size(); i++)
                 {
-                    const uint64_t instanceID = currTreeLevel.m_IDs[i];
-                    const uint32_t emissiveTriOffset = sceneHasEmissives &&
-                        (rtFlags.InstanceMask & RT_AS_SUBGROUP::EMISSIVE) ?
-                        scene.m_emissives.FindInstance(instanceID).value()->BaseTriOffset :
-                        UINT32_MAX;
+                    const auto rtFlags = RT_Flags::Decode(currTreeLevel.m_rtFlags[i]);
+                    const uint64_t meshID = currTreeLevel.m_meshIDs[i];
+                    if (meshID == Scene::INVALID_MESH || rtFlags.MeshMode != mode)
+                        continue;
 
-                    FillMeshInstanceData(instanceID, meshID, currTreeLevel.m_toWorlds[i], 
-                        emissiveTriOffset, true, (uint32)currInstance);
+                    instancePos[currInstance] = InstancePos{ .TreeLevel = (uint32_t)treeLevelIdx,
+                        .Offset = (uint32_t)i };
 
                     // Update RT mesh to instance ID map
                     scene.m_rtMeshInstanceIdxToID[currInstance++] = currTreeLevel.m_IDs[i];
                 }
             }
-        }
-    }
+        };
+
+    // Static meshes
+    if (scene.m_numStaticInstances)
+        findInstances(RT_MESH_MODE::STATIC);
 
     Assert(currInstance == scene.m_numStaticInstances, "Invalid instance count.");
 
     // Dynamic meshes
     if (scene.m_numDynamicInstances)
-    {
-        for (size_t treeLevelIdx = 1; treeLevelIdx < scene.m_sceneGraph.size(); treeLevelIdx++)
-        {
-            auto& currTreeLevel = scene.m_sceneGraph[treeLevelIdx];
-            const auto& rtFlagVec = currTreeLevel.m_rtFlags;
-
-            for (size_t i = 0; i < rtFlagVec.size(); i++)
-            {
-                const auto rtFlags = RT_Flags::Decode(currTreeLevel.m_rtFlags[i]);
-                const uint64_t meshID = currTreeLevel.m_meshIDs[i];
-                if (meshID == Scene::INVALID_MESH)
-                    continue;
-
-                if (rtFlags.MeshMode == RT_MESH_MODE::DYNAMIC_NO_REBUILD)
-                {
-                    const uint64_t instanceID = currTreeLevel.m_IDs[i];
-                    const uint32_t emissiveTriOffset = sceneHasEmissives &&
-                        (rtFlags.InstanceMask & RT_AS_SUBGROUP::EMISSIVE) ?
-                        scene.m_emissives.FindInstance(instanceID).value()->BaseTriOffset :
-                        UINT32_MAX;
+        findInstances(RT_MESH_MODE::DYNAMIC_NO_REBUILD);
 
-                    FillMeshInstanceData(instanceID, meshID, currTreeLevel.m_toWorlds[i], 
-                        emissiveTriOffset, false, (uint32)currInstance);
+    Assert(currInstance == numInstances, "Invalid instance count.");
 
-                    // Update RT mesh to instance ID map
-                    scene.m_rtMeshInstanceIdxToID[currInstance++] = currTreeLevel.m_IDs[i];
-                }
+    ParallelFor(0, numInstances, MIN_INSTANCES_PER_CHUNK, 
+        [this, &scene, &instancePos, sceneHasEmissives](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const auto& currTreeLevel = scene.m_sceneGraph[instancePos[i].TreeLevel];
+                const uint32_t offset = instancePos[i].Offset;
+                const auto rtFlags = RT_Flags::Decode(currTreeLevel.m_rtFlags[offset]);
+                const uint64_t instanceID = currTreeLevel.m_IDs[offset];
+                const uint32_t emissiveTriOffset = sceneHasEmissives &&
+                    (rtFlags.InstanceMask & RT_AS_SUBGROUP::EMISSIVE) ?
+                    scene.m_emissives.FindInstance(instanceID).value()->BaseTriOffset :
+                    UINT32_MAX;
+
+                FillMeshInstanceData(currTreeLevel.m_meshIDs[offset], currTreeLevel.m_toWorlds[offset],
+                    currTreeLevel.m_prevToWorlds[offset], emissiveTriOffset, 
+                    rtFlags.MeshMode == RT_MESH_MODE::STATIC, (uint32)i);
             }
-        }
-    }
-
-    Assert(currInstance == numInstances, "Invalid instance count.");
+        });
 
     const uint32_t sizeInBytes = numInstances * sizeof(RT::MeshInstance);
 
@@ -517,7 +515,7 @@ void TLAS::UpdateFrameMeshInstances_StaticToDynamic()
 
     // Sort in descending order (see visualization below)
     std::sort(scene.m_pendingRtMeshModeSwitch.begin(), scene.m_pendingRtMeshModeSwitch.end(),
-        [&scene](const uint64_t& lhs, const uint64_t& rhs)
+        [&scene](const InstanceHandle& lhs, const InstanceHandle& rhs)
         {
             RT_AS_Info lhsAsInfo = scene.GetInstanceRtASInfo(lhs);
             RT_AS_Info rhsAsInfo = scene.GetInstanceRtASInfo(rhs);
@@ -580,10 +578,10 @@ void TLAS::UpdateFrameMeshInstances_StaticToDynamic()
     // Append the newly converted dynamic meshes
     for (size_t i = 0; i < scene.m_pendingRtMeshModeSwitch.size(); i++)
     {
-        const auto instance = scene.m_pendingRtMeshModeSwitch[i];
-        const auto treePos = scene.FindTreePosFromID(instance).value();
+        const auto treePos = scene.FindTreePos(scene.m_pendingRtMeshModeSwitch[i]);
         auto& currTreeLevel = scene.m_sceneGraph[treePos.Level];
         const auto rtFlags = RT_Flags::Decode(currTreeLevel.m_rtFlags[treePos.Offset]);
+        const uint64_t instance = currTreeLevel.m_IDs[treePos.Offset];
 
         const uint64_t meshID = currTreeLevel.m_meshIDs[treePos.Offset];
         Assert(meshID != Scene::INVALID_MESH, "Invalid mesh");
@@ -594,8 +592,8 @@ void TLAS::UpdateFrameMeshInstances_StaticToDynamic()
             UINT32_MAX;
 
         // Unsorted, sort happens below
-        FillMeshInstanceData(instance, meshID, currTreeLevel.m_toWorlds[treePos.Offset],
-            emissiveTriOffset, false, currInstance);
+        FillMeshInstanceData(meshID, currTreeLevel.m_toWorlds[treePos.Offset],
+            currTreeLevel.m_prevToWorlds[treePos.Offset], emissiveTriOffset, false, currInstance);
         scene.m_rtMeshInstanceIdxToID[currInstance++] = instance;
 
         dynamicInstanceTreePositions.push_back(TreePosAndIdx{
@@ -657,18 +655,17 @@ void TLAS::UpdateFrameMeshInstances_NewTransform()
     for (auto it = scene.m_instanceUpdates.begin_it(); it != scene.m_instanceUpdates.end_it();
         it = scene.m_instanceUpdates.next_it(it))
     {
-        const auto instance = it->Key;
-        const auto treePos = scene.FindTreePosFromID(instance).value();
+        const auto treePos = scene.FindTreePos(it->Key);
         const auto& treeLevel = scene.m_sceneGraph[treePos.Level];
 
         const auto rtFlags = RT_Flags::Decode(treeLevel.m_rtFlags[treePos.Offset]);
         const uint32_t emissiveTriOffset = sceneHasEmissives &&
             (rtFlags.InstanceMask & RT_AS_SUBGROUP::EMISSIVE) ?
-            scene.m_emissives.FindInstance(instance).value()->BaseTriOffset :
+            scene.m_emissives.FindInstance(treeLevel.m_IDs[treePos.Offset]).value()->BaseTriOffset :
             UINT32_MAX;
 
         auto vecIt = std::lower_bound(m_dynamicBLASes.begin(), m_dynamicBLASes.end(), treePos,
-            [](const DynamicBLAS& lhs, const SceneCore::TreePos& key)
+            [](const DynamicBLAS& lhs, const TreePos& key)
             {
                 if (lhs.TreeLevel < key.Level)
                     return true;
@@ -684,8 +681,9 @@ void TLAS::UpdateFrameMeshInstances_NewTransform()
             "Dynamic BLAS for instance was not found.");
         const auto idx = vecIt - m_dynamicBLASes.begin();
 
-        FillMeshInstanceData(instance, treeLevel.m_meshIDs[treePos.Offset],
+        FillMeshInstanceData(treeLevel.m_meshIDs[treePos.Offset],
             treeLevel.m_toWorlds[treePos.Offset], 
+            treeLevel.m_prevToWorlds[treePos.Offset], 
             emissiveTriOffset, 
             false, 
             blas.InstanceID);
@@ -826,7 +824,7 @@ void TLAS::BuildDynamicBLASes(ComputeCmdList& cmdList)
 
             if (flags.MeshMode != RT_MESH_MODE::STATIC)
             {
-                const TriangleMesh* mesh = scene.GetMesh(currTreeLevel.m_meshIDs[i]).value();
+                const TriangleMesh mesh = scene.GetMesh(currTreeLevel.m_meshIDs[i]).value();
                 const auto sceneVBGpuVa = scene.GetMeshVB().GpuVA();
                 const auto sceneIBGpuVa = scene.GetMeshIB().GpuVA();
 
@@ -835,14 +833,14 @@ void TLAS::BuildDynamicBLASes(ComputeCmdList& cmdList)
                 buildItem.LevelIdx = (uint32_t)i;
                 buildItem.GeoDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
                 buildItem.GeoDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
-                buildItem.GeoDesc.Triangles.IndexBuffer = sceneIBGpuVa + mesh->m_idxBuffStartOffset * sizeof(uint32_t);
-                buildItem.GeoDesc.Triangles.IndexCount = mesh->m_numIndices;
+                buildItem.GeoDesc.Triangles.IndexBuffer = sceneIBGpuVa + mesh.m_idxBuffStartOffset * sizeof(uint32_t);
+                buildItem.GeoDesc.Triangles.IndexCount = mesh.m_numIndices;
                 buildItem.GeoDesc.Triangles.IndexFormat = DXGI_FORMAT_R32_UINT;
                 buildItem.GeoDesc.Triangles.Transform3x4 = 0;
                 buildItem.GeoDesc.Triangles.VertexBuffer.StartAddress = sceneVBGpuVa +
-                    mesh->m_vtxBuffStartOffset * sizeof(Vertex);
+                    mesh.m_vtxBuffStartOffset * sizeof(Vertex);
                 buildItem.GeoDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(Vertex);
-                buildItem.GeoDesc.Triangles.VertexCount = mesh->m_numVertices;
+                buildItem.GeoDesc.Triangles.VertexCount = mesh.m_numVertices;
                 buildItem.GeoDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
 
                 blasBuilds.push_back(buildItem);
@@ -1052,24 +1050,24 @@ void TLAS::RebuildOrUpdateBLASes(ComputeCmdList& cmdList)
 
         for (auto instance : scene.m_pendingRtMeshModeSwitch)
         {
-            const auto treePos = scene.FindTreePosFromID(instance).value();
+            const auto treePos = scene.FindTreePos(instance);
             const auto meshID = scene.m_sceneGraph[treePos.Level].m_meshIDs[treePos.Offset];
 
-            const TriangleMesh* mesh = scene.GetMesh(meshID).value();
+            const TriangleMesh mesh = scene.GetMesh(meshID).value();
             const auto sceneVBGpuVa = scene.GetMeshVB().GpuVA();
             const auto sceneIBGpuVa = scene.GetMeshIB().GpuVA();
 
             DynamicBlasBuild build;
             build.GeoDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
             build.GeoDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
-            build.GeoDesc.Triangles.IndexBuffer = sceneIBGpuVa + mesh->m_idxBuffStartOffset * sizeof(uint32_t);
-            build.GeoDesc.Triangles.IndexCount = mesh->m_numIndices;
+            build.GeoDesc.Triangles.IndexBuffer = sceneIBGpuVa + mesh.m_idxBuffStartOffset * sizeof(uint32_t);
+            build.GeoDesc.Triangles.IndexCount = mesh.m_numIndices;
             build.GeoDesc.Triangles.IndexFormat = DXGI_FORMAT_R32_UINT;
             build.GeoDesc.Triangles.Transform3x4 = 0;
             build.GeoDesc.Triangles.VertexBuffer.StartAddress = sceneVBGpuVa +
-                mesh->m_vtxBuffStartOffset * sizeof(Vertex);
+                mesh.m_vtxBuffStartOffset * sizeof(Vertex);
             build.GeoDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(Vertex);
-            build.GeoDesc.Triangles.VertexCount = mesh->m_numVertices;
+            build.GeoDesc.Triangles.VertexCount = mesh.m_numVertices;
             build.GeoDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
 
             build.TreeLevel = treePos.Level;
@@ -1398,11 +1396,10 @@ void TLAS::UpdateTLASInstances_NewTransform(ComputeCmdList& cmdList)
         if (it->Val < currFrame - 1)
             continue;
 
-        const auto instance = it->Key;
-        const SceneCore::TreePos treePos = scene.FindTreePosFromID(instance).value();
+        const TreePos treePos = scene.FindTreePos(it->Key);
 
         auto vecIt = std::lower_bound(m_dynamicBLASes.begin(), m_dynamicBLASes.end(), treePos,
-            [](const DynamicBLAS& lhs, const SceneCore::TreePos &key)
+            [](const DynamicBLAS& lhs, const TreePos &key)
             {
                 if (lhs.TreeLevel < key.Level)
                     return true;
@@ -1429,7 +1426,7 @@ void TLAS::UpdateTLASInstances_NewTransform(ComputeCmdList& cmdList)
             m_dynamicBLASArenas[blas.PageIdx].Page.GpuVA() +
             blas.PageOffset;
 
-        auto& M = scene.GetToWorld(instance);
+        auto& M = scene.m_sceneGraph[treePos.Level].m_toWorlds[treePos.Offset];
 
         for (int j = 0; j < 4; j++)
         {
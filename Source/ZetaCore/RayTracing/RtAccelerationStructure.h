@@ -89,7 +89,7 @@ namespace ZetaRay::RT
         };
 
         // Frame mesh instances
-        void FillMeshInstanceData(uint64_t instanceID, uint64_t meshID, const Math::float4x3& M,
+        void FillMeshInstanceData(uint64_t meshID, const Math::float4x3& M, const Math::float4x3& M_prev,
             uint32_t emissiveTriOffset, bool staticMesh, uint32_t currInstance);
         void RebuildFrameMeshInstanceData();
         void UpdateFrameMeshInstances_StaticToDynamic();
@@ -283,6 +283,11 @@ namespace ZetaRay
                     (uint32_t(newStrength.x) << Material::NUM_TEXTURE_BITS);
             }
 
+            ZetaInline void SetTex(uint32_t newTex)
+            {
+                PackedB = (PackedB & ~Material::TEXTURE_MASK) | newTex;
+            }
+
             ZetaInline void SetEmissiveFactor(uint32_t newFactorRGB8)
             {
                 PackedA = newFactorRGB8 | (PackedA & Material::UPPER_8_BITS_MASK);
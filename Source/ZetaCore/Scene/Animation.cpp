@@ -0,0 +1,189 @@
+#include "Animation.h"
+#include "../Math/Quaternion.h"
+#include "../Support/ParallelFor.h"
+#include "../Utility/Utility.h"
+
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Scene;
+using namespace ZetaRay::Scene::Internal;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+//--------------------------------------------------------------------------------------
+// AnimationTracks
+//--------------------------------------------------------------------------------------
+
+uint32_t AnimationTracks::Add(Span<Keyframe> keyframes, float t_start, bool loop)
+{
+    Check(keyframes.size() > 1, "Invalid animation.");
+
+    const uint32_t offset = (uint32_t)m_times.size();
+    m_tracks.push_back(Track{
+            .StartOffset = offset,
+            .Length = (uint32_t)keyframes.size(),
+            .T0 = t_start,
+            .Loop = loop
+        });
+    m_cursors.push_back(0);
+
+    const size_t newSize = m_times.size() + keyframes.size();
+    m_times.reserve(newSize);
+
+    for (int c = 0; c < COMPONENT::COUNT; c++)
+        m_keys[c].reserve(newSize);
+
+    for (size_t i = 0; i < keyframes.size(); i++)
+    {
+        const Keyframe& k = keyframes[i];
+        Assert(i == 0 || keyframes[i - 1].Time < k.Time, "Keyframes must be sorted and distinct.");
+
+        m_times.push_back(k.Time);
+        m_keys[COMPONENT::SCALE_X].push_back(k.Transform.Scale.x);
+        m_keys[COMPONENT::SCALE_Y].push_back(k.Transform.Scale.y);
+        m_keys[COMPONENT::SCALE_Z].push_back(k.Transform.Scale.z);
+        m_keys[COMPONENT::ROT_X].push_back(k.Transform.Rotation.x);
+        m_keys[COMPONENT::ROT_Y].push_back(k.Transform.Rotation.y);
+        m_keys[COMPONENT::ROT_Z].push_back(k.Transform.Rotation.z);
+        m_keys[COMPONENT::ROT_W].push_back(k.Transform.Rotation.w);
+        m_keys[COMPONENT::TR_X].push_back(k.Transform.Translation.x);
+        m_keys[COMPONENT::TR_Y].push_back(k.Transform.Translation.y);
+        m_keys[COMPONENT::TR_Z].push_back(k.Transform.Translation.z);
+    }
+
+    return (uint32_t)m_tracks.size() - 1;
+}
+
+void AnimationTracks::Clear()
+{
+    m_tracks.free_memory();
+    m_cursors.free_memory();
+    m_times.free_memory();
+
+    for (int c = 0; c < COMPONENT::COUNT; c++)
+        m_keys[c].free_memory();
+}
+
+uint32_t AnimationTracks::FindKeyframe(uint32_t trackIdx, float t, float& u)
+{
+    const Track& track = m_tracks[trackIdx];
+    const float* times = m_times.data() + track.StartOffset;
+    const uint32_t last = track.Length - 1;
+    float tLocal = t - track.T0;
+
+    // Before the start or (when not looping) after the end -- clamp to the first or last keyframe
+    if (tLocal <= times[0])
+    {
+        u = 0.0f;
+        return track.StartOffset;
+    }
+
+    if (tLocal >= times[last])
+    {
+        if (!track.Loop)
+        {
+            u = 1.0f;
+            return track.StartOffset + last - 1;
+        }
+
+        tLocal = times[0] + fmodf(tLocal - times[0], times[last] - times[0]);
+    }
+
+    // Time usually moves forward by less than a keyframe interval, so check the interval
+    // that was used last and the one after it before falling back to binary search
+    uint32_t c = m_cursors[trackIdx];
+
+    if (times[c] > tLocal || times[c + 1] <= tLocal)
+    {
+        if (c + 2 <= last && times[c + 1] <= tLocal && times[c + 2] > tLocal)
+            c++;
+        else
+        {
+            const int64_t idx = FindInterval(Span(times, track.Length), tLocal, [](float k) { return k; },
+                0, last - 1);
+            // Can only fail due to precision issues at the ends
+            c = idx == -1 ? (tLocal < times[1] ? 0 : last - 1) : (uint32_t)idx;
+        }
+
+        m_cursors[trackIdx] = c;
+    }
+
+    Assert(times[c] < times[c + 1], "divide-by-zero");
+    u = Min(Max((tLocal - times[c]) / (times[c + 1] - times[c]), 0.0f), 1.0f);
+
+    return track.StartOffset + c;
+}
+
+void AnimationTracks::SampleGroup(uint32_t firstTrack, float t, MutableSpan<AffineTransformation> out)
+{
+    const uint32_t numTracks = Min((uint32_t)NUM_LANES, (uint32_t)m_tracks.size() - firstTrack);
+    alignas(32) int keyIdx[NUM_LANES];
+    alignas(32) float u[NUM_LANES];
+
+    // Lanes past the last track redo the last track
+    for (int lane = 0; lane < NUM_LANES; lane++)
+    {
+        if (lane < (int)numTracks)
+            keyIdx[lane] = (int)FindKeyframe(firstTrack + lane, t, u[lane]);
+        else
+        {
+            keyIdx[lane] = keyIdx[numTracks - 1];
+            u[lane] = u[numTracks - 1];
+        }
+    }
+
+    const __m256i vIdx1 = _mm256_load_si256(reinterpret_cast<__m256i*>(keyIdx));
+    const __m256i vIdx2 = _mm256_add_epi32(vIdx1, _mm256_set1_epi32(1));
+    const __m256 vU = _mm256_load_ps(u);
+
+    __m256 vRes[COMPONENT::COUNT];
+    __m256 vQ2[4];
+
+    for (int c = 0; c < COMPONENT::COUNT; c++)
+    {
+        const float* keys = m_keys[c].data();
+        const __m256 v1 = _mm256_i32gather_ps(keys, vIdx1, sizeof(float));
+        const __m256 v2 = _mm256_i32gather_ps(keys, vIdx2, sizeof(float));
+
+        if (c >= COMPONENT::ROT_X && c <= COMPONENT::ROT_W)
+        {
+            vRes[c] = v1;
+            vQ2[c - COMPONENT::ROT_X] = v2;
+        }
+        else
+            vRes[c] = lerp(v1, v2, vU);
+    }
+
+    slerp(vRes + COMPONENT::ROT_X, vQ2, vU);
+
+    alignas(32) float res[COMPONENT::COUNT][NUM_LANES];
+
+    for (int c = 0; c < COMPONENT::COUNT; c++)
+        _mm256_store_ps(res[c], vRes[c]);
+
+    for (uint32_t lane = 0; lane < numTracks; lane++)
+    {
+        AffineTransformation& tr = out[firstTrack + lane];
+        tr.Scale = float3(res[COMPONENT::SCALE_X][lane], res[COMPONENT::SCALE_Y][lane],
+            res[COMPONENT::SCALE_Z][lane]);
+        tr.Rotation = float4(res[COMPONENT::ROT_X][lane], res[COMPONENT::ROT_Y][lane],
+            res[COMPONENT::ROT_Z][lane], res[COMPONENT::ROT_W][lane]);
+        tr.Translation = float3(res[COMPONENT::TR_X][lane], res[COMPONENT::TR_Y][lane],
+            res[COMPONENT::TR_Z][lane]);
+    }
+}
+
+void AnimationTracks::Sample(float t, MutableSpan<AffineTransformation> out, int maxNumThreads)
+{
+    // In groups of 8 tracks
+    constexpr size_t MIN_GROUPS_PER_CHUNK = 64;
+
+    Assert(out.size() >= m_tracks.size(), "Output is too small.");
+    const size_t numGroups = (m_tracks.size() + NUM_LANES - 1) / NUM_LANES;
+
+    // Every track (and its cursor) belongs to exactly one group
+    ParallelFor(0, numGroups, MIN_GROUPS_PER_CHUNK, [this, t, out](size_t begin, size_t end)
+        {
+            for (size_t g = begin; g < end; g++)
+                SampleGroup((uint32_t)(g * NUM_LANES), t, out);
+        }, maxNumThreads);
+}
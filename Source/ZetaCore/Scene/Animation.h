@@ -0,0 +1,90 @@
+#pragma once
+
+#include "../Math/Matrix.h"
+#include "../Utility/SmallVector.h"
+#include "../Utility/Span.h"
+
+namespace ZetaRay::Scene
+{
+    struct Keyframe
+    {
+        static Keyframe Identity()
+        {
+            Keyframe k;
+            k.Transform = Math::AffineTransformation::GetIdentity();
+
+            return k;
+        }
+
+        Math::AffineTransformation Transform;
+        float Time;
+    };
+}
+
+namespace ZetaRay::Scene::Internal
+{
+    // Keyframe animations of all the animated instances. Keyframes are stored as structure of
+    // arrays (one array per transformation component) and tracks are evaluated 8 at a time.
+    // Every track remembers the keyframe interval that was used last, so as long as time
+    // moves forward, finding the interval is usually O(1).
+    class AnimationTracks
+    {
+    public:
+        AnimationTracks() = default;
+        ~AnimationTracks() = default;
+
+        AnimationTracks(const AnimationTracks&) = delete;
+        AnimationTracks& operator=(const AnimationTracks&) = delete;
+
+        // Keyframe times are relative to t_start and must be sorted and distinct. Returns
+        // index of the new track.
+        uint32_t Add(Util::Span<Keyframe> keyframes, float t_start, bool loop);
+        // Evaluates every track at time t. "out[i]" receives the local transformation of
+        // the i'th track. maxNumThreads <= 0 uses all the worker threads.
+        void Sample(float t, Util::MutableSpan<Math::AffineTransformation> out,
+            int maxNumThreads = 0);
+        void Clear();
+
+        ZetaInline uint32_t NumTracks() const { return (uint32_t)m_tracks.size(); }
+        ZetaInline uint32_t NumKeyframes() const { return (uint32_t)m_times.size(); }
+
+    private:
+        // Scale, rotation (quaternion) and translation
+        enum COMPONENT
+        {
+            SCALE_X,
+            SCALE_Y,
+            SCALE_Z,
+            ROT_X,
+            ROT_Y,
+            ROT_Z,
+            ROT_W,
+            TR_X,
+            TR_Y,
+            TR_Z,
+            COUNT
+        };
+
+        static constexpr int NUM_LANES = 8;
+
+        // Offset into the keyframe arrays
+        struct Track
+        {
+            uint32_t StartOffset;
+            uint32_t Length;
+            float T0;
+            bool Loop;
+        };
+
+        // Returns offset of the first keyframe of the interval that contains t along with
+        // the interpolation weight between the two keyframes
+        uint32_t FindKeyframe(uint32_t trackIdx, float t, float& u);
+        void SampleGroup(uint32_t firstTrack, float t, Util::MutableSpan<Math::AffineTransformation> out);
+
+        Util::SmallVector<Track> m_tracks;
+        // Interval (relative to track's first keyframe) that was used last for each track
+        Util::SmallVector<uint32_t> m_cursors;
+        Util::SmallVector<float> m_times;
+        Util::SmallVector<float> m_keys[COMPONENT::COUNT];
+    };
+}
@@ -133,7 +133,12 @@ void MaterialBuffer::Add(uint32_t ID, const Material& mat)
     freeIdx += i << 6;        // Each uint64_t covers 64 slots
     Assert(freeIdx < MAX_NUM_MATERIALS, "Invalid table index.");
 
-    m_materials[ID] = Entry{ .Mat = mat, .GpuBufferIdx = freeIdx };
+    m_materials.insert_or_assign(ID, Entry{ .Mat = mat, .GpuBufferIdx = freeIdx });
+
+    if (freeIdx >= m_bufferCpu.size())
+        m_bufferCpu.resize(freeIdx + 1);
+
+    m_bufferCpu[freeIdx] = mat;
 }
 
 void MaterialBuffer::UploadToGPU()
@@ -141,36 +146,23 @@ void MaterialBuffer::UploadToGPU()
     // First time
     if (!m_buffer.IsInitialized())
     {
-        SmallVector<Material, FrameAllocator> buffer;
-        buffer.resize(m_materials.size());
-
-        // Convert hash table to array
-        for (auto it = m_materials.begin_it(); it < m_materials.end_it(); it = m_materials.next_it(it))
-        {
-            const uint32_t bufferIndex = it->Val.GpuBufferIdx;
-            buffer[bufferIndex] = it->Val.Mat;
-        }
-
         auto& renderer = App::GetRenderer();
-        const size_t sizeInBytes = buffer.size() * sizeof(Material);
+        const size_t sizeInBytes = m_bufferCpu.size() * sizeof(Material);
         m_buffer = GpuMemory::GetDefaultHeapBufferAndInit("MaterialBuffer",
             (uint32_t)sizeInBytes,
             false,
-            MemoryRegion{.Data = buffer.data(), .SizeInBytes = sizeInBytes });
+            MemoryRegion{.Data = m_bufferCpu.data(), .SizeInBytes = sizeInBytes });
 
         auto& r = renderer.GetSharedShaderResources();
         r.InsertOrAssignDefaultHeapBuffer(GlobalResource::MATERIAL_BUFFER, m_buffer);
+
+        m_staleMaterials.clear();
     }
-    // Update a single material
-    else if (m_staleID != UINT32_MAX)
+    // Update the modified materials
+    else if (!m_staleMaterials.empty())
     {
-        auto* entry = m_materials.find(m_staleID).value();
-
-        GpuMemory::UploadToDefaultHeapBuffer(m_buffer, sizeof(Material),
-            MemoryRegion{.Data = &entry->Mat, .SizeInBytes = sizeof(Material)}, 
-            sizeof(Material) * entry->GpuBufferIdx);
-
-        m_staleID = UINT32_MAX;
+        UploadDirtyRanges(m_bufferCpu.data(), m_staleMaterials,
+            GpuMemory::GetDefaultHeapUploader(m_buffer));
     }
 }
 
@@ -243,6 +235,29 @@ void MeshContainer::AddBatch(SmallVector<Model::glTF::Asset::Mesh>&& meshes,
         m_indices.append_range(indices.begin(), indices.end());
 }
 
+void MeshContainer::AddBatch(Span<uint64_t> meshIDs, Span<TriangleMesh> meshes, Span<Vertex> vertices, 
+    Span<uint32_t> indices)
+{
+    Assert(meshIDs.size() == meshes.size(), "Every mesh should have an ID.");
+
+    const uint32_t vtxOffset = (uint32_t)m_vertices.size();
+    const uint32_t idxOffset = (uint32_t)m_indices.size();
+    m_meshes.resize(meshes.size(), true);
+
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        TriangleMesh mesh = meshes[i];
+        mesh.m_vtxBuffStartOffset += vtxOffset;
+        mesh.m_idxBuffStartOffset += idxOffset;
+
+        bool success = m_meshes.try_emplace(meshIDs[i], mesh);
+        Assert(success, "Mesh with ID %llu already exists.", meshIDs[i]);
+    }
+
+    m_vertices.append_range(vertices.begin(), vertices.end(), true);
+    m_indices.append_range(indices.begin(), indices.end(), true);
+}
+
 void MeshContainer::Reserve(size_t numVertices, size_t numIndices)
 {
     m_vertices.reserve(numVertices);
@@ -358,20 +373,14 @@ void EmissiveBuffer::UploadToGPU()
         auto& r = App::GetRenderer().GetSharedShaderResources();
         r.InsertOrAssignDefaultHeapBuffer(GlobalResource::EMISSIVE_TRIANGLE_BUFFER, m_trisGpu);
     }
-    else if(m_staleNumTris > 0)
-    {
-        Assert(m_staleBaseOffset != UINT32_MAX, "Invalid base offset.");
-        const size_t numMbytes = sizeof(RT::EmissiveTriangle) * m_staleNumTris / (1024 * 1024);
-        LOG_UI_INFO("Uploading %d emissive triangles (%d MB)...", m_staleNumTris, numMbytes);
-
-        const size_t sizeInBytes = sizeof(RT::EmissiveTriangle) * m_staleNumTris;
-        GpuMemory::UploadToDefaultHeapBuffer(m_trisGpu, (uint32)sizeInBytes,
-            MemoryRegion{ .Data = &m_trisCpu[m_staleBaseOffset], .SizeInBytes = (uint32)sizeInBytes },
-            m_staleBaseOffset * sizeof(RT::EmissiveTriangle));
+    // Only upload the modified triangles
+    else if (!m_staleRanges.empty())
+        UploadModified(GpuMemory::GetDefaultHeapUploader(m_trisGpu));
+}
 
-        m_staleNumTris = 0;
-        m_staleBaseOffset = UINT32_MAX;
-    }
+size_t EmissiveBuffer::UploadModified(const BufferUploader& uploader)
+{
+    return UploadDirtyRanges(m_trisCpu.data(), m_staleRanges, uploader);
 }
 
 void EmissiveBuffer::Clear()
@@ -392,7 +401,8 @@ void EmissiveBuffer::UpdateMaterial(uint64_t instanceID, const float3& emissiveF
     const uint32 newEmissiveFactor = Float3ToRGB8(emissiveFactor);
     const half newStrength(strength);
 
-    m_staleBaseOffset = m_instances[idx].BaseTriOffset;
+    const uint32_t baseOffset = m_instances[idx].BaseTriOffset;
+    uint32_t numTris = 0;
 
     // Find every instance that uses this material
     while (idx < (int64)m_instances.size() && m_instances[idx].MaterialIdx == modifiedMatIdx)
@@ -405,15 +415,15 @@ void EmissiveBuffer::UpdateMaterial(uint64_t instanceID, const float3& emissiveF
             m_trisCpu[i].SetStrength(newStrength);
         }
 
-        m_staleNumTris += m_instances[idx].NumTriangles;
+        numTris += m_instances[idx].NumTriangles;
         idx++;
     } 
+
+    // Instances are sorted by material, so their triangles are contiguous
+    m_staleRanges.Add(baseOffset, numTris);
 }
 
-void EmissiveBuffer::UpdateTriPositions(size_t startIdx, size_t endIdx)
+void EmissiveBuffer::UpdateTriPositions(Span<EmissiveUpdate> updates, int maxNumThreads)
 {
-    Assert(endIdx <= m_trisCpu.size(), "Invalid index.");
-
-    m_staleBaseOffset = (uint32)startIdx;
-    m_staleNumTris = (uint32)(endIdx - startIdx);
+    TransformEmissiveTriangles(updates, m_triInitialPos, m_trisCpu, m_staleRanges, maxNumThreads);
 }
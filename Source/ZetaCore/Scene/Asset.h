@@ -1,9 +1,11 @@
 #pragma once
 
 #include "../Utility/HashTable.h"
+#include "../Utility/ConcurrentHashTable.h"
 #include "../Core/DescriptorHeap.h"
 #include "../Model/glTFAsset.h"
 #include "../RayTracing/RtCommon.h"
+#include "EmissiveUpdate.h"
 #include <Utility/Optional.h>
 
 namespace ZetaRay::Scene::Internal
@@ -75,25 +77,31 @@ namespace ZetaRay::Scene::Internal
         void Add(uint32_t ID, const Material& mat);
         void Update(uint32_t ID, const Material& mat)
         {
-            auto it = m_materials.find(ID);
-            it.value()->Mat = mat;
-            m_staleID = ID;
+            uint32_t bufferIdx = UINT32_MAX;
+            bool found = m_materials.modify(ID, [&mat, &bufferIdx](Entry& e)
+                {
+                    e.Mat = mat;
+                    bufferIdx = e.GpuBufferIdx;
+                });
+            Assert(found, "Material with ID %u was not found.", ID);
+
+            m_bufferCpu[bufferIdx] = mat;
+            m_staleMaterials.Add(bufferIdx);
         }
         void UploadToGPU();
         void ResizeAdditionalMaterials(uint32_t num);
         uint32_t NumMaterials() const { return (uint32_t)m_materials.size(); }
 
-        ZetaInline Util::Optional<const Material*> Get(uint32_t ID, uint32* bufferIdx = nullptr) const
+        // Safe to call while materials are being added or updated by other threads
+        ZetaInline Util::Optional<Material> Get(uint32_t ID, uint32* bufferIdx = nullptr) const
         {
-            auto it = m_materials.find(ID);
-            if (it)
+            auto entry = m_materials.find(ID);
+            if (entry)
             {
-                auto* entry = it.value();
-
                 if (bufferIdx)
-                    *bufferIdx = entry->GpuBufferIdx;
+                    *bufferIdx = entry.value().GpuBufferIdx;
 
-                return &entry->Mat;
+                return entry.value().Mat;
             }
 
             return {};
@@ -111,9 +119,15 @@ namespace ZetaRay::Scene::Internal
         static_assert(NUM_MASKS * 64 == MAX_NUM_MATERIALS, "these must match.");
         uint64_t m_inUseBitset[NUM_MASKS] = { 0 };
 
+        // Materials that are a few slots apart are uploaded with one copy
+        static constexpr uint32_t MAX_STALE_GAP = 4;
+
         Core::GpuMemory::Buffer m_buffer;
-        Util::HashTable<Entry, uint32_t> m_materials;
-        uint32 m_staleID = UINT32_MAX;
+        Util::ConcurrentHashTable<Entry, uint32_t> m_materials;
+        // CPU copy of the GPU buffer, indexed by Entry::GpuBufferIdx
+        Util::SmallVector<Material> m_bufferCpu;
+        // Materials that have changed since the last upload
+        Util::DirtyRanges m_staleMaterials{ MAX_STALE_GAP };
     };
 
     //--------------------------------------------------------------------------------------
@@ -127,18 +141,19 @@ namespace ZetaRay::Scene::Internal
         void AddBatch(Util::SmallVector<Model::glTF::Asset::Mesh>&& meshes, 
             Util::SmallVector<Core::Vertex>&& vertices,
             Util::SmallVector<uint32_t>&& indices);
+        // Mesh offsets are relative to the given vertex and index buffers
+        void AddBatch(Util::Span<uint64_t> meshIDs,
+            Util::Span<Model::TriangleMesh> meshes,
+            Util::Span<Core::Vertex> vertices,
+            Util::Span<uint32_t> indices);
         void Reserve(size_t numVertices, size_t numIndices);
         void RebuildBuffers();
         void Clear();
 
-        // Note: not thread safe for reading and writing at the same time
-        ZetaInline Util::Optional<const Model::TriangleMesh*> GetMesh(uint64_t id) const
+        // Safe to call while meshes are being added by other threads
+        ZetaInline Util::Optional<Model::TriangleMesh> GetMesh(uint64_t id) const
         {
-            auto it = m_meshes.find(id);
-            if (it)
-                return it.value();
-
-            return {};
+            return m_meshes.find(id);
         }
 
         const Core::GpuMemory::Buffer& GetVB() const { return m_vertexBuffer; }
@@ -146,7 +161,7 @@ namespace ZetaRay::Scene::Internal
         uint32_t NumMeshes() const { return (uint32_t)m_meshes.size(); }
 
     private:
-        Util::HashTable<Model::TriangleMesh> m_meshes;
+        Util::ConcurrentHashTable<Model::TriangleMesh> m_meshes;
         Util::SmallVector<Core::Vertex> m_vertices;
         Util::SmallVector<uint32_t> m_indices;
 
@@ -161,17 +176,6 @@ namespace ZetaRay::Scene::Internal
 
     struct EmissiveBuffer
     {
-        struct Triangle
-        {
-            // = CommittedPrimitiveIndex(): "...index of the primitive within the geometry 
-            // inside the bottom-level acceleration structure instance..."
-            uint32_t PrimIdx;
-            Math::float3 Vtx0;
-            unorm2_ V0V1;
-            unorm2_ V0V2;
-            half2_ EdgeLengths;
-        };
-
         using Instance = Model::glTF::Asset::EmissiveInstance;
 
         EmissiveBuffer() = default;
@@ -185,8 +189,8 @@ namespace ZetaRay::Scene::Internal
         ZetaInline uint32_t NumTriangles() const { return (uint32_t)m_trisCpu.size(); }
         ZetaInline Util::Span<Instance> Instances() { return m_instances; }
         ZetaInline Util::MutableSpan<RT::EmissiveTriangle> Triagnles() { return m_trisCpu; }
-        ZetaInline Util::MutableSpan<Triangle> InitialTriPositions() { return m_triInitialPos; }
-        ZetaInline bool HasStaleMaterials() const { return m_staleNumTris > 0; }
+        ZetaInline Util::MutableSpan<EmissiveTrianglePos> InitialTriPositions() { return m_triInitialPos; }
+        ZetaInline bool HasStaleMaterials() const { return !m_staleRanges.empty(); }
         ZetaInline Util::Optional<const Instance*> FindInstance(uint64_t ID)
         {
             auto it = m_idToIdxMap.find(ID);
@@ -199,19 +203,28 @@ namespace ZetaRay::Scene::Internal
         // Assumes proper GPU synchronization has been performed
         void Clear();
         void UpdateMaterial(uint64_t instanceID, const Math::float3& emissiveFactor, float strength);
-        void UpdateTriPositions(size_t startIdx, size_t endIdx);
+        // Transforms the triangles of the given instances to their new world positions. Only
+        // the modified triangles are uploaded by the next UploadToGPU() call. maxNumThreads <= 0
+        // uses all the worker threads.
+        void UpdateTriPositions(Util::Span<EmissiveUpdate> updates, int maxNumThreads = 0);
         void AddBatch(Util::SmallVector<Instance>&& instances,
             Util::SmallVector<RT::EmissiveTriangle>&& tris);
         void UploadToGPU();
+        // Uploads the triangles that have changed since the last upload to the given
+        // destination. Returns the number of uploaded bytes.
+        size_t UploadModified(const Core::BufferUploader& uploader);
 
     private:
+        // Triangles that are up to this many triangles apart are uploaded with one copy
+        static constexpr uint32_t MAX_STALE_GAP = 32;
+
         Util::SmallVector<Instance> m_instances;
         Util::SmallVector<RT::EmissiveTriangle> m_trisCpu;
-        Util::SmallVector<Triangle> m_triInitialPos;
+        Util::SmallVector<EmissiveTrianglePos> m_triInitialPos;
         // Maps instance ID to index in m_instances
         Util::HashTable<uint32_t> m_idToIdxMap;
         Core::GpuMemory::Buffer m_trisGpu;
-        uint32_t m_staleBaseOffset = UINT32_MAX;
-        uint32_t m_staleNumTris = 0;
+        // Triangles that have changed since the last upload
+        Util::DirtyRanges m_staleRanges{ MAX_STALE_GAP };
     };
 }
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include "EmissiveUpdate.h"
+#include "../App/App.h"
+#include "../Math/MatrixFuncs.h"
+#include "../Support/ParallelFor.h"
+#include <algorithm>
+#include <stddef.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::RT;
+using namespace ZetaRay::Scene::Internal;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+static_assert(ENCODE_EMISSIVE_POS == 1, "Emissive triangles are assumed to store encoded positions.");
+
+namespace
+{
+    static constexpr uint32_t NUM_LANES = 8;
+
+    // Initial positions are loaded with gathers, one 32-bit field at a time
+    static_assert(sizeof(EmissiveTrianglePos) % sizeof(int) == 0);
+    static constexpr int TRI_STRIDE = sizeof(EmissiveTrianglePos) / sizeof(int);
+
+    ZetaInline uint3 Pcg3d(uint3 v)
+    {
+        v = v * 1664525u + 1013904223u;
+        v.x += v.y * v.z;
+        v.y += v.z * v.x;
+        v.z += v.x * v.y;
+        v = v ^ (v >> 16u);
+        v.x += v.y * v.z;
+        v.y += v.z * v.x;
+        v.z += v.x * v.y;
+        return v;
+    }
+
+    // Same as Pcg3d(), only the x component is returned
+    ZetaInline __m256i __vectorcall Pcg3dX(__m256i vX, __m256i vY, __m256i vZ)
+    {
+        const __m256i vMul = _mm256_set1_epi32(1664525u);
+        const __m256i vAdd = _mm256_set1_epi32(1013904223u);
+        vX = _mm256_add_epi32(_mm256_mullo_epi32(vX, vMul), vAdd);
+        vY = _mm256_add_epi32(_mm256_mullo_epi32(vY, vMul), vAdd);
+        vZ = _mm256_add_epi32(_mm256_mullo_epi32(vZ, vMul), vAdd);
+
+        vX = _mm256_add_epi32(vX, _mm256_mullo_epi32(vY, vZ));
+        vY = _mm256_add_epi32(vY, _mm256_mullo_epi32(vZ, vX));
+        vZ = _mm256_add_epi32(vZ, _mm256_mullo_epi32(vX, vY));
+
+        vX = _mm256_xor_si256(vX, _mm256_srli_epi32(vX, 16));
+        vY = _mm256_xor_si256(vY, _mm256_srli_epi32(vY, 16));
+        vZ = _mm256_xor_si256(vZ, _mm256_srli_epi32(vZ, 16));
+
+        return _mm256_add_epi32(vX, _mm256_mullo_epi32(vY, vZ));
+    }
+
+    ZetaInline __m256 __vectorcall Abs(__m256 v)
+    {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+    }
+
+    // Decodes 8 octahedral-encoded directions that were quantized to pairs of 16-bit UNORMs.
+    // Same as decode_octahedral().
+    ZetaInline void __vectorcall DecodeOctahedral(__m256i vPacked, __m256& vX, __m256& vY, __m256& vZ)
+    {
+        const __m256 vOne = _mm256_set1_ps(1.0f);
+        const __m256 vZero = _mm256_setzero_ps();
+
+        // [0, 1] -> [-1, 1]
+        const __m256 vScale = _mm256_set1_ps(2.0f / ((1 << 16) - 1));
+        const __m256i vLow16 = _mm256_set1_epi32(0xffff);
+        const __m256 vU = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_and_si256(vPacked, vLow16)),
+            vScale, _mm256_set1_ps(-1.0f));
+        const __m256 vV = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(vPacked, 16)),
+            vScale, _mm256_set1_ps(-1.0f));
+
+        vZ = _mm256_sub_ps(_mm256_sub_ps(vOne, Abs(vU)), Abs(vV));
+        const __m256 vPosT = _mm256_min_ps(_mm256_max_ps(_mm256_sub_ps(vZero, vZ), vZero), vOne);
+        const __m256 vNegT = _mm256_sub_ps(vZero, vPosT);
+
+        // u >= 0 ? u - t : u + t
+        vX = _mm256_add_ps(vU, _mm256_blendv_ps(vPosT, vNegT, _mm256_cmp_ps(vU, vZero, _CMP_GE_OQ)));
+        vY = _mm256_add_ps(vV, _mm256_blendv_ps(vPosT, vNegT, _mm256_cmp_ps(vV, vZero, _CMP_GE_OQ)));
+
+        __m256 vLength = _mm256_mul_ps(vX, vX);
+        vLength = _mm256_fmadd_ps(vY, vY, vLength);
+        vLength = _mm256_fmadd_ps(vZ, vZ, vLength);
+        const __m256 vRcpLength = _mm256_div_ps(vOne, _mm256_sqrt_ps(vLength));
+
+        vX = _mm256_mul_ps(vX, vRcpLength);
+        vY = _mm256_mul_ps(vY, vRcpLength);
+        vZ = _mm256_mul_ps(vZ, vRcpLength);
+    }
+
+    // Inverse of the above. Same as encode_octahedral() followed by quantization to 16-bit
+    // UNORMs. Since octahedral encoding divides by the L1 norm, directions don't need to
+    // be normalized first.
+    ZetaInline __m256i __vectorcall EncodeOctahedral(__m256 vX, __m256 vY, __m256 vZ)
+    {
+        const __m256 vOne = _mm256_set1_ps(1.0f);
+        const __m256 vZero = _mm256_setzero_ps();
+
+        __m256 vL1 = _mm256_add_ps(_mm256_add_ps(Abs(vX), Abs(vY)), Abs(vZ));
+        // Avoid NaNs for degenerate triangles
+        vL1 = _mm256_max_ps(vL1, _mm256_set1_ps(FLT_MIN));
+        const __m256 vRcpL1 = _mm256_div_ps(vOne, vL1);
+        const __m256 vPosZx = _mm256_mul_ps(vX, vRcpL1);
+        const __m256 vPosZy = _mm256_mul_ps(vY, vRcpL1);
+
+        // v.z <= 0.0 ? 1.0 - abs(v.yx) * SignNotZero(v) : v
+        const __m256 vMinusOne = _mm256_set1_ps(-1.0f);
+        const __m256 vSignX = _mm256_blendv_ps(vMinusOne, vOne, _mm256_cmp_ps(vX, vZero, _CMP_GE_OQ));
+        const __m256 vSignY = _mm256_blendv_ps(vMinusOne, vOne, _mm256_cmp_ps(vY, vZero, _CMP_GE_OQ));
+        const __m256 vNegZx = _mm256_mul_ps(_mm256_sub_ps(vOne, Abs(vPosZy)), vSignX);
+        const __m256 vNegZy = _mm256_mul_ps(_mm256_sub_ps(vOne, Abs(vPosZx)), vSignY);
+        const __m256 vZLe0 = _mm256_cmp_ps(vZ, vZero, _CMP_LE_OQ);
+        const __m256 vEncodedX = _mm256_blendv_ps(vPosZx, vNegZx, vZLe0);
+        const __m256 vEncodedY = _mm256_blendv_ps(vPosZy, vNegZy, vZLe0);
+
+        // [-1, 1] -> [0, 1] -> UNORM-16
+        const __m256 vHalf = _mm256_set1_ps(0.5f);
+        const __m256 vMax = _mm256_set1_ps((1 << 16) - 1);
+        const __m256i vQx = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_fmadd_ps(vEncodedX, vHalf, vHalf), vMax));
+        const __m256i vQy = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_fmadd_ps(vEncodedY, vHalf, vHalf), vMax));
+
+        return _mm256_or_si256(vQx, _mm256_slli_epi32(vQy, 16));
+    }
+
+    // Converts 8 pairs of 16-bit floats, low halves go to vLo and high halves to vHi
+    ZetaInline void __vectorcall HalfToFloat(__m256i vPacked, __m256& vLo, __m256& vHi)
+    {
+        const __m256i vL = _mm256_and_si256(vPacked, _mm256_set1_epi32(0xffff));
+        const __m256i vH = _mm256_srli_epi32(vPacked, 16);
+        // Packing works on 128-bit lanes, so the result is (lo0-3, hi0-3, lo4-7, hi4-7)
+        __m256i v = _mm256_packus_epi32(vL, vH);
+        v = _mm256_permute4x64_epi64(v, 0xd8);
+
+        vLo = _mm256_cvtph_ps(_mm256_castsi256_si128(v));
+        vHi = _mm256_cvtph_ps(_mm256_extracti128_si256(v, 1));
+    }
+
+    // Inverse of the above
+    ZetaInline __m256i __vectorcall FloatToHalf(__m256 vLo, __m256 vHi)
+    {
+        const __m128i vLoHalf = _mm256_cvtps_ph(vLo, 0);
+        const __m128i vHiHalf = _mm256_cvtps_ph(vHi, 0);
+
+        return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_unpacklo_epi16(vLoHalf, vHiHalf)),
+            _mm_unpackhi_epi16(vLoHalf, vHiHalf), 1);
+    }
+
+    // Same as EmissiveTriangle::DecodeVertices() -> mul() -> EmissiveTriangle::StoreVertices()
+    // for up to 8 triangles at once. Instead of the three vertices, v0 and the two edges are
+    // transformed -- the latter without the translation -- which saves decoding v1 and v2 only
+    // to compute the edges again.
+    void TransformGroup(const __m256 vW[4][3], __m256i vInstanceID, const EmissiveTrianglePos* initialPos,
+        EmissiveTriangle* tris, uint32_t numTris)
+    {
+        // Lanes past the last triangle redo the last triangle
+        const __m256i vLane = _mm256_min_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+            _mm256_set1_epi32(numTris - 1));
+        const __m256i vIdx = _mm256_mullo_epi32(vLane, _mm256_set1_epi32(TRI_STRIDE));
+        const int* base = reinterpret_cast<const int*>(initialPos);
+
+        auto gather = [base, vIdx](size_t offsetInBytes)
+            {
+                return _mm256_i32gather_epi32(base + offsetInBytes / sizeof(int), vIdx, sizeof(int));
+            };
+
+        const size_t vtx0Offset = offsetof(EmissiveTrianglePos, Vtx0);
+        const __m256 vV0[3] = { _mm256_castsi256_ps(gather(vtx0Offset)),
+            _mm256_castsi256_ps(gather(vtx0Offset + sizeof(float))),
+            _mm256_castsi256_ps(gather(vtx0Offset + 2 * sizeof(float))) };
+
+        __m256 vEdge[2][3];
+        DecodeOctahedral(gather(offsetof(EmissiveTrianglePos, V0V1)), vEdge[0][0], vEdge[0][1], vEdge[0][2]);
+        DecodeOctahedral(gather(offsetof(EmissiveTrianglePos, V0V2)), vEdge[1][0], vEdge[1][1], vEdge[1][2]);
+
+        __m256 vLength[2];
+        HalfToFloat(gather(offsetof(EmissiveTrianglePos, EdgeLengths)), vLength[0], vLength[1]);
+
+        // Row vectors, same as mul(v_float4x4, __m128)
+        __m256 vV0W[3];
+        __m256 vEdgeW[2][3];
+
+        for (int c = 0; c < 3; c++)
+        {
+            vV0W[c] = _mm256_fmadd_ps(vV0[0], vW[0][c], vW[3][c]);
+            vV0W[c] = _mm256_fmadd_ps(vV0[1], vW[1][c], vV0W[c]);
+            vV0W[c] = _mm256_fmadd_ps(vV0[2], vW[2][c], vV0W[c]);
+        }
+
+        for (int e = 0; e < 2; e++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                vEdgeW[e][c] = _mm256_mul_ps(vEdge[e][0], vW[0][c]);
+                vEdgeW[e][c] = _mm256_fmadd_ps(vEdge[e][1], vW[1][c], vEdgeW[e][c]);
+                vEdgeW[e][c] = _mm256_fmadd_ps(vEdge[e][2], vW[2][c], vEdgeW[e][c]);
+                vEdgeW[e][c] = _mm256_mul_ps(vEdgeW[e][c], vLength[e]);
+            }
+
+            __m256 vLength2 = _mm256_mul_ps(vEdgeW[e][0], vEdgeW[e][0]);
+            vLength2 = _mm256_fmadd_ps(vEdgeW[e][1], vEdgeW[e][1], vLength2);
+            vLength2 = _mm256_fmadd_ps(vEdgeW[e][2], vEdgeW[e][2], vLength2);
+            vLength[e] = _mm256_sqrt_ps(vLength2);
+        }
+
+        alignas(32) float v0[3][NUM_LANES];
+        alignas(32) uint32_t v0v1[NUM_LANES];
+        alignas(32) uint32_t v0v2[NUM_LANES];
+        alignas(32) uint32_t edgeLengths[NUM_LANES];
+        alignas(32) uint32_t IDs[NUM_LANES];
+
+        for (int c = 0; c < 3; c++)
+            _mm256_store_ps(v0[c], vV0W[c]);
+
+        _mm256_store_si256(reinterpret_cast<__m256i*>(v0v1),
+            EncodeOctahedral(vEdgeW[0][0], vEdgeW[0][1], vEdgeW[0][2]));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(v0v2),
+            EncodeOctahedral(vEdgeW[1][0], vEdgeW[1][1], vEdgeW[1][2]));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(edgeLengths), FloatToHalf(vLength[0], vLength[1]));
+
+        // Dynamic instances have geometry index = 0
+        const __m256i vPrimIdx = gather(offsetof(EmissiveTrianglePos, PrimIdx));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(IDs), Pcg3dX(_mm256_setzero_si256(), vInstanceID, vPrimIdx));
+
+        for (uint32_t lane = 0; lane < numTris; lane++)
+        {
+            EmissiveTriangle& tri = tris[lane];
+            tri.Vtx0 = float3(v0[0][lane], v0[1][lane], v0[2][lane]);
+            memcpy(&tri.V0V1, &v0v1[lane], sizeof(uint32_t));
+            memcpy(&tri.V0V2, &v0v2[lane], sizeof(uint32_t));
+            memcpy(&tri.EdgeLengths, &edgeLengths[lane], sizeof(uint32_t));
+            tri.ID = IDs[lane];
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Emissive updates
+//--------------------------------------------------------------------------------------
+
+void Scene::Internal::InitEmissiveTriangles(const float4x3& toWorld, uint32_t geometryIndex,
+    uint32_t rtInstanceID, MutableSpan<EmissiveTriangle> tris, MutableSpan<EmissiveTrianglePos> initialPos)
+{
+    Assert(tris.size() == initialPos.size(), "Every triangle should have an initial position.");
+
+    const v_float4x4 vW = load4x3(toWorld);
+    const bool skipTransform = equal(vW, identity());
+
+    for (size_t t = 0; t < tris.size(); t++)
+    {
+        // Needed by later updates even if the instance doesn't move initially
+        initialPos[t].Vtx0 = tris[t].Vtx0;
+        initialPos[t].V0V1 = tris[t].V0V1;
+        initialPos[t].V0V2 = tris[t].V0V2;
+        initialPos[t].EdgeLengths = tris[t].EdgeLengths;
+        initialPos[t].PrimIdx = tris[t].ID;
+
+        if (!skipTransform)
+        {
+            __m128 vV0;
+            __m128 vV1;
+            __m128 vV2;
+            tris[t].LoadVertices(vV0, vV1, vV2);
+
+            vV0 = mul(vW, vV0);
+            vV1 = mul(vW, vV1);
+            vV2 = mul(vW, vV2);
+            tris[t].StoreVertices(vV0, vV1, vV2);
+        }
+
+        const uint32_t hash = Pcg3d(uint3(geometryIndex, rtInstanceID, tris[t].ID)).x;
+
+        Assert(!tris[t].IsIDPatched(), 
+            "Rewriting emissive triangle ID after the first assignment is invalid.");
+        tris[t].ResetID(hash);
+    }
+}
+
+void Scene::Internal::TransformEmissiveTriangles(Span<EmissiveUpdate> updates, Span<EmissiveTrianglePos> initialPos,
+    MutableSpan<EmissiveTriangle> tris, DirtyRanges& dirtyRanges, int maxNumThreads)
+{
+    constexpr size_t MIN_TRIS_PER_CHUNK = 1024;
+
+    if (updates.size() == 0)
+        return;
+
+    Assert(initialPos.size() == tris.size(), "Every triangle should have an initial position.");
+
+    // Position of each update's triangles if they were laid out back to back
+    SmallVector<uint32_t, App::FrameAllocator> triOffsets;
+    triOffsets.resize(updates.size() + 1);
+    triOffsets[0] = 0;
+
+    for (size_t i = 0; i < updates.size(); i++)
+    {
+        Assert(updates[i].BaseTriOffset + updates[i].NumTriangles <= tris.size(), "Out-of-bound access.");
+        triOffsets[i + 1] = triOffsets[i] + updates[i].NumTriangles;
+    }
+
+    const uint32_t numTris = triOffsets[updates.size()];
+
+    ParallelFor(0, numTris, MIN_TRIS_PER_CHUNK, [updates, initialPos, tris, &triOffsets](size_t begin, size_t end)
+        {
+            // Update that the first triangle of this chunk belongs to
+            size_t u = std::upper_bound(triOffsets.begin(), triOffsets.end(), (uint32_t)begin) -
+                triOffsets.begin() - 1;
+
+            for (; u < updates.size() && triOffsets[u] < end; u++)
+            {
+                const EmissiveUpdate& update = updates[u];
+                const uint32_t first = update.BaseTriOffset + (uint32_t)Max(begin, (size_t)triOffsets[u]) -
+                    triOffsets[u];
+                const uint32_t last = update.BaseTriOffset + (uint32_t)Min(end, (size_t)triOffsets[u + 1]) -
+                    triOffsets[u];
+
+                __m256 vW[4][3];
+
+                for (int r = 0; r < 4; r++)
+                {
+                    vW[r][0] = _mm256_set1_ps(update.ToWorld.m[r].x);
+                    vW[r][1] = _mm256_set1_ps(update.ToWorld.m[r].y);
+                    vW[r][2] = _mm256_set1_ps(update.ToWorld.m[r].z);
+                }
+
+                const __m256i vInstanceID = _mm256_set1_epi32(update.RtInstanceID);
+
+                for (uint32_t t = first; t < last; t += NUM_LANES)
+                {
+                    TransformGroup(vW, vInstanceID, &initialPos[t], &tris[t],
+                        Min(NUM_LANES, last - t));
+                }
+            }
+        }, maxNumThreads);
+
+    for (auto& update : updates)
+        dirtyRanges.Add(update.BaseTriOffset, update.NumTriangles);
+}
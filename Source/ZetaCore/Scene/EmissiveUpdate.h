@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../RayTracing/RtCommon.h"
+#include "../Utility/DirtyRanges.h"
+
+namespace ZetaRay::Scene::Internal
+{
+    // Object-space position of an emissive triangle, encoded the same way as RT::EmissiveTriangle
+    struct EmissiveTrianglePos
+    {
+        // = CommittedPrimitiveIndex(): "...index of the primitive within the geometry
+        // inside the bottom-level acceleration structure instance..."
+        uint32_t PrimIdx;
+        Math::float3 Vtx0;
+        unorm2_ V0V1;
+        unorm2_ V0V2;
+        half2_ EdgeLengths;
+    };
+
+    // Emissive instance whose world transformation has changed
+    struct EmissiveUpdate
+    {
+        Math::float4x3 ToWorld;
+        uint32_t BaseTriOffset;
+        uint32_t NumTriangles;
+        // Needed for computing the triangle IDs
+        uint32_t RtInstanceID;
+    };
+
+    // Called once for every emissive instance before any updates. Keeps object-space positions
+    // of the instance's triangles in "initialPos" (for the later updates), transforms the
+    // triangles to world space and replaces their IDs with a hash of the instance's RT-AS
+    // info, as IDs have to be unique across the scene.
+    void InitEmissiveTriangles(const Math::float4x3& toWorld, uint32_t geometryIndex,
+        uint32_t rtInstanceID, Util::MutableSpan<RT::EmissiveTriangle> tris,
+        Util::MutableSpan<EmissiveTrianglePos> initialPos);
+
+    // Applies the new world transformation of every update to the object-space positions of
+    // its triangles and writes the results to "tris". Work is split into chunks of triangles
+    // rather than instances, so a few instances with many triangles still use all the threads.
+    // Updated triangles are added to "dirtyRanges". maxNumThreads <= 0 uses all the worker
+    // threads.
+    void TransformEmissiveTriangles(Util::Span<EmissiveUpdate> updates,
+        Util::Span<EmissiveTrianglePos> initialPos,
+        Util::MutableSpan<RT::EmissiveTriangle> tris,
+        Util::DirtyRanges& dirtyRanges,
+        int maxNumThreads = 0);
+}
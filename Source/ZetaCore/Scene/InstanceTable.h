@@ -0,0 +1,104 @@
+#pragma once
+
+#include "SceneCommon.h"
+#include "../Utility/SmallVector.h"
+#include "../Utility/ConcurrentHashTable.h"
+
+namespace ZetaRay::Scene
+{
+    // Position of an instance in the scene graph
+    struct TreePos
+    {
+        uint32_t Level;
+        uint32_t Offset;
+    };
+
+    // Maps instance handles to their position in the scene graph and instance IDs to handles.
+    // Handle lookups go through an array of slots, so they don't involve any hashing.
+    //  - Find() only reads the hash table and can run concurrently with Add().
+    //  - Everything else reads the slots, which Add() may reallocate and ShiftRight() modifies,
+    //    so while instances could be added from other threads, callers must hold the same
+    //    lock as the writer.
+    //  - Instances are never removed, so slots aren't recycled and generation stays at zero
+    //    for now. Stale or out-of-range handles are still rejected in release builds.
+    class InstanceTable
+    {
+    public:
+        // Makes room for n more instances
+        void Reserve(size_t n)
+        {
+            m_slots.reserve(m_slots.size() + n);
+            m_IDtoHandle.resize(m_slots.size() + n, true);
+        }
+
+        // Slot that the next call to Add() is going to use
+        ZetaInline uint32_t NextSlot() const { return (uint32_t)m_slots.size(); }
+
+        InstanceHandle Add(uint64_t id, TreePos pos)
+        {
+            Assert(!m_IDtoHandle.find(id), "instance with id %llu already exists.", id);
+
+            const InstanceHandle h{ .Index = (uint32_t)m_slots.size(), .Generation = 0 };
+            m_slots.push_back(Slot{ .Pos = pos, .Generation = h.Generation });
+            m_IDtoHandle.insert_or_assign(id, h);
+
+            return h;
+        }
+
+        // Instance at the given slot was moved one position to the right within its level
+        ZetaInline void ShiftRight(uint32_t slot)
+        {
+            m_slots[slot].Pos.Offset++;
+        }
+
+        ZetaInline Util::Optional<InstanceHandle> Find(uint64_t id) const
+        {
+            return m_IDtoHandle.find(id);
+        }
+
+        ZetaInline bool IsValid(InstanceHandle h) const
+        {
+            return h.Index < m_slots.size() && m_slots[h.Index].Generation == h.Generation;
+        }
+
+        ZetaInline TreePos Pos(InstanceHandle h) const
+        {
+            Check(IsValid(h), "Invalid or stale instance handle (index: %u, generation: %u).",
+                h.Index, h.Generation);
+
+            return m_slots[h.Index].Pos;
+        }
+        ZetaInline TreePos Pos(uint32_t slot) const
+        {
+            Assert(slot < m_slots.size(), "Out-of-bound access.");
+            return m_slots[slot].Pos;
+        }
+        ZetaInline Util::Optional<TreePos> PosFromID(uint64_t id) const
+        {
+            auto h = m_IDtoHandle.find(id);
+            if (h)
+                return Pos(h.value());
+
+            return {};
+        }
+
+        ZetaInline InstanceHandle Handle(uint32_t slot) const
+        {
+            Assert(slot < m_slots.size(), "Out-of-bound access.");
+            return InstanceHandle{ .Index = slot, .Generation = m_slots[slot].Generation };
+        }
+
+        ZetaInline size_t size() const { return m_slots.size(); }
+        ZetaInline bool empty() const { return m_slots.empty(); }
+
+    private:
+        struct Slot
+        {
+            TreePos Pos;
+            uint32_t Generation;
+        };
+
+        Util::SmallVector<Slot> m_slots;
+        Util::ConcurrentHashTable<InstanceHandle> m_IDtoHandle;
+    };
+}
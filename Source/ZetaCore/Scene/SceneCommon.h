@@ -8,4 +8,20 @@ namespace ZetaRay::Scene
     static constexpr uint64_t INVALID_MESH = UINT64_MAX;
     static constexpr uint32_t DEFAULT_MATERIAL_ID = 0;
     static constexpr uint32_t DEFAULT_SCENE_ID = 0;
+
+    // Refers to an instance slot in the scene. Slot's tree position is kept in sync as 
+    // instances are inserted, so resolving a handle doesn't involve any hashing.
+    struct InstanceHandle
+    {
+        static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
+
+        ZetaInline bool IsValid() const { return Index != INVALID_INDEX; }
+        ZetaInline bool operator==(const InstanceHandle& other) const
+        {
+            return Index == other.Index && Generation == other.Generation;
+        }
+
+        uint32_t Index = INVALID_INDEX;
+        uint32_t Generation = 0;
+    };
 }
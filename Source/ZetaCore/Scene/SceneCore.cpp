@@ -2,7 +2,9 @@
 #include "../Math/CollisionFuncs.h"
 #include "../Math/Quaternion.h"
 #include "../Support/Task.h"
+#include "../Support/ParallelFor.h"
 #include "Camera.h"
+#include "TransformPropagation.h"
 #include <App/Timer.h>
 #include <Support/Param.h>
 #include <algorithm>
@@ -20,22 +22,6 @@ using namespace ZetaRay::Util;
 using namespace ZetaRay::Math;
 using namespace ZetaRay::App;
 
-namespace
-{
-    ZetaInline uint3 Pcg3d(uint3 v)
-    {
-        v = v * 1664525u + 1013904223u;
-        v.x += v.y * v.z;
-        v.y += v.z * v.x;
-        v.z += v.x * v.y;
-        v = v ^ (v >> 16u);
-        v.x += v.y * v.z;
-        v.y += v.z * v.x;
-        v.z += v.x * v.y;
-        return v;
-    }
-}
-
 //--------------------------------------------------------------------------------------
 // Scene
 //--------------------------------------------------------------------------------------
@@ -109,14 +95,17 @@ void SceneCore::Update(double dt, TaskSet& sceneTS, TaskSet& sceneRendererTS)
             if (m_rebuildBVHFlag)
                 InitWorldTransformations();
 
-            if (m_animate)
+            ResizeDirtyBitsets();
+            bool animated = false;
+
+            if (m_animate && m_animations.NumTracks())
             {
-                SmallVector<AnimationUpdate, App::FrameAllocator> animUpdates;
-                UpdateAnimations((float)App::GetTimer().GetTotalTime(), animUpdates);
-                UpdateLocalTransforms(animUpdates);
+                ApplyAnimations(m_animations, (float)App::GetTimer().GetTotalTime(), 
+                    m_animatedInstances, m_instances, m_sceneGraph);
+                animated = true;
             }
 
-            if (!m_instanceUpdates.empty())
+            if (!m_instanceUpdates.empty() || animated)
             {
                 SmallVector<BVH::BVHUpdateInput, App::FrameAllocator> toUpdateInstances;
                 UpdateWorldTransformations(toUpdateInstances);
@@ -129,7 +118,11 @@ void SceneCore::Update(double dt, TaskSet& sceneTS, TaskSet& sceneRendererTS)
     m_staleEmissiveMats = m_emissives.HasStaleMaterials() || !m_emissives.Initialized();
     // Size of m_instanceUpdates may change after async. task above runs, but since it never
     // goes from > 0 to 0, it doesn't matter
-    m_staleEmissivePositions = m_staleEmissivePositions || !m_emissives.Initialized();
+    // Which emissives have moved is only known after world transformations are updated, so
+    // schedule an update whenever that may happen -- it returns early if none did. This also
+    // covers emissives that move due to animation or because an ancestor was transformed.
+    m_staleEmissivePositions = m_staleEmissivePositions || !m_emissives.Initialized() ||
+        !m_instanceUpdates.empty() || (m_animate && m_animations.NumTracks());
 
     if (!m_emissives.Initialized() && numInstances)
     {
@@ -174,76 +167,38 @@ void SceneCore::Update(double dt, TaskSet& sceneTS, TaskSet& sceneRendererTS)
         // Full rebuild of emissive buffer for first time
         if (!m_emissives.Initialized())
         {
-            constexpr size_t MAX_NUM_EMISSIVE_WORKERS = 5;
-            constexpr size_t MIN_EMISSIVE_INSTANCES_PER_WORKER = 35;
-            size_t threadOffsets[MAX_NUM_EMISSIVE_WORKERS];
-            size_t threadSizes[MAX_NUM_EMISSIVE_WORKERS];
-
-            const size_t numEmissiveWorkers = SubdivideRangeWithMin(numInstances,
-                MAX_NUM_EMISSIVE_WORKERS,
-                threadOffsets,
-                threadSizes,
-                MIN_EMISSIVE_INSTANCES_PER_WORKER);
-
-            for (size_t i = 0; i < numEmissiveWorkers; i++)
-            {
-                StackStr(tname, n, "Scene::Emissive_%d", i);
-
-                auto h = sceneTS.EmplaceTask(tname, [this, offset = threadOffsets[i], size = threadSizes[i]]()
-                    {
-                        auto emissvies = m_emissives.Instances();
-                        auto tris = m_emissives.Triagnles();
-                        auto triInitialPos = m_emissives.InitialTriPositions();
-                        v_float4x4 I = identity();
+            auto h = sceneTS.EmplaceTask("Scene::Emissive", [this, numInstances]()
+                {
+                    constexpr size_t MIN_EMISSIVE_INSTANCES_PER_CHUNK = 32;
 
-                        // For every emissive instance, apply world transformation to all of its triangles
-                        for (size_t instance = offset; instance < offset + size; instance++)
+                    ParallelFor(0, numInstances, MIN_EMISSIVE_INSTANCES_PER_CHUNK,
+                        [this](size_t begin, size_t end)
                         {
-                            const auto& e = emissvies[instance];
-                            const v_float4x4 vW = load4x3(GetToWorld(e.InstanceID));
-                            const bool skipTransform = equal(vW, I);
+                            auto emissives = m_emissives.Instances();
+                            auto tris = m_emissives.Triagnles();
+                            auto triInitialPos = m_emissives.InitialTriPositions();
 
-                            const auto rtASInfo = GetInstanceRtASInfo(e.InstanceID);
-
-                            for (size_t t = e.BaseTriOffset; t < e.BaseTriOffset + e.NumTriangles; t++)
+                            // For every emissive instance, apply world transformation to all of its triangles
+                            for (size_t instance = begin; instance < end; instance++)
                             {
-                                if (!skipTransform)
-                                {
-                                    __m128 vV0;
-                                    __m128 vV1;
-                                    __m128 vV2;
-                                    tris[t].LoadVertices(vV0, vV1, vV2);
-
-                                    triInitialPos[t].Vtx0 = tris[t].Vtx0;
-                                    triInitialPos[t].V0V1 = tris[t].V0V1;
-                                    triInitialPos[t].V0V2 = tris[t].V0V2;
-                                    triInitialPos[t].EdgeLengths = tris[t].EdgeLengths;
-                                    triInitialPos[t].PrimIdx = tris[t].ID;
-
-                                    vV0 = mul(vW, vV0);
-                                    vV1 = mul(vW, vV1);
-                                    vV2 = mul(vW, vV2);
-                                    tris[t].StoreVertices(vV0, vV1, vV2);
-                                }
-
-                                const uint32_t hash = Pcg3d(uint3(rtASInfo.GeometryIndex, 
-                                    rtASInfo.InstanceID,
-                                    tris[t].ID)).x;
+                                const auto& e = emissives[instance];
+                                const InstanceHandle h = GetInstanceHandle(e.InstanceID).value();
+                                const auto rtASInfo = GetInstanceRtASInfo(h);
 
-                                Assert(!tris[t].IsIDPatched(), 
-                                    "Rewriting emissive triangle ID after the first assignment is invalid.");
-                                tris[t].ResetID(hash);
+                                InitEmissiveTriangles(GetToWorld(h), rtASInfo.GeometryIndex, 
+                                    rtASInfo.InstanceID,
+                                    MutableSpan(tris.data() + e.BaseTriOffset, e.NumTriangles),
+                                    MutableSpan(triInitialPos.data() + e.BaseTriOffset, e.NumTriangles));
                             }
-                        }
-                    });
+                        });
+                });
 
-                sceneTS.AddOutgoingEdge(updateWorldTransforms, h);
+            sceneTS.AddOutgoingEdge(updateWorldTransforms, h);
 
-                Assert(resetRtAsInfo != TaskSet::INVALID_TASK_HANDLE, "Invalid task handle.");
-                sceneTS.AddOutgoingEdge(resetRtAsInfo, h);
+            Assert(resetRtAsInfo != TaskSet::INVALID_TASK_HANDLE, "Invalid task handle.");
+            sceneTS.AddOutgoingEdge(resetRtAsInfo, h);
 
-                sceneTS.AddOutgoingEdge(h, upload);
-            }
+            sceneTS.AddOutgoingEdge(h, upload);
         }
         else if (m_staleEmissivePositions)
         {
@@ -253,6 +208,7 @@ void SceneCore::Update(double dt, TaskSet& sceneTS, TaskSet& sceneRendererTS)
                 });
 
             //sceneTS.AddOutgoingEdge(resetRtAsInfo, h);
+            sceneTS.AddOutgoingEdge(updateWorldTransforms, h);
             sceneTS.AddOutgoingEdge(h, upload);
         }
 
@@ -320,6 +276,19 @@ void SceneCore::AddMeshes(SmallVector<Asset::Mesh>&& meshes, SmallVector<Vertex>
         ReleaseSRWLockExclusive(&m_meshLock);
 }
 
+void SceneCore::AddMeshes(Span<uint64_t> meshIDs, Span<TriangleMesh> meshes, Span<Vertex> vertices,
+    Span<uint32_t> indices, bool lock)
+{
+    if (lock)
+        AcquireSRWLockExclusive(&m_meshLock);
+
+    m_numTriangles += (uint32_t)indices.size();
+    m_meshes.AddBatch(meshIDs, meshes, vertices, indices);
+
+    if (lock)
+        ReleaseSRWLockExclusive(&m_meshLock);
+}
+
 void SceneCore::AddMaterial(const Asset::MaterialDesc& matDesc, bool lock)
 {
     Material mat;
@@ -444,7 +413,7 @@ void SceneCore::ResizeAdditionalMaterials(uint32_t num)
     m_matBuffer.ResizeAdditionalMaterials(num);
 }
 
-void SceneCore::AddInstance(Asset::InstanceDesc& instance, bool lock)
+InstanceHandle SceneCore::AddInstance(Asset::InstanceDesc& instance, bool lock)
 {
     const uint64_t meshID = instance.MeshIdx == -1 ? INVALID_MESH :
         MeshID(instance.SceneID, instance.MeshIdx, instance.MeshPrimIdx);
@@ -452,58 +421,209 @@ void SceneCore::AddInstance(Asset::InstanceDesc& instance, bool lock)
     if (lock)
         AcquireSRWLockExclusive(&m_instanceLock);
 
-    if (meshID != INVALID_MESH)
-    {
-        m_meshBufferStale = true;
+    const InstanceHandle h = AddInstance(instance.ID, instance.ParentID, instance.LocalTransform,
+        meshID, instance.RtMeshMode, instance.RtInstanceMask, instance.IsOpaque);
 
-        if (instance.RtMeshMode == RT_MESH_MODE::STATIC)
-        {
-            m_numStaticInstances++;
-            m_numOpaqueInstances += instance.IsOpaque;
-            m_numNonOpaqueInstances += !instance.IsOpaque;
-        }
-        else
-            m_numDynamicInstances++;
-    }
+    if (lock)
+        ReleaseSRWLockExclusive(&m_instanceLock);
+
+    return h;
+}
+
+InstanceHandle SceneCore::AddInstance(uint64_t id, uint64_t parentID, AffineTransformation& localTransform,
+    uint64_t meshID, RT_MESH_MODE rtMeshMode, uint8_t rtInstanceMask, bool isOpaque)
+{
+    CountInstance(meshID, rtMeshMode, isOpaque);
 
     uint32_t treeLevel = 1;
     uint32_t parentIdx = 0;
 
     // Get parent's index from the hashmap
-    if (instance.ParentID != ROOT_ID)
+    if (parentID != ROOT_ID)
     {
-        const TreePos& p = FindTreePosFromID(instance.ParentID).value();
+        const TreePos p = FindTreePosFromID(parentID).value();
 
         treeLevel = p.Level + 1;
         parentIdx = p.Offset;
     }
 
-    const uint32_t insertIdx = InsertAtLevel(instance.ID, treeLevel, parentIdx, instance.LocalTransform, meshID,
-        instance.RtMeshMode, instance.RtInstanceMask, instance.IsOpaque);
+    Assert(!m_instances.Find(id), "instance with id %llu already exists.", id);
+
+    const uint32_t slot = m_instances.NextSlot();
+    const uint32_t insertIdx = InsertAtLevel(id, slot, treeLevel, parentIdx, 
+        localTransform, meshID, rtMeshMode, rtInstanceMask, isOpaque);
+
+    const InstanceHandle h = m_instances.Add(id, TreePos{ .Level = treeLevel, .Offset = insertIdx });
+
+    // Adjust tree positions of shifted instances
+    auto& currLevel = m_sceneGraph[treeLevel];
+    for (size_t i = insertIdx + 1; i < currLevel.m_slots.size(); i++)
+        m_instances.ShiftRight(currLevel.m_slots[i]);
+
+    m_rebuildBVHFlag = true;
+
+    return h;
+}
+
+void SceneCore::CountInstance(uint64_t meshID, RT_MESH_MODE rtMeshMode, bool isOpaque)
+{
+    if (meshID == INVALID_MESH)
+        return;
+
+    m_meshBufferStale = true;
+
+    if (rtMeshMode == RT_MESH_MODE::STATIC)
+    {
+        m_numStaticInstances++;
+        m_numOpaqueInstances += isOpaque;
+        m_numNonOpaqueInstances += !isOpaque;
+    }
+    else
+        m_numDynamicInstances++;
+}
+
+void SceneCore::AddInstances(const SceneGraphDesc& sceneGraph, bool lock)
+{
+    const size_t numInstances = sceneGraph.IDs.size();
+    Assert(sceneGraph.LocalTransforms.size() == numInstances && sceneGraph.MeshIDs.size() == numInstances &&
+        sceneGraph.Parents.size() == numInstances && sceneGraph.RtFlags.size() == numInstances,
+        "Every instance should have an entry in each array.");
+
+    if (numInstances == 0)
+        return;
 
-    // Update instance "dictionary"
+    if (lock)
+        AcquireSRWLockExclusive(&m_instanceLock);
+
+    if (m_instances.empty())
+        AddSceneGraph(sceneGraph);
+    else
     {
-        Assert(!m_IDtoTreePos.find(instance.ID), "instance with id %llu already exists.", instance.ID);
-        m_IDtoTreePos.insert_or_assign(instance.ID, TreePos{ .Level = treeLevel, .Offset = insertIdx });
+        // Preallocate
+        m_sceneGraph.resize(Max(m_sceneGraph.size(), sceneGraph.LevelSizes.size() + 1));
 
-        // Adjust tree positions of shifted instances
-        for (size_t i = insertIdx + 1; i < m_sceneGraph[treeLevel].m_IDs.size(); i++)
+        for (size_t i = 0; i < sceneGraph.LevelSizes.size(); i++)
         {
-            uint64_t insID = m_sceneGraph[treeLevel].m_IDs[i];
-            auto pos = m_IDtoTreePos.find(insID);
+            auto& level = m_sceneGraph[i + 1];
+            const size_t n = level.m_IDs.size() + sceneGraph.LevelSizes[i];
+
+            level.m_IDs.reserve(n);
+            level.m_localTransforms.reserve(n);
+            level.m_meshIDs.reserve(n);
+            level.m_rtASInfo.reserve(n);
+            level.m_rtFlags.reserve(n);
+            level.m_subtreeRanges.reserve(n);
+            level.m_toWorlds.reserve(n);
+            level.m_prevToWorlds.reserve(n);
+            level.m_slots.reserve(n);
+            level.m_parents.reserve(n);
+        }
+
+        m_instances.Reserve(numInstances);
+
+        // Parents are inserted before their children, since levels are processed in order
+        size_t levelBase = 0;
+        size_t prevLevelBase = 0;
+
+        for (size_t l = 0; l < sceneGraph.LevelSizes.size(); l++)
+        {
+            for (size_t i = levelBase; i < levelBase + sceneGraph.LevelSizes[l]; i++)
+            {
+                const uint64_t parentID = l == 0 ? ROOT_ID : 
+                    sceneGraph.IDs[prevLevelBase + sceneGraph.Parents[i]];
+                const RT_Flags flags = RT_Flags::Decode(sceneGraph.RtFlags[i]);
+                AffineTransformation tr = sceneGraph.LocalTransforms[i];
 
-            // Shift tree position to right
-            pos.value()->Offset++;
+                AddInstance(sceneGraph.IDs[i], parentID, tr, sceneGraph.MeshIDs[i], flags.MeshMode,
+                    flags.InstanceMask, flags.IsOpaque);
+            }
+
+            prevLevelBase = levelBase;
+            levelBase += sceneGraph.LevelSizes[l];
         }
     }
 
-    m_rebuildBVHFlag = true;
-
     if (lock)
         ReleaseSRWLockExclusive(&m_instanceLock);
 }
 
-uint32_t SceneCore::InsertAtLevel(uint64_t id, uint32_t treeLevel, uint32_t parentIdx, 
+void SceneCore::AddSceneGraph(const SceneGraphDesc& sceneGraph)
+{
+    const size_t numInstances = sceneGraph.IDs.size();
+    const size_t numLevels = sceneGraph.LevelSizes.size();
+    const float4x3 I = float4x3(store(identity()));
+
+    m_sceneGraph.resize(Max(m_sceneGraph.size(), numLevels + 1));
+    m_sceneGraph[0].m_subtreeRanges[0] = Range(0, sceneGraph.LevelSizes[0]);
+
+    m_instances.Reserve(numInstances);
+    m_worldTransformUpdates.resize(Min(numInstances, 32llu));
+
+    size_t levelBase = 0;
+
+    for (size_t l = 0; l < numLevels; l++)
+    {
+        auto& level = m_sceneGraph[l + 1];
+        const uint32_t n = sceneGraph.LevelSizes[l];
+        Assert(levelBase + n <= numInstances, "Out-of-bound access.");
+
+        level.m_IDs.append_range(sceneGraph.IDs.begin() + levelBase, 
+            sceneGraph.IDs.begin() + levelBase + n, true);
+        level.m_localTransforms.append_range(sceneGraph.LocalTransforms.begin() + levelBase, 
+            sceneGraph.LocalTransforms.begin() + levelBase + n, true);
+        level.m_meshIDs.append_range(sceneGraph.MeshIDs.begin() + levelBase,
+            sceneGraph.MeshIDs.begin() + levelBase + n, true);
+        level.m_parents.append_range(sceneGraph.Parents.begin() + levelBase,
+            sceneGraph.Parents.begin() + levelBase + n, true);
+        level.m_rtFlags.append_range(sceneGraph.RtFlags.begin() + levelBase,
+            sceneGraph.RtFlags.begin() + levelBase + n, true);
+        level.m_toWorlds.resize(n, I);
+        level.m_prevToWorlds.resize(n, I);
+        level.m_rtASInfo.resize(n, RT_AS_Info());
+        level.m_slots.resize(n);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const InstanceHandle h = m_instances.Add(level.m_IDs[i], 
+                TreePos{ .Level = (uint32_t)l + 1, .Offset = i });
+            level.m_slots[i] = h.Index;
+
+            const RT_Flags flags = RT_Flags::Decode(level.m_rtFlags[i]);
+            CountInstance(level.m_meshIDs[i], flags.MeshMode, flags.IsOpaque);
+        }
+
+        // Children are grouped by parent, so each parent's subtree range follows from 
+        // counting its children
+        level.m_subtreeRanges.resize(n, Range(0, 0));
+
+        if (l + 1 < numLevels)
+        {
+            Span<uint32_t> childParents(sceneGraph.Parents.begin() + levelBase + n, 
+                sceneGraph.LevelSizes[l + 1]);
+
+            for (size_t c = 0; c < childParents.size(); c++)
+            {
+                Assert(childParents[c] < n, "Invalid parent index.");
+                Assert(c == 0 || childParents[c] >= childParents[c - 1], "Children must be grouped by parent.");
+                level.m_subtreeRanges[childParents[c]].Count++;
+            }
+        }
+
+        uint32_t currBase = 0;
+        for (auto& r : level.m_subtreeRanges)
+        {
+            r.Base = currBase;
+            currBase += r.Count;
+        }
+
+        levelBase += n;
+    }
+
+    Assert(levelBase == numInstances, "Level sizes don't add up to the number of instances.");
+    m_rebuildBVHFlag = true;
+}
+
+uint32_t SceneCore::InsertAtLevel(uint64_t id, uint32_t slot, uint32_t treeLevel, uint32_t parentIdx, 
     AffineTransformation& localTransform, uint64_t meshID, RT_MESH_MODE rtMeshMode, 
     uint8_t rtInstanceMask, bool isOpaque)
 {
@@ -545,6 +665,7 @@ uint32_t SceneCore::InsertAtLevel(uint64_t id, uint32_t treeLevel, uint32_t pare
     rearrange(currLevel.m_IDs, insertIdx, id);
     rearrange(currLevel.m_localTransforms, insertIdx, localTransform);
     rearrange(currLevel.m_toWorlds, insertIdx, I);
+    rearrange(currLevel.m_prevToWorlds, insertIdx, I);
     rearrange(currLevel.m_meshIDs, insertIdx, meshID);
     const uint32_t newBase = currLevel.m_subtreeRanges.empty() ? 0 :
         currLevel.m_subtreeRanges.back().Base + currLevel.m_subtreeRanges.back().Count;
@@ -553,11 +674,20 @@ uint32_t SceneCore::InsertAtLevel(uint64_t id, uint32_t treeLevel, uint32_t pare
     auto flags = RT_Flags::Encode(rtMeshMode, rtInstanceMask, 1, 0, isOpaque);
     rearrange(currLevel.m_rtFlags, insertIdx, flags);
     rearrange(currLevel.m_rtASInfo, insertIdx, RT_AS_Info());
+    rearrange(currLevel.m_slots, insertIdx, slot);
+    rearrange(currLevel.m_parents, insertIdx, parentIdx);
 
     // Shift base offset of parent's right siblings to right by one
     for (size_t siblingIdx = parentIdx + 1; siblingIdx != parentLevel.m_subtreeRanges.size(); siblingIdx++)
         parentLevel.m_subtreeRanges[siblingIdx].Base++;
 
+    // Children of the shifted instances now have their parent one to the right
+    if (treeLevel + 1 < m_sceneGraph.size())
+    {
+        for (auto& p : m_sceneGraph[treeLevel + 1].m_parents)
+            p += p >= insertIdx;
+    }
+
     return insertIdx;
 }
 
@@ -622,34 +752,24 @@ void SceneCore::ResetRtAsInfos()
 void SceneCore::AddAnimation(uint64_t id, MutableSpan<Keyframe> keyframes, float t_start, 
     bool loop, bool isSorted)
 {
+    const InstanceHandle h = GetInstanceHandle(id).value();
 #ifndef NDEBUG
-    TreePos& p = FindTreePosFromID(id).value();
+    const TreePos p = FindTreePos(h);
     Assert(RT_Flags::Decode(m_sceneGraph[p.Level].m_rtFlags[p.Offset]).MeshMode != RT_MESH_MODE::STATIC,
         "Static instances can't be animated.");
 #endif
 
-    Check(keyframes.size() > 1, "Invalid animation.");
-
     if (!isSorted)
     {
-        std::sort(m_keyframes.begin(), m_keyframes.end(),
+        std::sort(keyframes.begin(), keyframes.end(),
             [](const Keyframe& k1, const Keyframe& k2)
             {
                 return k1.Time < k2.Time;
             });
     }
 
-    // Remember starting offset and number of keyframes
-    const uint32_t currOffset = (uint32_t)m_keyframes.size();
-    m_animationMetadata.push_back(AnimationMetadata{
-            .InstanceID = id,
-            .StartOffset = currOffset,
-            .Length = (uint32_t)keyframes.size(),
-            .T0 = t_start,
-            .Loop = loop
-        });
-
-    m_keyframes.append_range(keyframes.begin(), keyframes.end());
+    m_animations.Add(keyframes, t_start, loop);
+    m_animatedInstances.push_back(h);
 }
 
 void SceneCore::TransformInstance(uint64_t id, const float3& tr, const float3x3& rotation,
@@ -657,16 +777,17 @@ void SceneCore::TransformInstance(uint64_t id, const float3& tr, const float3x3&
 {
     m_tempWorldTransformUpdates[id] = TransformUpdate{ .Tr = tr, .Rotation = rotation, .Scale = scale };
 
-    const auto treePos = FindTreePosFromID(id).value();
+    const InstanceHandle h = GetInstanceHandle(id).value();
+    const auto treePos = FindTreePos(h);
     const auto rtFlags = RT_Flags::Decode(m_sceneGraph[treePos.Level].m_rtFlags[treePos.Offset]);
 
     m_staleEmissivePositions = m_staleEmissivePositions || 
         (m_emissives.NumInstances() &&
         (rtFlags.InstanceMask & RT_AS_SUBGROUP::EMISSIVE));
 
-    ConvertInstanceDynamic(id, treePos, rtFlags);
+    ConvertInstanceDynamic(h, treePos, rtFlags);
     // Updates if instance already exists
-    m_instanceUpdates[id] = App::GetTimer().GetTotalFrameCount();
+    m_instanceUpdates[h.Index] = App::GetTimer().GetTotalFrameCount();
 
     m_rendererInterface.SceneModified();
 }
@@ -686,10 +807,12 @@ void SceneCore::ReserveInstances(Span<int> treeLevels, size_t total)
         m_sceneGraph[i + 1].m_rtFlags.reserve(treeLevels[i]);
         m_sceneGraph[i + 1].m_subtreeRanges.reserve(treeLevels[i]);
         m_sceneGraph[i + 1].m_toWorlds.reserve(treeLevels[i]);
+        m_sceneGraph[i + 1].m_prevToWorlds.reserve(treeLevels[i]);
+        m_sceneGraph[i + 1].m_slots.reserve(treeLevels[i]);
+        m_sceneGraph[i + 1].m_parents.reserve(treeLevels[i]);
     }
 
-    m_prevToWorlds.resize(total, true);
-    m_IDtoTreePos.resize(total, true);
+    m_instances.Reserve(total);
     m_worldTransformUpdates.resize(Min(total, 32llu));
 }
 
@@ -730,11 +853,10 @@ void SceneCore::InitWorldTransformations()
     {
         AffineTransformation& tr = m_sceneGraph[1].m_localTransforms[i];
         v_float4x4 vLocal = affineTransformation(tr.Scale, tr.Rotation, tr.Translation);
-        const uint64_t ID = m_sceneGraph[1].m_IDs[i];
 
         // Set prev = new for 1st frame
         m_sceneGraph[1].m_toWorlds[i] = float4x3(store(vLocal));
-        m_prevToWorlds[ID] = m_sceneGraph[1].m_toWorlds[i];
+        m_sceneGraph[1].m_prevToWorlds[i] = m_sceneGraph[1].m_toWorlds[i];
     }
 
     const size_t numLevels = m_sceneGraph.size();
@@ -753,11 +875,10 @@ void SceneCore::InitWorldTransformations()
                 v_float4x4 vLocal = affineTransformation(tr.Scale, tr.Rotation, tr.Translation);
                 // Bottom up transformation hierarchy
                 v_float4x4 newW = mul(vLocal, vParentTr);
-                const uint64_t ID = m_sceneGraph[level + 1].m_IDs[j];
 
                 // Set prev = new for 1st frame
                 m_sceneGraph[level + 1].m_toWorlds[j] = float4x3(store(newW));
-                m_prevToWorlds[ID] = m_sceneGraph[level + 1].m_toWorlds[j];
+                m_sceneGraph[level + 1].m_prevToWorlds[j] = m_sceneGraph[level + 1].m_toWorlds[j];
             }
         }
     }
@@ -765,37 +886,28 @@ void SceneCore::InitWorldTransformations()
 
 void SceneCore::UpdateWorldTransformations(Vector<BVH::BVHUpdateInput, App::FrameAllocator>& toUpdateInstances)
 {
-    struct Entry
-    {
-        v_float4x4 W;
-        uint32_t TreeLevel;
-        uint32_t Base;
-        uint32_t Count;
-    };
-
-    SmallVector<Entry, App::FrameAllocator, 10> stack;
     const auto currFrame = App::GetTimer().GetTotalFrameCount();
 
-    // Can't append while iterating
-    SmallVector<uint64, App::FrameAllocator, 3> toAppend;
-
+    // Instances that were transformed directly
     for (auto it = m_instanceUpdates.begin_it(); it != m_instanceUpdates.end_it(); 
         it = m_instanceUpdates.next_it(it))
     {
-        const auto instance = it->Key;
         const auto frame = it->Val;
-        const TreePos& p = FindTreePosFromID(instance).value();
+        const TreePos p = FindTreePos(it->Key);
+        auto& level = m_sceneGraph[p.Level];
 
         // -1 -> update was added at the tail end of last frame
         if (frame < currFrame - 1)
         {
             // Mesh hasn't moved, just update previous transformation
-            m_prevToWorlds[instance] = m_sceneGraph[p.Level].m_toWorlds[p.Offset];
+            level.m_prevToWorlds[p.Offset] = level.m_toWorlds[p.Offset];
             continue;
         }
 
+        const uint64_t instance = level.m_IDs[p.Offset];
+
         // Grab current to world transformation
-        const float4x3& prevW = m_sceneGraph[p.Level].m_toWorlds[p.Offset];
+        const float4x3& prevW = level.m_toWorlds[p.Offset];
         v_float4x4 vW = load4x3(prevW);
 
         float4a t;
@@ -820,17 +932,11 @@ void SceneCore::UpdateWorldTransformations(Vector<BVH::BVHUpdateInput, App::Fram
         Assert(fabsf(R.m[2].length() - 1) < 1e-5, "");
 
         // Update previous & current transformations
-        m_prevToWorlds[instance] = prevW;
-        m_sceneGraph[p.Level].m_toWorlds[p.Offset] = float4x3(store(vNewWorld));
+        level.m_prevToWorlds[p.Offset] = prevW;
+        level.m_toWorlds[p.Offset] = float4x3(store(vNewWorld));
         
-        // Add subtree to stack
-        if (const auto range = m_sceneGraph[p.Level].m_subtreeRanges[p.Offset]; range.Count)
-        {
-            stack.push_back(Entry{ .W = vNewWorld,
-                .TreeLevel = p.Level, 
-                .Base = range.Base, 
-                .Count = range.Count });
-        }
+        // Subtree is updated below
+        SetBit(level.m_worldDirty, p.Offset);
 
         // Remember transformation update for future
         if (auto existingIt = m_worldTransformUpdates.find(instance); existingIt)
@@ -851,191 +957,38 @@ void SceneCore::UpdateWorldTransformations(Vector<BVH::BVHUpdateInput, App::Fram
             tr.Rotation = quaternionFromRotationMat1(vNewR);
 
             m_worldTransformUpdates[instance] = tr;
-        }
-    }
-
-    while (!stack.empty())
-    {
-        Entry e = stack.back();
-        stack.pop_back();
-        auto& currLevel = m_sceneGraph[e.TreeLevel + 1];
-
-        for (size_t j = e.Base; j < e.Base + e.Count; j++)
-        {
-            Assert(RT_Flags::Decode(currLevel.m_rtFlags[j]).MeshMode ==
-                RT_MESH_MODE::DYNAMIC_NO_REBUILD, "Invalid scene graph.");
-
-            const uint64_t ID = m_sceneGraph[e.TreeLevel + 1].m_IDs[j];
-            toAppend.push_back(ID);
-
-            AffineTransformation& local = currLevel.m_localTransforms[j];
-            v_float4x4 vLocal = affineTransformation(local.Scale, local.Rotation, local.Translation);
-            v_float4x4 vNewWorld = mul(vLocal, e.W);
-
-            // If instance has had updates, apply them
-            if (auto updateIt = m_worldTransformUpdates.find(ID); updateIt)
-            {
-                float4a t;
-                float4a s;
-                v_float4x4 vR = decomposeSRT(vNewWorld, s, t);
-
-                AffineTransformation& existing = *updateIt.value();
-                float3 newTr = existing.Translation + t.xyz();
-                float3 newScale = existing.Scale * s.xyz();
-
-                v_float4x4 vRotUpdate = rotationMatFromQuat(loadFloat4(existing.Rotation));
-                vR = mul(vR, vRotUpdate);
-
-                vNewWorld = affineTransformation(vR, newScale, newTr);
-            }
-
-            // Update previous & current transformations
-            m_prevToWorlds[ID] = currLevel.m_toWorlds[j];
-            currLevel.m_toWorlds[j] = float4x3(store(vNewWorld));
-
-            // Add subtree to stack
-            if (const auto& subtree = currLevel.m_subtreeRanges[j]; subtree.Count)
-            {
-                stack.push_back(Entry{ .W = vNewWorld,
-                    .TreeLevel = e.TreeLevel + 2,
-                    .Base = subtree.Base,
-                    .Count = subtree.Count });
-            }
+            SetBit(m_hasWorldTransformUpdate, it->Key);
         }
     }
 
     m_tempWorldTransformUpdates.clear();
-    
-    for(auto id : toAppend)
-        m_instanceUpdates[id] = App::GetTimer().GetTotalFrameCount() - 1;
-}
 
-void SceneCore::UpdateEmissivePositions()
-{
-    auto tris = m_emissives.Triagnles();
-    auto triInitialPos = m_emissives.InitialTriPositions();
-
-    uint32_t minIdx = (uint32_t)tris.size() - 1;
-    uint32_t maxIdx = 0;
+    // Subtrees of the above plus the instances with new local transformations
+    RecomputeWorldTransforms(m_sceneGraph, m_hasWorldTransformUpdate, m_worldTransformUpdates);
 
-    for (auto it = m_instanceUpdates.begin_it(); it != m_instanceUpdates.end_it();
-        it = m_instanceUpdates.next_it(it))
-    {
-        auto instance = it->Key;
-        const auto& emissiveInstance = *m_emissives.FindInstance(instance).value();
-        const v_float4x4 vW = load4x3(GetToWorld(instance));
-        const auto rtASInfo = GetInstanceRtASInfo(instance);
+    // Remember every updated instance for the TLAS and emissives, then reset the bitsets
+    SmallVector<uint32_t, App::FrameAllocator> updated;
+    m_emissiveUpdates.clear();
+    CollectUpdatedInstances(m_sceneGraph, m_emissives, updated, m_emissiveUpdates);
 
-        for (size_t t = emissiveInstance.BaseTriOffset; 
-            t < emissiveInstance.BaseTriOffset + emissiveInstance.NumTriangles; t++)
-        {
-            EmissiveBuffer::Triangle& initTri = triInitialPos[t];
-
-            __m128 vV0;
-            __m128 vV1;
-            __m128 vV2;
-            RT::EmissiveTriangle::DecodeVertices(initTri.Vtx0, initTri.V0V1, initTri.V0V2,
-                initTri.EdgeLengths,
-                vV0, vV1, vV2);
-
-            vV0 = mul(vW, vV0);
-            vV1 = mul(vW, vV1);
-            vV2 = mul(vW, vV2);
-            tris[t].StoreVertices(vV0, vV1, vV2);
-
-            // Dynamic instances have geometry index = 0
-            const uint32_t hash = Pcg3d(uint3(0,
-                rtASInfo.InstanceID,
-                initTri.PrimIdx)).x;
-            tris[t].ID = hash;
-        }
-
-        minIdx = Min(minIdx, emissiveInstance.BaseTriOffset);
-        maxIdx = Max(maxIdx, emissiveInstance.BaseTriOffset + emissiveInstance.NumTriangles);
-    }
-
-    Assert(minIdx <= maxIdx, "Invalid indices.");
-    m_emissives.UpdateTriPositions(minIdx, maxIdx);
+    for (auto slot : updated)
+        m_instanceUpdates[slot] = currFrame - 1;
 }
 
-void SceneCore::UpdateAnimations(float t, Vector<AnimationUpdate, App::FrameAllocator>& animVec)
+void SceneCore::UpdateEmissivePositions()
 {
-    for (auto& anim : m_animationMetadata)
-    {
-        AffineTransformation vRes;
-
-        const Keyframe& kStart = m_keyframes[anim.StartOffset];
-        const Keyframe& kEnd = m_keyframes[anim.StartOffset + anim.Length - 1];
-        const float t_start = anim.T0;
-
-        // Fast paths
-        if (t <= kStart.Time + t_start)
-        {
-            vRes = kStart.Transform;
-        }
-        else if (!anim.Loop && t >= kEnd.Time + t_start)
-        {
-            vRes = kEnd.Transform;
-        }
-        else
-        {
-            if (t >= kEnd.Time + t_start)
-            {
-                float numLoops = floorf((t - kStart.Time) / (kEnd.Time - kStart.Time));
-                float excess = numLoops * (kEnd.Time - kStart.Time) + kStart.Time;
-                t -= excess;
-                t += kStart.Time;
-            }
-
-            auto idx = FindInterval(Span(m_keyframes), t, [](const Keyframe& k) { return k.Time; },
-                anim.StartOffset,
-                anim.StartOffset + anim.Length - 1);
-
-            Assert(idx != -1, "FindInterval() unexpectedly failed.");
-            Keyframe& k1 = m_keyframes[idx];
-            Keyframe& k2 = m_keyframes[idx + 1];
-
-            Assert(t >= k1.Time + t_start && t <= k2.Time + t_start, "bug");
-            Assert(k1.Time < k2.Time, "divide-by-zero");
-
-            float interpolatedT = (t - (k1.Time + t_start)) / (k2.Time - k1.Time);
-
-            // Scale
-            const __m128 vScale1 = loadFloat3(k1.Transform.Scale);
-            const __m128 vScale2 = loadFloat3(k2.Transform.Scale);
-            const __m128 vScaleInt = lerp(vScale1, vScale2, interpolatedT);
-
-            // Translation
-            const __m128 vTranslate1 = loadFloat3(k1.Transform.Translation);
-            const __m128 vTranslate2 = loadFloat3(k2.Transform.Translation);
-            const __m128 vTranslateInt = lerp(vTranslate1, vTranslate2, interpolatedT);
-
-            // Rotation
-            const __m128 vRot1 = loadFloat4(k1.Transform.Rotation);
-            const __m128 vRot2 = loadFloat4(k2.Transform.Rotation);
-            const __m128 vRotInt = slerp(vRot1, vRot2, interpolatedT);
-
-            vRes.Scale = storeFloat3(vScaleInt);
-            vRes.Rotation = storeFloat4(vRotInt);
-            vRes.Translation = storeFloat3(vTranslateInt);
-        }
-
-        animVec.push_back(AnimationUpdate{
-            .M = vRes,
-            .InstanceID = anim.InstanceID });
-    }
+    // Nothing to do if none of the moved instances were emissive
+    if (!m_emissiveUpdates.empty())
+        m_emissives.UpdateTriPositions(m_emissiveUpdates);
 }
 
-void SceneCore::UpdateLocalTransforms(Span<AnimationUpdate> animVec)
+void SceneCore::ResizeDirtyBitsets()
 {
-    for (auto& update : animVec)
-    {
-        TreePos t = FindTreePosFromID(update.InstanceID).value();
-        m_sceneGraph[t.Level].m_localTransforms[t.Offset] = update.M;
-    }
+    Internal::ResizeDirtyBitsets(m_sceneGraph);
+    m_hasWorldTransformUpdate.resize(NumBitsetWords(m_instances.size()), 0);
 }
 
-bool SceneCore::ConvertInstanceDynamic(uint64_t instanceID, const TreePos& treePos, 
+bool SceneCore::ConvertInstanceDynamic(InstanceHandle h, const TreePos& treePos, 
     RT_Flags rtFlags)
 {
     if (rtFlags.MeshMode == RT_MESH_MODE::STATIC)
@@ -1044,7 +997,7 @@ bool SceneCore::ConvertInstanceDynamic(uint64_t instanceID, const TreePos& treeP
             RT_MESH_MODE::DYNAMIC_NO_REBUILD,
             rtFlags.InstanceMask, 1, 0, rtFlags.IsOpaque);
 
-        m_pendingRtMeshModeSwitch.push_back(instanceID);
+        m_pendingRtMeshModeSwitch.push_back(h);
         m_numStaticInstances--;
         m_numDynamicInstances++;
 
@@ -1069,7 +1022,7 @@ void SceneCore::ConvertSubtreeDynamic(uint32_t treeLevel, Range r)
                 Model::RT_MESH_MODE::DYNAMIC_NO_REBUILD,
                 rtFlags.InstanceMask, 1, 0, rtFlags.IsOpaque);
 
-            m_pendingRtMeshModeSwitch.push_back(m_sceneGraph[treeLevel].m_IDs[i]);
+            m_pendingRtMeshModeSwitch.push_back(HandleAt(treeLevel, (uint32_t)i));
             m_numStaticInstances--;
             m_numDynamicInstances++;
         }
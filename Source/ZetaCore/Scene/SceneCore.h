@@ -4,6 +4,8 @@
 #include "Asset.h"
 #include "SceneRenderer.h"
 #include "SceneCommon.h"
+#include "Animation.h"
+#include "SceneGraph.h"
 #include "../Utility/Utility.h"
 #include "../Utility/SynchronizedView.h"
 #include <xxHash/xxhash.h>
@@ -27,55 +29,6 @@ namespace ZetaRay::Support
 
 namespace ZetaRay::Scene
 {
-    struct Keyframe
-    {
-        static Keyframe Identity()
-        {
-            Keyframe k;
-            k.Transform = Math::AffineTransformation::GetIdentity();
-
-            return k;
-        }
-
-        Math::AffineTransformation Transform;
-        float Time;
-    };
-
-    struct RT_Flags
-    {
-        static RT_Flags Decode(uint8_t f)
-        {
-            return RT_Flags{
-                .MeshMode = (Model::RT_MESH_MODE)(f >> 6),
-                .InstanceMask = (uint8_t)(f & 0x7),
-                .IsOpaque = bool((f >> 3) & 0x1),
-                .RebuildFlag = bool((f >> 4) & 0x1),
-                .UpdateFlag = bool((f >> 5) & 0x1) };
-        }
-
-        // 7        6     5         4       3     2     1     0
-        //  meshmode    update    build   opaque     instance
-        static uint8_t Encode(Model::RT_MESH_MODE m, uint8_t instanceMask, uint8_t rebuild,
-            uint8_t update, bool isOpaque)
-        {
-            return ((uint8_t)m << 6) | instanceMask | (isOpaque << 3) | (rebuild << 4) | (update << 5);
-        }
-
-        Model::RT_MESH_MODE MeshMode;
-        // Note: Instance masks are specified per instance here, but in DXR can 
-        // only be applied per TLAS instance.
-        uint8_t InstanceMask;
-        bool IsOpaque;
-        bool RebuildFlag;
-        bool UpdateFlag;
-    };
-
-    struct RT_AS_Info
-    {
-        uint32_t GeometryIndex;
-        uint32_t InstanceID;
-    };
-
     ZetaInline uint64_t InstanceID(uint32_t sceneID, int nodeIdx, int mesh, int meshPrim)
     {
         StackStr(str, n, "instance_%u_%d_%d_%d", sceneID, nodeIdx, mesh, meshPrim);
@@ -135,16 +88,24 @@ namespace ZetaRay::Scene
             Util::SmallVector<Core::Vertex>&& vertices,
             Util::SmallVector<uint32_t>&& indices,
             bool lock = true);
-        ZetaInline Util::Optional<const Model::TriangleMesh*> GetMesh(uint64_t id) const
+        // Adds meshes whose TriangleMesh entries have already been computed (e.g. read from
+        // a scene cache). Vertex and index offsets are relative to the given buffers.
+        void AddMeshes(Util::Span<uint64_t> meshIDs,
+            Util::Span<Model::TriangleMesh> meshes,
+            Util::Span<Core::Vertex> vertices,
+            Util::Span<uint32_t> indices,
+            bool lock = true);
+        ZetaInline Util::Optional<Model::TriangleMesh> GetMesh(uint64_t id) const
         {
             return m_meshes.GetMesh(id);
         }
-        ZetaInline Util::Optional<const Model::TriangleMesh*> GetInstanceMesh(uint64_t id) const
+        ZetaInline Util::Optional<Model::TriangleMesh> GetInstanceMesh(InstanceHandle h) const
         {
-            const TreePos& p = FindTreePosFromID(id).value();
-            const uint64_t meshID = m_sceneGraph[p.Level].m_meshIDs[p.Offset];
-
-            return m_meshes.GetMesh(meshID);
+            return m_meshes.GetMesh(GetInstanceMeshID(h));
+        }
+        ZetaInline Util::Optional<Model::TriangleMesh> GetInstanceMesh(uint64_t id) const
+        {
+            return GetInstanceMesh(GetInstanceHandle(id).value());
         }
         ZetaInline const Core::GpuMemory::Buffer& GetMeshVB() { return m_meshes.GetVB(); }
         ZetaInline const Core::GpuMemory::Buffer& GetMeshIB() { return m_meshes.GetIB(); }
@@ -155,7 +116,7 @@ namespace ZetaRay::Scene
         void AddMaterial(const Model::glTF::Asset::MaterialDesc& mat, bool lock = true);
         void AddMaterial(const Model::glTF::Asset::MaterialDesc& mat,
             Util::MutableSpan<Core::GpuMemory::Texture> ddsImages, bool lock = true);
-        ZetaInline Util::Optional<const Material*> GetMaterial(uint32_t ID, uint32_t* bufferIdx = nullptr) const
+        ZetaInline Util::Optional<Material> GetMaterial(uint32_t ID, uint32_t* bufferIdx = nullptr) const
         {
             return m_matBuffer.Get(ID, bufferIdx);
         }
@@ -171,20 +132,59 @@ namespace ZetaRay::Scene
         //
         // Instance
         //
-        void AddInstance(Model::glTF::Asset::InstanceDesc& instance, bool lock = true);
+        InstanceHandle AddInstance(Model::glTF::Asset::InstanceDesc& instance, bool lock = true);
+        // Scene graph in the same level-by-level layout that's used internally (e.g. read
+        // from a scene cache), excluding the root. Instances of each level are grouped by
+        // parent, in the same order as parents appear in the previous level.
+        struct SceneGraphDesc
+        {
+            // Number of instances in each level
+            Util::Span<uint32_t> LevelSizes;
+            Util::Span<uint64_t> IDs;
+            Util::Span<Math::AffineTransformation> LocalTransforms;
+            Util::Span<uint64_t> MeshIDs;
+            // Index of parent in the previous level
+            Util::Span<uint32_t> Parents;
+            // See RT_Flags::Encode()
+            Util::Span<uint8_t> RtFlags;
+        };
+        // When the scene is empty, levels are copied over as a whole, otherwise, instances
+        // are inserted one by one
+        void AddInstances(const SceneGraphDesc& sceneGraph, bool lock = true);
+        // Instance ID is only needed for the initial lookup, all the following accessors
+        // have an overload that takes the handle instead. Unlike those, this one is safe to 
+        // call while instances are being added from other threads.
+        ZetaInline Util::Optional<InstanceHandle> GetInstanceHandle(uint64_t id) const
+        {
+            return m_instances.Find(id);
+        }
+        ZetaInline uint64_t GetInstanceID(InstanceHandle h) const
+        {
+            const TreePos p = FindTreePos(h);
+            return m_sceneGraph[p.Level].m_IDs[p.Offset];
+        }
+        ZetaInline const Math::float4x3& GetPrevToWorld(InstanceHandle h) const
+        {
+            const TreePos p = FindTreePos(h);
+            return m_sceneGraph[p.Level].m_prevToWorlds[p.Offset];
+        }
         ZetaInline Util::Optional<const Math::float4x3*> GetPrevToWorld(uint64_t id) const
         {
-            auto it = m_prevToWorlds.find(id);
-            if (it)
-                return it.value();
+            auto h = GetInstanceHandle(id);
+            if (h)
+                return &GetPrevToWorld(h.value());
 
             return {};
         }
-        ZetaInline const Math::float4x3& GetToWorld(uint64_t id) const
+        ZetaInline const Math::float4x3& GetToWorld(InstanceHandle h) const
         {
-            const TreePos& p = FindTreePosFromID(id).value();
+            const TreePos p = FindTreePos(h);
             return m_sceneGraph[p.Level].m_toWorlds[p.Offset];
         }
+        ZetaInline const Math::float4x3& GetToWorld(uint64_t id) const
+        {
+            return GetToWorld(GetInstanceHandle(id).value());
+        }
         ZetaInline Math::AffineTransformation GetLocalTransform(uint64_t id) const
         {
             auto it = m_worldTransformUpdates.find(id);
@@ -193,27 +193,41 @@ namespace ZetaRay::Scene
 
             return Math::AffineTransformation::GetIdentity();
         }
-        ZetaInline const Math::AABB& GetAABB(uint64_t id) const
+        ZetaInline Math::AABB GetAABB(InstanceHandle h) const
         {
-            const TreePos& p = FindTreePosFromID(id).value();
-            const uint64_t meshID = m_sceneGraph[p.Level].m_meshIDs[p.Offset];
-            return m_meshes.GetMesh(meshID).value()->m_AABB;
+            return m_meshes.GetMesh(GetInstanceMeshID(h)).value().m_AABB;
         }
-        ZetaInline uint64_t GetInstanceMeshID(uint64_t id) const
+        ZetaInline Math::AABB GetAABB(uint64_t id) const
         {
-            const TreePos& p = FindTreePosFromID(id).value();
+            return GetAABB(GetInstanceHandle(id).value());
+        }
+        ZetaInline uint64_t GetInstanceMeshID(InstanceHandle h) const
+        {
+            const TreePos p = FindTreePos(h);
             return m_sceneGraph[p.Level].m_meshIDs[p.Offset];
         }
-        ZetaInline RT_AS_Info GetInstanceRtASInfo(uint64_t id) const
+        ZetaInline uint64_t GetInstanceMeshID(uint64_t id) const
+        {
+            return GetInstanceMeshID(GetInstanceHandle(id).value());
+        }
+        ZetaInline RT_AS_Info GetInstanceRtASInfo(InstanceHandle h) const
         {
-            const TreePos& p = FindTreePosFromID(id).value();
+            const TreePos p = FindTreePos(h);
             return m_sceneGraph[p.Level].m_rtASInfo[p.Offset];
         }
-        ZetaInline RT_Flags GetInstanceRtFlags(uint64_t id) const
+        ZetaInline RT_AS_Info GetInstanceRtASInfo(uint64_t id) const
+        {
+            return GetInstanceRtASInfo(GetInstanceHandle(id).value());
+        }
+        ZetaInline RT_Flags GetInstanceRtFlags(InstanceHandle h) const
         {
-            const TreePos& p = FindTreePosFromID(id).value();
+            const TreePos p = FindTreePos(h);
             return RT_Flags::Decode(m_sceneGraph[p.Level].m_rtFlags[p.Offset]);
         }
+        ZetaInline RT_Flags GetInstanceRtFlags(uint64_t id) const
+        {
+            return GetInstanceRtFlags(GetInstanceHandle(id).value());
+        }
         ZetaInline uint64_t GetIDFromRtMeshIdx(uint32 idx) const
         {
             return m_rtMeshInstanceIdxToID[idx];
@@ -247,7 +261,7 @@ namespace ZetaRay::Scene
         //
         //ZetaInline Math::AABB GetWorldAABB() { return m_bvh.GetWorldAABB(); }
         ZetaInline uint32_t TotalNumTriangles() const { return m_numTriangles; }
-        ZetaInline uint32_t TotalNumInstances() const { return (uint32_t)m_IDtoTreePos.size(); }
+        ZetaInline uint32_t TotalNumInstances() const { return (uint32_t)m_instances.size(); }
         ZetaInline uint32_t TotalNumMeshes() const { return m_meshes.NumMeshes(); }
         ZetaInline uint32_t TotalNumMaterials() const { return m_matBuffer.NumMaterials(); }
         ZetaInline uint32_t NumOpaqueInstances() const { return m_numOpaqueInstances; }
@@ -283,62 +297,28 @@ namespace ZetaRay::Scene
         static constexpr uint32_t METALLIC_ROUGHNESS_DESC_TABLE_SIZE = 256;
         static constexpr uint32_t EMISSIVE_DESC_TABLE_SIZE = 64;
 
-        struct TreePos
-        {
-            uint32_t Level;
-            uint32_t Offset;
-        };
-
-        struct AnimationUpdate
+        ZetaInline TreePos FindTreePos(InstanceHandle h) const
         {
-            Math::AffineTransformation M;
-            uint64_t InstanceID;
-        };
-
-        struct Range
-        {
-            Range() = default;
-            Range(uint32_t b, uint32_t c)
-                : Base(b),
-                Count(c)
-            {}
-
-            uint32_t Base;
-            uint32_t Count;
-        };
-
-        struct TreeLevel
-        {
-            Util::SmallVector<uint64_t> m_IDs;
-            Util::SmallVector<Math::AffineTransformation> m_localTransforms;
-            Util::SmallVector<Math::float4x3> m_toWorlds;
-            Util::SmallVector<uint64_t> m_meshIDs;
-            Util::SmallVector<Range> m_subtreeRanges;
-            Util::SmallVector<uint8_t> m_rtFlags;
-            // (Also) filled in by TLAS::RebuildTLASInstances()
-            Util::SmallVector<RT_AS_Info> m_rtASInfo;
-        };
-
-        // Offset into "m_keyframes" array
-        struct AnimationMetadata
+            return m_instances.Pos(h);
+        }
+        ZetaInline TreePos FindTreePos(uint32_t slot) const
         {
-            uint64_t InstanceID;
-            uint32_t StartOffset;
-            uint32_t Length;
-            float T0;
-            bool Loop;
-        };
-
+            return m_instances.Pos(slot);
+        }
         ZetaInline Util::Optional<TreePos> FindTreePosFromID(uint64_t id) const
         {
-            auto pos = m_IDtoTreePos.find(id);
-            if (pos)
-                return *pos.value();
-
-            return {};
+            return m_instances.PosFromID(id);
+        }
+        ZetaInline InstanceHandle HandleAt(uint32_t treeLevel, uint32_t offset) const
+        {
+            return m_instances.Handle(m_sceneGraph[treeLevel].m_slots[offset]);
         }
 
-        uint32_t InsertAtLevel(uint64_t id, uint32_t treeLevel, uint32_t parentIdx, 
+        InstanceHandle AddInstance(uint64_t id, uint64_t parentID, Math::AffineTransformation& localTransform,
+            uint64_t meshID, Model::RT_MESH_MODE rtMeshMode, uint8_t rtInstanceMask, bool isOpaque);
+        void AddSceneGraph(const SceneGraphDesc& sceneGraph);
+        void CountInstance(uint64_t meshID, Model::RT_MESH_MODE rtMeshMode, bool isOpaque);
+        uint32_t InsertAtLevel(uint64_t id, uint32_t slot, uint32_t treeLevel, uint32_t parentIdx, 
             Math::AffineTransformation& localTransform, uint64_t meshID, 
             Model::RT_MESH_MODE rtMeshMode, uint8_t rtInstanceMask, bool isOpaque);
         void ResetRtAsInfos();
@@ -347,18 +327,17 @@ namespace ZetaRay::Scene
             App::FrameAllocator>& toUpdateInstances);
         void UpdateEmissivePositions();
         void RebuildBVH();
-        void UpdateAnimations(float t, Util::Vector<AnimationUpdate, App::FrameAllocator>& animVec);
-        void UpdateLocalTransforms(Util::Span<AnimationUpdate> animVec);
-        bool ConvertInstanceDynamic(uint64_t instanceID, const TreePos& treePos, RT_Flags rtFlags);
-        void ConvertSubtreeDynamic(uint32_t treeLevel, Range r);
-
-        // Maps instance ID to tree position
-        Util::HashTable<TreePos> m_IDtoTreePos;
+        void ResizeDirtyBitsets();
+        bool ConvertInstanceDynamic(InstanceHandle h, const TreePos& treePos, RT_Flags rtFlags);
+        void ConvertSubtreeDynamic(uint32_t treeLevel, Internal::Range r);
+
+        // Maps instance IDs and handles to scene graph positions. Instances are added while 
+        // holding "m_instanceLock" -- apart from ID lookups, accessors that resolve a handle 
+        // shouldn't run concurrently with that (e.g. while a scene is loading).
+        InstanceTable m_instances;
         // Maps RT mesh index to instance ID -- filled in by TLAS::BuildFrameMeshInstanceData()
         Util::SmallVector<uint64> m_rtMeshInstanceIdxToID;
-        Util::SmallVector<TreeLevel, Support::SystemAllocator, 3> m_sceneGraph;
-        // Previous frame's world transformation
-        Util::HashTable<Math::float4x3> m_prevToWorlds;
+        Util::SmallVector<Internal::TreeLevel, Support::SystemAllocator, 3> m_sceneGraph;
         Util::SmallVector<uint64, Support::SystemAllocator, 4> m_pickedInstances;
         bool m_multiPick = false;
         bool m_isPaused = false;
@@ -372,8 +351,9 @@ namespace ZetaRay::Scene
         uint32_t m_numNonOpaqueInstances = 0;
         uint32_t m_numTriangles = 0;
         bool m_meshBufferStale = false;
-        Util::SmallVector<uint64_t, Support::SystemAllocator, 3> m_pendingRtMeshModeSwitch;
-        Util::HashTable<uint64_t> m_instanceUpdates;
+        Util::SmallVector<InstanceHandle, Support::SystemAllocator, 3> m_pendingRtMeshModeSwitch;
+        // Maps instance slot to frame number of its last transformation update
+        Util::HashTable<uint64_t, uint32_t> m_instanceUpdates;
         
         struct TransformUpdate
         {
@@ -384,6 +364,8 @@ namespace ZetaRay::Scene
         
         Util::HashTable<TransformUpdate> m_tempWorldTransformUpdates;
         Util::HashTable<Math::AffineTransformation> m_worldTransformUpdates;
+        // One bit per instance slot, set when instance has an entry in m_worldTransformUpdates
+        Util::SmallVector<uint64_t> m_hasWorldTransformUpdate;
 
         //
         // BVH
@@ -406,7 +388,9 @@ namespace ZetaRay::Scene
         // Emissives
         //
         Internal::EmissiveBuffer m_emissives;
-        Util::SmallVector<uint64_t, App::FrameAllocator> m_toUpdateEmissives;
+        // Emissive instances whose world transformation changed this frame. Filled in by
+        // UpdateWorldTransformations().
+        Util::SmallVector<Internal::EmissiveUpdate> m_emissiveUpdates;
         bool m_staleEmissiveMats = false;
         bool m_staleEmissivePositions = false;
         bool m_ignoreEmissives = false;
@@ -420,8 +404,9 @@ namespace ZetaRay::Scene
         //
         // Animation
         //
-        Util::SmallVector<AnimationMetadata> m_animationMetadata;
-        Util::SmallVector<Keyframe> m_keyframes;
+        Internal::AnimationTracks m_animations;
+        // Instance that is animated by each track
+        Util::SmallVector<InstanceHandle> m_animatedInstances;
         bool m_animate = true;
 
         //
@@ -0,0 +1,126 @@
+#include "SceneGraph.h"
+#include "Asset.h"
+#include "TransformPropagation.h"
+#include "../RayTracing/RtCommon.h"
+
+using namespace ZetaRay;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Model;
+using namespace ZetaRay::RT;
+using namespace ZetaRay::Scene;
+using namespace ZetaRay::Scene::Internal;
+using namespace ZetaRay::Util;
+
+void Scene::Internal::ResizeDirtyBitsets(MutableSpan<TreeLevel> sceneGraph)
+{
+    for (auto& level : sceneGraph)
+    {
+        const size_t numWords = NumBitsetWords(level.m_toWorlds.size());
+        level.m_localDirty.resize(numWords, 0);
+        level.m_worldDirty.resize(numWords, 0);
+    }
+}
+
+void Scene::Internal::ApplyAnimations(AnimationTracks& animations, float t,
+    Span<InstanceHandle> animatedInstances, const InstanceTable& instances,
+    MutableSpan<TreeLevel> sceneGraph, int maxNumThreads)
+{
+    Assert(animations.NumTracks() == animatedInstances.size(), "Every track should animate an instance.");
+
+    SmallVector<AffineTransformation, App::FrameAllocator> localTransforms;
+    localTransforms.resize(animations.NumTracks());
+    animations.Sample(t, localTransforms, maxNumThreads);
+
+    for (size_t i = 0; i < localTransforms.size(); i++)
+    {
+        const TreePos p = instances.Pos(animatedInstances[i]);
+        sceneGraph[p.Level].m_localTransforms[p.Offset] = localTransforms[i];
+        SetBit(sceneGraph[p.Level].m_localDirty, p.Offset);
+    }
+}
+
+void Scene::Internal::RecomputeWorldTransforms(MutableSpan<TreeLevel> sceneGraph,
+    Span<uint64_t> hasWorldTransformUpdate,
+    const HashTable<AffineTransformation>& worldTransformUpdates,
+    int maxNumThreads)
+{
+    SmallVector<TransformLevel, App::FrameAllocator, 8> levels;
+    levels.reserve(sceneGraph.size());
+
+    for (auto& level : sceneGraph)
+    {
+        levels.push_back(TransformLevel{
+            .LocalTransforms = level.m_localTransforms,
+            .ToWorlds = level.m_toWorlds,
+            .PrevToWorlds = level.m_prevToWorlds,
+            .Parents = level.m_parents,
+            .LocalDirty = level.m_localDirty,
+            .WorldDirty = level.m_worldDirty });
+    }
+
+    PropagateWorldTransforms(levels, [sceneGraph, hasWorldTransformUpdate, &worldTransformUpdates]
+        (size_t levelIdx, size_t i, v_float4x4& vW)
+        {
+            const auto& level = sceneGraph[levelIdx];
+            Assert(RT_Flags::Decode(level.m_rtFlags[i]).MeshMode != RT_MESH_MODE::STATIC,
+                "Static instances can't move.");
+
+            if (!TestBit(hasWorldTransformUpdate, level.m_slots[i]))
+                return;
+
+            // If instance has had updates, apply them
+            AffineTransformation existing = *worldTransformUpdates.find(level.m_IDs[i]).value();
+
+            float4a t;
+            float4a s;
+            v_float4x4 vR = decomposeSRT(vW, s, t);
+            float3 newTr = existing.Translation + t.xyz();
+            float3 newScale = existing.Scale * s.xyz();
+
+            v_float4x4 vRotUpdate = rotationMatFromQuat(loadFloat4(existing.Rotation));
+            vR = mul(vR, vRotUpdate);
+
+            vW = affineTransformation(vR, newScale, newTr);
+        }, maxNumThreads);
+}
+
+void Scene::Internal::CollectUpdatedInstances(MutableSpan<TreeLevel> sceneGraph, EmissiveBuffer& emissives,
+    Vector<uint32_t, App::FrameAllocator>& updated, SmallVector<EmissiveUpdate>& emissiveUpdates)
+{
+    const bool hasEmissives = emissives.NumInstances() > 0;
+
+    for (size_t levelIdx = 1; levelIdx < sceneGraph.size(); levelIdx++)
+    {
+        auto& level = sceneGraph[levelIdx];
+
+        for (size_t w = 0; w < level.m_worldDirty.size(); w++)
+        {
+            uint64_t bits = level.m_worldDirty[w];
+
+            while (bits)
+            {
+                const size_t i = w * 64 + _tzcnt_u64(bits);
+                updated.push_back(level.m_slots[i]);
+                bits &= bits - 1;
+
+                if (!hasEmissives ||
+                    !(RT_Flags::Decode(level.m_rtFlags[i]).InstanceMask & RT_AS_SUBGROUP::EMISSIVE))
+                {
+                    continue;
+                }
+
+                if (auto e = emissives.FindInstance(level.m_IDs[i]); e)
+                {
+                    const auto* emissive = e.value();
+                    emissiveUpdates.push_back(EmissiveUpdate{ .ToWorld = level.m_toWorlds[i],
+                        .BaseTriOffset = emissive->BaseTriOffset,
+                        .NumTriangles = emissive->NumTriangles,
+                        .RtInstanceID = level.m_rtASInfo[i].InstanceID });
+                }
+            }
+        }
+
+        memset(level.m_worldDirty.data(), 0, level.m_worldDirty.size() * sizeof(uint64_t));
+        memset(level.m_localDirty.data(), 0, level.m_localDirty.size() * sizeof(uint64_t));
+    }
+}
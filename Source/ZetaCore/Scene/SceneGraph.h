@@ -0,0 +1,118 @@
+#pragma once
+
+#include "../App/App.h"
+#include "../Model/Mesh.h"
+#include "../Utility/HashTable.h"
+#include "Animation.h"
+#include "EmissiveUpdate.h"
+#include "InstanceTable.h"
+
+namespace ZetaRay::Scene
+{
+    struct RT_Flags
+    {
+        static RT_Flags Decode(uint8_t f)
+        {
+            return RT_Flags{
+                .MeshMode = (Model::RT_MESH_MODE)(f >> 6),
+                .InstanceMask = (uint8_t)(f & 0x7),
+                .IsOpaque = bool((f >> 3) & 0x1),
+                .RebuildFlag = bool((f >> 4) & 0x1),
+                .UpdateFlag = bool((f >> 5) & 0x1) };
+        }
+
+        // 7        6     5         4       3     2     1     0
+        //  meshmode    update    build   opaque     instance
+        static uint8_t Encode(Model::RT_MESH_MODE m, uint8_t instanceMask, uint8_t rebuild,
+            uint8_t update, bool isOpaque)
+        {
+            return ((uint8_t)m << 6) | instanceMask | (isOpaque << 3) | (rebuild << 4) | (update << 5);
+        }
+
+        Model::RT_MESH_MODE MeshMode;
+        // Note: Instance masks are specified per instance here, but in DXR can
+        // only be applied per TLAS instance.
+        uint8_t InstanceMask;
+        bool IsOpaque;
+        bool RebuildFlag;
+        bool UpdateFlag;
+    };
+
+    struct RT_AS_Info
+    {
+        uint32_t GeometryIndex;
+        uint32_t InstanceID;
+    };
+}
+
+namespace ZetaRay::Scene::Internal
+{
+    struct EmissiveBuffer;
+
+    struct Range
+    {
+        Range() = default;
+        Range(uint32_t b, uint32_t c)
+            : Base(b),
+            Count(c)
+        {}
+
+        uint32_t Base;
+        uint32_t Count;
+    };
+
+    // One level of the scene graph, stored as structure of arrays. Children of each parent
+    // are contiguous and follow the same order as their parents.
+    struct TreeLevel
+    {
+        Util::SmallVector<uint64_t> m_IDs;
+        Util::SmallVector<Math::AffineTransformation> m_localTransforms;
+        Util::SmallVector<Math::float4x3> m_toWorlds;
+        // Previous frame's world transformation
+        Util::SmallVector<Math::float4x3> m_prevToWorlds;
+        Util::SmallVector<uint64_t> m_meshIDs;
+        Util::SmallVector<Range> m_subtreeRanges;
+        Util::SmallVector<uint8_t> m_rtFlags;
+        // (Also) filled in by TLAS::RebuildTLASInstances()
+        Util::SmallVector<RT_AS_Info> m_rtASInfo;
+        // Instance slot in the scene's InstanceTable
+        Util::SmallVector<uint32_t> m_slots;
+        // Index of parent in the previous level
+        Util::SmallVector<uint32_t> m_parents;
+        // One bit per instance, cleared after every world transformation update
+        Util::SmallVector<uint64_t> m_localDirty;
+        Util::SmallVector<uint64_t> m_worldDirty;
+    };
+
+    //--------------------------------------------------------------------------------------
+    // Per-frame update of the scene graph. Doesn't touch any GPU resources, so that the
+    // headless benchmarks run the same code as SceneCore. Called in this order every frame.
+    //--------------------------------------------------------------------------------------
+
+    // Makes sure every level has one dirty bit per instance
+    void ResizeDirtyBitsets(Util::MutableSpan<TreeLevel> sceneGraph);
+
+    // Samples every animation track at time t and writes the results to the local
+    // transformations of the animated instances ("animatedInstances[i]" is animated by
+    // track i), which are marked dirty
+    void ApplyAnimations(AnimationTracks& animations, float t,
+        Util::Span<InstanceHandle> animatedInstances, const InstanceTable& instances,
+        Util::MutableSpan<TreeLevel> sceneGraph, int maxNumThreads = 0);
+
+    // Recomputes world transformations of the instances whose local transformation or
+    // parent's world transformation has changed (see PropagateWorldTransforms()). Instances
+    // that were transformed directly have a bit set in "hasWorldTransformUpdate" (indexed by
+    // slot) and their accumulated transformation in "worldTransformUpdates" (keyed by ID),
+    // which is reapplied on top of the new world transformation.
+    void RecomputeWorldTransforms(Util::MutableSpan<TreeLevel> sceneGraph,
+        Util::Span<uint64_t> hasWorldTransformUpdate,
+        const Util::HashTable<Math::AffineTransformation>& worldTransformUpdates,
+        int maxNumThreads = 0);
+
+    // Appends the slot of every instance whose world transformation has changed to "updated"
+    // and the new world transformation of the emissive ones to "emissiveUpdates", then
+    // clears the dirty bits
+    void CollectUpdatedInstances(Util::MutableSpan<TreeLevel> sceneGraph, EmissiveBuffer& emissives,
+        Util::Vector<uint32_t, App::FrameAllocator>& updated,
+        Util::SmallVector<EmissiveUpdate>& emissiveUpdates);
+}
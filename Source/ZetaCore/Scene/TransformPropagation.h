@@ -0,0 +1,110 @@
+#pragma once
+
+#include "../Math/MatrixFuncs.h"
+#include "../Support/ParallelFor.h"
+#include "../Utility/Span.h"
+
+namespace ZetaRay::Scene::Internal
+{
+    ZetaInline size_t NumBitsetWords(size_t numBits)
+    {
+        return (numBits + 63) >> 6;
+    }
+
+    ZetaInline bool TestBit(Util::Span<uint64_t> bitset, size_t i)
+    {
+        return (bitset[i >> 6] >> (i & 63)) & 0x1;
+    }
+
+    ZetaInline void SetBit(Util::MutableSpan<uint64_t> bitset, size_t i)
+    {
+        bitset[i >> 6] |= 1llu << (i & 63);
+    }
+
+    ZetaInline bool AnyBitSet(Util::Span<uint64_t> bitset)
+    {
+        for (auto w : bitset)
+        {
+            if (w)
+                return true;
+        }
+
+        return false;
+    }
+
+    // View into one level of the scene graph. Bitsets have one bit per instance.
+    struct TransformLevel
+    {
+        Util::MutableSpan<Math::AffineTransformation> LocalTransforms = { nullptr, 0 };
+        Util::MutableSpan<Math::float4x3> ToWorlds = { nullptr, 0 };
+        Util::MutableSpan<Math::float4x3> PrevToWorlds = { nullptr, 0 };
+        // Index of each instance's parent in the previous level
+        Util::Span<uint32_t> Parents = { nullptr, 0 };
+        // Local transformation has changed (e.g. animation)
+        Util::Span<uint64_t> LocalDirty = { nullptr, 0 };
+        // World transformation has changed. Expected to be set by the caller for instances
+        // that were directly transformed, filled in for the rest.
+        Util::MutableSpan<uint64_t> WorldDirty = { nullptr, 0 };
+    };
+
+    // Recomputes the world transformation of every instance whose local transformation or
+    // parent's world transformation has changed. Levels are processed top-down and instances
+    // within each level are processed in parallel, so work is spread across the cores for
+    // both wide and deep hierarchies. "adjust(levelIdx, idx, vW)" is called for every updated
+    // instance and may modify the new world transformation (from any thread).
+    //
+    // First level is the root and is never updated.
+    template<typename F>
+    void PropagateWorldTransforms(Util::MutableSpan<TransformLevel> levels, F adjust,
+        int maxNumThreads = 0)
+    {
+        // In bitset words, 512 instances
+        constexpr size_t MIN_WORDS_PER_CHUNK = 8;
+
+        for (size_t levelIdx = 1; levelIdx < levels.size(); levelIdx++)
+        {
+            const TransformLevel& parent = levels[levelIdx - 1];
+            TransformLevel& curr = levels[levelIdx];
+            const size_t numInstances = curr.ToWorlds.size();
+
+            if (!AnyBitSet(parent.WorldDirty) && !AnyBitSet(curr.LocalDirty))
+                continue;
+
+            Assert(curr.WorldDirty.size() == NumBitsetWords(numInstances), "Invalid bitset size.");
+            Assert(curr.LocalDirty.size() == NumBitsetWords(numInstances), "Invalid bitset size.");
+
+            // Every chunk covers whole bitset words, so no two threads write to the same word
+            Support::ParallelFor(0, NumBitsetWords(numInstances), MIN_WORDS_PER_CHUNK,
+                [&parent, &curr, &adjust, levelIdx, numInstances](size_t begin, size_t end)
+                {
+                    for (size_t w = begin; w < end; w++)
+                    {
+                        const size_t base = w * 64;
+                        const size_t last = Math::Min(base + 64, numInstances);
+                        uint64_t updated = 0;
+
+                        for (size_t i = base; i < last; i++)
+                        {
+                            const uint32_t p = curr.Parents[i];
+
+                            if (!TestBit(parent.WorldDirty, p) && !TestBit(curr.LocalDirty, i))
+                                continue;
+
+                            Math::AffineTransformation& tr = curr.LocalTransforms[i];
+                            const Math::v_float4x4 vLocal = Math::affineTransformation(tr.Scale,
+                                tr.Rotation, tr.Translation);
+                            // Bottom up transformation hierarchy
+                            Math::v_float4x4 vW = Math::mul(vLocal, Math::load4x3(parent.ToWorlds[p]));
+                            adjust(levelIdx, i, vW);
+
+                            curr.PrevToWorlds[i] = curr.ToWorlds[i];
+                            curr.ToWorlds[i] = Math::float4x3(Math::store(vW));
+                            updated |= 1llu << (i - base);
+                        }
+
+                        curr.WorldDirty[w] |= updated;
+                    }
+                }, maxNumThreads);
+        }
+    }
+}
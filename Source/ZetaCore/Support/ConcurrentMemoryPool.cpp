@@ -0,0 +1,304 @@
+#include "ConcurrentMemoryPool.h"
+#include "../Utility/Error.h"
+#include "../Math/Common.h"
+#include <intrin.h>
+#include <new>
+#include <string.h>
+
+using namespace ZetaRay::Support;
+
+namespace
+{
+    static constexpr int COUNTER_SHIFT = 48;
+    static constexpr uint64_t POINTER_MASK = (1llu << COUNTER_SHIFT) - 1;
+
+    template<typename T>
+    ZetaInline T* Untag(uint64_t head)
+    {
+        return reinterpret_cast<T*>(head & POINTER_MASK);
+    }
+
+    // Pushes a node onto an intrusive push-only (or pop-all) stack
+    template<typename T>
+    ZetaInline void PushFront(std::atomic<T*>& head, T* node, T*& nodeNext)
+    {
+        T* oldHead = head.load(std::memory_order_relaxed);
+
+        do
+        {
+            nodeNext = oldHead;
+        } while (!head.compare_exchange_weak(oldHead, node, std::memory_order_release,
+            std::memory_order_relaxed));
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// MagazineStack
+//--------------------------------------------------------------------------------------
+
+void ConcurrentMemoryPool::MagazineStack::Push(Magazine* m)
+{
+    Assert((reinterpret_cast<uintptr_t>(m) & ~POINTER_MASK) == 0, "Pointer doesn't fit in 48 bits.");
+    uint64_t oldHead = Head.load(std::memory_order_relaxed);
+    uint64_t newHead;
+
+    do
+    {
+        m->Next.store(Untag<Magazine>(oldHead), std::memory_order_relaxed);
+        const uint64_t counter = (oldHead >> COUNTER_SHIFT) + 1;
+        newHead = (counter << COUNTER_SHIFT) | reinterpret_cast<uintptr_t>(m);
+    } while (!Head.compare_exchange_weak(oldHead, newHead, std::memory_order_release,
+        std::memory_order_relaxed));
+}
+
+ConcurrentMemoryPool::Magazine* ConcurrentMemoryPool::MagazineStack::Pop()
+{
+    uint64_t oldHead = Head.load(std::memory_order_acquire);
+
+    while (Magazine* m = Untag<Magazine>(oldHead))
+    {
+        // If m was popped (and possibly pushed again) by another thread in the meantime,
+        // Next might be stale, but then the counter has changed and CAS fails
+        Magazine* next = m->Next.load(std::memory_order_relaxed);
+        const uint64_t newHead = (oldHead & ~POINTER_MASK) | reinterpret_cast<uintptr_t>(next);
+
+        if (Head.compare_exchange_weak(oldHead, newHead, std::memory_order_acquire,
+            std::memory_order_acquire))
+        {
+            return m;
+        }
+    }
+
+    return nullptr;
+}
+
+//--------------------------------------------------------------------------------------
+// ConcurrentMemoryPool
+//--------------------------------------------------------------------------------------
+
+ConcurrentMemoryPool::~ConcurrentMemoryPool()
+{
+    Clear();
+}
+
+void ConcurrentMemoryPool::Clear()
+{
+    BlockHeader* block = m_blocks.exchange(nullptr, std::memory_order_acquire);
+
+    while (block)
+    {
+        BlockHeader* next = block->Next;
+        _aligned_free(block);
+        block = next;
+    }
+
+    Magazine* magazine = m_magazines.exchange(nullptr, std::memory_order_acquire);
+
+    while (magazine)
+    {
+        Magazine* next = magazine->NextAllocated;
+        delete magazine;
+        magazine = next;
+    }
+
+    for (int t = 0; t < MAX_NUM_THREADS; t++)
+    {
+        for (int i = 0; i < POOL_COUNT; i++)
+        {
+            m_caches[t][i] = ThreadCache{};
+            m_remoteFrees[t][i].Head.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    for (int i = 0; i < POOL_COUNT; i++)
+        m_fullMagazines[i].Head.store(0, std::memory_order_relaxed);
+
+    m_emptyMagazines.Head.store(0, std::memory_order_relaxed);
+    m_numBlocks.store(0, std::memory_order_relaxed);
+}
+
+int ConcurrentMemoryPool::GetPoolIndex(size_t size, size_t alignment)
+{
+    // Chunks are only aligned to min(chunk size, BLOCK_HEADER_SIZE)
+    if (alignment > BLOCK_HEADER_SIZE)
+        return -1;
+
+    const size_t s = Math::Max(Math::Max(size, alignment), MIN_ALLOC_SIZE);
+    if (s > MAX_ALLOC_SIZE)
+        return -1;
+
+    return (int)_tzcnt_u64(Math::NextPow2(s)) - (int)INDEX_SHIFT;
+}
+
+void* ConcurrentMemoryPool::AllocateAligned(size_t size, size_t alignment)
+{
+    const int poolIndex = GetPoolIndex(size, alignment);
+
+    if (poolIndex == -1)
+        return _aligned_malloc(size, alignment);
+
+    return Allocate(poolIndex);
+}
+
+void ConcurrentMemoryPool::FreeAligned(void* mem, size_t size, size_t alignment)
+{
+    if (!mem)
+        return;
+
+    const int poolIndex = GetPoolIndex(size, alignment);
+
+    if (poolIndex == -1)
+    {
+        _aligned_free(mem);
+        return;
+    }
+
+    Free(mem, poolIndex);
+}
+
+void* ConcurrentMemoryPool::Allocate(int poolIndex)
+{
+    const int threadIdx = g_threadIdx;
+    Assert(threadIdx >= 0 && threadIdx < MAX_NUM_THREADS, "Invalid thread index.");
+    ThreadCache& cache = m_caches[threadIdx][poolIndex];
+
+    if (!cache.Loaded || cache.Loaded->NumChunks == 0)
+    {
+        // Previous is either full or empty
+        if (cache.Previous && cache.Previous->NumChunks > 0)
+            std::swap(cache.Loaded, cache.Previous);
+        else
+            Refill(cache, threadIdx, poolIndex);
+    }
+
+    Assert(cache.Loaded->NumChunks > 0, "bug");
+
+    return cache.Loaded->Chunks[--cache.Loaded->NumChunks];
+}
+
+void ConcurrentMemoryPool::Free(void* mem, int poolIndex)
+{
+    const int threadIdx = g_threadIdx;
+    Assert(threadIdx >= 0 && threadIdx < MAX_NUM_THREADS, "Invalid thread index.");
+
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(reinterpret_cast<uintptr_t>(mem) & ~(BLOCK_SIZE - 1));
+    Assert(block->PoolIndex == poolIndex, "Size or alignment doesn't match the allocation.");
+
+    // Return it to the owner
+    if (block->OwnerThread != threadIdx)
+    {
+        std::atomic<void*>& head = m_remoteFrees[block->OwnerThread][poolIndex].Head;
+        void* oldHead = head.load(std::memory_order_relaxed);
+
+        do
+        {
+            memcpy(mem, &oldHead, sizeof(void*));
+        } while (!head.compare_exchange_weak(oldHead, mem, std::memory_order_release,
+            std::memory_order_relaxed));
+
+        return;
+    }
+
+    ThreadCache& cache = m_caches[threadIdx][poolIndex];
+
+    if (!cache.Loaded || cache.Loaded->NumChunks == MAGAZINE_SIZE)
+    {
+        // Previous is either full or empty
+        if (cache.Previous && cache.Previous->NumChunks == 0)
+            std::swap(cache.Loaded, cache.Previous);
+        else
+        {
+            // Both are full -- hand one over to the depot
+            if (cache.Previous)
+                m_fullMagazines[poolIndex].Push(cache.Previous);
+
+            cache.Previous = cache.Loaded;
+            cache.Loaded = GetEmptyMagazine();
+        }
+    }
+
+    cache.Loaded->Chunks[cache.Loaded->NumChunks++] = mem;
+}
+
+void ConcurrentMemoryPool::Refill(ThreadCache& cache, int threadIdx, int poolIndex)
+{
+    if (!cache.Loaded)
+        cache.Loaded = GetEmptyMagazine();
+
+    // Take back the chunks that other threads have freed. Whatever doesn't fit goes
+    // to the depot.
+    void* remote = m_remoteFrees[threadIdx][poolIndex].Head.exchange(nullptr, std::memory_order_acquire);
+
+    while (remote)
+    {
+        if (cache.Loaded->NumChunks == MAGAZINE_SIZE)
+        {
+            m_fullMagazines[poolIndex].Push(cache.Loaded);
+            cache.Loaded = GetEmptyMagazine();
+        }
+
+        void* next;
+        memcpy(&next, remote, sizeof(void*));
+        cache.Loaded->Chunks[cache.Loaded->NumChunks++] = remote;
+        remote = next;
+    }
+
+    if (cache.Loaded->NumChunks > 0)
+        return;
+
+    if (Magazine* full = m_fullMagazines[poolIndex].Pop())
+    {
+        m_emptyMagazines.Push(cache.Loaded);
+        cache.Loaded = full;
+
+        return;
+    }
+
+    // Carve new chunks from the current block
+    const size_t chunkSize = GetChunkSizeFromPoolIndex(poolIndex);
+
+    if (cache.BlockCurr + chunkSize > cache.BlockEnd)
+    {
+        BlockHeader* block = NewBlock(poolIndex);
+        cache.BlockCurr = reinterpret_cast<uintptr_t>(block) + BLOCK_HEADER_SIZE;
+        cache.BlockEnd = reinterpret_cast<uintptr_t>(block) + BLOCK_SIZE;
+    }
+
+    const uint32_t numChunks = (uint32_t)Math::Min((cache.BlockEnd - cache.BlockCurr) / chunkSize,
+        (size_t)MAGAZINE_SIZE);
+
+    // In reverse, so that chunks are handed out in address order
+    for (uint32_t i = 0; i < numChunks; i++)
+        cache.Loaded->Chunks[numChunks - 1 - i] = reinterpret_cast<void*>(cache.BlockCurr + i * chunkSize);
+
+    cache.Loaded->NumChunks = numChunks;
+    cache.BlockCurr += numChunks * chunkSize;
+}
+
+ConcurrentMemoryPool::Magazine* ConcurrentMemoryPool::GetEmptyMagazine()
+{
+    if (Magazine* m = m_emptyMagazines.Pop())
+        return m;
+
+    Magazine* m = new (std::nothrow) Magazine;
+    Check(m, "Out of memory.");
+    m->NumChunks = 0;
+    PushFront(m_magazines, m, m->NextAllocated);
+
+    return m;
+}
+
+ConcurrentMemoryPool::BlockHeader* ConcurrentMemoryPool::NewBlock(int poolIndex)
+{
+    static_assert(sizeof(BlockHeader) <= BLOCK_HEADER_SIZE, "Block header doesn't fit.");
+
+    // Aligned to its size, so that the header can be found from any chunk
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(_aligned_malloc(BLOCK_SIZE, BLOCK_SIZE));
+    Check(block, "Out of memory.");
+    block->OwnerThread = g_threadIdx;
+    block->PoolIndex = poolIndex;
+    PushFront(m_blocks, block, block->Next);
+    m_numBlocks.fetch_add(1, std::memory_order_relaxed);
+
+    return block;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "../App/App.h"
+#include <atomic>
+
+namespace ZetaRay::Support
+{
+    //    Thread-safe variant of MemoryPool
+    //     - Same size classes as MemoryPool -- pool i has chunk size 2^(i + 3), from 8 bytes
+    //       to 4 KB. Larger requests go to _aligned_malloc().
+    //     - Chunks are carved from 64 KB blocks. Every block is owned by the thread that
+    //       allocated it.
+    //     - Each thread caches free chunks of each size class in two magazines (fixed-size
+    //       arrays of chunks). Most allocations and frees only touch the calling thread's
+    //       magazines, without any synchronization.
+    //     - When both of its magazines are full (empty), a thread hands a full magazine to
+    //       (takes a full magazine from) the global depot, which is a lock-free stack of
+    //       magazines.
+    //     - Freeing a chunk from a thread other than the block's owner pushes the chunk
+    //       onto the owner's lock-free remote free list. Owner takes those back before
+    //       going to the depot.
+    //
+    //    Must be called from threads with a valid g_threadIdx (main thread and the thread
+    //    pool threads). Ref: J. Bonwick and J. Adams, "Magazines and Vmem: Extending the
+    //    Slab Allocator to Many CPUs and Arbitrary Resources," USENIX ATC, 2001.
+    class ConcurrentMemoryPool
+    {
+    public:
+        ConcurrentMemoryPool() = default;
+        ~ConcurrentMemoryPool();
+
+        ConcurrentMemoryPool(ConcurrentMemoryPool&&) = delete;
+        ConcurrentMemoryPool& operator=(ConcurrentMemoryPool&&) = delete;
+
+        void* AllocateAligned(size_t size, size_t alignment = alignof(std::max_align_t));
+        void FreeAligned(void* mem, size_t size, size_t alignment = alignof(std::max_align_t));
+
+        // Frees all the memory. Not thread-safe -- all the allocations must have been
+        // freed (or abandoned) and no other thread can be using the pool.
+        void Clear();
+        size_t TotalSize() const { return m_numBlocks.load(std::memory_order_relaxed) * BLOCK_SIZE; }
+
+    private:
+        static constexpr size_t BLOCK_SIZE = 64 * 1024;
+        static constexpr size_t MAX_ALLOC_SIZE = 4096;
+        static constexpr int POOL_COUNT = 10;
+        static constexpr size_t INDEX_SHIFT = 3;
+        static constexpr size_t MIN_ALLOC_SIZE = 1 << INDEX_SHIFT;
+        // Chunks start at this offset into their block, so chunks of at least this size
+        // are aligned to it
+        static constexpr size_t BLOCK_HEADER_SIZE = 64;
+        static constexpr uint32_t MAGAZINE_SIZE = 32;
+
+        struct BlockHeader
+        {
+            BlockHeader* Next;
+            int OwnerThread;
+            int PoolIndex;
+        };
+
+        struct Magazine
+        {
+            // Link in the depot stacks -- magazines are never freed until Clear(), so
+            // this can be read after another thread has popped it
+            std::atomic<Magazine*> Next;
+            // Link in the list of all magazines
+            Magazine* NextAllocated;
+            uint32_t NumChunks;
+            void* Chunks[MAGAZINE_SIZE];
+        };
+
+        struct alignas(64) ThreadCache
+        {
+            Magazine* Loaded;
+            Magazine* Previous;
+            // Unused part of the most recent block
+            uintptr_t BlockCurr;
+            uintptr_t BlockEnd;
+        };
+
+        struct alignas(64) RemoteFreeList
+        {
+            // Intrusive linked list, next pointer is stored in the first 8 bytes of
+            // each chunk
+            std::atomic<void*> Head;
+        };
+
+        // Lock-free stack of magazines. To avoid ABA, top 16 bits of the head are a
+        // counter that's incremented on every push.
+        struct alignas(64) MagazineStack
+        {
+            void Push(Magazine* m);
+            Magazine* Pop();
+
+            std::atomic_uint64_t Head;
+        };
+
+        // Returns -1 for requests that don't go through the pool
+        static int GetPoolIndex(size_t size, size_t alignment);
+        ZetaInline static size_t GetChunkSizeFromPoolIndex(int i) { return 1llu << (i + INDEX_SHIFT); }
+
+        void* Allocate(int poolIndex);
+        void Free(void* mem, int poolIndex);
+        // Fills the (empty) loaded magazine of the calling thread
+        void Refill(ThreadCache& cache, int threadIdx, int poolIndex);
+        // Returns an empty magazine from the depot or allocates a new one
+        Magazine* GetEmptyMagazine();
+        BlockHeader* NewBlock(int poolIndex);
+
+        ThreadCache m_caches[MAX_NUM_THREADS][POOL_COUNT] = {};
+        RemoteFreeList m_remoteFrees[MAX_NUM_THREADS][POOL_COUNT] = {};
+        MagazineStack m_fullMagazines[POOL_COUNT] = {};
+        MagazineStack m_emptyMagazines;
+
+        // Push-only lists of everything that was allocated, so that it can be freed in Clear()
+        std::atomic<BlockHeader*> m_blocks = nullptr;
+        std::atomic<Magazine*> m_magazines = nullptr;
+        std::atomic_size_t m_numBlocks = 0;
+    };
+
+    struct ConcurrentPoolAllocator
+    {
+        ConcurrentPoolAllocator(ConcurrentMemoryPool& mp)
+            : m_allocator(&mp)
+        {}
+
+        ConcurrentPoolAllocator(const ConcurrentPoolAllocator& other)
+            : m_allocator(other.m_allocator)
+        {}
+
+        ConcurrentPoolAllocator& operator=(const ConcurrentPoolAllocator& other)
+        {
+            m_allocator = other.m_allocator;
+            return *this;
+        }
+
+        ZetaInline void* AllocateAligned(size_t size, size_t alignment = alignof(std::max_align_t))
+        {
+            return m_allocator->AllocateAligned(size, alignment);
+        }
+
+        ZetaInline void FreeAligned(void* mem, size_t size, size_t alignment = alignof(std::max_align_t))
+        {
+            m_allocator->FreeAligned(mem, size, alignment);
+        }
+
+    private:
+        ConcurrentMemoryPool* m_allocator;
+    };
+}
@@ -1,86 +1,247 @@
 #pragma once
 
 #include "../App/App.h"
-#include <string.h>
+#include "../Math/Common.h"
+#include <atomic>
 
 namespace ZetaRay::Support
 {
+    //    Linear allocator for memory that's only needed until the end of the frame
+    //     - Every thread bumps a pointer into its own current block. When that block
+    //       is exhausted, thread takes another one from the free list (or mallocs a new
+    //       one) and chains the old one to its list of used blocks, so there's no limit
+    //       on the amount of memory a thread can use per frame.
+    //     - Requests that don't fit in a block go to a per-thread list of large
+    //       allocations that's freed in Reset().
+    //     - Free list is only pushed to in Reset(), so popping from it during the frame
+    //       doesn't suffer from ABA.
+    //     - Blocks that weren't used for NUM_FRAMES_TO_FREE_DELAY consecutive frames are
+    //       released.
+    //
+    //    AllocateAligned() must be called from threads with a valid g_threadIdx.
     template<size_t BlockSize>
     struct FrameMemory
     {
-        FrameMemory()
-        {
-            memset(m_blocks, 0, sizeof(MemoryBlock) * NUM_BLOCKS);
-        }
+        static constexpr int NUM_FRAMES_TO_FREE_DELAY = 10;
+        static constexpr size_t BLOCK_SIZE = BlockSize;
+
+        FrameMemory() = default;
         ~FrameMemory()
         {
-            for (int i = 0; i < NUM_BLOCKS; i++)
+            Reset();
+
+            MemoryBlock* block = m_freeBlocks.load(std::memory_order_relaxed);
+
+            while (block)
             {
-                if (m_blocks[i].Start)
-                    free(m_blocks[i].Start);
+                MemoryBlock* next = block->Next;
+                free(block);
+                block = next;
             }
         }
 
         FrameMemory(FrameMemory&&) = delete;
         FrameMemory& operator=(FrameMemory&&) = delete;
 
-        struct MemoryBlock
+        struct ThreadUsage
         {
-            void* Start;
-            uintptr_t Offset;
-            int UsageCounter;
+            // Number of bytes requested by this thread during the last frame
+            size_t NumBytes;
+            // Max of the above over all the frames
+            size_t PeakNumBytes;
         };
 
-        ZetaInline MemoryBlock& GetAndInitIfEmpty(int i)
+        void* AllocateAligned(size_t size, size_t alignment)
         {
-            Assert(i >= 0 && i < NUM_BLOCKS, "Invalid block index.");
+            Assert(g_threadIdx >= 0 && g_threadIdx < MAX_NUM_THREADS, "Invalid thread index.");
+            ThreadContext& ctx = m_threads[g_threadIdx];
+            alignment = Math::Max(alignof(std::max_align_t), alignment);
+            ctx.NumBytes += size;
+
+            // at most alignment - 1 extra bytes are required
+            if (size + alignment - 1 > BLOCK_SIZE - BLOCK_HEADER_SIZE)
+                return AllocateLarge(ctx, size, alignment);
 
-            if (!m_blocks[i].Start)
+            // current block has enough space
+            if (ctx.Curr)
             {
-                m_blocks[i].Start = malloc(BLOCK_SIZE);
-                m_blocks[i].Offset = 0;
+                const uintptr_t start = reinterpret_cast<uintptr_t>(ctx.Curr);
+                const uintptr_t ret = Math::AlignUp(start + ctx.Offset, alignment);
+
+                if (ret + size <= start + BLOCK_SIZE)
+                {
+                    ctx.Offset = ret + size - start;
+                    return reinterpret_cast<void*>(ret);
+                }
+
+                ctx.Curr->Next = ctx.Used;
+                ctx.Used = ctx.Curr;
             }
 
-            m_blocks[i].UsageCounter = NUM_FRAMES_TO_FREE_DELAY;
+            ctx.Curr = AcquireBlock();
+
+            const uintptr_t start = reinterpret_cast<uintptr_t>(ctx.Curr);
+            const uintptr_t ret = Math::AlignUp(start + BLOCK_HEADER_SIZE, alignment);
+            ctx.Offset = ret + size - start;
 
-            return m_blocks[i];
+            return reinterpret_cast<void*>(ret);
         }
 
+        // Releases all the allocations. Not thread-safe -- no other thread can be
+        // allocating at the same time.
         void Reset()
         {
-            for (int i = 0; i < NUM_BLOCKS; i++)
+            // Blocks that are still in the free list weren't used during this frame
+            MemoryBlock* block = m_freeBlocks.load(std::memory_order_relaxed);
+            MemoryBlock* freeList = nullptr;
+
+            while (block)
             {
-                m_blocks[i].Offset = 0;
+                MemoryBlock* next = block->Next;
+
+                if (++block->NumFramesUnused >= NUM_FRAMES_TO_FREE_DELAY)
+                {
+                    free(block);
+                    m_numBlocks--;
+                }
+                else
+                {
+                    block->Next = freeList;
+                    freeList = block;
+                }
+
+                block = next;
+            }
+
+            size_t frameNumBytes = 0;
+            size_t frameNumLargeBytes = 0;
+
+            for (int i = 0; i < MAX_NUM_THREADS; i++)
+            {
+                ThreadContext& ctx = m_threads[i];
+
+                if (ctx.Curr)
+                {
+                    ctx.Curr->Next = ctx.Used;
+                    ctx.Used = ctx.Curr;
+                }
+
+                block = ctx.Used;
 
-                m_blocks[i].UsageCounter = (m_blocks[i].UsageCounter == NUM_FRAMES_TO_FREE_DELAY) ?
-                    NUM_FRAMES_TO_FREE_DELAY :
-                    m_blocks[i].UsageCounter - 1;
+                while (block)
+                {
+                    MemoryBlock* next = block->Next;
+                    block->NumFramesUnused = 0;
+                    block->Next = freeList;
+                    freeList = block;
+                    block = next;
+                }
 
-                if (m_blocks[i].UsageCounter == 0)
+                LargeAllocation* large = ctx.Large;
+
+                while (large)
                 {
-                    free(m_blocks[i].Start);
-                    m_blocks[i].Start = nullptr;
+                    LargeAllocation* next = large->Next;
+                    _aligned_free(large);
+                    large = next;
                 }
+
+                m_usage[i].NumBytes = ctx.NumBytes;
+                m_usage[i].PeakNumBytes = Math::Max(m_usage[i].PeakNumBytes, ctx.NumBytes);
+                frameNumBytes += ctx.NumBytes;
+                frameNumLargeBytes += ctx.NumLargeBytes;
+
+                ctx = ThreadContext{};
             }
+
+            m_freeBlocks.store(freeList, std::memory_order_relaxed);
+            m_frameNumBytes = frameNumBytes;
+            m_frameNumLargeBytes = frameNumLargeBytes;
+            m_peakFrameNumBytes = Math::Max(m_peakFrameNumBytes, frameNumBytes);
         }
 
-        size_t TotalSize()
+        // Memory that's currently reserved for blocks, excluding large allocations
+        size_t TotalSize() const { return m_numBlocks.load(std::memory_order_relaxed) * BLOCK_SIZE; }
+        // Following are for the last frame (i.e. as of the last Reset() call)
+        size_t GetFrameUsage() const { return m_frameNumBytes; }
+        size_t GetPeakFrameUsage() const { return m_peakFrameNumBytes; }
+        size_t GetFrameLargeAllocationUsage() const { return m_frameNumLargeBytes; }
+        ThreadUsage GetThreadUsage(int threadIdx) const
+        {
+            Assert(threadIdx >= 0 && threadIdx < MAX_NUM_THREADS, "Invalid thread index.");
+            return m_usage[threadIdx];
+        }
+
+    private:
+        // Allocations in each block start at this offset
+        static constexpr size_t BLOCK_HEADER_SIZE = 64;
+
+        struct MemoryBlock
+        {
+            MemoryBlock* Next;
+            int NumFramesUnused;
+        };
+
+        struct LargeAllocation
+        {
+            LargeAllocation* Next;
+        };
+
+        struct alignas(64) ThreadContext
+        {
+            MemoryBlock* Curr;
+            uintptr_t Offset;
+            // Exhausted blocks from this frame
+            MemoryBlock* Used;
+            LargeAllocation* Large;
+            size_t NumBytes;
+            size_t NumLargeBytes;
+        };
+
+        static_assert(sizeof(MemoryBlock) <= BLOCK_HEADER_SIZE, "Block header doesn't fit.");
+        static_assert(BLOCK_SIZE > BLOCK_HEADER_SIZE, "Block size is too small.");
+
+        MemoryBlock* AcquireBlock()
         {
-            size_t sum = 0;
+            MemoryBlock* block = m_freeBlocks.load(std::memory_order_acquire);
 
-            for (int i = 0; i < NUM_BLOCKS; i++)
+            while (block && !m_freeBlocks.compare_exchange_weak(block, block->Next,
+                std::memory_order_acquire, std::memory_order_acquire))
             {
-                if (m_blocks[i].Start)
-                    sum += BLOCK_SIZE;
             }
 
-            return sum;
+            if (block)
+                return block;
+
+            block = reinterpret_cast<MemoryBlock*>(malloc(BLOCK_SIZE));
+            Check(block, "Out of memory.");
+            block->Next = nullptr;
+            block->NumFramesUnused = 0;
+            m_numBlocks.fetch_add(1, std::memory_order_relaxed);
+
+            return block;
         }
 
-        static constexpr int NUM_BLOCKS = MAX_NUM_THREADS * 2;
-        static constexpr int NUM_FRAMES_TO_FREE_DELAY = 10;
-        static constexpr size_t BLOCK_SIZE = BlockSize;
+        void* AllocateLarge(ThreadContext& ctx, size_t size, size_t alignment)
+        {
+            // Header goes right before the returned memory
+            const size_t offset = Math::AlignUp(sizeof(LargeAllocation), alignment);
+            LargeAllocation* large = reinterpret_cast<LargeAllocation*>(_aligned_malloc(offset + size, alignment));
+            Check(large, "Out of memory.");
+
+            large->Next = ctx.Large;
+            ctx.Large = large;
+            ctx.NumLargeBytes += size;
+
+            return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(large) + offset);
+        }
 
-        MemoryBlock m_blocks[NUM_BLOCKS];
+        ThreadContext m_threads[MAX_NUM_THREADS] = {};
+        ThreadUsage m_usage[MAX_NUM_THREADS] = {};
+        std::atomic<MemoryBlock*> m_freeBlocks = nullptr;
+        std::atomic_size_t m_numBlocks = 0;
+        size_t m_frameNumBytes = 0;
+        size_t m_frameNumLargeBytes = 0;
+        size_t m_peakFrameNumBytes = 0;
     };
-}
\ No newline at end of file
+}
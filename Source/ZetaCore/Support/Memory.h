@@ -2,6 +2,7 @@
 
 #include "../App/ZetaRay.h"
 #include <malloc.h>
+#include <atomic>
 #include <concepts>
 
 namespace ZetaRay::Support
@@ -16,10 +17,23 @@ namespace ZetaRay::Support
             { t.FreeAligned(mem, s, a) } -> std::same_as<void>;
         };
 
+    // Allocations that went through SystemAllocator since the process started (from all
+    // threads). Meant for diagnostics, e.g. counting allocations per frame in benchmarks.
+    struct SystemAllocatorStats
+    {
+        std::atomic_uint64_t NumAllocs;
+        std::atomic_uint64_t NumAllocatedBytes;
+    };
+
+    inline SystemAllocatorStats g_systemAllocatorStats;
+
     struct SystemAllocator
     {
         ZetaInline void* AllocateAligned(size_t size, size_t alignment)
         {
+            g_systemAllocatorStats.NumAllocs.fetch_add(1, std::memory_order_relaxed);
+            g_systemAllocatorStats.NumAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+
             return _aligned_malloc(size, alignment);
         }
 
@@ -1,32 +1,71 @@
 #include "MemoryArena.h"
+#include "../Win32/Win32.h"
 
 using namespace ZetaRay::Support;
 using namespace ZetaRay::Math;
 
+namespace
+{
+    static constexpr size_t VM_PAGE_SIZE = 4096;
+}
+
 //--------------------------------------------------------------------------------------
 // MemoryArena
 //--------------------------------------------------------------------------------------
 
-MemoryArena::MemoryArena(size_t blockSize)
+MemoryArena::MemoryArena(size_t blockSize, size_t reserveSize)
     : m_blockSize(blockSize)
-{}
+{
+    if (reserveSize)
+    {
+        void* base = VirtualAlloc(nullptr, reserveSize, MEM_RESERVE, PAGE_NOACCESS);
+        Check(base, "VirtualAlloc() for reserving %llu bytes failed with the following error code: %d.",
+            reserveSize, GetLastError());
+
+        m_reserveBase = reinterpret_cast<uintptr_t>(base);
+        m_reserveSize = reserveSize;
+        m_committedEnd = m_reserveBase;
+        m_ptr = m_reserveBase;
+        m_end = m_reserveBase;
+    }
+}
+
+MemoryArena::~MemoryArena()
+{
+    Release();
+}
 
 MemoryArena::MemoryArena(MemoryArena&& other)
     : m_blockSize(other.m_blockSize)
 {
-    m_blocks.swap(other.m_blocks);
-
-#ifndef NDEBUG
-    m_numAllocs = other.m_numAllocs;
-#endif
+    *this = ZetaMove(other);
 }
 
 MemoryArena& MemoryArena::operator=(MemoryArena&& other)
 {
     Check(m_blockSize == other.m_blockSize, "These MemoryArenas are incompatible.");
 
-    m_blocks.swap(other.m_blocks);
-    other.m_blocks.free_memory();
+    Release();
+
+    m_ptr = other.m_ptr;
+    m_end = other.m_end;
+    m_blocks = other.m_blocks;
+    m_largeBlocks = other.m_largeBlocks;
+    m_freeBlocks = other.m_freeBlocks;
+    m_reserveBase = other.m_reserveBase;
+    m_reserveSize = other.m_reserveSize;
+    m_committedEnd = other.m_committedEnd;
+    m_totalSize = other.m_totalSize;
+
+    other.m_ptr = 0;
+    other.m_end = 0;
+    other.m_blocks = nullptr;
+    other.m_largeBlocks = nullptr;
+    other.m_freeBlocks = nullptr;
+    other.m_reserveBase = 0;
+    other.m_reserveSize = 0;
+    other.m_committedEnd = 0;
+    other.m_totalSize = 0;
 
 #ifndef NDEBUG
     m_numAllocs = other.m_numAllocs;
@@ -36,64 +75,207 @@ MemoryArena& MemoryArena::operator=(MemoryArena&& other)
     return *this;
 }
 
-void* MemoryArena::AllocateAligned(size_t size, size_t alignment)
+void* MemoryArena::AllocateSlow(size_t size, size_t alignment)
 {
-    for (auto& block : m_blocks)
+#ifndef NDEBUG
+    m_numAllocs++;
+#endif
+
+    // Still in the reserved range
+    if (m_reserveBase && !m_blocks)
     {
-        const uintptr_t start = reinterpret_cast<uintptr_t>(block.Start);
-        const uintptr_t ret = AlignUp(start + block.Offset, alignment);
-        const uintptr_t startOffset = ret - start;
+        if (void* mem = CommitAndAllocate(size, alignment))
+            return mem;
+    }
 
-        if (startOffset + size < block.Size)
-        {
-            block.Offset = startOffset + size;
+    // Memory allocations are 16-byte aligned by default -- for larger alignments, at
+    // most alignment - 1 extra bytes are required
+    const size_t maxSize = alignment > BLOCK_HEADER_SIZE ? size + alignment - 1 : size;
 
-#ifndef NDEBUG
-            m_numAllocs++;
-#endif
+    if (maxSize + BLOCK_HEADER_SIZE >= m_blockSize || size > m_blockSize / 4)
+        return AllocateLarge(size, alignment);
 
-            return reinterpret_cast<void*>(ret);
-        }
+    BlockHeader* block = m_freeBlocks;
+
+    if (block)
+        m_freeBlocks = block->Next;
+    else
+    {
+        block = reinterpret_cast<BlockHeader*>(malloc(m_blockSize));
+        Check(block, "Out of memory.");
+        block->Size = m_blockSize;
+        m_totalSize += m_blockSize;
     }
 
-    size_t blockSize = Max(m_blockSize, size);
+    block->Next = m_blocks;
+    m_blocks = block;
 
-    // Memory allocationss are 16-byte aligned by default -- for larger alignments, at
-    // most alignment - 1 extra bytes are required
-    if (alignment > 16)
-        blockSize = AlignUp(blockSize + alignment - 1, alignment);
+    const uintptr_t ret = AlignUp(reinterpret_cast<uintptr_t>(block) + BLOCK_HEADER_SIZE, alignment);
+    m_ptr = ret + size;
+    m_end = reinterpret_cast<uintptr_t>(block) + m_blockSize;
+    Assert(m_ptr < m_end, "Offset must be < size.");
+
+    return reinterpret_cast<void*>(ret);
+}
+
+void* MemoryArena::AllocateLarge(size_t size, size_t alignment)
+{
+    const size_t blockSize = BLOCK_HEADER_SIZE + (alignment > BLOCK_HEADER_SIZE ?
+        size + alignment - 1 : size);
+    BlockHeader* block = reinterpret_cast<BlockHeader*>(malloc(blockSize));
+    Check(block, "Out of memory.");
+
+    block->Size = blockSize;
+    block->Next = m_largeBlocks;
+    m_largeBlocks = block;
+    m_totalSize += blockSize;
+
+    return reinterpret_cast<void*>(AlignUp(reinterpret_cast<uintptr_t>(block) + BLOCK_HEADER_SIZE, alignment));
+}
+
+void* MemoryArena::CommitAndAllocate(size_t size, size_t alignment)
+{
+    const uintptr_t ret = AlignUp(m_ptr, alignment);
+    const uintptr_t reserveEnd = m_reserveBase + m_reserveSize;
 
-    MemoryBlock memBlock(blockSize);
+    if (ret + size >= reserveEnd)
+        return nullptr;
 
-    const uintptr_t ret = AlignUp(reinterpret_cast<uintptr_t>(memBlock.Start), 
-        alignment);
-    memBlock.Offset = ret - reinterpret_cast<uintptr_t>(memBlock.Start);
-    memBlock.Offset += size;
-    Assert(memBlock.Offset <= memBlock.Size, "Offset must be <= size.");
+    // Commit in multiples of block size. VirtualAlloc() commits every page that overlaps
+    // the given range, so block size doesn't have to be a multiple of page size.
+    const uintptr_t newEnd = Min(m_reserveBase + AlignUp(ret + size + 1 - m_reserveBase, m_blockSize),
+        reserveEnd);
+    Assert(newEnd > m_committedEnd, "bug");
 
-    // Push the newly added block to the front, so it's searched before others 
-    // for future allocations
-    m_blocks.push_front(ZetaMove(memBlock));
+    void* mem = VirtualAlloc(reinterpret_cast<void*>(m_committedEnd), newEnd - m_committedEnd,
+        MEM_COMMIT, PAGE_READWRITE);
+    Check(mem, "VirtualAlloc() for committing %llu bytes failed with the following error code: %d.",
+        newEnd - m_committedEnd, GetLastError());
+
+    m_totalSize += newEnd - m_committedEnd;
+    m_committedEnd = newEnd;
+    m_ptr = ret + size;
+    m_end = newEnd;
 
     return reinterpret_cast<void*>(ret);
 }
 
-size_t MemoryArena::TotalSize() const
+MemoryArena::Checkpoint MemoryArena::GetCheckpoint() const
+{
+    Checkpoint c;
+    c.Ptr = m_ptr;
+    c.Blocks = m_blocks;
+    c.LargeBlocks = m_largeBlocks;
+
+    return c;
+}
+
+void MemoryArena::Rewind(const Checkpoint& checkpoint)
 {
-    size_t sum = 0;
+    // Regular blocks are kept around for reuse
+    while (m_blocks != checkpoint.Blocks)
+    {
+        Assert(m_blocks, "Invalid checkpoint.");
+        BlockHeader* next = m_blocks->Next;
+        m_blocks->Next = m_freeBlocks;
+        m_freeBlocks = m_blocks;
+        m_blocks = next;
+    }
+
+    while (m_largeBlocks != checkpoint.LargeBlocks)
+    {
+        Assert(m_largeBlocks, "Invalid checkpoint.");
+        BlockHeader* next = m_largeBlocks->Next;
+        m_totalSize -= m_largeBlocks->Size;
+        free(m_largeBlocks);
+        m_largeBlocks = next;
+    }
 
-    for (auto& block : m_blocks)
-        sum += block.Size;
+    m_ptr = checkpoint.Ptr;
 
-    return sum;
+    if (m_blocks)
+        m_end = reinterpret_cast<uintptr_t>(m_blocks) + m_blockSize;
+    else
+        m_end = m_reserveBase ? m_committedEnd : 0;
 }
 
 void MemoryArena::Reset()
 {
-    while (m_blocks.size() > 1)
-        m_blocks.pop_back();
+    // Keep the most recently used block, unless there's a reserved range
+    BlockHeader* keep = m_reserveBase ? nullptr : (m_blocks ? m_blocks : m_freeBlocks);
+    BlockHeader* lists[] = { m_blocks, m_largeBlocks, m_freeBlocks };
+
+    for (BlockHeader* block : lists)
+    {
+        while (block)
+        {
+            BlockHeader* next = block->Next;
+
+            if (block != keep)
+            {
+                m_totalSize -= block->Size;
+                free(block);
+            }
+
+            block = next;
+        }
+    }
+
+    m_blocks = keep;
+    m_largeBlocks = nullptr;
+    m_freeBlocks = nullptr;
+
+    if (keep)
+    {
+        keep->Next = nullptr;
+        m_ptr = reinterpret_cast<uintptr_t>(keep) + BLOCK_HEADER_SIZE;
+        m_end = reinterpret_cast<uintptr_t>(keep) + m_blockSize;
+    }
+    else if (m_reserveBase)
+    {
+        // First blockSize bytes stay committed. Decommit works on whole pages.
+        const uintptr_t keepEnd = Min(m_reserveBase + AlignUp(m_blockSize, VM_PAGE_SIZE), m_committedEnd);
+
+        if (m_committedEnd > keepEnd)
+        {
+            VirtualFree(reinterpret_cast<void*>(keepEnd), m_committedEnd - keepEnd, MEM_DECOMMIT);
+            m_totalSize -= m_committedEnd - keepEnd;
+            m_committedEnd = keepEnd;
+        }
+
+        m_ptr = m_reserveBase;
+        m_end = m_committedEnd;
+    }
 
-    if (!m_blocks.empty())
-        m_blocks[0].Offset = 0;
+#ifndef NDEBUG
+    m_numAllocs = 0;
+#endif
 }
 
+void MemoryArena::Release()
+{
+    BlockHeader* lists[] = { m_blocks, m_largeBlocks, m_freeBlocks };
+
+    for (BlockHeader* block : lists)
+    {
+        while (block)
+        {
+            BlockHeader* next = block->Next;
+            free(block);
+            block = next;
+        }
+    }
+
+    if (m_reserveBase)
+        VirtualFree(reinterpret_cast<void*>(m_reserveBase), 0, MEM_RELEASE);
+
+    m_ptr = 0;
+    m_end = 0;
+    m_blocks = nullptr;
+    m_largeBlocks = nullptr;
+    m_freeBlocks = nullptr;
+    m_reserveBase = 0;
+    m_reserveSize = 0;
+    m_committedEnd = 0;
+    m_totalSize = 0;
+}
@@ -4,72 +4,118 @@
 
 namespace ZetaRay::Support
 {
+    //    Linear allocator where memory is only released all at once (Reset()) or back
+    //    to a previously taken checkpoint (Rewind()).
+    //     - Allocations bump a pointer into the current block. Once it's exhausted, a new
+    //       block becomes the current one, so allocation is O(1).
+    //     - Requests larger than a quarter of the block size get their own block, so that
+    //       the rest of the current block isn't wasted.
+    //     - If reserveSize is nonzero, a contiguous range of virtual memory with that size
+    //       is reserved up front and committed lazily (blockSize bytes at a time). Regular
+    //       blocks are only used after the reserved range has been exhausted.
     class MemoryArena
     {
+        struct BlockHeader
+        {
+            BlockHeader* Next;
+            size_t Size;
+        };
+
     public:
-        explicit MemoryArena(size_t blockSize = 64 * 1024);
-        ~MemoryArena() = default;
+        explicit MemoryArena(size_t blockSize = 64 * 1024, size_t reserveSize = 0);
+        ~MemoryArena();
         MemoryArena(MemoryArena&&);
         MemoryArena& operator=(MemoryArena&&);
 
-        void* AllocateAligned(size_t size, size_t alignment = alignof(std::max_align_t));
-        void FreeAligned(void* pMem, size_t size, size_t alignment = alignof(std::max_align_t)) {};
-        size_t TotalSize() const;
-        void Reset();
+        // State of the arena at some point in time. All the allocations that were made
+        // after it was taken are released when arena is rewound to it.
+        struct Checkpoint
+        {
+        private:
+            friend class MemoryArena;
 
-    private:
-        struct MemoryBlock
+            uintptr_t Ptr;
+            BlockHeader* Blocks;
+            BlockHeader* LargeBlocks;
+        };
+
+        ZetaInline void* AllocateAligned(size_t size, size_t alignment = alignof(std::max_align_t))
         {
-            MemoryBlock() = default;
-            explicit MemoryBlock(size_t size)
-                : Size(size),
-                Offset(0)
-            {
-                Start = malloc(size);
-            }
-            ~MemoryBlock()
-            {
-                if (Start)
-                    free(Start);
+            const uintptr_t ret = Math::AlignUp(m_ptr, alignment);
 
-                Start = nullptr;
-                Offset = 0;
-                Size = 0;
-            }
-            MemoryBlock(MemoryBlock&& rhs)
-                : Start(rhs.Start),
-                Size(rhs.Size),
-                Offset(rhs.Offset)
+            if (ret + size < m_end)
             {
-                rhs.Start = nullptr;
-                rhs.Offset = 0;
-                rhs.Size = 0;
-            }
-            MemoryBlock& operator=(MemoryBlock&& rhs)
-            {
-                Start = rhs.Start;
-                Size = rhs.Size;
-                Offset = rhs.Offset;
+                m_ptr = ret + size;
 
-                rhs.Start = nullptr;
-                rhs.Size = 0;
-                rhs.Offset = 0;
+#ifndef NDEBUG
+                m_numAllocs++;
+#endif
 
-                return *this;
+                return reinterpret_cast<void*>(ret);
             }
 
-            void* Start;
-            size_t Size;
-            uintptr_t Offset;
-        };
+            return AllocateSlow(size, alignment);
+        }
+
+        void FreeAligned(void* pMem, size_t size, size_t alignment = alignof(std::max_align_t)) {};
+        size_t TotalSize() const { return m_totalSize; }
+        // Releases all the allocations. Keeps one block (or the first blockSize bytes of the
+        // reserved range) around for future allocations.
+        void Reset();
+        Checkpoint GetCheckpoint() const;
+        // Checkpoint must have been taken after the last call to Reset() and arena
+        // can't have been rewound to an earlier checkpoint in the meantime.
+        void Rewind(const Checkpoint& checkpoint);
+
+    private:
+        // Allocations in a block start at this offset, which keeps them 16-byte aligned
+        static constexpr size_t BLOCK_HEADER_SIZE = 16;
+        static_assert(sizeof(BlockHeader) <= BLOCK_HEADER_SIZE, "Block header doesn't fit.");
+
+        void* AllocateSlow(size_t size, size_t alignment);
+        void* AllocateLarge(size_t size, size_t alignment);
+        void* CommitAndAllocate(size_t size, size_t alignment);
+        void Release();
 
         const size_t m_blockSize;
-        Util::SmallVector<MemoryBlock, SystemAllocator, 8> m_blocks;
+        // Unused part of the current block
+        uintptr_t m_ptr = 0;
+        uintptr_t m_end = 0;
+        // Singly-linked lists, most recent first. First one in m_blocks is the current block.
+        BlockHeader* m_blocks = nullptr;
+        BlockHeader* m_largeBlocks = nullptr;
+        // Regular blocks that were released by Rewind() and can be reused
+        BlockHeader* m_freeBlocks = nullptr;
+        // Reserved virtual memory range, [m_reserveBase, m_committedEnd) is committed
+        uintptr_t m_reserveBase = 0;
+        size_t m_reserveSize = 0;
+        uintptr_t m_committedEnd = 0;
+        size_t m_totalSize = 0;
 #ifndef NDEBUG
         uint32_t m_numAllocs = 0;
 #endif
     };
 
+    // Rewinds the arena to its state at construction when going out of scope
+    struct ScopedArenaCheckpoint
+    {
+        explicit ScopedArenaCheckpoint(MemoryArena& ma)
+            : m_arena(ma),
+            m_checkpoint(ma.GetCheckpoint())
+        {}
+        ~ScopedArenaCheckpoint()
+        {
+            m_arena.Rewind(m_checkpoint);
+        }
+
+        ScopedArenaCheckpoint(const ScopedArenaCheckpoint&) = delete;
+        ScopedArenaCheckpoint& operator=(const ScopedArenaCheckpoint&) = delete;
+
+    private:
+        MemoryArena& m_arena;
+        const MemoryArena::Checkpoint m_checkpoint;
+    };
+
     struct ArenaAllocator
     {
         ArenaAllocator(MemoryArena& ma)
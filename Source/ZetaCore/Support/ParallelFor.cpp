@@ -0,0 +1,114 @@
+#include "ParallelFor.h"
+#include "Task.h"
+#include "../Utility/Error.h"
+#include <new>
+
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Support::Internal;
+using namespace ZetaRay::Math;
+
+namespace
+{
+    static constexpr size_t NUM_CHUNKS_PER_THREAD = 4;
+
+    // Shared between the calling thread and the helper tasks. Helper tasks may start after
+    // all the chunks have been processed (and the calling thread has returned), so this
+    // is reference counted rather than stored on the caller's stack.
+    struct alignas(64) ParallelForContext
+    {
+        ParallelForChunkFunc Func;
+        void* Param;
+        uint32_t NumChunks;
+        std::atomic_int32_t RefCount;
+        alignas(64) std::atomic_uint32_t NextChunk;
+        alignas(64) std::atomic_uint32_t NumFinishedChunks;
+    };
+
+    void ProcessChunks(ParallelForContext& ctx)
+    {
+        while (true)
+        {
+            const uint32_t chunkIdx = ctx.NextChunk.fetch_add(1, std::memory_order_relaxed);
+            if (chunkIdx >= ctx.NumChunks)
+                break;
+
+            ctx.Func(ctx.Param, chunkIdx);
+
+            // Wake up the calling thread if it's waiting for this chunk
+            if (ctx.NumFinishedChunks.fetch_add(1, std::memory_order_acq_rel) + 1 == ctx.NumChunks)
+                ctx.NumFinishedChunks.notify_one();
+        }
+    }
+
+    void Release(ParallelForContext* ctx)
+    {
+        if (ctx->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete ctx;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// ParallelFor
+//--------------------------------------------------------------------------------------
+
+ParallelForChunks Internal::ComputeChunks(size_t n, size_t grain, int maxNumThreads)
+{
+    Assert(n > 0, "Empty range.");
+
+    const int numWorkers = App::GetNumWorkerThreads();
+    const int numThreads = maxNumThreads > 0 ? Min(maxNumThreads, numWorkers) : numWorkers;
+    const size_t target = CeilUnsignedIntDiv(n, (size_t)numThreads * NUM_CHUNKS_PER_THREAD);
+    const size_t chunkSize = Max(Max(grain, size_t(1)), target);
+
+    return ParallelForChunks{ .ChunkSize = chunkSize,
+        .NumChunks = CeilUnsignedIntDiv(n, chunkSize),
+        .NumThreads = numThreads };
+}
+
+void Internal::ParallelForImpl(size_t numChunks, int numThreads, ParallelForChunkFunc f, void* param)
+{
+    Assert(numChunks <= UINT32_MAX, "Too many chunks.");
+    const int numHelpers = (int)Min(numChunks, (size_t)numThreads) - 1;
+
+    if (numHelpers <= 0)
+    {
+        for (size_t i = 0; i < numChunks; i++)
+            f(param, i);
+
+        return;
+    }
+
+    ParallelForContext* ctx = new (std::nothrow) ParallelForContext;
+    Check(ctx, "Out of memory.");
+    ctx->Func = f;
+    ctx->Param = param;
+    ctx->NumChunks = (uint32_t)numChunks;
+    ctx->RefCount.store(numHelpers + 1, std::memory_order_relaxed);
+    ctx->NextChunk.store(0, std::memory_order_relaxed);
+    ctx->NumFinishedChunks.store(0, std::memory_order_relaxed);
+
+    for (int i = 0; i < numHelpers; i++)
+    {
+        Task t("ParallelFor", TASK_PRIORITY::NORMAL, [ctx]()
+            {
+                ProcessChunks(*ctx);
+                Release(ctx);
+            });
+
+        App::Submit(ZetaMove(t));
+    }
+
+    // Calling thread joins the work
+    ProcessChunks(*ctx);
+
+    // Wait for the chunks that are still being processed by other threads
+    uint32_t numFinished = ctx->NumFinishedChunks.load(std::memory_order_acquire);
+
+    while (numFinished < numChunks)
+    {
+        ctx->NumFinishedChunks.wait(numFinished, std::memory_order_acquire);
+        numFinished = ctx->NumFinishedChunks.load(std::memory_order_acquire);
+    }
+
+    Release(ctx);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "../App/App.h"
+#include "../Math/Common.h"
+#include "../Utility/SmallVector.h"
+
+namespace ZetaRay::Support
+{
+    namespace Internal
+    {
+        struct ParallelForChunks
+        {
+            size_t ChunkSize;
+            size_t NumChunks;
+            int NumThreads;
+        };
+
+        using ParallelForChunkFunc = void(*)(void* param, size_t chunkIdx);
+
+        // Chunk size is the larger of "grain" and the size that gives every thread a few
+        // chunks -- the latter helps with load balancing when iterations have different costs
+        ParallelForChunks ComputeChunks(size_t n, size_t grain, int maxNumThreads);
+        // Processes chunks [0, numChunks) using up to numThreads threads (including the
+        // calling thread). Returns once every chunk has been processed.
+        void ParallelForImpl(size_t numChunks, int numThreads, ParallelForChunkFunc f, void* param);
+    }
+
+    // Calls f(b, e) for disjoint subranges [b, e) that together cover [begin, end). Every
+    // subrange (except possibly the last one) has at least "grain" iterations, grain = 0
+    // lets the chunk size be picked automatically. Subranges are processed by the worker
+    // threads and the calling thread, which joins the work and returns once all of them
+    // have been processed. maxNumThreads <= 0 uses all the worker threads.
+    //
+    // Can be called from inside tasks (including nested calls).
+    template<typename F>
+    void ParallelFor(size_t begin, size_t end, size_t grain, F f, int maxNumThreads = 0)
+    {
+        if (end <= begin)
+            return;
+
+        const auto chunks = Internal::ComputeChunks(end - begin, grain, maxNumThreads);
+
+        if (chunks.NumChunks == 1)
+        {
+            f(begin, end);
+            return;
+        }
+
+        struct Param
+        {
+            F& Func;
+            size_t Begin;
+            size_t End;
+            size_t ChunkSize;
+        };
+
+        Param param{ f, begin, end, chunks.ChunkSize };
+
+        Internal::ParallelForImpl(chunks.NumChunks, chunks.NumThreads, [](void* p, size_t chunkIdx)
+            {
+                Param& param = *reinterpret_cast<Param*>(p);
+                const size_t b = param.Begin + chunkIdx * param.ChunkSize;
+                const size_t e = Math::Min(b + param.ChunkSize, param.End);
+
+                param.Func(b, e);
+            }, &param);
+    }
+
+    // Returns reduce(... reduce(reduce(identity, f(b_0, e_0)), f(b_1, e_1)) ..., f(b_n, e_n))
+    // where [b_i, e_i) are consecutive subranges of [begin, end) with the same rules as
+    // ParallelFor(). Partial results are combined on the calling thread in the order of
+    // subranges, so "reduce" only needs to be associative.
+    template<typename T, typename F, typename R>
+    T ParallelReduce(size_t begin, size_t end, size_t grain, const T& identity, F f, R reduce,
+        int maxNumThreads = 0)
+    {
+        if (end <= begin)
+            return identity;
+
+        const auto chunks = Internal::ComputeChunks(end - begin, grain, maxNumThreads);
+
+        if (chunks.NumChunks == 1)
+            return reduce(identity, f(begin, end));
+
+        Util::SmallVector<T, App::FrameAllocator> partials;
+        partials.resize(chunks.NumChunks, identity);
+
+        struct Param
+        {
+            F& Func;
+            T* Partials;
+            size_t Begin;
+            size_t End;
+            size_t ChunkSize;
+        };
+
+        Param param{ f, partials.data(), begin, end, chunks.ChunkSize };
+
+        Internal::ParallelForImpl(chunks.NumChunks, chunks.NumThreads, [](void* p, size_t chunkIdx)
+            {
+                Param& param = *reinterpret_cast<Param*>(p);
+                const size_t b = param.Begin + chunkIdx * param.ChunkSize;
+                const size_t e = Math::Min(b + param.ChunkSize, param.End);
+
+                param.Partials[chunkIdx] = param.Func(b, e);
+            }, &param);
+
+        T result = identity;
+
+        for (auto& p : partials)
+            result = reduce(result, p);
+
+        return result;
+    }
+}
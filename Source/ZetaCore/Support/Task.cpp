@@ -1,6 +1,7 @@
 #include "Task.h"
 #include "../App/Timer.h"
 #include <intrin.h>
+#include <string.h>
 
 using namespace ZetaRay::Support;
 using namespace ZetaRay::Util;
@@ -14,8 +15,7 @@ Task::Task(const char* name, TASK_PRIORITY priority, Function&& f)
     : m_dlg(ZetaMove(f)),
     m_priority(priority)
 {
-    if(m_priority == TASK_PRIORITY::NORMAL)
-        m_signalHandle = App::RegisterTask();
+    SetName(name);
 }
 
 Task::Task(Task&& other)
@@ -24,6 +24,8 @@ Task::Task(Task&& other)
     m_indegree(other.m_indegree),
     m_priority(other.m_priority)
 {
+    memcpy(m_name, other.m_name, MAX_NAME_LENGTH);
+
     //m_adjacentTailNodes.swap(other.m_adjacentTailNodes);
     m_adjacentTailNodes = ZetaMove(other.m_adjacentTailNodes);
     other.m_adjacentTailNodes.clear();
@@ -42,6 +44,7 @@ Task& Task::operator=(Task&& other)
     other.m_adjacentTailNodes.clear();
 
     m_dlg = ZetaMove(other.m_dlg);
+    memcpy(m_name, other.m_name, MAX_NAME_LENGTH);
     m_indegree = other.m_indegree;
     m_signalHandle = other.m_signalHandle;
     m_priority = other.m_priority;
@@ -58,9 +61,24 @@ void Task::Reset(const char* name, TASK_PRIORITY priority, Function&& f)
     m_priority = priority;
     m_indegree = 0;
     m_dlg = ZetaMove(f);
+    SetName(name);
+}
+
+int Task::AcquireSignalHandle()
+{
+    Assert(m_priority == TASK_PRIORITY::NORMAL, "Background tasks can't have dependencies.");
 
-    if(m_priority == TASK_PRIORITY::NORMAL)
+    if (m_signalHandle == -1)
         m_signalHandle = App::RegisterTask();
+
+    return m_signalHandle;
+}
+
+void Task::SetName(const char* name)
+{
+    const size_t n = name ? Min(strlen(name), (size_t)MAX_NAME_LENGTH - 1) : 0;
+    memcpy(m_name, name, n);
+    m_name[n] = '\0';
 }
 
 //--------------------------------------------------------------------------------------
@@ -69,60 +87,69 @@ void Task::Reset(const char* name, TASK_PRIORITY priority, Function&& f)
 
 void TaskSet::AddOutgoingEdge(TaskHandle a, TaskHandle b)
 {
-    Assert(a < m_currSize && b < m_currSize, "Invalid task handles.");
-    TaskMetadata& ta = m_taskMetadata[a];
-    TaskMetadata& tb = m_taskMetadata[b];
+    Assert(!m_isSorted, "Adding edges after TaskSet has been sorted is not allowed.");
+    Assert(a >= 0 && a < GetSize() && b >= 0 && b < GetSize() && a != b, "Invalid task handles.");
 
-    bool prev1 = _bittestandset((long*)&ta.SuccessorMask, b);
-    Assert(!prev1, "Redundant call, edge already exists.");
+    m_edges.push_back(Edge{ .Head = a, .Tail = b });
+    m_taskMetadata[a].Outdegree++;
+    m_taskMetadata[b].Indegree++;
 
-    bool prev2 = _bittestandset((long*)&tb.PredecessorMask, a);
-    Assert(!prev2, "Redundant call, edge already exists.");
-
-    m_tasks[a].m_adjacentTailNodes.push_back(m_tasks[b].m_signalHandle);
+    m_tasks[a].m_adjacentTailNodes.push_back(m_tasks[b].AcquireSignalHandle());
 }
 
 void TaskSet::AddOutgoingEdgeToAll(TaskHandle a)
 {
-    Assert(a < m_currSize, "Invalid task handle.");
-    TaskMetadata& ta = m_taskMetadata[a];
+    Assert(a >= 0 && a < GetSize(), "Invalid task handle.");
+    m_tasks[a].m_adjacentTailNodes.reserve(m_tasks[a].m_adjacentTailNodes.size() + GetSize() - 1);
 
-    for (int b = 0; b < m_currSize; b++)
+    for (int b = 0; b < GetSize(); b++)
     {
-        if (b == a)
-            continue;
-
-        TaskMetadata& tb = m_taskMetadata[b];
-        ta.SuccessorMask |= (1 << b);
-        tb.PredecessorMask |= (1 << a);
-
-        m_tasks[a].m_adjacentTailNodes.push_back(m_tasks[b].m_signalHandle);
+        if (b != a)
+            AddOutgoingEdge(a, b);
     }
 }
 
 void TaskSet::AddIncomingEdgeFromAll(TaskHandle a)
 {
-    Assert(a < m_currSize, "Invalid task handle.");
-    TaskMetadata& ta = m_taskMetadata[a];
+    Assert(a >= 0 && a < GetSize(), "Invalid task handle.");
 
-    for (int b = 0; b < m_currSize; b++)
+    for (int b = 0; b < GetSize(); b++)
     {
-        if (b == a)
-            continue;
-
-        TaskMetadata& tb = m_taskMetadata[b];
-        ta.PredecessorMask |= (1 << b);
-        tb.SuccessorMask |= (1 << a);
-
-        m_tasks[b].m_adjacentTailNodes.push_back(m_tasks[a].m_signalHandle);
+        if (b != a)
+            AddOutgoingEdge(b, a);
     }
 }
 
 void TaskSet::Sort()
 {
     Assert(!m_isSorted, "TaskSet is already sorted.");
-    TopologicalSort();
-    ComputeInOutMask();
+    const int n = GetSize();
+
+    // sorted[i] is the index of the task that should be at position i
+    SmallVector<int, App::FrameAllocator, MAX_NUM_TASKS_BITMASK> sorted;
+    sorted.resize(n);
+
+    if (n <= MAX_NUM_TASKS_BITMASK)
+        TopologicalSortBitmask(sorted);
+    else
+        TopologicalSort(sorted);
+
+    SmallVector<Task, Support::SystemAllocator, NUM_INLINE_TASKS> sortedTasks;
+    SmallVector<TaskMetadata, Support::SystemAllocator, NUM_INLINE_TASKS> sortedMetadata;
+    sortedTasks.resize(n);
+    sortedMetadata.resize(n);
+
+    for (int i = 0; i < n; i++)
+    {
+        sortedTasks[i] = ZetaMove(m_tasks[sorted[i]]);
+        sortedMetadata[i] = m_taskMetadata[sorted[i]];
+    }
+
+    m_tasks = ZetaMove(sortedTasks);
+    m_taskMetadata = ZetaMove(sortedMetadata);
+
+    // Edges refer to the old task indices and aren't needed anymore
+    m_edges.free_memory();
 
     m_isSorted = true;
 }
@@ -131,9 +158,9 @@ void TaskSet::Finalize(WaitObject* waitObj)
 {
     Assert(!m_isFinalized && m_isSorted, "Finalize() shouldn't be called when TaskSet hasn't been sorted.");
 
-    for (int i = 0; i < m_currSize; i++)
+    for (int i = 0; i < GetSize(); i++)
     {
-        const int indegree = m_taskMetadata[i].Indegree();
+        const int indegree = m_taskMetadata[i].Indegree;
 
         // Dependencies between TaskSets can't be detected by indegree as those only
         // for dependencies inside the TaskSet
@@ -153,177 +180,191 @@ void TaskSet::Finalize(WaitObject* waitObj)
 
     if (waitObj)
     {
-        Assert(m_currSize < MAX_NUM_TASKS, "Out of space for new tasks in this TaskSet.");
-        m_tasks[m_currSize++].Reset("NotifyCompletion", m_tasks[0].m_priority, [waitObj]()
+        const int numTasks = GetSize();
+        Task notifyTask("NotifyCompletion", m_tasks[0].m_priority, [waitObj]()
             {
                 waitObj->Notify();
             });
 
-        // ConnectTo(m_tasks[m_currSize]);
-        Task& notifyTask = m_tasks[m_currSize - 1];
-        uint64_t mask = m_leafMask;
-        notifyTask.m_indegree += __popcnt((uint32_t)mask);
+        // ConnectTo(notifyTask)
+        const int notifyHandle = notifyTask.AcquireSignalHandle();
 
-        unsigned long idx;
-        while (_BitScanForward64(&idx, mask))
+        for (int i = 0; i < numTasks; i++)
         {
-            Assert(idx < m_currSize, "Bug");
-            m_tasks[idx].m_adjacentTailNodes.push_back(notifyTask.m_signalHandle);
-
-            mask &= ~(1llu << idx);
+            if (m_taskMetadata[i].Outdegree == 0)
+            {
+                m_tasks[i].m_adjacentTailNodes.push_back(notifyHandle);
+                notifyTask.m_indegree++;
+            }
         }
 
-        App::TaskFinalizedCallback(notifyTask.m_signalHandle, notifyTask.m_indegree);
+        App::TaskFinalizedCallback(notifyHandle, notifyTask.m_indegree);
+
+        m_taskMetadata.push_back(TaskMetadata{ .Indegree = notifyTask.m_indegree, .Outdegree = 0 });
+        m_tasks.push_back(ZetaMove(notifyTask));
     }
 }
 
-void TaskSet::ComputeInOutMask()
+void TaskSet::TopologicalSortBitmask(MutableSpan<int> sorted)
 {
-    for (int i = 0; i < m_currSize; ++i)
+    const int n = GetSize();
+    Assert(n <= MAX_NUM_TASKS_BITMASK, "Too many tasks for bitmask sorting.");
+
+    // Index of adjacent tasks (i.e. this task has an edge to them)
+    uint64_t successorMask[MAX_NUM_TASKS_BITMASK];
+    // Make a temporary copy for the duration of topological sorting
+    int tempIndegree[MAX_NUM_TASKS_BITMASK];
+    uint64_t rootMask = 0;
+
+    for (int i = 0; i < n; i++)
     {
-        if (m_taskMetadata[i].Indegree() == 0)
-            m_rootMask |= (1llu << i);
+        successorMask[i] = 0;
+        tempIndegree[i] = m_taskMetadata[i].Indegree;
 
-        if (m_taskMetadata[i].Outdegree() == 0)
-            m_leafMask |= (1llu << i);
+        if (tempIndegree[i] == 0)
+            rootMask |= (1llu << i);
     }
-}
-
-void TaskSet::TopologicalSort()
-{
-    // Find the root nodes
-    uint32_t rootMask = 0;
 
-    for (int i = 0; i < m_currSize; ++i)
+    for (auto e : m_edges)
     {
-        if (m_taskMetadata[i].Indegree() == 0)
-            rootMask |= (1llu << i);
+        const bool prev = _bittestandset64((__int64*)&successorMask[e.Head], e.Tail);
+        Assert(!prev, "Redundant edge %d -> %d, edge already exists.", e.Head, e.Tail);
     }
 
     // In each iteration, points to remaining elements that have an indegree of zero
-    uint32_t currMask = rootMask;
-    size_t currIdx = 0;
-    int sorted[MAX_NUM_TASKS];
-
-    // Make a temporary copy for the duration of topological sorting
-    int tempIndegree[MAX_NUM_TASKS];
-    for (int i = 0; i < m_currSize; i++)
-        tempIndegree[i] = m_taskMetadata[i].Indegree();
+    uint64_t currMask = rootMask;
+    int currIdx = 0;
 
     // Find all nodes with zero indegree
     unsigned long zeroIndegreeIdx;
     while (_BitScanForward64(&zeroIndegreeIdx, currMask))
     {
-        Assert(zeroIndegreeIdx < m_currSize, "Invalid index.");
-        TaskMetadata& t = m_taskMetadata[zeroIndegreeIdx];
-        uint32_t tails = t.SuccessorMask;
+        Assert(zeroIndegreeIdx < (unsigned long)n, "Invalid index.");
+        uint64_t tails = successorMask[zeroIndegreeIdx];
         unsigned long tailIdx;
 
         // For every tail-adjacent node
         while (_BitScanForward64(&tailIdx, tails))
         {
-            Assert(tailIdx < m_currSize, "Invalid index.");
+            Assert(tailIdx < (unsigned long)n, "Invalid index.");
 
             // Remove one edge
             tempIndegree[tailIdx] -= 1;
 
             // If tail node's indegree has become 0, add it to mask
             if (tempIndegree[tailIdx] == 0)
-                currMask |= (1 << tailIdx);
+                currMask |= (1llu << tailIdx);
 
-            tails &= ~(1 << tailIdx);
+            tails &= tails - 1;
         }
 
         // Save new position for current node
         sorted[currIdx++] = zeroIndegreeIdx;
 
         // Remove current node
-        currMask &= ~(1 << zeroIndegreeIdx);
+        currMask &= ~(1llu << zeroIndegreeIdx);
     }
 
-    Assert(currIdx == m_currSize, "Graph has a cycle.");
+    Assert(currIdx == n, "Graph has a cycle.");
+}
 
-    for (int i = 0; i < m_currSize; i++)
-        Assert(tempIndegree[i] == 0, "Graph has a cycle.");
+void TaskSet::TopologicalSort(MutableSpan<int> sorted)
+{
+    const int n = GetSize();
+
+    // Build the successor lists in compressed form -- successors of task i are 
+    // successors[offsets[i]], ..., successors[offsets[i + 1] - 1]
+    SmallVector<int, App::FrameAllocator> offsets;
+    SmallVector<int, App::FrameAllocator> cursor;
+    SmallVector<int, App::FrameAllocator> successors;
+    SmallVector<int, App::FrameAllocator> tempIndegree;
+    offsets.resize(n + 1);
+    cursor.resize(n);
+    successors.resize(m_edges.size());
+    tempIndegree.resize(n);
+
+    offsets[0] = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        offsets[i + 1] = offsets[i] + m_taskMetadata[i].Outdegree;
+        cursor[i] = offsets[i];
+        tempIndegree[i] = m_taskMetadata[i].Indegree;
+    }
+
+    Assert(offsets[n] == (int)m_edges.size(), "Invalid task outdegrees.");
 
-    Task oldTaskArr[MAX_NUM_TASKS];
-    for (int i = 0; i < m_currSize; i++)
-        oldTaskArr[i] = ZetaMove(m_tasks[i]);
+    for (auto e : m_edges)
+        successors[cursor[e.Head]++] = e.Tail;
 
-    TaskMetadata oldTaskMetadata[MAX_NUM_TASKS];
-    memcpy(oldTaskMetadata, m_taskMetadata, m_currSize * sizeof(TaskMetadata));
+    // Kahn's algorithm -- "sorted" doubles as the queue of tasks with zero indegree
+    int queueEnd = 0;
 
-    for (int i = 0; i < m_currSize; i++)
+    for (int i = 0; i < n; i++)
     {
-        m_tasks[i] = ZetaMove(oldTaskArr[sorted[i]]);
-        m_taskMetadata[i] = oldTaskMetadata[sorted[i]];
+        if (tempIndegree[i] == 0)
+            sorted[queueEnd++] = i;
     }
-}
-
-void TaskSet::ConnectTo(TaskSet& other)
-{
-    Assert(!m_isFinalized, "Calling this method on a finalized TaskSet is invalid.");
-    Assert(!other.m_isFinalized, "Calling this method on a finalized TaskSet is invalid.");
-
-    uint64_t headMask = m_leafMask;
-    const uint64_t tailMask = other.m_rootMask;
 
-    // Connect every leaf of this TaskSet to every root of "other"
-    unsigned long headIdx;
-    while (_BitScanForward64(&headIdx, headMask))
+    for (int queueBeg = 0; queueBeg < queueEnd; queueBeg++)
     {
-        Assert(headIdx < m_currSize, "Bug");
-        Assert(m_tasks[headIdx].m_adjacentTailNodes.empty(), "Leaf task should not have tail nodes.");
-        m_tasks[headIdx].m_adjacentTailNodes.reserve(__popcnt16(other.m_rootMask));
+        const int curr = sorted[queueBeg];
 
-        unsigned long tailIdx;
-        uint64_t tailMaskCopy = tailMask;
-        while (_BitScanForward64(&tailIdx, tailMaskCopy))
+        for (int j = offsets[curr]; j < offsets[curr + 1]; j++)
         {
-            Assert(tailIdx < other.m_currSize, "Index out of bound.");
-
-            // Add one edge
-            other.m_tasks[tailIdx].m_indegree += 1;
-            m_tasks[headIdx].m_adjacentTailNodes.push_back(other.m_tasks[tailIdx].m_signalHandle);
+            const int tail = successors[j];
 
-            tailMaskCopy &= ~(1llu << tailIdx);
+            // Remove one edge. If tail node's indegree has become 0, add it to the queue.
+            if (--tempIndegree[tail] == 0)
+                sorted[queueEnd++] = tail;
         }
-
-        headMask &= ~(1llu << headIdx);
     }
+
+    Assert(queueEnd == n, "Graph has a cycle.");
 }
 
-void TaskSet::ConnectTo(Task& other)
+void TaskSet::ConnectTo(TaskSet& other)
 {
     Assert(!m_isFinalized, "Calling this method on a finalized TaskSet is invalid.");
+    Assert(!other.m_isFinalized, "Calling this method on a finalized TaskSet is invalid.");
+    Assert(m_isSorted && other.m_isSorted, "TaskSets must be sorted before they can be connected.");
 
-    uint64_t mask = m_leafMask;
+    int numRoots = 0;
+    for (int j = 0; j < other.GetSize(); j++)
+        numRoots += other.m_taskMetadata[j].Indegree == 0;
 
-    unsigned long idx;
-    while (_BitScanForward64(&idx, mask))
+    // Connect every leaf of this TaskSet to every root of "other"
+    for (int i = 0; i < GetSize(); i++)
     {
-        Assert(idx < m_currSize, "Bug");
-        m_tasks[idx].m_adjacentTailNodes.push_back(other.m_signalHandle);
+        if (m_taskMetadata[i].Outdegree != 0)
+            continue;
 
-        mask &= ~(1llu << idx);
-    }
+        Assert(m_tasks[i].m_adjacentTailNodes.empty(), "Leaf task should not have tail nodes.");
+        m_tasks[i].m_adjacentTailNodes.reserve(numRoots);
+
+        for (int j = 0; j < other.GetSize(); j++)
+        {
+            if (other.m_taskMetadata[j].Indegree != 0)
+                continue;
 
-    other.m_indegree += __popcnt((uint32_t)mask);
+            // Add one edge
+            other.m_tasks[j].m_indegree += 1;
+            m_tasks[i].m_adjacentTailNodes.push_back(other.m_tasks[j].AcquireSignalHandle());
+        }
+    }
 }
 
 void TaskSet::ConnectFrom(Task& other)
 {
     Assert(!m_isFinalized, "Calling this method on a finalized TaskSet is invalid.");
+    Assert(m_isSorted, "TaskSet must be sorted before it can be connected.");
 
-    uint64_t mask = m_rootMask;
-
-    unsigned long idx;
-    while (_BitScanForward64(&idx, mask))
+    for (int i = 0; i < GetSize(); i++)
     {
-        Assert(idx < m_currSize, "Invalid index.");
-        m_tasks[idx].m_indegree += 1;
-        other.m_adjacentTailNodes.push_back(m_tasks[idx].m_signalHandle);
-
-        mask &= ~(1llu << idx);
+        if (m_taskMetadata[i].Indegree == 0)
+        {
+            m_tasks[i].m_indegree += 1;
+            other.m_adjacentTailNodes.push_back(m_tasks[i].AcquireSignalHandle());
+        }
     }
-}
\ No newline at end of file
+}
@@ -32,8 +32,11 @@ namespace ZetaRay::Support
 
         void Reset(const char* name, TASK_PRIORITY priority, Util::Function&& f);
         ZetaInline int GetSignalHandle() const { return m_signalHandle; }
+        ZetaInline const char* GetName() const { return m_name; }
         ZetaInline Util::Span<int> GetAdjacencies() { return Util::Span(m_adjacentTailNodes); }
         ZetaInline TASK_PRIORITY GetPriority() const { return m_priority; }
+        // Number of tasks that have to finish before this task can run
+        ZetaInline int GetIndegree() const { return m_indegree; }
 
         ZetaInline void DoTask()
         {
@@ -42,8 +45,16 @@ namespace ZetaRay::Support
         }
 
     private:
+        void SetName(const char* name);
+        // Signals are only needed by tasks that have dependencies (i.e. are the tail of 
+        // some edge), so they're registered when the first incoming edge is added rather 
+        // than for every task
+        int AcquireSignalHandle();
+
         Util::Function m_dlg;
         Util::SmallVector<int, App::FrameAllocator, 3> m_adjacentTailNodes;
+        // Copied as the given string might not outlive the task (e.g. StackStr)
+        char m_name[MAX_NAME_LENGTH] = { '\0' };
         int m_signalHandle = -1;
         int m_indegree = 0;
         TASK_PRIORITY m_priority;
@@ -86,9 +97,13 @@ namespace ZetaRay::Support
     // 3. Sort
     // 4. (Optional) Connect different TaskSets
     // 5. Finalize
+    //
+    // There's no limit on the number of tasks. Edges are stored in frame memory and sorting 
+    // takes O(V + E) time. Sets with at most MAX_NUM_TASKS_BITMASK tasks are sorted using 
+    // bitmasks without any extra allocations.
     struct TaskSet
     {
-        static constexpr int MAX_NUM_TASKS = 16;
+        static constexpr int MAX_NUM_TASKS_BITMASK = 64;
         using TaskHandle = int;
         static constexpr TaskHandle INVALID_TASK_HANDLE = -1;
 
@@ -100,14 +115,14 @@ namespace ZetaRay::Support
 
         TaskHandle EmplaceTask(const char* name, Util::Function&& f)
         {
-            Assert(!m_isFinalized, "Calling AddTask() on an unfinalized TaskSet is not allowed.");
-            Assert(m_currSize < MAX_NUM_TASKS, 
-                "Current implementation doesn't support more than %d tasks.", MAX_NUM_TASKS);
+            Assert(!m_isFinalized, "Calling AddTask() on a finalized TaskSet is not allowed.");
+            Assert(!m_isSorted, "Adding tasks after TaskSet has been sorted is not allowed.");
 
             // TaskSet is not needed for background tasks
-            m_tasks[m_currSize++].Reset(name, TASK_PRIORITY::NORMAL, ZetaMove(f));
+            m_tasks.emplace_back(name, TASK_PRIORITY::NORMAL, ZetaMove(f));
+            m_taskMetadata.emplace_back(TaskMetadata{});
 
-            return (TaskHandle)(m_currSize - 1);
+            return (TaskHandle)(m_tasks.size() - 1);
         }
 
         // Adds a dependent task to the list of tasks that are notified by this task upon completion
@@ -116,37 +131,38 @@ namespace ZetaRay::Support
         void AddOutgoingEdgeToAll(TaskHandle a);
         void AddIncomingEdgeFromAll(TaskHandle a);
         void ConnectTo(TaskSet& other);
-        void ConnectTo(Task& other);
         void ConnectFrom(Task& other);
 
         ZetaInline bool IsFinalized() { return m_isFinalized; }
         void Sort();
         void Finalize(WaitObject* waitObj = nullptr);
-        ZetaInline int GetSize() { return m_currSize; }
-        ZetaInline Util::MutableSpan<Task> GetTasks() { return Util::MutableSpan(m_tasks, m_currSize); }
+        ZetaInline int GetSize() { return (int)m_tasks.size(); }
+        ZetaInline Util::MutableSpan<Task> GetTasks() { return Util::MutableSpan(m_tasks); }
 
     private:
+        static constexpr int NUM_INLINE_TASKS = 16;
+        static constexpr int NUM_INLINE_EDGES = 32;
+
         struct TaskMetadata
         {
-            ZetaInline int Indegree() const { return __popcnt16(PredecessorMask); }
-            ZetaInline int Outdegree() const { return __popcnt16(SuccessorMask); }
-
-            // Index of adjacent tasks (i.e. this task has an edge to them)
-            uint16_t SuccessorMask = 0;
-
-            // Index of predecessor tasks (i.e. have an edge to this task)
-            uint16_t PredecessorMask = 0;
+            // Number of edges to/from other tasks in this TaskSet
+            int Indegree;
+            int Outdegree;
         };
 
-        void ComputeInOutMask();
-        void TopologicalSort();
+        struct Edge
+        {
+            TaskHandle Head;
+            TaskHandle Tail;
+        };
 
-        Task m_tasks[MAX_NUM_TASKS];
-        TaskMetadata m_taskMetadata[MAX_NUM_TASKS];
+        void TopologicalSortBitmask(Util::MutableSpan<int> sorted);
+        void TopologicalSort(Util::MutableSpan<int> sorted);
 
-        uint16_t m_rootMask = 0;
-        uint16_t m_leafMask = 0;
-        uint8_t m_currSize = 0;
+        Util::SmallVector<Task, Support::SystemAllocator, NUM_INLINE_TASKS> m_tasks;
+        Util::SmallVector<TaskMetadata, Support::SystemAllocator, NUM_INLINE_TASKS> m_taskMetadata;
+        // Only needed until the TaskSet is sorted
+        Util::SmallVector<Edge, App::FrameAllocator, NUM_INLINE_EDGES> m_edges;
         bool m_isSorted = false;
         bool m_isFinalized = false;
     };
@@ -0,0 +1,153 @@
+#include "TaskProfiler.h"
+#include "../App/Filesystem.h"
+#include "../App/Log.h"
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+using namespace ZetaRay::App;
+
+namespace
+{
+    template<typename... Args>
+    void Append(SmallVector<char>& out, const char* formatStr, Args... args)
+    {
+        char buffer[256];
+        const int n = stbsp_snprintf(buffer, sizeof(buffer), formatStr, args...);
+        out.append_range(buffer, buffer + n);
+    }
+
+    void AppendEscaped(SmallVector<char>& out, const char* str)
+    {
+        for (const char* c = str; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                out.push_back('\\');
+
+            out.push_back(*c);
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// TaskProfiler
+//--------------------------------------------------------------------------------------
+
+TaskProfiler::~TaskProfiler()
+{
+    Shutdown();
+}
+
+void TaskProfiler::Init()
+{
+    m_start = std::chrono::steady_clock::now();
+}
+
+void TaskProfiler::Shutdown()
+{
+    m_enabled.store(false, std::memory_order_relaxed);
+
+    for (int i = 0; i < MAX_NUM_THREADS; i++)
+    {
+        free(m_buffers[i].Records);
+        m_buffers[i].Records = nullptr;
+        m_buffers[i].NumRecords.store(0, std::memory_order_relaxed);
+    }
+}
+
+void TaskProfiler::Write(const char* name, int64_t readyTime, int64_t startTime, int64_t endTime)
+{
+    Assert(g_threadIdx >= 0 && g_threadIdx < MAX_NUM_THREADS, "Invalid thread index.");
+    ThreadBuffer& buffer = m_buffers[g_threadIdx];
+
+    // Only allocated for threads that actually run tasks
+    if (!buffer.Records)
+    {
+        buffer.Records = reinterpret_cast<TaskRecord*>(malloc(sizeof(TaskRecord) * NUM_RECORDS_PER_THREAD));
+        Check(buffer.Records, "Out of memory.");
+    }
+
+    const uint64_t n = buffer.NumRecords.load(std::memory_order_relaxed);
+    TaskRecord& r = buffer.Records[n % NUM_RECORDS_PER_THREAD];
+
+    const size_t len = Math::Min(strlen(name), (size_t)Task::MAX_NAME_LENGTH - 1);
+    memcpy(r.Name, name, len);
+    r.Name[len] = '\0';
+    r.ReadyTime = readyTime;
+    r.StartTime = startTime;
+    r.EndTime = endTime;
+    r.ThreadIdx = g_threadIdx;
+
+    buffer.NumRecords.store(n + 1, std::memory_order_release);
+}
+
+void TaskProfiler::Record(const char* name, int64_t readyTime, int64_t startTime, int64_t endTime)
+{
+    // Task might have been inserted before profiling was enabled
+    Write(name, readyTime >= 0 ? readyTime : startTime, startTime, endTime);
+}
+
+void TaskProfiler::Mark(const char* name)
+{
+    const int64_t now = Now();
+    Write(name, -1, now, now);
+}
+
+void TaskProfiler::Clear()
+{
+    for (int i = 0; i < MAX_NUM_THREADS; i++)
+        m_buffers[i].NumRecords.store(0, std::memory_order_relaxed);
+}
+
+void TaskProfiler::ExportChromeTrace(const char* path)
+{
+    SmallVector<char> out;
+    Append(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+
+    for (int t = 0; t < MAX_NUM_THREADS; t++)
+    {
+        const ThreadBuffer& buffer = m_buffers[t];
+        const uint64_t numRecords = buffer.NumRecords.load(std::memory_order_acquire);
+        if (numRecords == 0)
+            continue;
+
+        Append(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+            "\"args\":{\"name\":\"%s %d\"}}", first ? "" : ",\n", t,
+            t == 0 ? "Main" : "Thread", t);
+        first = false;
+
+        // Only the most recent records are available
+        const uint64_t beg = numRecords > NUM_RECORDS_PER_THREAD ?
+            numRecords - NUM_RECORDS_PER_THREAD : 0;
+
+        for (uint64_t i = beg; i < numRecords; i++)
+        {
+            const TaskRecord& r = buffer.Records[i % NUM_RECORDS_PER_THREAD];
+            Append(out, ",\n{\"name\":\"");
+            AppendEscaped(out, r.Name);
+
+            // Timestamps are in microseconds
+            if (r.ReadyTime < 0)
+            {
+                Append(out, "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":0,\"tid\":%d,\"ts\":%.3f}",
+                    r.ThreadIdx, r.StartTime / 1000.0);
+            }
+            else
+            {
+                Append(out, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                    "\"args\":{\"wait_us\":%.3f}}",
+                    r.ThreadIdx,
+                    r.StartTime / 1000.0,
+                    (r.EndTime - r.StartTime) / 1000.0,
+                    (r.StartTime - r.ReadyTime) / 1000.0);
+            }
+        }
+    }
+
+    Append(out, "\n]}\n");
+
+    Filesystem::WriteToFile(path, reinterpret_cast<uint8_t*>(out.data()), (uint32_t)out.size());
+    LOG_UI(INFO, "Task trace written to %s.\n", path);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Task.h"
+#include <chrono>
+
+namespace ZetaRay::Support
+{
+    // Records every task execution (name, thread, and when the task became ready, started
+    // and finished). Each thread appends to its own ring buffer without any locks --
+    // once a buffer is full, the oldest records are overwritten.
+    class TaskProfiler
+    {
+    public:
+        static constexpr int NUM_RECORDS_PER_THREAD = 8192;
+
+        struct TaskRecord
+        {
+            char Name[Task::MAX_NAME_LENGTH];
+            // Nanoseconds since Init(). ReadyTime is when the task was inserted into the
+            // queue (i.e. all of its dependencies had finished), so StartTime - ReadyTime
+            // is the time it spent waiting for a thread. Markers have ReadyTime = -1.
+            int64_t ReadyTime;
+            int64_t StartTime;
+            int64_t EndTime;
+            int ThreadIdx;
+        };
+
+        TaskProfiler() = default;
+        ~TaskProfiler();
+
+        TaskProfiler(const TaskProfiler&) = delete;
+        TaskProfiler& operator=(const TaskProfiler&) = delete;
+
+        void Init();
+        void Shutdown();
+
+        ZetaInline bool IsEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+        ZetaInline void SetEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+        // Nanoseconds since Init()
+        ZetaInline int64_t Now() const
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_start).count();
+        }
+
+        // Must be called by the thread that executed the task
+        void Record(const char* name, int64_t readyTime, int64_t startTime, int64_t endTime);
+        // Adds a zero-duration marker, e.g. for the start of a frame
+        void Mark(const char* name);
+        // Discards all the records
+        void Clear();
+        // Writes the records in Chrome's trace event format (viewable in chrome://tracing
+        // or Perfetto). Records are read without synchronization, so this should be called
+        // when no tasks are running (e.g. after flushing the thread pools).
+        void ExportChromeTrace(const char* path);
+
+    private:
+        struct alignas(64) ThreadBuffer
+        {
+            TaskRecord* Records = nullptr;
+            // Total number of records ever written -- (NumRecords % NUM_RECORDS_PER_THREAD)
+            // is the next slot
+            std::atomic_uint64_t NumRecords = 0;
+        };
+
+        void Write(const char* name, int64_t readyTime, int64_t startTime, int64_t endTime);
+
+        ThreadBuffer m_buffers[MAX_NUM_THREADS];
+        std::chrono::steady_clock::time_point m_start;
+        std::atomic_bool m_enabled = false;
+    };
+}
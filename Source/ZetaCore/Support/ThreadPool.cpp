@@ -1,5 +1,6 @@
 #include "ThreadPool.h"
 #include "../App/Log.h"
+#include <intrin.h>
 
 using namespace ZetaRay::Support;
 using namespace ZetaRay::App;
@@ -9,41 +10,17 @@ using namespace ZetaRay::Util;
 // ThreadPool
 //--------------------------------------------------------------------------------------
 
-void ThreadPool::Init(int poolSize, int totalNumThreads, const wchar_t* threadNamePrefix, 
+void ThreadPool::Init(int poolSize, int totalNumThreads, const wchar_t* threadNamePrefix,
     THREAD_PRIORITY priority, int threadIdxOffset)
 {
     m_threadPoolSize = poolSize;
     m_totalNumThreads = totalNumThreads;
 
-    // Tokens below have to conisder that threads outside this thread pool
-    // (e.g. the main thread) may also insert tasks and occasionally execute 
-    // tasks (for example when trying to pump the queue to empty it)
-
-    // Consumers
-    {
-        // +1 for main therad
-        uintptr_t curr = reinterpret_cast<uintptr_t>(m_consumerTokensMem);
-        for (int i = 0; i < m_totalNumThreads; i++)
-        {
-            new (reinterpret_cast<void*>(curr)) moodycamel::ConsumerToken(m_taskQueue);
-            curr += sizeof(moodycamel::ConsumerToken);
-        }
-
-        m_consumerTokens = reinterpret_cast<moodycamel::ConsumerToken*>(m_consumerTokensMem);
-    }
-
-    // Producers
-    {
-        // +1 for main therad
-        uintptr_t curr = reinterpret_cast<uintptr_t>(m_producerTokensMem);
-        for (int i = 0; i < m_totalNumThreads; i++)
-        {
-            new (reinterpret_cast<void*>(curr)) moodycamel::ProducerToken(m_taskQueue);
-            curr += sizeof(moodycamel::ProducerToken);
-        }
-
-        m_producerTokens = reinterpret_cast<moodycamel::ProducerToken*>(m_producerTokensMem);
-    }
+    // Threads outside this thread pool (e.g. the main thread) may also insert tasks
+    // and occasionally execute tasks (for example when trying to pump the queue to
+    // empty it), so every thread needs a deque
+    for (int i = 0; i < m_totalNumThreads; i++)
+        m_threadContexts[i].Deque.Init();
 
     for (int i = 0; i < m_threadPoolSize; i++)
     {
@@ -67,74 +44,262 @@ void ThreadPool::Start()
 
 void ThreadPool::Shutdown()
 {
-    // Relaxed since Enqueue has a release op
-    m_shutdown.store(true, std::memory_order_relaxed);
-
     // Upon observing shutdown flag to be true, all the threads are going to exit
+    m_shutdown.store(true, std::memory_order_release);
 
-    for (int i = 0; i < m_threadPoolSize; i++)
-    {
-        Task t("NoOp", TASK_PRIORITY::NORMAL, []() {});
-        Enqueue(ZetaMove(t));
-    }
+    // Wake up the sleeping threads
+    m_wakeSignal.fetch_add(1, std::memory_order_seq_cst);
+    m_wakeSignal.notify_all();
 
     for (int i = 0; i < m_threadPoolSize; i++)
         m_threadPool[i].join();
+
+    for (int i = 0; i < m_totalNumThreads; i++)
+    {
+        auto& ctx = m_threadContexts[i];
+        ctx.Deque.Free();
+
+        for (auto block : ctx.Blocks)
+            _aligned_free(block);
+
+        ctx.Blocks.free_memory();
+        ctx.FreeList = nullptr;
+        ctx.RemoteFreeList.store(nullptr, std::memory_order_relaxed);
+    }
 }
 
 void ThreadPool::Enqueue(Task&& task)
 {
-    bool memAllocFailed = m_taskQueue.enqueue(m_producerTokens[g_threadIdx], ZetaMove(task));
-    Assert(memAllocFailed, "moodycamel::ConcurrentQueue couldn't allocate memory.");
-
     m_numTasksToFinishTarget.fetch_add(1, std::memory_order_relaxed);
-    m_numTasksInQueue.fetch_add(1, std::memory_order_release);
+
+    // Task is inserted into the queue once its last dependency has finished
+    if (task.GetIndegree() > 0)
+    {
+        App::DeferTask(ZetaMove(task));
+        return;
+    }
+
+    m_numTasksInQueue.fetch_add(1, std::memory_order_seq_cst);
+    Push(ZetaMove(task));
+    WakeUp(1);
 }
 
 void ThreadPool::Enqueue(TaskSet&& ts)
 {
     Assert(ts.IsFinalized(), "Given TaskSet is not finalized.");
 
-    m_numTasksToFinishTarget.fetch_add(ts.GetSize(), std::memory_order_relaxed);
-    m_numTasksInQueue.fetch_add(ts.GetSize(), std::memory_order_release);
     auto tasks = ts.GetTasks();
+    int numReady = 0;
+
+    for (auto& task : tasks)
+        numReady += task.GetIndegree() == 0;
 
-    bool memAllocFailed = m_taskQueue.enqueue_bulk(m_producerTokens[g_threadIdx],
-        std::make_move_iterator(tasks.data()), tasks.size());
-    Assert(memAllocFailed, "moodycamel::ConcurrentQueue couldn't allocate memory.");
+    m_numTasksToFinishTarget.fetch_add(ts.GetSize(), std::memory_order_relaxed);
+    m_numTasksInQueue.fetch_add(numReady, std::memory_order_seq_cst);
+
+    // Insert the ready tasks first so that workers can start on them right away
+    for (auto& task : tasks)
+    {
+        if (task.GetIndegree() == 0)
+            Push(ZetaMove(task));
+    }
+
+    WakeUp(numReady);
+
+    // Moved-from tasks have indegree of zero and are skipped
+    for (auto& task : tasks)
+    {
+        if (task.GetIndegree() > 0)
+            App::DeferTask(ZetaMove(task));
+    }
 }
 
-void ThreadPool::PumpUntilEmpty()
+void ThreadPool::EnqueueUnblocked(Task&& task)
+{
+    m_numTasksInQueue.fetch_add(1, std::memory_order_seq_cst);
+    Push(ZetaMove(task));
+    WakeUp(1);
+}
+
+void ThreadPool::Push(Task&& task)
+{
+    Assert(g_threadIdx >= 0 && g_threadIdx < m_totalNumThreads, "Invalid thread index.");
+
+    TaskNode* node = AllocateNode();
+    new (node->TaskMem) Task(ZetaMove(task));
+    node->ReadyTime = m_profiler && m_profiler->IsEnabled() ? m_profiler->Now() : -1;
+
+    m_threadContexts[g_threadIdx].Deque.Push(node);
+}
+
+ThreadPool::TaskNode* ThreadPool::TryGetTask()
 {
-    Task task;
+    const int threadIdx = g_threadIdx;
+    Assert(threadIdx >= 0 && threadIdx < m_totalNumThreads, "Invalid thread index.");
+    ThreadContext& ctx = m_threadContexts[threadIdx];
+    TaskNode* node;
 
-    // "try_dequeue()" returning false doesn't guarantee that queue is empty
-    while (m_numTasksInQueue.load(std::memory_order_acquire) != 0)
+    // Most recently inserted task first
+    if (!ctx.Deque.Pop(node))
     {
-        if (m_taskQueue.try_dequeue(m_consumerTokens[g_threadIdx], task))
+        bool stolen = false;
+
+        // Oldest task from other threads
+        for (int i = 1; i < m_totalNumThreads; i++)
         {
-            m_numTasksInQueue.fetch_sub(1, std::memory_order_relaxed);
+            int victim = threadIdx + i;
+            victim = victim >= m_totalNumThreads ? victim - m_totalNumThreads : victim;
+
+            if (m_threadContexts[victim].Deque.Steal(node))
+            {
+                stolen = true;
+                break;
+            }
+        }
+
+        if (!stolen)
+            return nullptr;
+
+        ctx.NumSteals.store(ctx.NumSteals.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+    }
+
+    m_numTasksInQueue.fetch_sub(1, std::memory_order_relaxed);
+
+    return node;
+}
+
+void ThreadPool::ExecuteTask(TaskNode* node)
+{
+    Task& task = node->GetTask();
+    const bool profile = m_profiler && m_profiler->IsEnabled();
+    const int64_t startTime = profile ? m_profiler->Now() : 0;
+
+    task.DoTask();
+
+    if (profile)
+        m_profiler->Record(task.GetName(), node->ReadyTime, startTime, m_profiler->Now());
 
-            const int taskHandle = task.GetSignalHandle();
+    // Signal dependent tasks that this task has finished. Tasks that become ready
+    // are inserted into the queue.
+    if (task.GetPriority() != TASK_PRIORITY::BACKGROUND)
+    {
+        auto adjacencies = task.GetAdjacencies();
+        if (adjacencies.size() > 0)
+            App::SignalAdjacentTailNodes(adjacencies);
+    }
+
+    task.~Task();
+    FreeNode(node);
+
+    ThreadContext& ctx = m_threadContexts[g_threadIdx];
+    ctx.NumTasksExecuted.store(ctx.NumTasksExecuted.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed);
 
-            // Block if this task depends on other unfinished tasks
-            App::WaitForAdjacentHeadNodes(taskHandle);
+    // Must come after signalling so that the successors are visible to TryFlush()
+    m_numTasksFinished.fetch_add(1, std::memory_order_release);
+}
+
+void ThreadPool::WakeUp(int numTasks)
+{
+    if (numTasks == 0)
+        return;
 
-            task.DoTask();
+    // Paired with the seq_cst ops in Sleep() -- either the sleeping thread sees the new
+    // task count or this thread sees the sleeping thread
+    if (m_numSleepingThreads.load(std::memory_order_seq_cst) == 0)
+        return;
 
-            // Signal dependent tasks that this task has finished
-            auto adjacencies = task.GetAdjacencies();
-            if (adjacencies.size() > 0)
-                App::SignalAdjacentTailNodes(adjacencies);
+    m_wakeSignal.fetch_add(1, std::memory_order_seq_cst);
 
-            m_numTasksFinished.fetch_add(1, std::memory_order_release);
+    if (numTasks == 1)
+        m_wakeSignal.notify_one();
+    else
+        m_wakeSignal.notify_all();
+}
+
+void ThreadPool::Sleep(ThreadContext& ctx)
+{
+    m_numSleepingThreads.fetch_add(1, std::memory_order_seq_cst);
+    const uint32_t wakeSignal = m_wakeSignal.load(std::memory_order_seq_cst);
+
+    if (m_numTasksInQueue.load(std::memory_order_seq_cst) <= 0 &&
+        !m_shutdown.load(std::memory_order_seq_cst))
+    {
+        ctx.NumSleeps.store(ctx.NumSleeps.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
+
+        // Returns once m_wakeSignal has changed
+        m_wakeSignal.wait(wakeSignal, std::memory_order_acquire);
+    }
+
+    m_numSleepingThreads.fetch_sub(1, std::memory_order_relaxed);
+}
+
+ThreadPool::TaskNode* ThreadPool::AllocateNode()
+{
+    ThreadContext& ctx = m_threadContexts[g_threadIdx];
+
+    // Reclaim the nodes that were freed by other threads
+    if (!ctx.FreeList)
+        ctx.FreeList = ctx.RemoteFreeList.exchange(nullptr, std::memory_order_acquire);
+
+    if (!ctx.FreeList)
+    {
+        TaskNode* block = reinterpret_cast<TaskNode*>(_aligned_malloc(
+            sizeof(TaskNode) * NUM_TASKS_PER_BLOCK, alignof(TaskNode)));
+
+        for (int i = 0; i < NUM_TASKS_PER_BLOCK; i++)
+        {
+            block[i].Next = i < NUM_TASKS_PER_BLOCK - 1 ? &block[i + 1] : nullptr;
+            block[i].Owner = g_threadIdx;
         }
+
+        ctx.Blocks.push_back(block);
+        ctx.FreeList = block;
+    }
+
+    TaskNode* node = ctx.FreeList;
+    ctx.FreeList = node->Next;
+
+    return node;
+}
+
+void ThreadPool::FreeNode(TaskNode* node)
+{
+    if (node->Owner == g_threadIdx)
+    {
+        ThreadContext& ctx = m_threadContexts[g_threadIdx];
+        node->Next = ctx.FreeList;
+        ctx.FreeList = node;
+
+        return;
+    }
+
+    // Only the owner removes from this list and it always takes the whole list, so
+    // there's no ABA problem
+    auto& remoteList = m_threadContexts[node->Owner].RemoteFreeList;
+    TaskNode* head = remoteList.load(std::memory_order_relaxed);
+
+    do
+    {
+        node->Next = head;
+    } while (!remoteList.compare_exchange_weak(head, node, std::memory_order_release,
+        std::memory_order_relaxed));
+}
+
+void ThreadPool::PumpUntilEmpty()
+{
+    while (m_numTasksInQueue.load(std::memory_order_acquire) > 0)
+    {
+        if (TaskNode* node = TryGetTask(); node)
+            ExecuteTask(node);
     }
 }
 
 bool ThreadPool::TryFlush()
 {
-    const bool success = m_numTasksFinished.load(std::memory_order_acquire) == 
+    const bool success = m_numTasksFinished.load(std::memory_order_acquire) ==
         m_numTasksToFinishTarget.load(std::memory_order_acquire);
     if (!success)
     {
@@ -150,6 +315,21 @@ bool ThreadPool::TryFlush()
     return success;
 }
 
+ThreadPool::Stats ThreadPool::GetAndResetStats()
+{
+    Stats stats{};
+
+    for (int i = 0; i < m_totalNumThreads; i++)
+    {
+        auto& ctx = m_threadContexts[i];
+        stats.NumTasksExecuted += ctx.NumTasksExecuted.exchange(0, std::memory_order_relaxed);
+        stats.NumSteals += ctx.NumSteals.exchange(0, std::memory_order_relaxed);
+        stats.NumSleeps += ctx.NumSleeps.exchange(0, std::memory_order_relaxed);
+    }
+
+    return stats;
+}
+
 void ThreadPool::WorkerThread(int idx)
 {
     Assert(g_threadIdx == -1, "Two or more threads have the same global index.");
@@ -159,35 +339,33 @@ void ThreadPool::WorkerThread(int idx)
 
     LOG_UI(INFO, "Thread %d waiting for tasks...\n", g_threadIdx);
 
+    ThreadContext& ctx = m_threadContexts[idx];
+    int numSpins = 0;
+
     while (true)
     {
-        Task task;
+        // Only tasks without unfinished dependencies are ever inserted into the queue
+        if (TaskNode* node = TryGetTask(); node)
+        {
+            ExecuteTask(node);
+            numSpins = 0;
+
+            continue;
+        }
 
         // Exit
         if (m_shutdown.load(std::memory_order_acquire))
             break;
 
-        // block if there aren't any tasks
-        m_taskQueue.wait_dequeue(m_consumerTokens[g_threadIdx], task);
-        m_numTasksInQueue.fetch_sub(1, std::memory_order_acquire);
-
-        const int taskHandle = task.GetSignalHandle();
-
-        // Block if this task has unfinished dependencies
-        if(task.GetPriority() != TASK_PRIORITY::BACKGROUND)
-            App::WaitForAdjacentHeadNodes(taskHandle);
-
-        task.DoTask();
-
-        // Signal dependent tasks that this task has finished
-        if (task.GetPriority() != TASK_PRIORITY::BACKGROUND)
+        // Spin for a while before going to sleep as new tasks often arrive shortly after
+        if (numSpins++ < NUM_SPINS_BEFORE_SLEEP)
         {
-            auto adjacencies = task.GetAdjacencies();
-            if (adjacencies.size() > 0)
-                App::SignalAdjacentTailNodes(adjacencies);
+            _mm_pause();
+            continue;
         }
 
-        m_numTasksFinished.fetch_add(1, std::memory_order_release);
+        Sleep(ctx);
+        numSpins = 0;
     }
 
     LOG_UI(INFO, "Thread %d exiting...\n", g_threadIdx);
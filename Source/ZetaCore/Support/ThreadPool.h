@@ -1,67 +1,109 @@
 #pragma once
 
 #include "Task.h"
-#include "concurrentqueue/blockingconcurrentqueue.h"
+#include "WorkStealingDeque.h"
+#include "TaskProfiler.h"
+#include <thread>
 
 namespace ZetaRay::Support
 {
+    // Every thread that inserts tasks (including threads outside this thread pool, e.g.
+    // the main thread) has its own deque. Tasks are pushed to the calling thread's deque
+    // and popped by the same thread in LIFO order, so that tasks that are spawned by a
+    // running task (e.g. successors that have become ready) stay in the same core's cache.
+    // Threads that run out of tasks steal from other threads' deques in FIFO order.
     class ThreadPool
     {
     public:
+        using Stats = App::ThreadPoolStats;
+
         ThreadPool() = default;
         ~ThreadPool() = default;
         ThreadPool(const ThreadPool&) = delete;
         ThreadPool& operator=(const ThreadPool&) = delete;
 
-        void Init(int poolSize, int totalNumThreads, const wchar_t* threadNamePrefix, 
+        void Init(int poolSize, int totalNumThreads, const wchar_t* threadNamePrefix,
             App::THREAD_PRIORITY priority, int threadIdxOffset);
         void Start();
         void Shutdown();
 
+        // Tasks with unfinished dependencies are not inserted into the queue. Instead,
+        // they're deferred until their last dependency finishes (see App::DeferTask()).
         void Enqueue(TaskSet&& ts);
         void Enqueue(Task&& t);
+        // Inserts a task whose dependencies have all finished into the queue. Task must have
+        // been previously accounted for by Enqueue().
+        void EnqueueUnblocked(Task&& t);
 
-        // The calling thread dequeues task until task queue becomes empty
+        // The calling thread executes tasks until task queue becomes empty
         void PumpUntilEmpty();
         // Waits until all tasks are finished (!= empty queue)
         bool TryFlush();
 
         ZetaInline bool AreAllTasksFinished() const
         {
-            const bool isEmpty = m_numTasksFinished.load(std::memory_order_acquire) == 
+            const bool isEmpty = m_numTasksFinished.load(std::memory_order_acquire) ==
                 m_numTasksToFinishTarget.load(std::memory_order_acquire);
             return isEmpty;
         }
 
         ZetaInline int ThreadPoolSize() const { return m_threadPoolSize; }
+        // When set and enabled, every task execution is recorded
+        ZetaInline void SetProfiler(TaskProfiler* profiler) { m_profiler = profiler; }
+
+        // Returns the counters accumulated since the last call and resets them
+        Stats GetAndResetStats();
 
     private:
+        static constexpr int NUM_TASKS_PER_BLOCK = 64;
+        static constexpr int NUM_SPINS_BEFORE_SLEEP = 64;
+
+        // Tasks are stored in per-thread blocks. Tasks are allocated by the thread that
+        // inserts them but may be freed by any thread -- those are returned to the owner
+        // through RemoteFreeList.
+        struct TaskNode
+        {
+            ZetaInline Task& GetTask() { return *reinterpret_cast<Task*>(TaskMem); }
+
+            // Task is constructed in place when the node is allocated
+            alignas(alignof(Task)) uint8_t TaskMem[sizeof(Task)];
+            TaskNode* Next;
+            // When task was inserted into the queue (only when profiling)
+            int64_t ReadyTime;
+            int Owner;
+        };
+
+        struct alignas(64) ThreadContext
+        {
+            WorkStealingDeque<TaskNode*> Deque;
+            TaskNode* FreeList = nullptr;
+            Util::SmallVector<TaskNode*> Blocks;
+            std::atomic_uint32_t NumTasksExecuted = 0;
+            std::atomic_uint32_t NumSteals = 0;
+            std::atomic_uint32_t NumSleeps = 0;
+            alignas(64) std::atomic<TaskNode*> RemoteFreeList = nullptr;
+        };
+
         void WorkerThread(int idx);
+        void ExecuteTask(TaskNode* node);
+        void Push(Task&& t);
+        TaskNode* TryGetTask();
+        void WakeUp(int numTasks);
+        void Sleep(ThreadContext& ctx);
+        TaskNode* AllocateNode();
+        void FreeNode(TaskNode* node);
 
         int m_threadPoolSize;
         int m_totalNumThreads;
         std::atomic_int32_t m_numTasksInQueue = 0;
         std::atomic_int32_t m_numTasksFinished = 0;
         std::atomic_int32_t m_numTasksToFinishTarget = 0;
+        std::atomic_int32_t m_numSleepingThreads = 0;
+        std::atomic_uint32_t m_wakeSignal = 0;
 
+        TaskProfiler* m_profiler = nullptr;
         std::thread m_threadPool[MAX_NUM_THREADS];
-
-        // Concurrent task queue
-        // Source: https://github.com/cameron314/concurrentqueue
-        struct MyTraits : public moodycamel::ConcurrentQueueDefaultTraits
-        {
-            static const size_t BLOCK_SIZE = 256;
-        };
-
-        moodycamel::BlockingConcurrentQueue<Task, MyTraits> m_taskQueue;
-
-        alignas(alignof(moodycamel::ProducerToken)) uint8_t m_producerTokensMem[
-            sizeof(moodycamel::ProducerToken) * MAX_NUM_THREADS];
-        moodycamel::ProducerToken* m_producerTokens;
-
-        alignas(alignof(moodycamel::ConsumerToken)) uint8_t m_consumerTokensMem[
-            sizeof(moodycamel::ConsumerToken) * MAX_NUM_THREADS];
-        moodycamel::ConsumerToken* m_consumerTokens;
+        ThreadContext m_threadContexts[MAX_NUM_THREADS];
 
         std::atomic_bool m_start = false;
         std::atomic_bool m_shutdown = false;
@@ -0,0 +1,178 @@
+#pragma once
+
+#include "../Utility/SmallVector.h"
+#include <atomic>
+#include <stdlib.h>
+
+namespace ZetaRay::Support
+{
+    // Chase-Lev work-stealing deque. The owner thread pushes and pops from the bottom
+    // (LIFO), while other threads steal from the top (FIFO).
+    //
+    // Ref: N. M. Le, A. Pop, A. Cohen and F. Zappa Nardelli, "Correct and Efficient
+    // Work-Stealing for Weak Memory Models," PPoPP 2013.
+    template<typename T>
+    requires std::is_trivially_copyable_v<T>
+    class WorkStealingDeque
+    {
+    public:
+        static constexpr int64_t DEFAULT_CAPACITY = 256;
+
+        WorkStealingDeque() = default;
+        ~WorkStealingDeque()
+        {
+            Free();
+        }
+
+        WorkStealingDeque(const WorkStealingDeque&) = delete;
+        WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+        void Init(int64_t capacity = DEFAULT_CAPACITY)
+        {
+            Assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "Capacity must be a power of two.");
+            Assert(!m_array.load(std::memory_order_relaxed), "Deque has already been initialized.");
+
+            m_array.store(Array::Create(capacity), std::memory_order_relaxed);
+            m_top.store(0, std::memory_order_relaxed);
+            m_bottom.store(0, std::memory_order_relaxed);
+        }
+
+        // Not thread-safe
+        void Free()
+        {
+            for (auto a : m_retired)
+                Array::Destroy(a);
+
+            m_retired.free_memory();
+
+            if (Array* a = m_array.load(std::memory_order_relaxed); a)
+            {
+                Array::Destroy(a);
+                m_array.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // Must only be called by the owner thread
+        void Push(T x)
+        {
+            const int64_t b = m_bottom.load(std::memory_order_relaxed);
+            const int64_t t = m_top.load(std::memory_order_acquire);
+            Array* a = m_array.load(std::memory_order_relaxed);
+
+            if (b - t > a->Capacity - 1)
+                a = Grow(a, t, b);
+
+            a->Put(b, x);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+        }
+
+        // Must only be called by the owner thread
+        bool Pop(T& x)
+        {
+            const int64_t b = m_bottom.load(std::memory_order_relaxed) - 1;
+            Array* a = m_array.load(std::memory_order_relaxed);
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = m_top.load(std::memory_order_relaxed);
+
+            // Empty
+            if (t > b)
+            {
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            x = a->Get(b);
+
+            if (t != b)
+                return true;
+
+            // Single remaining element -- compete with the stealers
+            const bool success = m_top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+
+            return success;
+        }
+
+        // Can be called by any thread
+        bool Steal(T& x)
+        {
+            int64_t t = m_top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b = m_bottom.load(std::memory_order_acquire);
+
+            if (t >= b)
+                return false;
+
+            Array* a = m_array.load(std::memory_order_acquire);
+            x = a->Get(t);
+
+            // Failure means another thread (either the owner or a stealer) got it first
+            return m_top.compare_exchange_strong(t, t + 1,
+                std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+
+        // Approximate when there are concurrent operations
+        ZetaInline bool IsEmpty() const
+        {
+            return m_bottom.load(std::memory_order_relaxed) <= m_top.load(std::memory_order_relaxed);
+        }
+
+    private:
+        struct Array
+        {
+            static Array* Create(int64_t capacity)
+            {
+                void* mem = malloc(sizeof(Array) + sizeof(std::atomic<T>) * capacity);
+                Array* a = new (mem) Array;
+                a->Capacity = capacity;
+                a->Data = reinterpret_cast<std::atomic<T>*>(a + 1);
+
+                for (int64_t i = 0; i < capacity; i++)
+                    new (&a->Data[i]) std::atomic<T>();
+
+                return a;
+            }
+
+            static void Destroy(Array* a)
+            {
+                free(a);
+            }
+
+            ZetaInline T Get(int64_t i) const
+            {
+                return Data[i & (Capacity - 1)].load(std::memory_order_relaxed);
+            }
+
+            ZetaInline void Put(int64_t i, T x)
+            {
+                Data[i & (Capacity - 1)].store(x, std::memory_order_relaxed);
+            }
+
+            int64_t Capacity;
+            std::atomic<T>* Data;
+        };
+
+        Array* Grow(Array* a, int64_t t, int64_t b)
+        {
+            Array* newArray = Array::Create(a->Capacity * 2);
+
+            for (int64_t i = t; i < b; i++)
+                newArray->Put(i, a->Get(i));
+
+            // Stealers may still be reading from the old array, so it's only released in Free()
+            m_retired.push_back(a);
+            m_array.store(newArray, std::memory_order_release);
+
+            return newArray;
+        }
+
+        alignas(64) std::atomic_int64_t m_top = 0;
+        alignas(64) std::atomic_int64_t m_bottom = 0;
+        std::atomic<Array*> m_array = nullptr;
+        // Only accessed by the owner thread
+        Util::SmallVector<Array*> m_retired;
+    };
+}
@@ -0,0 +1,513 @@
+#pragma once
+
+#include "../Math/Common.h"
+#include "../Support/Memory.h"
+#include "../Utility/Optional.h"
+#include "../Win32/Win32.h"
+#include <atomic>
+#include <string.h>
+
+namespace ZetaRay::Util
+{
+    // Hash table for read-mostly data that's looked up from multiple threads (e.g. instance
+    // ID -> tree position). Entries are split into independent shards based on key's hash.
+    //
+    //  - Readers never block or write to shared memory. Every shard is protected by a sequence
+    //    lock; readers copy the value out and retry if a writer modified that shard in the
+    //    meantime. Therefore, values must be trivially copyable and are returned by value.
+    //  - Writers to the same shard are serialized (SRW lock), writers to different shards
+    //    don't contend.
+    //  - Every shard is an open-addressing table with linear probing. Erase shifts the
+    //    following entries back, so there are no tombstones.
+    //  - When a shard grows, readers might still be probing its old table, so old tables are
+    //    only freed by clear() or free_memory(). Their total size is bounded by the size of
+    //    current tables.
+    //  - clear(), free_memory() and for_each() must not run concurrently with other operations.
+    //  - Keys are assumed to be already hashed (they're only mixed cheaply).
+    // Ref: H. Boehm, "Can Seqlocks Get Along With Programming Language Memory Models?", 2012.
+    template<typename ValueType, typename KeyType = uint64_t, Support::AllocatorType Allocator = Support::SystemAllocator>
+    requires std::is_integral_v<KeyType>
+    class ConcurrentHashTable
+    {
+        static_assert(std::is_trivially_copyable_v<ValueType>, "ValueType must be trivially copyable.");
+
+    public:
+        static constexpr uint32_t NUM_SHARDS = 16;
+
+        explicit ConcurrentHashTable(const Allocator& a = Allocator())
+            : m_allocator(a)
+        {}
+        explicit ConcurrentHashTable(size_t initialSize, const Allocator& a = Allocator())
+            : m_allocator(a)
+        {
+            resize(initialSize);
+        }
+        ~ConcurrentHashTable()
+        {
+            free_memory();
+        }
+
+        ConcurrentHashTable(const ConcurrentHashTable&) = delete;
+        ConcurrentHashTable& operator=(const ConcurrentHashTable&) = delete;
+
+        // Makes sure there are at least n buckets in total. Note that unlike HashTable, load is
+        // different for each shard, so a few more allocations might take place when size
+        // approaches n. Safe to call concurrently with readers and writers.
+        void resize(size_t n, bool accountForMaxLoad = false)
+        {
+            size_t perShard = (n + NUM_SHARDS - 1) / NUM_SHARDS;
+            perShard = accountForMaxLoad ? Math::Ceil(perShard / MAX_LOAD) : perShard;
+            perShard = Math::NextPow2(Math::Max(perShard, MIN_NUM_BUCKETS_PER_SHARD));
+
+            for (auto& shard : m_shards)
+            {
+                AcquireSRWLockExclusive(&shard.Lock);
+
+                const Table* t = shard.Tab.load(std::memory_order_relaxed);
+                if (!t || t->Capacity < perShard)
+                    relocate(shard, perShard);
+
+                ReleaseSRWLockExclusive(&shard.Lock);
+            }
+        }
+
+        // Never blocks. Returns a copy of the value, as it might be modified (or moved)
+        // by a concurrent writer right after.
+        Util::Optional<ValueType> find(KeyType key) const
+        {
+            const uint64_t h = hash(key);
+            const Shard& shard = m_shards[shard_index(h)];
+            alignas(ValueType) uint8_t val[sizeof(ValueType)];
+
+            while (true)
+            {
+                const uint32_t seq = shard.Seq.load(std::memory_order_acquire);
+
+                // A write is in progress
+                if (seq & 0x1)
+                {
+                    _mm_pause();
+                    continue;
+                }
+
+                const bool found = probe(shard.Tab.load(std::memory_order_acquire), key, h, val);
+
+                // Prevents reads of the table from being reordered after the following load
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if (shard.Seq.load(std::memory_order_relaxed) == seq)
+                {
+                    if (found)
+                        return *reinterpret_cast<const ValueType*>(val);
+
+                    return {};
+                }
+            }
+        }
+
+        ZetaInline bool contains(KeyType key) const
+        {
+            return (bool)find(key);
+        }
+
+        // Inserts a new entry only if it doesn't already exist
+        template<typename... Args>
+        bool try_emplace(KeyType key, Args&&... args)
+        {
+            const ValueType val(ZetaForward(args)...);
+            return insert(key, val, false);
+        }
+
+        // Inserts a new entry or assigns to the existing one
+        void insert_or_assign(KeyType key, const ValueType& val)
+        {
+            insert(key, val, true);
+        }
+
+        // Calls f(ValueType&) on the value with the given key (if found) while holding the
+        // shard's write lock. Returns whether key was found.
+        template<typename F>
+        bool modify(KeyType key, F f)
+        {
+            const uint64_t h = hash(key);
+            Shard& shard = m_shards[shard_index(h)];
+            AcquireSRWLockExclusive(&shard.Lock);
+
+            Table* t = shard.Tab.load(std::memory_order_relaxed);
+            const size_t idx = find_index(t, key, h);
+
+            if (idx != INVALID_INDEX)
+            {
+                begin_write(shard);
+                f(t->Slots()[idx].Val);
+                end_write(shard);
+            }
+
+            ReleaseSRWLockExclusive(&shard.Lock);
+
+            return idx != INVALID_INDEX;
+        }
+
+        size_t erase(KeyType key)
+        {
+            const uint64_t h = hash(key);
+            Shard& shard = m_shards[shard_index(h)];
+            AcquireSRWLockExclusive(&shard.Lock);
+
+            Table* t = shard.Tab.load(std::memory_order_relaxed);
+            size_t hole = find_index(t, key, h);
+
+            if (hole == INVALID_INDEX)
+            {
+                ReleaseSRWLockExclusive(&shard.Lock);
+                return 0;
+            }
+
+            begin_write(shard);
+
+            // Backward-shift deletion -- move the following entries in the same cluster into
+            // the hole, as long as they remain reachable from their home bucket
+            Slot* slots = t->Slots();
+            const size_t mask = t->Capacity - 1;
+            size_t next = hole;
+
+            while (true)
+            {
+                next = (next + 1) & mask;
+                if (!slots[next].Full)
+                    break;
+
+                const size_t home = hash(slots[next].Key) & mask;
+
+                if (((next - home) & mask) >= ((next - hole) & mask))
+                {
+                    slots[hole] = slots[next];
+                    hole = next;
+                }
+            }
+
+            slots[hole].Full = false;
+            shard.Size.store(shard.Size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+
+            end_write(shard);
+            ReleaseSRWLockExclusive(&shard.Lock);
+
+            return 1;
+        }
+
+        size_t size() const
+        {
+            size_t n = 0;
+            for (auto& shard : m_shards)
+                n += shard.Size.load(std::memory_order_relaxed);
+
+            return n;
+        }
+
+        ZetaInline bool empty() const
+        {
+            return size() == 0;
+        }
+
+        size_t bucket_count() const
+        {
+            size_t n = 0;
+            for (auto& shard : m_shards)
+            {
+                const Table* t = shard.Tab.load(std::memory_order_relaxed);
+                n += t ? t->Capacity : 0;
+            }
+
+            return n;
+        }
+
+        // Removes all the entries and frees the old tables. Current tables are kept.
+        void clear()
+        {
+            for (auto& shard : m_shards)
+            {
+                free_retired(shard);
+
+                if (Table* t = shard.Tab.load(std::memory_order_relaxed); t)
+                {
+                    Slot* slots = t->Slots();
+                    for (size_t i = 0; i < t->Capacity; i++)
+                        slots[i].Full = false;
+                }
+
+                shard.Size.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        void free_memory()
+        {
+            for (auto& shard : m_shards)
+            {
+                free_retired(shard);
+
+                if (Table* t = shard.Tab.load(std::memory_order_relaxed); t)
+                    free_table(t);
+
+                shard.Tab.store(nullptr, std::memory_order_relaxed);
+                shard.Size.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // Calls f(KeyType, ValueType&) for every entry, in no particular order
+        template<typename F>
+        void for_each(F f)
+        {
+            for (auto& shard : m_shards)
+            {
+                Table* t = shard.Tab.load(std::memory_order_relaxed);
+                if (!t)
+                    continue;
+
+                Slot* slots = t->Slots();
+
+                for (size_t i = 0; i < t->Capacity; i++)
+                {
+                    if (slots[i].Full)
+                        f(slots[i].Key, slots[i].Val);
+                }
+            }
+        }
+
+    private:
+        static constexpr size_t INVALID_INDEX = size_t(-1);
+        static constexpr size_t MIN_NUM_BUCKETS_PER_SHARD = 8;
+        // Linear probing degrades quickly at higher loads
+        static constexpr float MAX_LOAD = 0.75f;
+        static constexpr int SHARD_SHIFT = 64 - 4;
+        static_assert((1 << (64 - SHARD_SHIFT)) == NUM_SHARDS, "Invalid shard shift.");
+
+        struct Slot
+        {
+            KeyType Key;
+            bool Full;
+            ValueType Val;
+        };
+
+        // Immutable apart from the slots once published, so readers can't see mismatching
+        // slots and capacity
+        struct Table
+        {
+            ZetaInline Slot* Slots()
+            {
+                return reinterpret_cast<Slot*>(reinterpret_cast<uint8_t*>(this) + SLOTS_OFFSET);
+            }
+            ZetaInline const Slot* Slots() const
+            {
+                return reinterpret_cast<const Slot*>(reinterpret_cast<const uint8_t*>(this) + SLOTS_OFFSET);
+            }
+
+            // Next older table that was replaced by this one
+            Table* Retired;
+            size_t Capacity;
+        };
+
+        static constexpr size_t TABLE_ALIGNMENT = Math::Max(alignof(Table), alignof(Slot));
+        static constexpr size_t SLOTS_OFFSET = (sizeof(Table) + alignof(Slot) - 1) & ~(alignof(Slot) - 1);
+
+        // Separate cache lines, so that writes to one shard don't slow down readers of others
+        struct alignas(64) Shard
+        {
+            std::atomic_uint32_t Seq = 0;
+            std::atomic<Table*> Tab = nullptr;
+            std::atomic_uint32_t Size = 0;
+            SRWLOCK Lock = SRWLOCK_INIT;
+        };
+
+        static ZetaInline uint64_t hash(KeyType key)
+        {
+            const uint64_t h = uint64_t(key) * 0x9e3779b97f4a7c15;
+            return h ^ (h >> 32);
+        }
+
+        // Use the top bits for shard and lower bits for buckets
+        static ZetaInline uint32_t shard_index(uint64_t h)
+        {
+            return (uint32_t)(h >> SHARD_SHIFT);
+        }
+
+        // Might be reading a table that's being modified -- caller must validate the result
+        static bool probe(const Table* t, KeyType key, uint64_t h, void* out)
+        {
+            if (!t)
+                return false;
+
+            const Slot* slots = t->Slots();
+            const size_t mask = t->Capacity - 1;
+            size_t idx = h & mask;
+
+            // Bounded, as an inconsistent table might not have any empty buckets
+            for (size_t i = 0; i < t->Capacity; i++)
+            {
+                const Slot& slot = slots[idx];
+                if (!slot.Full)
+                    return false;
+
+                if (slot.Key == key)
+                {
+                    memcpy(out, &slot.Val, sizeof(ValueType));
+                    return true;
+                }
+
+                idx = (idx + 1) & mask;
+            }
+
+            return false;
+        }
+
+        // Caller must hold the shard's write lock
+        static size_t find_index(const Table* t, KeyType key, uint64_t h)
+        {
+            if (!t)
+                return INVALID_INDEX;
+
+            const Slot* slots = t->Slots();
+            const size_t mask = t->Capacity - 1;
+            size_t idx = h & mask;
+
+            while (slots[idx].Full)
+            {
+                if (slots[idx].Key == key)
+                    return idx;
+
+                idx = (idx + 1) & mask;
+            }
+
+            return INVALID_INDEX;
+        }
+
+        ZetaInline static void begin_write(Shard& shard)
+        {
+            shard.Seq.store(shard.Seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            // Prevents the following writes to the table from being reordered before the above
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        ZetaInline static void end_write(Shard& shard)
+        {
+            shard.Seq.store(shard.Seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool insert(KeyType key, const ValueType& val, bool assign)
+        {
+            const uint64_t h = hash(key);
+            Shard& shard = m_shards[shard_index(h)];
+            AcquireSRWLockExclusive(&shard.Lock);
+
+            Table* t = shard.Tab.load(std::memory_order_relaxed);
+            size_t idx = find_index(t, key, h);
+            const bool exists = idx != INVALID_INDEX;
+
+            if (exists && !assign)
+            {
+                ReleaseSRWLockExclusive(&shard.Lock);
+                return false;
+            }
+
+            if (!exists)
+            {
+                const uint32_t size = shard.Size.load(std::memory_order_relaxed);
+
+                // Readers of the old table are unaffected, so this happens outside the write
+                if (!t || size + 1 > size_t(t->Capacity * MAX_LOAD))
+                    t = relocate(shard, t ? t->Capacity << 1 : MIN_NUM_BUCKETS_PER_SHARD);
+
+                shard.Size.store(size + 1, std::memory_order_relaxed);
+                idx = h & (t->Capacity - 1);
+
+                while (t->Slots()[idx].Full)
+                    idx = (idx + 1) & (t->Capacity - 1);
+            }
+
+            begin_write(shard);
+
+            Slot& slot = t->Slots()[idx];
+            slot.Key = key;
+            slot.Val = val;
+            slot.Full = true;
+
+            end_write(shard);
+            ReleaseSRWLockExclusive(&shard.Lock);
+
+            return !exists;
+        }
+
+        // Copies the entries into a new table with the given capacity and publishes it. Caller
+        // must hold the shard's write lock.
+        Table* relocate(Shard& shard, size_t n)
+        {
+            Assert(Math::IsPow2(n), "Capacity must be a power of two.");
+
+            Table* newTable = reinterpret_cast<Table*>(m_allocator.AllocateAligned(table_size(n),
+                TABLE_ALIGNMENT));
+            newTable->Capacity = n;
+
+            Slot* newSlots = newTable->Slots();
+            for (size_t i = 0; i < n; i++)
+                newSlots[i].Full = false;
+
+            Table* oldTable = shard.Tab.load(std::memory_order_relaxed);
+            newTable->Retired = oldTable;
+
+            if (oldTable)
+            {
+                const Slot* oldSlots = oldTable->Slots();
+
+                for (size_t i = 0; i < oldTable->Capacity; i++)
+                {
+                    if (!oldSlots[i].Full)
+                        continue;
+
+                    size_t idx = hash(oldSlots[i].Key) & (n - 1);
+                    while (newSlots[idx].Full)
+                        idx = (idx + 1) & (n - 1);
+
+                    newSlots[idx] = oldSlots[i];
+                }
+            }
+
+            // Make sure the new table is fully written before readers can see it
+            shard.Tab.store(newTable, std::memory_order_release);
+
+            return newTable;
+        }
+
+        void free_retired(Shard& shard)
+        {
+            Table* t = shard.Tab.load(std::memory_order_relaxed);
+            if (!t)
+                return;
+
+            Table* curr = t->Retired;
+            t->Retired = nullptr;
+
+            while (curr)
+            {
+                Table* next = curr->Retired;
+                free_table(curr);
+                curr = next;
+            }
+        }
+
+        ZetaInline static constexpr size_t table_size(size_t n)
+        {
+            return SLOTS_OFFSET + n * sizeof(Slot);
+        }
+
+        ZetaInline void free_table(Table* t)
+        {
+            m_allocator.FreeAligned(t, table_size(t->Capacity), TABLE_ALIGNMENT);
+        }
+
+        Shard m_shards[NUM_SHARDS];
+#if defined(ZETA_HAS_NO_UNIQUE_ADDRESS)
+        [[msvc::no_unique_address]] Allocator m_allocator;
+#else
+        Allocator m_allocator;
+#endif
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Span.h"
+#include <algorithm>
+
+namespace ZetaRay::Util
+{
+    // Keeps track of the modified elements of a buffer, so that only those need to be copied
+    // (e.g. to the GPU). Modified elements are returned as a sorted list of disjoint ranges,
+    // where ranges that overlap, touch or are at most "maxGap" elements apart are merged --
+    // copying a few unmodified elements tends to be cheaper than issuing another copy.
+    class DirtyRanges
+    {
+    public:
+        // Elements [Base, Base + Count)
+        struct Range
+        {
+            uint32_t Base;
+            uint32_t Count;
+        };
+
+        explicit DirtyRanges(uint32_t maxGap = 0)
+            : m_maxGap(maxGap)
+        {}
+
+        // Marks elements [base, base + count) as modified
+        void Add(uint32_t base, uint32_t count = 1)
+        {
+            if (count == 0)
+                return;
+
+            // Additions mostly come in increasing order, in which case they can be merged right away
+            if (m_coalesced && !m_ranges.empty())
+            {
+                Range& last = m_ranges.back();
+                const uint32_t lastEnd = last.Base + last.Count;
+
+                if (base >= last.Base && base <= lastEnd + m_maxGap)
+                {
+                    last.Count = std::max(lastEnd, base + count) - last.Base;
+                    return;
+                }
+
+                m_coalesced = base > lastEnd;
+            }
+
+            m_ranges.push_back(Range{ .Base = base, .Count = count });
+        }
+
+        // Returns the modified ranges, sorted and merged
+        Span<Range> Ranges()
+        {
+            Coalesce();
+            return m_ranges;
+        }
+
+        // Total number of elements that would be copied
+        size_t NumElements()
+        {
+            Coalesce();
+
+            size_t n = 0;
+            for (auto& r : m_ranges)
+                n += r.Count;
+
+            return n;
+        }
+
+        ZetaInline bool empty() const { return m_ranges.empty(); }
+        ZetaInline void clear()
+        {
+            m_ranges.clear();
+            m_coalesced = true;
+        }
+
+    private:
+        void Coalesce()
+        {
+            if (m_coalesced)
+                return;
+
+            std::sort(m_ranges.begin(), m_ranges.end(), [](const Range& r1, const Range& r2)
+                {
+                    return r1.Base < r2.Base;
+                });
+
+            size_t curr = 0;
+
+            for (size_t i = 1; i < m_ranges.size(); i++)
+            {
+                const uint32_t currEnd = m_ranges[curr].Base + m_ranges[curr].Count;
+
+                if (m_ranges[i].Base <= currEnd + m_maxGap)
+                {
+                    m_ranges[curr].Count = std::max(currEnd, m_ranges[i].Base + m_ranges[i].Count) -
+                        m_ranges[curr].Base;
+                }
+                else
+                    m_ranges[++curr] = m_ranges[i];
+            }
+
+            m_ranges.resize(curr + 1);
+            m_coalesced = true;
+        }
+
+        SmallVector<Range> m_ranges;
+        uint32_t m_maxGap;
+        // Whether m_ranges is sorted and merged
+        bool m_coalesced = true;
+    };
+}
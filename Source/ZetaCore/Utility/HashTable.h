@@ -6,20 +6,27 @@
 
 namespace ZetaRay::Util
 {
-    // Open-set addressing with linear probing
-    // 
-    //  - Assumes keys are already hashed; key itself is not stored, only its hash (uint64_t). Consequently,
-    //    collisions on keys could lead to wrong results. By using a decent hash function, chances of 
-    //    such collisions should be low.
+    // Open-set addressing with SIMD group probing (Swiss table)
+    //
+    //  - Every bucket has a control byte that's either empty, deleted or (when full) 7 bits
+    //    of the key's hash. Lookups compare 16 control bytes at a time using SSE2 and only
+    //    compare keys of buckets whose control bytes match.
+    //  - Probing goes over groups of 16 consecutive buckets (not necessarily aligned) with
+    //    triangular steps, until a group that contains an empty bucket is found.
+    //  - Erased buckets are marked empty unless they're in the middle of a run of 16
+    //    non-empty buckets that some probe might have passed over. In that case, they're
+    //    marked as deleted (tombstone). When there's no room left, tombstones are purged
+    //    by rehashing in place if the table is mostly tombstones, otherwise table grows.
+    //  - Keys are assumed to be already hashed (they're only mixed cheaply).
     //  - Iterators (pointers) are NOT stable; pointer to an entry found earlier might not be valid
     //    anymore due to subsequent insertions and possible resize.
     //  - Not thread-safe
+    // Ref: https://abseil.io/about/design/swisstables
     template<typename ValueType, typename KeyType = uint64_t, Support::AllocatorType Allocator = Support::SystemAllocator>
     requires std::is_integral_v<KeyType>
     class HashTable
     {
-        static_assert(std::is_copy_constructible_v<ValueType> || std::is_move_constructible_v<ValueType>, 
-            "ValueType is not move or copy-constructible.");
+        static_assert(std::is_move_constructible_v<ValueType>, "ValueType is not move-constructible.");
 
     public:
         struct Entry
@@ -34,8 +41,7 @@ namespace ZetaRay::Util
         explicit HashTable(size_t initialSize, const Allocator& a = Allocator())
             : m_allocator(a)
         {
-            static_assert(std::is_default_constructible_v<ValueType>);
-            relocate(Math::NextPow2(initialSize));
+            resize(initialSize);
         }
         ~HashTable()
         {
@@ -45,13 +51,43 @@ namespace ZetaRay::Util
                 this->m_allocator.~Allocator();
         }
 
-        // TODO implement move & copy constructors/assignments
-        HashTable(const HashTable&) = delete;
-        HashTable& operator=(const HashTable&) = delete;
+        HashTable(const HashTable& other)
+            requires std::is_copy_constructible_v<ValueType>
+            : m_allocator(other.m_allocator)
+        {
+            copy_from(other);
+        }
+        HashTable& operator=(const HashTable& other)
+            requires std::is_copy_constructible_v<ValueType>
+        {
+            if (this == &other)
+                return *this;
+
+            free_memory();
+            copy_from(other);
+
+            return *this;
+        }
+        // Takes over other's memory, which is left empty
+        HashTable(HashTable&& other)
+            : m_allocator(other.m_allocator)
+        {
+            swap(other);
+        }
+        HashTable& operator=(HashTable&& other)
+        {
+            if (this == &other)
+                return *this;
+
+            free_memory();
+            swap(other);
 
-        // "accountForMaxLoad": A common use case is when the maximum number of 
-        // elements is known, so resize is used to allocate all the necessary storage 
-        // once. But this doesn't account for load factor, as when size approaches 
+            return *this;
+        }
+
+        // "accountForMaxLoad": A common use case is when the maximum number of
+        // elements is known, so resize is used to allocate all the necessary storage
+        // once. But this doesn't account for load factor, as when size approaches
         // "n", another allocation takes place so that load factor stays below maximum.
         // When accounting for this, table should be resized to ceil(n / max_load_factor).
         void resize(size_t n, bool accountForMaxLoad = false)
@@ -66,12 +102,11 @@ namespace ZetaRay::Util
         }
 
         // Returns NULL if an element with the given key is not found.
-        // Note: in contrast to find(), find_entry() returns NULL only when the table is empty.
         Util::Optional<ValueType*> find(KeyType key) const
         {
-            Entry* e = find_entry(key);
-            if (e && e->Key == key)
-                return &e->Val;
+            const size_t idx = find_index(key);
+            if (idx != INVALID_INDEX)
+                return &m_slots[idx].Val;
 
             return {};
         }
@@ -80,70 +115,23 @@ namespace ZetaRay::Util
         template<typename... Args>
         bool try_emplace(KeyType key, Args&&... args)
         {
-            Assert(key != NULL_KEY && key != TOMBSTONE_KEY, "Invalid key.");
-
-            Entry* elem = find_entry(key);
-            if (!elem || elem->Key != key)
-            {
-                if (elem && (elem->Key == TOMBSTONE_KEY))
-                {
-                    elem->Key = key;
-                    new (&elem->Val) ValueType(ZetaForward(args)...);
-                    m_numNonTombstoneEntries++;
-
-                    return true;
-                }
-
-                if (!m_beg || load_factor() >= MAX_LOAD || m_numEntries + 1 == bucket_count())
-                {
-                    relocate(Math::Max(bucket_count() << 1, MIN_NUM_BUCKETS));
-                    // Find the new position to construct this Entry
-                    elem = find_entry(key);
-                }
-
-                elem->Key = key;
-                new (&elem->Val) ValueType(ZetaForward(args)...);
-                m_numEntries++;
-                m_numNonTombstoneEntries++;
-                Assert(m_numEntries < bucket_count(), "Load factor should never be 1.0.");
+            if (find_index(key) != INVALID_INDEX)
+                return false;
 
-                return true;
-            }
+            // prepare_insert() might relocate
+            const size_t idx = prepare_insert(key);
+            Entry* elem = m_slots + idx;
+            new (&elem->Val) ValueType(ZetaForward(args)...);
 
-            return false;
+            return true;
         }
 
         // Assign to the entry if already exists, otherwise inserts a new entry
         Entry& insert_or_assign(KeyType key, const ValueType& val)
         {
-            static_assert(std::is_copy_constructible_v<ValueType> || std::is_move_constructible_v<ValueType>,
-                "ValueType must be move-or-copy constructible.");
-            Assert(key != NULL_KEY && key != TOMBSTONE_KEY, "Invalid key.");
-
-            Entry* elem = find_entry(key);
-            if (!elem || elem->Key != key)
-            {
-                if (elem && elem->Key == TOMBSTONE_KEY)
-                {
-                    elem->Key = key;
-                    new (&elem->Val) ValueType(val);
-                    m_numNonTombstoneEntries++;
-
-                    return *elem;
-                }
-
-                if (!m_beg || load_factor() >= MAX_LOAD || m_numEntries + 1 == bucket_count())
-                {
-                    relocate(Math::Max(bucket_count() << 1, MIN_NUM_BUCKETS));
-                    elem = find_entry(key);
-                }
-
-                elem->Key = key;
-                m_numEntries++;
-                m_numNonTombstoneEntries++;
-                Assert(m_numEntries < bucket_count(), "Load factor should never be 1.0.");
-            }
+            static_assert(std::is_copy_constructible_v<ValueType>, "ValueType must be copy-constructible.");
 
+            Entry* elem = find_or_prepare_insert(key);
             new (&elem->Val) ValueType(val);
 
             return *elem;
@@ -151,34 +139,7 @@ namespace ZetaRay::Util
 
         Entry& insert_or_assign(KeyType key, ValueType&& val)
         {
-            static_assert(std::is_copy_constructible_v<ValueType> || std::is_move_constructible_v<ValueType>,
-                "ValueType must be move-or-copy constructible.");
-            Assert(key != NULL_KEY && key != TOMBSTONE_KEY, "Invalid key.");
-
-            Entry* elem = find_entry(key);
-            if (!elem || elem->Key != key)
-            {
-                if (elem && elem->Key == TOMBSTONE_KEY)
-                {
-                    elem->Key = key;
-                    new (&elem->Val) ValueType(ZetaForward(val));
-                    m_numNonTombstoneEntries++;
-
-                    return *elem;
-                }
-
-                if (!m_beg || load_factor() >= MAX_LOAD || m_numEntries + 1 == bucket_count())
-                {
-                    relocate(Math::Max(bucket_count() << 1, MIN_NUM_BUCKETS));
-                    elem = find_entry(key);
-                }
-
-                elem->Key = key;
-                m_numEntries++;
-                m_numNonTombstoneEntries++;
-                Assert(m_numEntries < bucket_count(), "Load factor should never be 1.0.");
-            }
-
+            Entry* elem = find_or_prepare_insert(key);
             new (&elem->Val) ValueType(ZetaForward(val));
 
             return *elem;
@@ -186,251 +147,467 @@ namespace ZetaRay::Util
 
         ZetaInline size_t erase(KeyType key)
         {
-            Entry* elem = find_entry(key);
-            if (!elem || elem->Key != key || elem->Key == TOMBSTONE_KEY)
+            const size_t idx = find_index(key);
+            if (idx == INVALID_INDEX)
                 return 0;
 
-            elem->Key = TOMBSTONE_KEY;
-            Assert(m_numNonTombstoneEntries >= 1, "Invalid hash table state.");
-            m_numNonTombstoneEntries--;
             if constexpr (!std::is_trivially_destructible_v<ValueType>)
-                elem->~Entry();
+                m_slots[idx].~Entry();
+
+            Assert(m_size >= 1, "Invalid hash table state.");
+            m_size--;
+
+            // Probes stop at the first group with an empty bucket, so idx can only become empty
+            // if every window of 16 buckets containing it has an empty bucket. For tables with
+            // less than 16 buckets, every probe covers the whole table, which always has an
+            // empty bucket.
+            bool wasNeverFull = true;
+
+            if (bucket_count() >= GROUP_WIDTH)
+            {
+                const uint32_t emptyBefore = Group(m_ctrl + ((idx - GROUP_WIDTH) & (bucket_count() - 1))).MatchEmpty();
+                const uint32_t emptyAfter = Group(m_ctrl + idx).MatchEmpty();
+                wasNeverFull = emptyBefore && emptyAfter &&
+                    (_tzcnt_u32(emptyAfter) + _lzcnt_u32(emptyBefore << 16)) < GROUP_WIDTH;
+            }
+
+            set_ctrl(idx, wasNeverFull ? CTRL_EMPTY : CTRL_DELETED);
+            m_growthLeft += wasNeverFull;
 
             return 1;
         }
 
         ZetaInline size_t bucket_count() const
         {
-            return m_end - m_beg;
+            return m_capacity;
         }
 
-        // Note that tombstone entries count towards #entries
         ZetaInline size_t size() const
         {
-            return m_numNonTombstoneEntries;
+            return m_size;
         }
 
         ZetaInline float load_factor() const
         {
             // Avoid divide-by-zero
-            return m_numEntries == 0 ? 0.0f : (float)m_numEntries / bucket_count();
+            return m_size == 0 ? 0.0f : (float)m_size / bucket_count();
         }
 
         ZetaInline bool empty() const
         {
-            return m_numNonTombstoneEntries == 0;
+            return m_size == 0;
         }
 
         void clear()
         {
-            if constexpr (!std::is_trivially_destructible_v<ValueType>)
-            {
-                size_t i = 0;
-                
-                for (auto it = begin_it(); it < end_it(); it = next_it(it))
-                {
-                    it->~Entry();
-                    i++;
-                }
-                
-                Assert(i == m_numNonTombstoneEntries, "Number of cleared entries must match the number of entries.");
-            }
+            destruct_all();
 
-            for (Entry* curr = m_beg; curr != m_end; curr++)
-                curr->Key = NULL_KEY;
+            if (m_ctrl)
+                memset(m_ctrl, CTRL_EMPTY, bucket_count() + GROUP_WIDTH);
 
-            m_numEntries = 0;
-            m_numNonTombstoneEntries = 0;
+            m_size = 0;
+            m_growthLeft = bucket_count() ? max_growth(bucket_count()) : 0;
             // Don't free the memory
         }
 
         void free_memory()
         {
-            if constexpr (!std::is_trivially_destructible_v<ValueType>)
-            {
-                size_t i = 0;
-
-                for (auto it = begin_it(); it < end_it(); it = next_it(it))
-                {
-                    it->~Entry();
-                    i++;
-                }
-
-                Assert(i == m_numNonTombstoneEntries, "Number of cleared entries must match the number of entries.");
-            }
+            destruct_all();
 
             // Free the previously allocated memory
-            if(bucket_count())
-                m_allocator.FreeAligned(m_beg, bucket_count() * sizeof(Entry), alignof(Entry));
-
-            m_numEntries = 0;
-            m_numNonTombstoneEntries = 0;
-            m_beg = nullptr;
-            m_end = nullptr;
+            if (bucket_count())
+                m_allocator.FreeAligned(m_slots, allocation_size(bucket_count()), alignof(Entry));
+
+            m_slots = nullptr;
+            m_ctrl = nullptr;
+            m_capacity = 0;
+            m_size = 0;
+            m_growthLeft = 0;
         }
 
         void swap(HashTable& other)
         {
-            std::swap(m_beg, other.m_beg);
-            std::swap(m_end, other.m_end);
-            std::swap(m_numEntries, other.m_numEntries);
-            std::swap(m_numNonTombstoneEntries, other.m_numNonTombstoneEntries);
+            std::swap(m_slots, other.m_slots);
+            std::swap(m_ctrl, other.m_ctrl);
+            std::swap(m_capacity, other.m_capacity);
+            std::swap(m_size, other.m_size);
+            std::swap(m_growthLeft, other.m_growthLeft);
             std::swap(m_allocator, other.m_allocator);
         }
 
         ValueType& operator[](KeyType key)
         {
             static_assert(std::is_default_constructible_v<ValueType>, "ValueType must be default-constructible");
-            Assert(key != NULL_KEY && key != TOMBSTONE_KEY, "Invalid key.");
 
-            Entry* elem = find_entry(key);
-            if (!elem || elem->Key != key)
+            const size_t idx = find_index(key);
+            if (idx != INVALID_INDEX)
+                return m_slots[idx].Val;
+
+            // prepare_insert() might relocate
+            const size_t newIdx = prepare_insert(key);
+            Entry* elem = m_slots + newIdx;
+            new (&elem->Val) ValueType();
+
+            return elem->Val;
+        }
+
+        ZetaInline Entry* begin_it()
+        {
+            return m_size == 0 ? end_it() : next_full(0);
+        }
+
+        ZetaInline Entry* next_it(Entry* curr)
+        {
+            return next_full(curr - m_slots + 1);
+        }
+
+        ZetaInline Entry* end_it()
+        {
+            return m_slots + m_capacity;
+        }
+
+    private:
+        static constexpr size_t MIN_NUM_BUCKETS = 4;
+        static constexpr float MAX_LOAD = 0.875f;
+        static constexpr size_t GROUP_WIDTH = 16;
+        static constexpr size_t INVALID_INDEX = size_t(-1);
+        static constexpr int8_t CTRL_EMPTY = -128;
+        static constexpr int8_t CTRL_DELETED = -2;
+
+        // 16 consecutive control bytes
+        struct Group
+        {
+            ZetaInline explicit Group(const int8_t* ctrl)
+                : Ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+            {}
+
+            // Bit i is set if i'th control byte matches the given hash
+            ZetaInline uint32_t Match(int8_t h2) const
+            {
+                return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), Ctrl));
+            }
+            ZetaInline uint32_t MatchEmpty() const
+            {
+                return Match(CTRL_EMPTY);
+            }
+            // Empty and deleted are the only control bytes with the sign bit set
+            ZetaInline uint32_t MatchEmptyOrDeleted() const
+            {
+                return _mm_movemask_epi8(Ctrl);
+            }
+            ZetaInline uint32_t MatchFull() const
+            {
+                return ~(uint32_t)_mm_movemask_epi8(Ctrl) & 0xffff;
+            }
+
+            __m128i Ctrl;
+        };
+
+        ZetaInline static uint64_t hash(KeyType key)
+        {
+            // Keys are assumed to be hashed already, but mixing makes sure the
+            // bits that are used for H1 and H2 aren't correlated
+            uint64_t h = (uint64_t)key * 0x9e3779b97f4a7c15;
+            return h ^ (h >> 32);
+        }
+        // Probe start
+        ZetaInline static size_t H1(uint64_t h) { return h >> 7; }
+        // Stored in the control byte
+        ZetaInline static int8_t H2(uint64_t h) { return (int8_t)(h & 0x7f); }
+        ZetaInline static bool is_full(int8_t c) { return c >= 0; }
+
+        ZetaInline static size_t max_growth(size_t n)
+        {
+            return n - Math::Max(n / 8, (size_t)1);
+        }
+
+        // Control bytes are stored after the slots, followed by copies of the first
+        // GROUP_WIDTH control bytes, so that groups can be loaded from any position
+        // without wrapping around.
+        ZetaInline static size_t allocation_size(size_t n)
+        {
+            return n * sizeof(Entry) + n + GROUP_WIDTH;
+        }
+
+        ZetaInline void set_ctrl(size_t idx, int8_t c)
+        {
+            m_ctrl[idx] = c;
+
+            // With less than GROUP_WIDTH buckets, the copies repeat the whole table
+            for (size_t i = idx; i < GROUP_WIDTH; i += bucket_count())
+                m_ctrl[bucket_count() + i] = c;
+        }
+
+        size_t find_index(KeyType key) const
+        {
+            if (bucket_count() == 0)
+                return INVALID_INDEX;
+
+            const uint64_t h = hash(key);
+            const int8_t h2 = H2(h);
+            const size_t mask = bucket_count() - 1;
+            size_t pos = H1(h) & mask;
+            size_t step = 0;
+
+            while (true)
             {
-                if (elem && elem->Key == TOMBSTONE_KEY)
+                const Group g(m_ctrl + pos);
+
+                for (uint32_t match = g.Match(h2); match; match &= match - 1)
                 {
-                    elem->Key = key;
-                    new (&elem->Val) ValueType();
-                    m_numNonTombstoneEntries++;
+                    const size_t idx = (pos + _tzcnt_u32(match)) & mask;
 
-                    return elem->Val;
+                    if (m_slots[idx].Key == key)
+                        return idx;
                 }
 
-                if (!m_beg || load_factor() >= MAX_LOAD || m_numEntries + 1 == bucket_count())
+                if (g.MatchEmpty())
+                    return INVALID_INDEX;
+
+                // Triangular probing visits every group when #buckets is a power of two
+                step += GROUP_WIDTH;
+                pos = (pos + step) & mask;
+                Assert(step <= bucket_count(), "infinite loop");   // Should never happen due to load_factor < 1
+            }
+        }
+
+        // Returns first empty or deleted bucket in the probe sequence for given hash. Start of
+        // the group that contained it is written to "groupStart".
+        size_t find_first_non_full(uint64_t h, size_t& groupStart) const
+        {
+            const size_t mask = bucket_count() - 1;
+            size_t pos = H1(h) & mask;
+            size_t step = 0;
+
+            while (true)
+            {
+                const uint32_t match = Group(m_ctrl + pos).MatchEmptyOrDeleted();
+
+                if (match)
                 {
-                    relocate(Math::Max(bucket_count() << 1, MIN_NUM_BUCKETS));
-                    elem = find_entry(key);
+                    groupStart = pos;
+                    return (pos + _tzcnt_u32(match)) & mask;
                 }
 
-                elem->Key = key;
-                new (&elem->Val) ValueType();
-                m_numEntries++;
-                m_numNonTombstoneEntries++;
-                Assert(m_numEntries < bucket_count(), "Load factor should never be 1.0.");
+                step += GROUP_WIDTH;
+                pos = (pos + step) & mask;
+                Assert(step <= bucket_count(), "infinite loop");
             }
-
-            return elem->Val;
         }
 
-        ZetaInline Entry* begin_it()
+        // Marks a bucket for the given key (that's not in the table) as full, growing the
+        // table if necessary. Caller must construct the value.
+        size_t prepare_insert(KeyType key)
         {
-            // When memory is allocated, but there hasn't been any insertions,
-            // m_beg != m_end, which would erroneously indicate table is non-mepty.
-            if (m_numEntries == 0)
-                return m_end;
+            if (bucket_count() == 0)
+                relocate(MIN_NUM_BUCKETS);
 
-            auto it = m_beg;
-            while (it != m_end && (it->Key == NULL_KEY || it->Key == TOMBSTONE_KEY))
-                it++;
+            const uint64_t h = hash(key);
+            size_t groupStart;
+            size_t idx = find_first_non_full(h, groupStart);
 
-            return it;
+            // Reusing a deleted bucket doesn't change the number of non-empty buckets
+            if (m_growthLeft == 0 && m_ctrl[idx] != CTRL_DELETED)
+            {
+                rehash_and_grow_if_necessary();
+                idx = find_first_non_full(h, groupStart);
+            }
+
+            m_growthLeft -= m_ctrl[idx] == CTRL_EMPTY;
+            set_ctrl(idx, H2(h));
+            new (&m_slots[idx].Key) KeyType(key);
+            m_size++;
+
+            return idx;
         }
 
-        ZetaInline Entry* next_it(Entry* curr)
+        Entry* find_or_prepare_insert(KeyType key)
         {
-            Entry* next = curr + 1;
-            while (next != m_end && (next->Key == NULL_KEY || next->Key == TOMBSTONE_KEY))
-                next++;
+            const size_t idx = find_index(key);
+            if (idx == INVALID_INDEX)
+            {
+                // prepare_insert() might relocate
+                const size_t newIdx = prepare_insert(key);
+                return m_slots + newIdx;
+            }
+
+            if constexpr (!std::is_trivially_destructible_v<ValueType>)
+                m_slots[idx].Val.~ValueType();
 
-            return next;
+            return m_slots + idx;
         }
 
-        ZetaInline Entry* end_it()
+        void rehash_and_grow_if_necessary()
         {
-            return m_end;
+            // Enough tombstones to be worth purging (size <= 25/32 of capacity) -- rehashing
+            // in place frees up at least capacity / 8 - 1 buckets without allocating
+            if (bucket_count() > GROUP_WIDTH && m_size * 32 <= bucket_count() * 25)
+                rehash_in_place();
+            else
+                relocate(bucket_count() << 1);
         }
 
-    private:
-        Entry* find_entry(KeyType key) const
+        // Purges tombstones without allocating
+        void rehash_in_place()
         {
             const size_t n = bucket_count();
-            if (n == 0)
-                return nullptr;
+            const size_t mask = n - 1;
+
+            // Deleted -> empty, full -> deleted (i.e. needs to be placed)
+            for (size_t i = 0; i < n; i++)
+                m_ctrl[i] = is_full(m_ctrl[i]) ? CTRL_DELETED : CTRL_EMPTY;
 
-            const size_t origPos = key & (n - 1);    // == key % n (n is a power of two)
-            size_t nextPos = origPos;
-            Entry* curr = m_beg + origPos;
-            Entry* tombstone = nullptr;
+            memcpy(m_ctrl + n, m_ctrl, GROUP_WIDTH);
 
-            // Which bucket the entry belongs to
-            while (curr->Key != key && curr->Key != NULL_KEY)
+            for (size_t i = 0; i < n; i++)
             {
-                // Remember tombstone entries but keep probing
-                if (curr->Key == TOMBSTONE_KEY)
-                    tombstone = curr;
- 
-                nextPos++;                                  // Linear probing
-                nextPos = nextPos < n ? nextPos : 0;        // Wrap around to zero
-                curr = m_beg + nextPos;
-                Assert(nextPos != origPos, "infinite loop");    // Should never happen due to load_factor < 1
-            }
+                if (m_ctrl[i] != CTRL_DELETED)
+                    continue;
+
+                const uint64_t h = hash(m_slots[i].Key);
+                size_t groupStart;
+                const size_t target = find_first_non_full(h, groupStart);
+
+                // Already in the first group (in probe order) that has a free bucket -- every
+                // group before it is full with entries that have already been placed
+                if (((i - groupStart) & mask) < GROUP_WIDTH)
+                {
+                    set_ctrl(i, H2(h));
+                    continue;
+                }
+
+                if (m_ctrl[target] == CTRL_EMPTY)
+                {
+                    new (&m_slots[target]) Entry{ m_slots[i].Key, ZetaMove(m_slots[i].Val) };
+                    if constexpr (!std::is_trivially_destructible_v<ValueType>)
+                        m_slots[i].~Entry();
+
+                    set_ctrl(target, H2(h));
+                    set_ctrl(i, CTRL_EMPTY);
+                }
+                else
+                {
+                    // Target hasn't been placed yet -- swap and process i again
+                    Assert(m_ctrl[target] == CTRL_DELETED, "bug");
+                    Entry tmp{ m_slots[i].Key, ZetaMove(m_slots[i].Val) };
 
-            if (curr->Key == key)
-                return curr;
+                    if constexpr (!std::is_trivially_destructible_v<ValueType>)
+                        m_slots[i].~Entry();
 
-            return tombstone ? tombstone : curr;
+                    new (&m_slots[i]) Entry{ m_slots[target].Key, ZetaMove(m_slots[target].Val) };
+
+                    if constexpr (!std::is_trivially_destructible_v<ValueType>)
+                        m_slots[target].~Entry();
+
+                    new (&m_slots[target]) Entry{ tmp.Key, ZetaMove(tmp.Val) };
+                    set_ctrl(target, H2(h));
+                    i--;
+                }
+            }
+
+            m_growthLeft = max_growth(n) - m_size;
         }
 
         void relocate(size_t n)
         {
             Assert(Math::IsPow2(n), "n must be a power of two.");
             Assert(n > bucket_count(), "n must be greater than the current bucket count.");
-            Entry* oldTable = m_beg;
+            Entry* oldSlots = m_slots;
+            int8_t* oldCtrl = m_ctrl;
             const size_t oldBucketCount = bucket_count();
 
-            m_beg = reinterpret_cast<Entry*>(m_allocator.AllocateAligned(n * sizeof(Entry), alignof(Entry)));
-            m_end = m_beg + n;  // Adjust end pointer
-            m_numEntries = 0;
-            m_numNonTombstoneEntries = 0;
+            m_slots = reinterpret_cast<Entry*>(m_allocator.AllocateAligned(allocation_size(n), alignof(Entry)));
+            m_ctrl = reinterpret_cast<int8_t*>(m_slots + n);
+            m_capacity = n;
+            m_growthLeft = max_growth(n) - m_size;
+            memset(m_ctrl, CTRL_EMPTY, n + GROUP_WIDTH);
 
-            // Initialize new table
-            for (Entry* curr = m_beg; curr != m_beg + n; curr++)
+            // Reinsert all elements, there are no duplicates or tombstones to worry about
+            for (size_t i = 0; i < oldBucketCount; i++)
             {
-                if constexpr (!std::is_trivially_default_constructible_v<Entry>)
-                    new (curr) Entry;
+                if (!is_full(oldCtrl[i]))
+                    continue;
 
-                curr->Key = NULL_KEY;
+                const uint64_t h = hash(oldSlots[i].Key);
+                size_t groupStart;
+                const size_t idx = find_first_non_full(h, groupStart);
+                set_ctrl(idx, H2(h));
+
+                new (&m_slots[idx]) Entry{ oldSlots[i].Key, ZetaMove(oldSlots[i].Val) };
+                if constexpr (!std::is_trivially_destructible_v<ValueType>)
+                    oldSlots[i].~Entry();
             }
 
-            // Reinsert all elements
-            for (Entry* curr = oldTable; curr < oldTable + oldBucketCount; curr++)
-            {
-                if (curr->Key == NULL_KEY || curr->Key == TOMBSTONE_KEY)
-                    continue;
+            // Free the previously allocated memory
+            if (oldSlots)
+                m_allocator.FreeAligned(oldSlots, allocation_size(oldBucketCount), alignof(Entry));
+        }
+
+        void copy_from(const HashTable& other)
+        {
+            if (other.bucket_count() == 0)
+                return;
+
+            const size_t n = other.bucket_count();
+            m_slots = reinterpret_cast<Entry*>(m_allocator.AllocateAligned(allocation_size(n), alignof(Entry)));
+            m_ctrl = reinterpret_cast<int8_t*>(m_slots + n);
+            m_capacity = n;
+            m_size = other.m_size;
+            m_growthLeft = other.m_growthLeft;
+            memcpy(m_ctrl, other.m_ctrl, n + GROUP_WIDTH);
 
-                Entry* elem = find_entry(curr->Key);
-                Assert(elem->Key == NULL_KEY, "duplicate keys.");
-                elem->Key = curr->Key;
-                elem->Val = ZetaMove(curr->Val);
-                m_numEntries++;
+            for (size_t i = 0; i < n; i++)
+            {
+                if (is_full(m_ctrl[i]))
+                    new (&m_slots[i]) Entry(other.m_slots[i]);
             }
+        }
+
+        void destruct_all()
+        {
+            if constexpr (!std::is_trivially_destructible_v<ValueType>)
+            {
+                size_t i = 0;
+
+                for (auto it = begin_it(); it < end_it(); it = next_it(it))
+                {
+                    it->~Entry();
+                    i++;
+                }
 
-            m_numNonTombstoneEntries = m_numEntries;
+                Assert(i == m_size, "Number of cleared entries must match the number of entries.");
+            }
+        }
 
-            // Destruct previous elements (if necessary)
-            if constexpr (!std::is_trivially_destructible_v<Entry>)
+        Entry* next_full(size_t i)
+        {
+            while (i < bucket_count())
             {
-                for (Entry* curr = oldTable; curr < oldTable + oldBucketCount; curr++)
-                    curr->~Entry();
+                uint32_t match = Group(m_ctrl + i).MatchFull();
+
+                // Ignore the copies at the end
+                if (i + GROUP_WIDTH > bucket_count())
+                    match &= (1u << (bucket_count() - i)) - 1;
+
+                if (match)
+                    return m_slots + i + _tzcnt_u32(match);
+
+                i += GROUP_WIDTH;
             }
 
-            // Free the previously allocated memory
-            if(oldTable)
-                m_allocator.FreeAligned(oldTable, oldBucketCount * sizeof(Entry), alignof(Entry));
+            return end_it();
         }
 
-        static constexpr size_t MIN_NUM_BUCKETS = 4;
-        static constexpr float MAX_LOAD = 0.8f;
-        static constexpr KeyType NULL_KEY = KeyType(-1);
-        static constexpr KeyType TOMBSTONE_KEY = KeyType(-2);
-
-        Entry* m_beg = nullptr;        // Pointer to the beginning of memory block
-        Entry* m_end = nullptr;        // Pointer to the end of memory block
-        size_t m_numEntries = 0;
-        size_t m_numNonTombstoneEntries = 0;
+        Entry* m_slots = nullptr;
+        int8_t* m_ctrl = nullptr;
+        size_t m_capacity = 0;
+        size_t m_size = 0;
+        // Number of empty buckets that can be filled before rehashing
+        size_t m_growthLeft = 0;
 #if defined(ZETA_HAS_NO_UNIQUE_ADDRESS)
         [[msvc::no_unique_address]] Allocator m_allocator;
 #else
         Allocator m_allocator;
 #endif
     };
-}
\ No newline at end of file
+}
@@ -115,12 +115,6 @@ namespace
 
 namespace
 {
-    struct FrameMemoryContext
-    {
-        alignas(64) int m_threadFrameAllocIndices[MAX_NUM_THREADS] = { -1 };
-        std::atomic_int32_t m_currFrameAllocIndex;
-    };
-
     struct AppData
     {
         inline static constexpr const char* COMPILED_SHADER_DIR = "..\\Assets\\CSO";
@@ -130,23 +124,40 @@ namespace
         inline static constexpr const char* DXC_PATH = "..\\Tools\\dxc\\bin\\x64\\dxc.exe";
         inline static constexpr const char* RENDER_PASS_DIR = "..\\Source\\ZetaRenderPass";
         static constexpr int NUM_BACKGROUND_THREADS = 2;
-        static constexpr int MAX_NUM_TASKS_PER_FRAME = 256;
+        // Task signals are allocated in chunks as needed and are reused across frames
+        static constexpr int TASK_SIGNAL_CHUNK_SIZE = 256;
+        static constexpr int MAX_NUM_TASK_SIGNAL_CHUNKS = 32;
+        static constexpr int MAX_NUM_TASKS_PER_FRAME = TASK_SIGNAL_CHUNK_SIZE * MAX_NUM_TASK_SIGNAL_CHUNKS;
         static constexpr int CLIPBOARD_LEN = 128;
-        static constexpr int FRAME_ALLOCATOR_BLOCK_SIZE = FRAME_ALLOCATOR_MAX_ALLOCATION_SIZE;
 
         struct alignas(64) TaskSignal
         {
+            // Number of unfinished dependencies plus one. The extra count is released
+            // once the task has been handed over by the thread pool, which ensures the
+            // task is enqueued exactly once even if all of its dependencies finish 
+            // before it's submitted.
             std::atomic_int32_t Indegree;
-            std::atomic_bool BlockFlag;
+            Task PendingTask;
         };
 
-        TaskSignal m_registeredTasks[MAX_NUM_TASKS_PER_FRAME];
+        struct TaskSignalChunk
+        {
+            TaskSignal Signals[TASK_SIGNAL_CHUNK_SIZE];
+        };
+
+        ~AppData()
+        {
+            for (auto& chunk : m_taskSignalChunks)
+                delete chunk.load(std::memory_order_relaxed);
+        }
+
+        std::atomic<TaskSignalChunk*> m_taskSignalChunks[MAX_NUM_TASK_SIGNAL_CHUNKS] = {};
 
-        FrameMemoryContext m_frameMemoryContext;
         Camera m_camera;
         FrameMemory<FRAME_ALLOCATOR_BLOCK_SIZE> m_frameMemory;
         ThreadPool m_workerThreadPool;
         ThreadPool m_backgroundThreadPool;
+        TaskProfiler m_taskProfiler;
         RendererCore m_renderer;
         Timer m_timer;
         SceneCore m_scene;
@@ -606,7 +617,7 @@ namespace ZetaRay::AppImpl
         ImNodes::GetIO().AltMouseButton = ImGuiMouseButton_Right;
     }
 
-    void UpdateStats(size_t tempMemoryUsage)
+    void UpdateStats()
     {
         g_app->m_frameStats.free_memory();
 
@@ -642,12 +653,36 @@ namespace ZetaRay::AppImpl
         g_app->m_frameStats.emplace_back("Frame", "Frame time", movingAvg / N);
         g_app->m_frameStats.emplace_back("GPU", "VRAM Usage (MB)", memoryInfo.CurrentUsage >> 20);
         g_app->m_frameStats.emplace_back("GPU", "VRAM Budget (MB)", memoryInfo.Budget >> 20);
-        g_app->m_frameStats.emplace_back("Frame", "Frame temp memory usage (kb)", tempMemoryUsage >> 10);
+
+        // Frame memory was reset right before this, so these are for the previous frame
+        const auto& frameMemory = g_app->m_frameMemory;
+        g_app->m_frameStats.emplace_back("Frame", "Frame temp memory usage (kb)", frameMemory.TotalSize() >> 10);
+        g_app->m_frameStats.emplace_back("Frame", "Temp memory used (kb)", frameMemory.GetFrameUsage() >> 10);
+        g_app->m_frameStats.emplace_back("Frame", "Temp memory peak (kb)", frameMemory.GetPeakFrameUsage() >> 10);
+        g_app->m_frameStats.emplace_back("Frame", "Temp large allocations (kb)", 
+            frameMemory.GetFrameLargeAllocationUsage() >> 10);
+
+        // Current frame vs high-water mark
+        for (int i = 0; i < MAX_NUM_THREADS; i++)
+        {
+            const auto usage = frameMemory.GetThreadUsage(i);
+            if (usage.PeakNumBytes == 0)
+                continue;
+
+            StackStr(name, n, "Thread %d temp memory (kb)", i);
+            g_app->m_frameStats.emplace_back("Frame", name, (uint32_t)(usage.NumBytes >> 10), 
+                (uint32_t)(usage.PeakNumBytes >> 10));
+        }
+
+        const auto workerStats = g_app->m_workerThreadPool.GetAndResetStats();
+        g_app->m_frameStats.emplace_back("Frame", "Stolen tasks", workerStats.NumSteals, 
+            workerStats.NumTasksExecuted);
+        g_app->m_frameStats.emplace_back("Frame", "Worker sleeps", workerStats.NumSleeps);
     }
 
-    void Update(TaskSet& sceneTS, TaskSet& sceneRendererTS, size_t tempMemoryUsage)
+    void Update(TaskSet& sceneTS, TaskSet& sceneRendererTS)
     {
-        UpdateStats(tempMemoryUsage);
+        UpdateStats();
 
         ImGui_UpdateMouse();
         ImGui_ProcessKeyEventsWorkarounds();
@@ -1296,49 +1331,19 @@ namespace ZetaRay::AppImpl
         }
     }
 
-    template<size_t blockSize>
-    ZetaInline void* AllocateFrameAllocator(FrameMemory<blockSize>& frameMemory, FrameMemoryContext& context,
-        size_t size, size_t alignment)
+    void ResetFrameMemory()
     {
-        alignment = Math::Max(alignof(std::max_align_t), alignment);
-
-        // at most alignment - 1 extra bytes are required
-        Assert(size + alignment - 1 <= frameMemory.BLOCK_SIZE,
-            "allocations larger than FrameMemory::BLOCK_SIZE are not possible with FrameAllocator.");
-
-        // current memory block has enough space
-        int allocIdx = context.m_threadFrameAllocIndices[g_threadIdx];
-
-        // first time in this frame
-        if (allocIdx != -1)
-        {
-            auto& block = frameMemory.GetAndInitIfEmpty(allocIdx);
-
-            const uintptr_t start = reinterpret_cast<uintptr_t>(block.Start);
-            const uintptr_t ret = Math::AlignUp(start + block.Offset, alignment);
-            const uintptr_t startOffset = ret - start;
-
-            if (startOffset + size < frameMemory.BLOCK_SIZE)
-            {
-                block.Offset = startOffset + size;
-                return reinterpret_cast<void*>(ret);
-            }
-        }
-
-        // allocate/reuse a new block
-        allocIdx = context.m_currFrameAllocIndex.fetch_add(1, std::memory_order_relaxed);
-        context.m_threadFrameAllocIndices[g_threadIdx] = allocIdx;
-        auto& block = frameMemory.GetAndInitIfEmpty(allocIdx);
-        Assert(block.Offset == 0, "block offset should be initially 0");
-
-        const uintptr_t start = reinterpret_cast<uintptr_t>(block.Start);
-        const uintptr_t ret = Math::AlignUp(start, alignment);
-        const uintptr_t startOffset = ret - start;
+        // Essentially releases all the memory
+        g_app->m_frameMemory.Reset();
+    }
 
-        Assert(startOffset + size < frameMemory.BLOCK_SIZE, "should never happen.");
-        block.Offset = startOffset + size;
+    ZetaInline AppData::TaskSignal& GetTaskSignal(int handle)
+    {
+        auto* chunk = g_app->m_taskSignalChunks[handle / AppData::TASK_SIGNAL_CHUNK_SIZE].load(
+            std::memory_order_acquire);
+        Assert(chunk, "Task signal %d hasn't been allocated.", handle);
 
-        return reinterpret_cast<void*>(ret);
+        return chunk->Signals[handle % AppData::TASK_SIGNAL_CHUNK_SIZE];
     }
 }
 
@@ -1481,10 +1486,9 @@ namespace ZetaRay
             THREAD_PRIORITY::BACKGROUND,
             g_app->m_processorCoreCount);
 
-        // Initialize frame allocators
-        memset(g_app->m_frameMemoryContext.m_threadFrameAllocIndices, -1,
-            sizeof(int) * MAX_NUM_THREADS);
-        g_app->m_frameMemoryContext.m_currFrameAllocIndex.store(0, std::memory_order_release);
+        g_app->m_taskProfiler.Init();
+        g_app->m_workerThreadPool.SetProfiler(&g_app->m_taskProfiler);
+        g_app->m_backgroundThreadPool.SetProfiler(&g_app->m_taskProfiler);
 
         g_app->m_workerThreadPool.Start();
         g_app->m_backgroundThreadPool.Start();
@@ -1526,7 +1530,7 @@ namespace ZetaRay
             g_app->m_displayWidth, g_app->m_displayHeight);
     }
 
-    void App::InitBasic()
+    void App::InitBasic(bool createDevice)
     {
         setlocale(LC_ALL, "C");
 
@@ -1546,10 +1550,14 @@ namespace ZetaRay
         // main thread
         g_threadIdx = 0;
 
+        g_app->m_taskProfiler.Init();
+        g_app->m_workerThreadPool.SetProfiler(&g_app->m_taskProfiler);
+
         g_app->m_workerThreadPool.Start();
 
         // renderer (for d3dDevice)
-        g_app->m_renderer.InitBasic();
+        if (createDevice)
+            g_app->m_renderer.InitBasic();
     }
 
     void App::ShutdownBasic()
@@ -1561,6 +1569,14 @@ namespace ZetaRay
         g_app = nullptr;
     }
 
+    void App::ResetFrameBasic()
+    {
+        Assert(g_app->m_workerThreadPool.AreAllTasksFinished(), "There are unfinished tasks.");
+
+        g_app->m_currTaskSignalIdx.store(0, std::memory_order_relaxed);
+        AppImpl::ResetFrameMemory();
+    }
+
     int App::Run()
     {
         MSG msg = {};
@@ -1598,20 +1614,21 @@ namespace ZetaRay
             // at this point, all worker tasks from previous frame are done (GPU may still 
             // be executing those though)
             g_app->m_currTaskSignalIdx.store(0, std::memory_order_relaxed);
-            const size_t tempMemoryUsed = g_app->m_frameMemory.TotalSize();
 
             // Skip first frame
             if (g_app->m_timer.GetTotalFrameCount() > 0)
-            {
-                g_app->m_frameMemoryContext.m_currFrameAllocIndex.store(0, std::memory_order_release);
-                for (int i = 0; i < MAX_NUM_THREADS; i++)
-                    g_app->m_frameMemoryContext.m_threadFrameAllocIndices[i] = -1;
-                g_app->m_frameMemory.Reset();        // set the offset to 0, essentially releasing the memory
-            }
+                AppImpl::ResetFrameMemory();
 
             g_app->m_renderer.BeginFrame();
             // Startup is counted as "frame" 0, so program loop starts from frame 1
             g_app->m_timer.Tick();
+
+            if (g_app->m_taskProfiler.IsEnabled())
+            {
+                StackStr(frameName, n, "Frame %llu", g_app->m_timer.GetTotalFrameCount());
+                g_app->m_taskProfiler.Mark(frameName);
+            }
+
             AppImpl::ResizeIfQueued();
             AppImpl::ChangeDPIIfQueued();
 
@@ -1619,7 +1636,7 @@ namespace ZetaRay
             {
                 TaskSet sceneTS;
                 TaskSet sceneRendererTS;
-                AppImpl::Update(sceneTS, sceneRendererTS, tempMemoryUsed);
+                AppImpl::Update(sceneTS, sceneRendererTS);
 
                 if (!g_app->m_paramsUpdates.empty())
                 {
@@ -1692,16 +1709,30 @@ namespace ZetaRay
 
     void* App::AllocateFrameAllocator(size_t size, size_t alignment)
     {
-        return AppImpl::AllocateFrameAllocator<>(g_app->m_frameMemory,
-            g_app->m_frameMemoryContext, size, alignment);
+        return g_app->m_frameMemory.AllocateAligned(size, alignment);
     }
 
     int App::RegisterTask()
     {
         int idx = g_app->m_currTaskSignalIdx.fetch_add(1, std::memory_order_relaxed);
-        Assert(idx < AppData::MAX_NUM_TASKS_PER_FRAME,
+        Check(idx < AppData::MAX_NUM_TASKS_PER_FRAME,
             "Number of task signals exceeded MAX_NUM_TASKS_PER_FRAME.");
 
+        // First signal in a chunk that hasn't been used before -- allocate it. Handles from 
+        // the same chunk might be requested concurrently, so whoever loses the race frees 
+        // its copy.
+        auto& chunk = g_app->m_taskSignalChunks[idx / AppData::TASK_SIGNAL_CHUNK_SIZE];
+
+        if (!chunk.load(std::memory_order_acquire))
+        {
+            auto* newChunk = new (std::nothrow) AppData::TaskSignalChunk;
+            Check(newChunk, "Out of memory.");
+            AppData::TaskSignalChunk* expected = nullptr;
+
+            if (!chunk.compare_exchange_strong(expected, newChunk, std::memory_order_acq_rel))
+                delete newChunk;
+        }
+
         return idx;
     }
 
@@ -1711,39 +1742,39 @@ namespace ZetaRay
         const int c = g_app->m_currTaskSignalIdx.load(std::memory_order_relaxed);
         Assert(handle < c, "Received handle %d while #handles for current frame is %d.", c);
 
-        g_app->m_registeredTasks[handle].Indegree.store(indegree, std::memory_order_release);
-        g_app->m_registeredTasks[handle].BlockFlag.store(true, std::memory_order_release);
+        AppImpl::GetTaskSignal(handle).Indegree.store(indegree + 1, std::memory_order_release);
     }
 
-    void App::WaitForAdjacentHeadNodes(int handle)
+    void App::DeferTask(Task&& t)
     {
+        const int handle = t.GetSignalHandle();
         const int c = g_app->m_currTaskSignalIdx.load(std::memory_order_relaxed);
         Assert(handle >= 0 && handle < c, "Received handle %d while #handles for current frame is %d.", c);
 
-        auto& taskSignal = g_app->m_registeredTasks[handle];
-        const int indegree = taskSignal.Indegree.load(std::memory_order_acquire);
-        Assert(indegree >= 0, "Invalid task indegree.");
+        auto& taskSignal = AppImpl::GetTaskSignal(handle);
+        taskSignal.PendingTask = ZetaMove(t);
 
-        if (indegree != 0)
-        {
-            taskSignal.BlockFlag.wait(true, std::memory_order_acquire);
-            return;
-        }
+        // Release the submission count. If all the dependencies have already finished,
+        // then it's up to this thread to enqueue the task.
+        const int remaining = taskSignal.Indegree.fetch_sub(1, std::memory_order_acq_rel);
+        Assert(remaining >= 1, "Invalid task indegree.");
+
+        if (remaining == 1)
+            g_app->m_workerThreadPool.EnqueueUnblocked(ZetaMove(taskSignal.PendingTask));
     }
 
     void App::SignalAdjacentTailNodes(Span<int> taskIDs)
     {
         for (auto handle : taskIDs)
         {
-            auto& taskSignal = g_app->m_registeredTasks[handle];
-            const int remaining = taskSignal.Indegree.fetch_sub(1, std::memory_order_acquire);
+            auto& taskSignal = AppImpl::GetTaskSignal(handle);
+            const int remaining = taskSignal.Indegree.fetch_sub(1, std::memory_order_acq_rel);
+            Assert(remaining >= 1, "Invalid task indegree.");
 
-            // this was the last dependency, unblock the task
+            // This was the last dependency and the task has been submitted -- insert it into 
+            // the queue. Otherwise, the thread calling DeferTask() will do it.
             if (remaining == 1)
-            {
-                taskSignal.BlockFlag.store(false, std::memory_order_release);
-                taskSignal.BlockFlag.notify_one();
-            }
+                g_app->m_workerThreadPool.EnqueueUnblocked(ZetaMove(taskSignal.PendingTask));
         }
     }
 
@@ -1788,6 +1819,7 @@ namespace ZetaRay
     SceneCore& App::GetScene() { return g_app->m_scene; }
     const Camera& App::GetCamera() { return g_app->m_camera; }
     int App::GetNumWorkerThreads() { return g_app->m_processorCoreCount; }
+    App::ThreadPoolStats App::GetAndResetWorkerStats() { return g_app->m_workerThreadPool.GetAndResetStats(); }
     int App::GetNumBackgroundThreads() { return AppData::NUM_BACKGROUND_THREADS; }
     uint32_t App::GetDPI() { return g_app->m_dpi; }
     float App::GetDPIScaling() { return (float)g_app->m_dpi / USER_DEFAULT_SCREEN_DPI; }
@@ -1835,6 +1867,8 @@ namespace ZetaRay
         return SynchronizedMutableSpan<ShaderReloadHandler>(g_app->m_shaderReloadHandlers, g_app->m_shaderReloadLock);
     }
 
+    TaskProfiler& App::GetTaskProfiler() { return g_app->m_taskProfiler; }
+
     SynchronizedSpan<Stat> App::GetStats()
     {
         return SynchronizedSpan<Stat>(g_app->m_frameStats, g_app->m_statsLock);
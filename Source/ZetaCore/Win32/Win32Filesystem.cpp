@@ -1,4 +1,5 @@
 #include "../App/Filesystem.h"
+#include "../App/Path.h"
 #include "../Support/MemoryArena.h"
 #include "Win32.h"
 
@@ -152,6 +153,17 @@ size_t Filesystem::GetFileSize(const char* path)
     return s.QuadPart;
 }
 
+uint64_t Filesystem::GetLastWriteTime(const char* path)
+{
+    Assert(path, "path argument was NULL.");
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+        return 0;
+
+    return ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+}
+
 void Filesystem::CreateDirectoryIfNotExists(const char* path)
 {
     Assert(path, "path argument was NULL.");
@@ -192,3 +204,222 @@ bool Filesystem::IsDirectory(const char* path)
 
     return ret & FILE_ATTRIBUTE_DIRECTORY;
 }
+
+void Filesystem::ForEachFile(const char* directory, void(*f)(void* param, const char* path), void* param)
+{
+    Assert(directory, "directory argument was NULL.");
+
+    Path pattern(directory);
+    pattern.Append("*");
+
+    WIN32_FIND_DATAA data;
+    HANDLE h = FindFirstFileA(pattern.Get(), &data);
+    if (h == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            continue;
+
+        Path path(directory);
+        path.Append(data.cFileName);
+        f(param, path.Get());
+    } while (FindNextFileA(h, &data));
+
+    FindClose(h);
+}
+
+//--------------------------------------------------------------------------------------
+// MappedFile
+//--------------------------------------------------------------------------------------
+
+Filesystem::MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool Filesystem::MappedFile::Open(const char* path)
+{
+    Assert(path, "path argument was NULL.");
+    Close();
+
+    HANDLE h = CreateFileA(path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (h == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER s;
+    if (!GetFileSizeEx(h, &s) || s.QuadPart == 0)
+    {
+        CloseHandle(h);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMappingA(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+    {
+        CloseHandle(h);
+        return false;
+    }
+
+    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(h);
+        return false;
+    }
+
+    m_file = h;
+    m_mapping = mapping;
+    m_data = reinterpret_cast<const uint8_t*>(data);
+    m_sizeInBytes = s.QuadPart;
+
+    return true;
+}
+
+void Filesystem::MappedFile::Close()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+
+    m_file = nullptr;
+    m_mapping = nullptr;
+    m_data = nullptr;
+    m_sizeInBytes = 0;
+}
+
+//--------------------------------------------------------------------------------------
+// AsyncFileReader
+//--------------------------------------------------------------------------------------
+
+namespace
+{
+    struct PendingRead
+    {
+        OVERLAPPED Overlapped;
+        HANDLE File;
+        uint8_t* Data;
+        DWORD SizeInBytes;
+        size_t FileIdx;
+    };
+}
+
+Filesystem::AsyncFileReader::AsyncFileReader()
+{
+    // Completions are only dequeued by the thread that calls ReadAll()
+    m_completionPort = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 1);
+    CheckWin32(m_completionPort);
+}
+
+Filesystem::AsyncFileReader::~AsyncFileReader()
+{
+    CloseHandle(m_completionPort);
+}
+
+void Filesystem::AsyncFileReader::ReadAll(Span<const char*> paths, Support::ArenaAllocator allocator,
+    CompletionFunc onCompletion, void* param)
+{
+    PendingRead reads[MAX_NUM_IN_FLIGHT];
+    int freeSlots[MAX_NUM_IN_FLIGHT];
+    int numFreeSlots = MAX_NUM_IN_FLIGHT;
+    int numInFlight = 0;
+    size_t nextFile = 0;
+
+    for (int i = 0; i < MAX_NUM_IN_FLIGHT; i++)
+        freeSlots[i] = i;
+
+    // Keeps issuing reads until either all the slots are in use or there aren't any files left
+    auto issueReads = [&]()
+        {
+            while (numFreeSlots > 0 && nextFile < paths.size())
+            {
+                const size_t fileIdx = nextFile++;
+
+                HANDLE h = CreateFileA(paths[fileIdx],
+                    GENERIC_READ,
+                    FILE_SHARE_READ,
+                    nullptr,
+                    OPEN_EXISTING,
+                    FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+                if (h == INVALID_HANDLE_VALUE)
+                {
+                    onCompletion(param, fileIdx, Span<uint8_t>(nullptr, 0));
+                    continue;
+                }
+
+                LARGE_INTEGER s;
+                if (!GetFileSizeEx(h, &s) || s.QuadPart == 0 || s.HighPart > 0)
+                {
+                    CloseHandle(h);
+                    onCompletion(param, fileIdx, Span<uint8_t>(nullptr, 0));
+                    continue;
+                }
+
+                const int slot = freeSlots[--numFreeSlots];
+                PendingRead& r = reads[slot];
+                memset(&r.Overlapped, 0, sizeof(OVERLAPPED));
+                r.File = h;
+                r.Data = reinterpret_cast<uint8_t*>(allocator.AllocateAligned(s.QuadPart));
+                r.SizeInBytes = s.LowPart;
+                r.FileIdx = fileIdx;
+
+                // Completion key identifies the slot. Note that a completion packet is queued even
+                // if ReadFile() finishes synchronously.
+                bool success = CreateIoCompletionPort(h, m_completionPort, slot, 0) != nullptr;
+                success = success && (ReadFile(h, r.Data, r.SizeInBytes, nullptr, &r.Overlapped) ||
+                    GetLastError() == ERROR_IO_PENDING);
+
+                if (!success)
+                {
+                    CloseHandle(h);
+                    freeSlots[numFreeSlots++] = slot;
+                    onCompletion(param, fileIdx, Span<uint8_t>(nullptr, 0));
+
+                    continue;
+                }
+
+                numInFlight++;
+            }
+        };
+
+    issueReads();
+
+    while (numInFlight > 0)
+    {
+        OVERLAPPED_ENTRY entries[MAX_NUM_IN_FLIGHT];
+        ULONG numEntries = 0;
+        CheckWin32(GetQueuedCompletionStatusEx(m_completionPort, entries, MAX_NUM_IN_FLIGHT, 
+            &numEntries, INFINITE, false));
+
+        for (ULONG e = 0; e < numEntries; e++)
+        {
+            const int slot = (int)entries[e].lpCompletionKey;
+            const PendingRead r = reads[slot];
+
+            DWORD numRead = 0;
+            const bool success = GetOverlappedResult(r.File, &reads[slot].Overlapped, &numRead, false) &&
+                numRead == r.SizeInBytes;
+
+            CloseHandle(r.File);
+            freeSlots[numFreeSlots++] = slot;
+            numInFlight--;
+
+            // Keep the disk busy while this file is being processed
+            issueReads();
+
+            onCompletion(param, r.FileIdx, success ? Span(r.Data, r.SizeInBytes) : Span<uint8_t>(nullptr, 0));
+        }
+    }
+}
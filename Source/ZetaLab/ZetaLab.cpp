@@ -30,6 +30,61 @@ extern "C"
     _declspec(dllexport) extern const char8_t* D3D12SDKPath = u8".\\D3D12\\";
 }
 
+namespace
+{
+    static constexpr const char* USAGE = "Usage: ZetaLab [-cache] [-optimize] <path-to-gltf>\n"
+        "  -cache     Load the scene from (or save it to) <path-to-gltf>.zscene\n"
+        "  -optimize  Optimize meshes when loading\n";
+
+    struct Options
+    {
+        const char* Path;
+        bool UseSceneCache;
+        bool OptimizeMeshes;
+    };
+
+    // Options come before the path, so that paths with spaces don't need to be quoted
+    Options ParseCmdLine(const char* cmdLine)
+    {
+        Options opts{};
+
+        while (true)
+        {
+            while (*cmdLine == ' ')
+                cmdLine++;
+
+            if (*cmdLine != '-')
+                break;
+
+            const char* end = cmdLine;
+            while (*end && *end != ' ')
+                end++;
+
+            const size_t len = end - cmdLine;
+            auto matches = [cmdLine, len](const char* opt)
+                {
+                    return strlen(opt) == len && strncmp(cmdLine, opt, len) == 0;
+                };
+
+            if (matches("-cache"))
+                opts.UseSceneCache = true;
+            else if (matches("-optimize"))
+                opts.OptimizeMeshes = true;
+            else
+            {
+                Check(false, "Unknown option: %.*s\n%s", (int)len, cmdLine, USAGE);
+            }
+
+            cmdLine = end;
+        }
+
+        Check(*cmdLine, "%s", USAGE);
+        opts.Path = cmdLine;
+
+        return opts;
+    }
+}
+
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ PSTR lpCmdLine, _In_ int nCmdShow)
 {
 #if OPEN_CONSOLE == 1
@@ -40,11 +95,11 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
     freopen_s(&fp, "CONOUT$", "w", stdout);
 #endif
 
-    Check(strlen(lpCmdLine), "Usage: ZetaLab <path-to-gltf>\n");
+    const Options opts = ParseCmdLine(lpCmdLine);
 
     {
-        App::Filesystem::Path path(lpCmdLine);
-        Check(App::Filesystem::Exists(path.Get()), "Provided path was not found: %s\nExiting...\n", lpCmdLine);
+        App::Filesystem::Path path(opts.Path);
+        Check(App::Filesystem::Exists(path.Get()), "Provided path was not found: %s\nExiting...\n", opts.Path);
 
         App::DeltaTimer timer;
         timer.Start();
@@ -59,7 +114,7 @@ int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _
         // load the gltf model(s)
         timer.Start();
 
-        glTF::Load(path);
+        glTF::Load(path, opts.UseSceneCache, opts.OptimizeMeshes);
 
         App::FlushWorkerThreadPool();
 
@@ -316,7 +316,7 @@ void DisplayPass::DrawPicked(GraphicsCmdList& cmdList, Span<uint64_t> picks)
         {
             auto& scene = App::GetScene();
             auto meshID = scene.GetInstanceMeshID(ID);
-            auto* mesh = scene.GetMesh(meshID).value();
+            const auto mesh = scene.GetMesh(meshID).value();
             float4x3 toWorld = scene.GetToWorld(ID);
 
             const Camera& cam = App::GetCamera();
@@ -338,13 +338,13 @@ void DisplayPass::DrawPicked(GraphicsCmdList& cmdList, Span<uint64_t> picks)
 
             D3D12_VERTEX_BUFFER_VIEW vbv;
             vbv.StrideInBytes = sizeof(Vertex);
-            vbv.BufferLocation = sceneVB.GpuVA() + mesh->m_vtxBuffStartOffset * sizeof(Vertex);
-            vbv.SizeInBytes = mesh->m_numVertices * sizeof(Vertex);
+            vbv.BufferLocation = sceneVB.GpuVA() + mesh.m_vtxBuffStartOffset * sizeof(Vertex);
+            vbv.SizeInBytes = mesh.m_numVertices * sizeof(Vertex);
 
             D3D12_INDEX_BUFFER_VIEW ibv;
             ibv.Format = DXGI_FORMAT_R32_UINT;
-            ibv.BufferLocation = sceneIB.GpuVA() + mesh->m_idxBuffStartOffset * sizeof(uint32);
-            ibv.SizeInBytes = mesh->m_numIndices * sizeof(uint32);
+            ibv.BufferLocation = sceneIB.GpuVA() + mesh.m_idxBuffStartOffset * sizeof(uint32);
+            ibv.SizeInBytes = mesh.m_numIndices * sizeof(uint32);
 
             auto layoutToRT = TextureBarrier(m_pickMask.Resource(),
                 D3D12_BARRIER_SYNC_NONE,
@@ -367,7 +367,7 @@ void DisplayPass::DrawPicked(GraphicsCmdList& cmdList, Span<uint64_t> picks)
             m_rootSig.SetRootConstants(0, sizeof(cbDrawPicked) / sizeof(uint32), &cb);
             m_rootSig.End(cmdList);
 
-            cmdList.DrawIndexedInstanced(mesh->m_numIndices,
+            cmdList.DrawIndexedInstanced(mesh.m_numIndices,
                 1,
                 0,
                 0,
@@ -535,7 +535,7 @@ void GuiPass::RenderUI()
             firstPicked = picks.m_span[0];
 
             W = float4x4a(scene.GetToWorld(firstPicked));
-            instanceMesh = *scene.GetInstanceMesh(firstPicked).value();
+            instanceMesh = scene.GetInstanceMesh(firstPicked).value();
 
             if (m_gizmoActive)
                 RenderGizmo(picks.m_span, instanceMesh, W);
@@ -1675,8 +1675,8 @@ void GuiPass::PickedMaterial(uint64 pickedID)
 
     auto& scene = App::GetScene();
     const auto meshID = scene.GetInstanceMeshID(pickedID);
-    const auto& mesh = *scene.GetMesh(meshID).value();
-    Material mat = *scene.GetMaterial(mesh.m_materialID).value();
+    const auto mesh = scene.GetMesh(meshID).value();
+    Material mat = scene.GetMaterial(mesh.m_materialID).value();
     bool modified = false;
     constexpr ImVec4 texturedCol = ImVec4(0.9587256f, 0.76055556f, 0.704035435f, 1);
 
@@ -58,8 +58,7 @@ namespace
 
         const size_t sizeInBytes = N * sizeof(uint32_t);
         const size_t totalSizeInBytes = 2 * sizeInBytes;
-        App::OneTimeFrameAllocatorWithFallback allocator;
-        void* mem = allocator.AllocateAligned(totalSizeInBytes);
+        void* mem = App::AllocateFrameAllocator(totalSizeInBytes);
 
         TempAllocator tempAllocator1{
             .m_memPtr = mem,
@@ -533,9 +532,7 @@ void EmissiveTriangleAliasTable::Render(CommandList& cmdList)
         return;
     }
 
-    // Try to use frame allocator first, if it fails (allocation size exceeded per-frame max),
-    // use malloc instead
-    SmallVector<RT::EmissiveLumenAliasTableEntry, App::OneTimeFrameAllocatorWithFallback> table;
+    SmallVector<RT::EmissiveLumenAliasTableEntry, App::FrameAllocator> table;
     table.resize(m_currNumTris);
 
     App::DeltaTimer timer;
@@ -0,0 +1,274 @@
+#include <App/App.h>
+#include <Math/BVH.h>
+#include <Math/CollisionFuncs.h>
+#include <Math/MatrixFuncs.h>
+#include <Scene/SceneCommon.h>
+#include <Utility/RNG.h>
+#include <Utility/SmallVector.h>
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <float.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    // BVH uses the worker thread pool and frame memory
+    struct AppFixture
+    {
+        AppFixture() { App::InitBasic(false); }
+        ~AppFixture() 
+        { 
+            // ParallelFor() may return before all of its helper tasks have run
+            App::FlushWorkerThreadPool();
+            App::ShutdownBasic(); 
+        }
+    };
+
+    // Small boxes in a few clusters that are far apart, so that the tree has some structure.
+    // Instance ID is the index into the array.
+    float3 RandomCenter(RNG& rng)
+    {
+        const float cluster = (float)rng.UniformUintBounded(8);
+        return float3(rng.Uniform() * 100 + cluster * 300, rng.Uniform() * 100, rng.Uniform() * 10);
+    }
+
+    void MakeInstances(uint32_t n, uint64_t seed, SmallVector<BVH::BVHInput>& instances)
+    {
+        RNG rng(seed);
+        instances.resize(n);
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            instances[i].BoundingBox = AABB(RandomCenter(rng), float3(rng.Uniform(), rng.Uniform(), rng.Uniform()));
+            instances[i].InstanceID = i;
+        }
+    }
+
+    Ray RandomRay(RNG& rng)
+    {
+        float3 o(rng.Uniform() * 2400 - 50, rng.Uniform() * 100, rng.Uniform() * 10);
+        float3 d(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f);
+        d.normalize();
+
+        return Ray(o, d);
+    }
+
+    // Distance to the given instance's box along the ray, FLT_MAX if it's missed
+    float HitDistance(Span<BVH::BVHInput> instances, uint64_t id, Ray r)
+    {
+        float t;
+        if (id == Scene::INVALID_INSTANCE || !intersectRayVsAABB(v_Ray(r), v_AABB(instances[id].BoundingBox), t))
+            return FLT_MAX;
+
+        return t;
+    }
+
+    float ClosestHitBruteForce(Span<BVH::BVHInput> instances, Ray r)
+    {
+        float closest = FLT_MAX;
+
+        for (size_t i = 0; i < instances.size(); i++)
+            closest = std::min(closest, HitDistance(instances, i, r));
+
+        return closest;
+    }
+
+    // Compares the results of frustum culling with testing every instance
+    void CheckCulling(BVH& bvh, Span<BVH::BVHInput> instances, RNG& rng)
+    {
+        for (int q = 0; q < 20; q++)
+        {
+            ViewFrustum frustum(0.5f + rng.Uniform(), 1.5f, 0.1f, 50.0f + rng.Uniform() * 2000);
+            v_float4x4 vViewToWorld = mul(rotateY(rng.Uniform() * 6.28f),
+                translate(rng.Uniform() * 2400, rng.Uniform() * 100, rng.Uniform() * 100));
+            float4x4a viewToWorld = store(vViewToWorld);
+
+            SmallVector<uint64_t, App::FrameAllocator> visible;
+            bvh.DoFrustumCulling(frustum, viewToWorld, visible);
+            std::sort(visible.begin(), visible.end());
+
+            v_ViewFrustum vFrustum(frustum);
+            vFrustum = transform(vViewToWorld, vFrustum);
+            SmallVector<uint64_t> expected;
+
+            for (size_t i = 0; i < instances.size(); i++)
+            {
+                if (instersectFrustumVsAABB(vFrustum, v_AABB(instances[i].BoundingBox)) != COLLISION_TYPE::DISJOINT)
+                    expected.push_back(i);
+            }
+
+            REQUIRE(visible.size() == expected.size());
+            CHECK(std::equal(visible.begin(), visible.end(), expected.begin()));
+        }
+    }
+
+    // Instances may overlap, so the hit distance is compared rather than the instance
+    void CheckClosestHit(BVH& bvh, Span<BVH::BVHInput> instances, RNG& rng)
+    {
+        int numMismatches = 0;
+
+        for (int q = 0; q < 500; q++)
+        {
+            Ray r = RandomRay(rng);
+            const uint64_t hit = bvh.CastRay(r);
+            numMismatches += HitDistance(instances, hit, r) != ClosestHitBruteForce(instances, r);
+        }
+
+        CHECK(numMismatches == 0);
+    }
+
+    // Coherent rays (one origin, neighboring directions) share most of their traversal, 
+    // incoherent ones don't. Number of rays isn't a multiple of the packet size, so the 
+    // last packet is partially filled. Some rays are parallel to the axes.
+    void CheckRayPackets(BVH& bvh, Span<BVH::BVHInput> instances, RNG& rng)
+    {
+        constexpr int NUM_RAYS = 64 * 16 + 3;
+        SmallVector<Ray> rays;
+        rays.resize(NUM_RAYS);
+
+        for (int coherent = 0; coherent < 2; coherent++)
+        {
+            // Just outside one of the clusters, facing it
+            const float3 origin(rng.UniformUintBounded(8) * 300.0f - 20.0f, 50, 5);
+
+            for (int i = 0; i < NUM_RAYS; i++)
+            {
+                if (i % 7 == 0)
+                    rays[i] = Ray(origin, float3(1, 0, 0));
+                else if (i % 11 == 0)
+                    rays[i] = Ray(origin, float3(0, 0, 1));
+                else if (coherent)
+                {
+                    float3 d(1.0f, (i % 64) / 64.0f - 0.5f, ((i / 64) / 16.0f - 0.5f) * 0.1f);
+                    d.normalize();
+                    rays[i] = Ray(origin, d);
+                }
+                else
+                    rays[i] = RandomRay(rng);
+            }
+
+            SmallVector<uint64_t> hits;
+            hits.resize(NUM_RAYS);
+            bvh.CastRays(rays, hits);
+
+            int numMismatches = 0;
+
+            for (int i = 0; i < NUM_RAYS; i++)
+                numMismatches += HitDistance(instances, hits[i], rays[i]) != ClosestHitBruteForce(instances, rays[i]);
+
+            INFO("Coherent: ", coherent);
+            CHECK(numMismatches == 0);
+        }
+    }
+}
+
+TEST_SUITE("BVH")
+{
+    TEST_CASE_FIXTURE(AppFixture, "Build")
+    {
+        const uint32_t sizes[] = { 1, 9, 1000, 5000 };
+
+        for (auto n : sizes)
+        {
+            INFO("Number of instances: ", n);
+            SmallVector<BVH::BVHInput> instances;
+            MakeInstances(n, n, instances);
+
+            BVH bvh;
+            bvh.Build(instances);
+            REQUIRE(bvh.IsBuilt());
+
+            RNG rng(n + 1);
+            CheckCulling(bvh, instances, rng);
+            CheckClosestHit(bvh, instances, rng);
+            CheckRayPackets(bvh, instances, rng);
+        }
+    }
+
+    TEST_CASE_FIXTURE(AppFixture, "Update")
+    {
+        SmallVector<BVH::BVHInput> instances;
+        MakeInstances(5000, 11, instances);
+
+        BVH bvh;
+        bvh.Build(instances);
+
+        RNG rng(12);
+        SmallVector<BVH::BVHUpdateInput> updates;
+
+        for (int round = 0; round < 8; round++)
+        {
+            INFO("Round: ", round);
+            updates.clear();
+
+            // In the first rounds, instances move slightly and the tree is only refit. Later, 
+            // some of them jump to a random cluster, which degrades the tree enough for 
+            // subtrees to be rebuilt.
+            const bool jump = round >= 4;
+
+            for (size_t i = 0; i < instances.size(); i++)
+            {
+                if (rng.Uniform() > 0.2f)
+                    continue;
+
+                auto& box = instances[i].BoundingBox;
+                AABB newBox = box;
+
+                if (jump && rng.Uniform() < 0.25f)
+                    newBox.Center = RandomCenter(rng);
+                else
+                    newBox.Center = box.Center + float3(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f);
+
+                updates.push_back(BVH::BVHUpdateInput{ .OldBox = box, .NewBox = newBox, .InstanceID = i });
+                box = newBox;
+            }
+
+            bvh.Update(updates);
+
+            CheckCulling(bvh, instances, rng);
+            CheckClosestHit(bvh, instances, rng);
+            CheckRayPackets(bvh, instances, rng);
+        }
+    }
+
+    TEST_CASE_FIXTURE(AppFixture, "Rebuild")
+    {
+        // Every Build() resets the BVH's arena and reuses it for the new tree. Node arrays of 
+        // the larger trees don't fit in an arena block and get their own blocks.
+        const uint32_t sizes[] = { 5000, 10, 20000, 1000 };
+        BVH bvh;
+
+        for (auto n : sizes)
+        {
+            INFO("Number of instances: ", n);
+            SmallVector<BVH::BVHInput> instances;
+            MakeInstances(n, n + 2, instances);
+
+            bvh.Build(instances);
+
+            RNG rng(n + 3);
+            CheckCulling(bvh, instances, rng);
+            CheckClosestHit(bvh, instances, rng);
+        }
+
+        // Empty input discards the tree
+        bvh.Build(Span<BVH::BVHInput>(nullptr, 0));
+        CHECK(!bvh.IsBuilt());
+    }
+
+    TEST_CASE_FIXTURE(AppFixture, "BuildIsDeterministic")
+    {
+        SmallVector<BVH::BVHInput> instances;
+        MakeInstances(5000, 7, instances);
+
+        BVH serial;
+        serial.Build(instances, 1);
+        BVH parallel;
+        parallel.Build(instances);
+
+        CHECK(serial.ComputeSAHCost() == parallel.ComputeSAHCost());
+    }
+}
@@ -0,0 +1,147 @@
+#include <Math/BatchConversion.h>
+#include <Utility/RNG.h>
+#include <doctest/doctest.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Util;
+using namespace ZetaRay::Math;
+
+namespace
+{
+    // Not a multiple of 8, so that the remainder loops are covered as well
+    constexpr size_t N = 1021;
+
+    float3 RandomUnitVector(RNG& rng)
+    {
+        float3 v;
+
+        do
+        {
+            v = float3(rng.Uniform() * 2 - 1, rng.Uniform() * 2 - 1, rng.Uniform() * 2 - 1);
+        } while (v.dot(v) < 1e-4f || v.dot(v) > 1.0f);
+
+        v.normalize();
+        return v;
+    }
+}
+
+TEST_SUITE("BatchConversion")
+{
+    TEST_CASE("Oct32")
+    {
+        RNG rng(0x1234);
+        SmallVector<float3> vectors;
+        vectors.resize(N);
+
+        for (auto& v : vectors)
+            v = RandomUnitVector(rng);
+
+        // Axes and signed zeros
+        vectors[0] = float3(1, 0, 0);
+        vectors[1] = float3(0, -1, 0);
+        vectors[2] = float3(0, 0, 1);
+        vectors[3] = float3(0, 0, -1);
+        vectors[4] = float3(-0.0f, 0, -1);
+        vectors[5] = float3(0, -0.0f, -0.0f);
+
+        SmallVector<oct32> encoded;
+        encoded.resize(N);
+        Float3ToOct32(vectors, encoded);
+
+        SmallVector<float3> decoded;
+        decoded.resize(N);
+        Oct32ToFloat3(encoded, decoded);
+
+        int numEncodeMismatches = 0;
+        float maxDecodeDiff = 0.0f;
+        float minCosError = 1.0f;
+
+        for (size_t i = 0; i < N; i++)
+        {
+            oct32 expected(vectors[i]);
+            if (expected.v.x != encoded[i].v.x || expected.v.y != encoded[i].v.y)
+                numEncodeMismatches++;
+
+            const float3 expectedDecoded = expected.decode();
+            maxDecodeDiff = Max(maxDecodeDiff, fabsf(expectedDecoded.x - decoded[i].x));
+            maxDecodeDiff = Max(maxDecodeDiff, fabsf(expectedDecoded.y - decoded[i].y));
+            maxDecodeDiff = Max(maxDecodeDiff, fabsf(expectedDecoded.z - decoded[i].z));
+
+            // Zero vector doesn't round trip
+            if (i != 5)
+                minCosError = Min(minCosError, vectors[i].dot(decoded[i]));
+        }
+
+        CHECK(numEncodeMismatches == 0);
+        CHECK(maxDecodeDiff < 1e-6f);
+        // 16 bits per component gives an angular error well below 0.01 degrees
+        CHECK(minCosError > 0.99999f);
+    }
+
+    TEST_CASE("UNorm2")
+    {
+        RNG rng(0x5678);
+        SmallVector<float2> values;
+        values.resize(N);
+
+        for (auto& v : values)
+            v = float2(rng.Uniform() * 2 - 1, rng.Uniform() * 2 - 1);
+
+        values[0] = float2(-1.0f, 1.0f);
+        values[1] = float2(0.0f, -0.0f);
+
+        SmallVector<unorm2> encoded;
+        encoded.resize(N);
+        Float2ToUNorm2(values, encoded);
+
+        int numMismatches = 0;
+
+        for (size_t i = 0; i < N; i++)
+        {
+            const unorm2 expected = unorm2::FromNormalized(values[i]);
+            if (expected.x != encoded[i].x || expected.y != encoded[i].y)
+                numMismatches++;
+        }
+
+        CHECK(numMismatches == 0);
+    }
+
+    TEST_CASE("Half")
+    {
+        RNG rng(0x9abc);
+        SmallVector<float2> values2;
+        SmallVector<float3> values3;
+        values2.resize(N);
+        values3.resize(N);
+
+        // Range of half is [-65504, 65504], some of the values are out of range
+        for (auto& v : values2)
+            v = float2((rng.Uniform() - 0.5f) * 1e5f, rng.Uniform() - 0.5f);
+
+        for (auto& v : values3)
+            v = float3((rng.Uniform() - 0.5f) * 1e-3f, rng.Uniform() * 100, -rng.Uniform() * 1e5f);
+
+        SmallVector<half2> halves2;
+        SmallVector<half3> halves3;
+        halves2.resize(N);
+        halves3.resize(N);
+        Float2ToHalf2(values2, halves2);
+        Float3ToHalf3(values3, halves3);
+
+        int numMismatches = 0;
+
+        for (size_t i = 0; i < N; i++)
+        {
+            const half2 expected2(values2[i]);
+            const half3 expected3(values3[i]);
+
+            if (expected2.x != halves2[i].x || expected2.y != halves2[i].y)
+                numMismatches++;
+
+            if (expected3.x != halves3[i].x || expected3.y != halves3[i].y || expected3.z != halves3[i].z)
+                numMismatches++;
+        }
+
+        CHECK(numMismatches == 0);
+    }
+}
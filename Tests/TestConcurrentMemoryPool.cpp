@@ -0,0 +1,203 @@
+#include <Support/ConcurrentMemoryPool.h>
+#include <Utility/SmallVector.h>
+#include <Utility/RNG.h>
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <thread>
+#include <string.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_THREADS = 4;
+    static constexpr int NUM_ALLOCS_PER_THREAD = 2000;
+
+    struct Allocation
+    {
+        uint8_t* Ptr;
+        uint32_t Size;
+        uint8_t Tag;
+    };
+
+    using ThreadAllocations = SmallVector<Allocation>[NUM_THREADS];
+
+    // Pool uses g_threadIdx to find the calling thread's caches. Index 0 belongs to the
+    // main thread, so test thread t uses t + 1.
+    template<typename F>
+    void RunOnThreads(F f)
+    {
+        std::thread threads[NUM_THREADS];
+
+        for (int t = 0; t < NUM_THREADS; t++)
+        {
+            threads[t] = std::thread([t, &f]()
+                {
+                    g_threadIdx = t + 1;
+                    f(t);
+                });
+        }
+
+        for (auto& t : threads)
+            t.join();
+    }
+
+    // Every thread allocates chunks of random sizes (some larger than the largest size
+    // class) and fills them with a tag
+    void AllocateConcurrently(ConcurrentMemoryPool& pool, ThreadAllocations& allocs, uint64_t seed)
+    {
+        RunOnThreads([&pool, &allocs, seed](int t)
+            {
+                RNG rng(seed + t);
+
+                for (int i = 0; i < NUM_ALLOCS_PER_THREAD; i++)
+                {
+                    const uint32_t size = i % 100 == 0 ? 5000 : 1 + rng.UniformUintBounded(600);
+                    const uint8_t tag = uint8_t(i * NUM_THREADS + t);
+                    uint8_t* ptr = reinterpret_cast<uint8_t*>(pool.AllocateAligned(size));
+                    memset(ptr, tag, size);
+
+                    allocs[t].push_back(Allocation{ .Ptr = ptr, .Size = size, .Tag = tag });
+                }
+            });
+    }
+
+    // Frees the allocations that were made by thread t from thread (t + 1) % NUM_THREADS
+    void FreeFromOtherThreads(ConcurrentMemoryPool& pool, ThreadAllocations& allocs)
+    {
+        RunOnThreads([&pool, &allocs](int t)
+            {
+                auto& owned = allocs[(t + NUM_THREADS - 1) % NUM_THREADS];
+
+                for (auto& a : owned)
+                    pool.FreeAligned(a.Ptr, a.Size);
+            });
+
+        for (auto& a : allocs)
+            a.clear();
+    }
+
+    // Live allocations must not overlap -- every chunk is handed out at most once and
+    // still holds the tag that it was filled with
+    void CheckNoOverlap(ThreadAllocations& allocs)
+    {
+        SmallVector<uint8_t*> ptrs;
+        int numCorrupted = 0;
+
+        for (auto& threadAllocs : allocs)
+        {
+            for (auto& a : threadAllocs)
+            {
+                ptrs.push_back(a.Ptr);
+
+                for (uint32_t i = 0; i < a.Size; i++)
+                {
+                    if (a.Ptr[i] != a.Tag)
+                    {
+                        numCorrupted++;
+                        break;
+                    }
+                }
+            }
+        }
+
+        std::sort(ptrs.begin(), ptrs.end());
+
+        CHECK(ptrs.size() == NUM_THREADS * NUM_ALLOCS_PER_THREAD);
+        CHECK(std::adjacent_find(ptrs.begin(), ptrs.end()) == ptrs.end());
+        CHECK(numCorrupted == 0);
+    }
+}
+
+TEST_SUITE("ConcurrentMemoryPool")
+{
+    TEST_CASE("Alignment")
+    {
+        ConcurrentMemoryPool pool;
+        const uint32_t sizes[] = { 1, 8, 24, 100, 513, 4096, 5000 };
+        const uint32_t alignments[] = { 8, 16, 32, 64, 128 };
+        bool aligned = true;
+
+        std::thread thread([&pool, &sizes, &alignments, &aligned]()
+            {
+                g_threadIdx = 1;
+
+                for (auto s : sizes)
+                {
+                    for (auto a : alignments)
+                    {
+                        void* mem = pool.AllocateAligned(s, a);
+                        aligned = aligned && (reinterpret_cast<uintptr_t>(mem) & (a - 1)) == 0;
+                        memset(mem, 0xcd, s);
+
+                        pool.FreeAligned(mem, s, a);
+                    }
+                }
+            });
+
+        thread.join();
+        CHECK(aligned);
+    }
+
+    TEST_CASE("CrossThreadFrees")
+    {
+        ConcurrentMemoryPool pool;
+        ThreadAllocations allocs;
+
+        // Chunks that were freed by other threads go back to their owner, which hands
+        // them out again
+        for (int round = 0; round < 3; round++)
+        {
+            INFO("Round: ", round);
+
+            AllocateConcurrently(pool, allocs, round * NUM_THREADS);
+            CheckNoOverlap(allocs);
+            FreeFromOtherThreads(pool, allocs);
+        }
+
+        // Same after all the memory has been released
+        pool.Clear();
+        CHECK(pool.TotalSize() == 0);
+
+        for (int round = 0; round < 3; round++)
+        {
+            INFO("Round after Clear(): ", round);
+
+            AllocateConcurrently(pool, allocs, 100 + round * NUM_THREADS);
+            CheckNoOverlap(allocs);
+            FreeFromOtherThreads(pool, allocs);
+        }
+    }
+
+    TEST_CASE("ClearWithLiveAllocations")
+    {
+        ConcurrentMemoryPool pool;
+        ThreadAllocations allocs;
+
+        // Allocations that are still live when Clear() is called are abandoned (except for
+        // the ones larger than the largest size class, which don't come from the pool's 
+        // blocks). Some of the chunks have also been through the remote free lists.
+        AllocateConcurrently(pool, allocs, 1);
+        FreeFromOtherThreads(pool, allocs);
+        AllocateConcurrently(pool, allocs, 2);
+
+        for (auto& threadAllocs : allocs)
+        {
+            for (auto& a : threadAllocs)
+            {
+                if (a.Size > 4096)
+                    pool.FreeAligned(a.Ptr, a.Size);
+            }
+
+            threadAllocs.clear();
+        }
+
+        pool.Clear();
+
+        AllocateConcurrently(pool, allocs, 3);
+        CheckNoOverlap(allocs);
+        FreeFromOtherThreads(pool, allocs);
+    }
+}
@@ -1,8 +1,10 @@
 #include <Utility/SmallVector.h>
 #include <Utility/HashTable.h>
+#include <Utility/ConcurrentHashTable.h>
 #include <App/App.h>
 #include <Support/MemoryArena.h>
 #include <doctest/doctest.h>
+#include <thread>
 
 using namespace ZetaRay::Util;
 using namespace ZetaRay::Support;
@@ -304,7 +306,6 @@ TEST_SUITE("HashTable")
         HashTable<int> table(6);
         CHECK(table.bucket_count() == 8);
 
-        // Following keys map to same bucket
         table[3] = 103;
         table[3 + 8] = 104;
         table[3 + 8 * 2] = 105;
@@ -328,11 +329,10 @@ TEST_SUITE("HashTable")
         CHECK(entry2);
         CHECK(*entry2.value() == 105);
 
-        // Should reuse the removed entry
-        auto oldLoad = table.load_factor();
+        // Erased entries don't count towards load
+        CHECK(table.load_factor() == 2.0f / table.bucket_count());
         table[3 + 8 * 3] = 106;
-        auto newLoad = table.load_factor();
-        CHECK(oldLoad == newLoad);
+        CHECK(table.load_factor() == 3.0f / table.bucket_count());
 
         // Delete all the entries
         numErased = table.erase(3);
@@ -354,16 +354,115 @@ TEST_SUITE("HashTable")
         table.erase(1);
         CHECK(table.size() == 2);
 
-        // Insert new entries to force resize
-        oldLoad = table.load_factor();
+        // Erased entries shouldn't force a resize
         table[6] = 106;
         table[7] = 107;
-        newLoad = table.load_factor();
-        CHECK(newLoad < oldLoad);
-        // Tombstones shouldn't be carried over to new table
+        CHECK(table.bucket_count() == 8);
         CHECK(table.load_factor() == 4.0f / table.bucket_count());
     }
 
+    TEST_CASE("Tombstones")
+    {
+        HashTable<int> table(64);
+        CHECK(table.bucket_count() == 64);
+
+        // Erased entries in the middle of full groups become tombstones. Once the table
+        // runs out of empty buckets, those should be purged by rehashing in place rather
+        // than growing the table.
+        for (int i = 0; i < 4000; i++)
+        {
+            table[i] = i;
+
+            if (i >= 40)
+                CHECK(table.erase(i - 40) == 1);
+        }
+
+        CHECK(table.size() == 40);
+
+        for (int i = 3960; i < 4000; i++)
+        {
+            CHECK(*table.find(i).value() == i);
+            table.erase(i);
+        }
+
+        CHECK(table.bucket_count() == 64);
+        CHECK(table.empty());
+
+        for (int i = 0; i < 50; i++)
+            table[i] = i;
+
+        CHECK(table.bucket_count() == 64);
+
+        for (int i = 0; i < 50; i++)
+            CHECK(*table.find(i).value() == i);
+    }
+
+    TEST_CASE("ManyKeys")
+    {
+        HashTable<uint64_t> table;
+        uint64_t key = 0x1234;
+
+        // Mix of insertions and erasures, compared against a simple deterministic pattern
+        for (uint64_t i = 0; i < 10000; i++)
+        {
+            key = key * 6364136223846793005ull + 1442695040888963407ull;
+            table.try_emplace(key, i);
+
+            if (i % 3 == 0)
+                table.erase(key);
+        }
+
+        CHECK(table.size() == 10000 - 3334);
+        key = 0x1234;
+
+        for (uint64_t i = 0; i < 10000; i++)
+        {
+            key = key * 6364136223846793005ull + 1442695040888963407ull;
+            auto val = table.find(key);
+
+            if (i % 3 == 0)
+                CHECK(!val);
+            else
+                CHECK((val && *val.value() == i));
+        }
+    }
+
+    TEST_CASE("MoveAndCopy")
+    {
+        HashTable<int> table;
+
+        for (int i = 0; i < 100; i++)
+            table[i] = i;
+
+        HashTable<int> copy(table);
+        CHECK(copy.size() == 100);
+        CHECK(copy.bucket_count() == table.bucket_count());
+        copy[0] = -1;
+        CHECK(*table.find(0).value() == 0);
+
+        HashTable<int> moved(ZetaMove(table));
+        CHECK(moved.size() == 100);
+        CHECK(table.empty());
+        CHECK(table.bucket_count() == 0);
+
+        for (int i = 1; i < 100; i++)
+        {
+            CHECK(*moved.find(i).value() == i);
+            CHECK(*copy.find(i).value() == i);
+        }
+
+        // Moved-from table is still usable
+        table[5] = 5;
+        CHECK(table.size() == 1);
+
+        table = ZetaMove(moved);
+        CHECK(table.size() == 100);
+        CHECK(moved.empty());
+
+        copy = table;
+        CHECK(*copy.find(0).value() == 0);
+    }
+
     TEST_CASE("Iteration")
     {
         HashTable<int> table(4);
@@ -396,4 +495,147 @@ TEST_SUITE("HashTable")
 
         CHECK(i == 2);
     }
-};
\ No newline at end of file
+};
+
+TEST_SUITE("ConcurrentHashTable")
+{
+    TEST_CASE("Basic")
+    {
+        ConcurrentHashTable<int> table;
+
+        CHECK(table.empty());
+        CHECK(!table.find(1));
+
+        CHECK(table.try_emplace(1, 101));
+        CHECK(!table.try_emplace(1, 102));
+        CHECK(table.find(1).value() == 101);
+
+        table.insert_or_assign(1, 103);
+        CHECK(table.find(1).value() == 103);
+        CHECK(table.size() == 1);
+
+        CHECK(table.modify(1, [](int& v) { v++; }));
+        CHECK(!table.modify(2, [](int& v) { v++; }));
+        CHECK(table.find(1).value() == 104);
+
+        CHECK(table.erase(1) == 1);
+        CHECK(table.erase(1) == 0);
+        CHECK(table.empty());
+    }
+
+    TEST_CASE("ManyKeys")
+    {
+        ConcurrentHashTable<uint64_t> table;
+        table.resize(1000, true);
+        const size_t numBuckets = table.bucket_count();
+
+        uint64_t key = 1;
+        for (int i = 0; i < 10000; i++)
+        {
+            key = key * 6364136223846793005ull + 1442695040888963407ull;
+            CHECK(table.try_emplace(key, key + 1));
+        }
+
+        CHECK(table.size() == 10000);
+        CHECK(table.bucket_count() > numBuckets);
+
+        // Erase every third key -- remaining ones must stay reachable after entries are
+        // shifted back
+        key = 1;
+        for (int i = 0; i < 10000; i++)
+        {
+            key = key * 6364136223846793005ull + 1442695040888963407ull;
+            if (i % 3 == 0)
+                CHECK(table.erase(key) == 1);
+        }
+
+        key = 1;
+        for (int i = 0; i < 10000; i++)
+        {
+            key = key * 6364136223846793005ull + 1442695040888963407ull;
+            auto val = table.find(key);
+            CHECK((bool)val == (i % 3 != 0));
+
+            if (val)
+                CHECK(val.value() == key + 1);
+        }
+
+        int n = 0;
+        table.for_each([&n](uint64_t k, uint64_t& v)
+            {
+                CHECK(v == k + 1);
+                n++;
+            });
+
+        CHECK(n == (int)table.size());
+
+        table.clear();
+        CHECK(table.empty());
+        CHECK(!table.find(key));
+    }
+
+    TEST_CASE("ReadersAndWriter")
+    {
+        struct Value
+        {
+            uint64_t A;
+            uint64_t B;
+        };
+
+        ConcurrentHashTable<Value> table;
+        static constexpr int NUM_KEYS = 1000;
+        static constexpr int NUM_READERS = 3;
+
+        for (uint64_t k = 0; k < NUM_KEYS; k += 2)
+            table.insert_or_assign(k, Value{ k, k });
+
+        std::atomic_bool done = false;
+        std::atomic_int numTorn = 0;
+        std::thread readers[NUM_READERS];
+
+        // Readers must never see a partially written value or lose an existing key
+        for (auto& r : readers)
+        {
+            r = std::thread([&table, &done, &numTorn]()
+                {
+                    while (!done.load(std::memory_order_relaxed))
+                    {
+                        for (uint64_t k = 0; k < NUM_KEYS; k++)
+                        {
+                            auto v = table.find(k);
+
+                            if ((k & 0x1) == 0 && !v)
+                                numTorn++;
+                            else if (v && (v.value().A != v.value().B || v.value().A % NUM_KEYS != k))
+                                numTorn++;
+                        }
+                    }
+                });
+        }
+
+        // Writer keeps updating even keys and adding/removing odd ones (which causes
+        // shards to grow and entries to be shifted around)
+        for (uint64_t round = 1; round < 200; round++)
+        {
+            for (uint64_t k = 0; k < NUM_KEYS; k++)
+            {
+                const uint64_t v = round * NUM_KEYS + k;
+
+                if ((k & 0x1) == 0)
+                    table.insert_or_assign(k, Value{ v, v });
+                else if (round & 0x1)
+                    table.try_emplace(k, Value{ v, v });
+                else
+                    table.erase(k);
+            }
+        }
+
+        done = true;
+
+        for (auto& r : readers)
+            r.join();
+
+        CHECK(numTorn.load() == 0);
+    }
+};
+
@@ -0,0 +1,129 @@
+#include <Utility/DirtyRanges.h>
+#include <Core/BufferUpload.h>
+#include <doctest/doctest.h>
+#include <string.h>
+
+using namespace ZetaRay::Util;
+using namespace ZetaRay::Core;
+
+namespace
+{
+    // Destination buffer that is plain memory
+    struct MemoryBuffer
+    {
+        static void Upload(void* param, const void* data, uint32_t sizeInBytes, uint32_t destOffsetInBytes)
+        {
+            auto* buffer = reinterpret_cast<MemoryBuffer*>(param);
+            REQUIRE(destOffsetInBytes + sizeInBytes <= sizeof(buffer->Data));
+            memcpy(reinterpret_cast<uint8_t*>(buffer->Data) + destOffsetInBytes, data, sizeInBytes);
+
+            buffer->NumCopies++;
+        }
+
+        BufferUploader Uploader()
+        {
+            return BufferUploader{ .Func = &MemoryBuffer::Upload, .Param = this };
+        }
+
+        int Data[64] = { 0 };
+        int NumCopies = 0;
+    };
+}
+
+TEST_SUITE("DirtyRanges")
+{
+    TEST_CASE("Merge")
+    {
+        DirtyRanges ranges;
+        CHECK(ranges.empty());
+
+        ranges.Add(0, 4);
+        ranges.Add(4, 2);    // Touching
+        ranges.Add(5, 3);    // Overlapping
+        ranges.Add(10);
+
+        auto r = ranges.Ranges();
+        REQUIRE(r.size() == 2);
+        CHECK(r[0].Base == 0);
+        CHECK(r[0].Count == 8);
+        CHECK(r[1].Base == 10);
+        CHECK(r[1].Count == 1);
+        CHECK(ranges.NumElements() == 9);
+
+        ranges.clear();
+        CHECK(ranges.empty());
+        CHECK(ranges.Ranges().size() == 0);
+    }
+
+    TEST_CASE("OutOfOrder")
+    {
+        DirtyRanges ranges;
+        ranges.Add(20, 5);
+        ranges.Add(3);
+        ranges.Add(10, 2);
+        ranges.Add(0, 3);
+        ranges.Add(11, 12);
+        ranges.Add(3);
+
+        auto r = ranges.Ranges();
+        REQUIRE(r.size() == 2);
+        CHECK(r[0].Base == 0);
+        CHECK(r[0].Count == 4);
+        CHECK(r[1].Base == 10);
+        CHECK(r[1].Count == 15);
+
+        // Adding after coalescing
+        ranges.Add(5);
+        r = ranges.Ranges();
+        REQUIRE(r.size() == 3);
+        CHECK(r[1].Base == 5);
+        CHECK(r[1].Count == 1);
+        CHECK(ranges.NumElements() == 20);
+    }
+
+    TEST_CASE("Gap")
+    {
+        DirtyRanges ranges(2);
+        ranges.Add(0);
+        ranges.Add(3);      // 2 apart
+        ranges.Add(7);      // 3 apart
+        ranges.Add(9, 0);   // Ignored
+
+        auto r = ranges.Ranges();
+        REQUIRE(r.size() == 2);
+        CHECK(r[0].Base == 0);
+        CHECK(r[0].Count == 4);
+        CHECK(r[1].Base == 7);
+        CHECK(r[1].Count == 1);
+    }
+
+    TEST_CASE("Upload")
+    {
+        int src[64];
+        for (int i = 0; i < 64; i++)
+            src[i] = i + 1;
+
+        MemoryBuffer dest;
+        DirtyRanges ranges(1);
+        ranges.Add(40, 8);
+        ranges.Add(2);
+        ranges.Add(4);
+        ranges.Add(63);
+        ranges.Add(3);
+
+        const size_t numBytes = UploadDirtyRanges(src, ranges, dest.Uploader());
+        CHECK(numBytes == (3 + 8 + 1) * sizeof(int));
+        CHECK(dest.NumCopies == 3);
+        CHECK(ranges.empty());
+
+        for (int i = 0; i < 64; i++)
+        {
+            const bool dirty = (i >= 2 && i <= 4) || (i >= 40 && i < 48) || i == 63;
+            CHECK(dest.Data[i] == (dirty ? src[i] : 0));
+        }
+
+        // Nothing left to upload
+        CHECK(UploadDirtyRanges(src, ranges, dest.Uploader()) == 0);
+        CHECK(dest.NumCopies == 3);
+    }
+}
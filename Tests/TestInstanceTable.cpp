@@ -0,0 +1,115 @@
+#include <Scene/InstanceTable.h>
+#include <doctest/doctest.h>
+#include <atomic>
+#include <thread>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Scene;
+
+TEST_SUITE("InstanceTable")
+{
+    TEST_CASE("Lookup")
+    {
+        InstanceTable table;
+        CHECK(table.empty());
+
+        // IDs are hashes in practice, so they're not contiguous
+        const uint64_t ids[] = { 0x9e3779b97f4a7c15, 12, 0xdeadbeef, 7 };
+        InstanceHandle handles[4];
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            CHECK(table.NextSlot() == i);
+            handles[i] = table.Add(ids[i], TreePos{ .Level = 1 + i / 2, .Offset = i % 2 });
+            CHECK(handles[i].Index == i);
+            CHECK(table.IsValid(handles[i]));
+        }
+
+        REQUIRE(table.size() == 4);
+
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            auto h = table.Find(ids[i]);
+            REQUIRE(h);
+            CHECK(h.value() == handles[i]);
+            CHECK(table.Handle(i) == handles[i]);
+
+            const TreePos p = table.Pos(handles[i]);
+            CHECK(p.Level == 1 + i / 2);
+            CHECK(p.Offset == i % 2);
+        }
+
+        CHECK(!table.Find(13));
+        CHECK(!table.PosFromID(13));
+
+        // Instance was inserted in front of the one at slot 1
+        table.ShiftRight(1);
+        CHECK(table.Pos(handles[1]).Offset == 2);
+        CHECK(table.PosFromID(ids[1]).value().Offset == 2);
+        CHECK(table.Pos(handles[0]).Offset == 0);
+    }
+
+    TEST_CASE("InvalidHandles")
+    {
+        InstanceTable table;
+        const InstanceHandle h = table.Add(1, TreePos{ .Level = 1, .Offset = 0 });
+
+        InstanceHandle stale = h;
+        stale.Generation++;
+        CHECK(!table.IsValid(stale));
+        CHECK(!table.IsValid(InstanceHandle{ .Index = 1, .Generation = 0 }));
+        CHECK(!table.IsValid(InstanceHandle()));
+        CHECK(!(stale == h));
+    }
+
+    TEST_CASE("ConcurrentFind")
+    {
+        // Readers look up IDs while another thread adds instances (and grows the
+        // hash table). Every ID that was found must map to its handle.
+        constexpr uint32_t NUM_INSTANCES = 20000;
+        constexpr int NUM_READERS = 3;
+
+        InstanceTable table;
+        std::atomic_uint32_t numAdded = 0;
+        std::atomic_int numMismatches = 0;
+
+        std::thread writer([&table, &numAdded]()
+            {
+                for (uint32_t i = 0; i < NUM_INSTANCES; i++)
+                {
+                    table.Add(i * 31 + 5, TreePos{ .Level = 1, .Offset = i });
+                    numAdded.store(i + 1, std::memory_order_release);
+                }
+            });
+
+        std::thread readers[NUM_READERS];
+
+        for (auto& r : readers)
+        {
+            r = std::thread([&numAdded, &numMismatches, &table]()
+                {
+                    while (true)
+                    {
+                        const uint32_t n = numAdded.load(std::memory_order_acquire);
+
+                        for (uint32_t i = 0; i < n; i += 7)
+                        {
+                            auto h = table.Find(i * 31 + 5);
+                            numMismatches += !h || h.value().Index != i;
+                        }
+
+                        if (n == NUM_INSTANCES)
+                            break;
+                    }
+                });
+        }
+
+        writer.join();
+
+        for (auto& r : readers)
+            r.join();
+
+        CHECK(numMismatches == 0);
+        CHECK(table.size() == NUM_INSTANCES);
+    }
+}
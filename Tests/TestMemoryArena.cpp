@@ -0,0 +1,114 @@
+#include <Support/MemoryArena.h>
+#include <doctest/doctest.h>
+#include <string.h>
+
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+TEST_SUITE("MemoryArena")
+{
+    TEST_CASE("Alignment")
+    {
+        MemoryArena arena(1024);
+
+        for (size_t alignment = 1; alignment <= 256; alignment *= 2)
+        {
+            void* a = arena.AllocateAligned(3, alignment);
+            CHECK((reinterpret_cast<uintptr_t>(a) & (alignment - 1)) == 0);
+        }
+
+        // Doesn't fit in a block
+        void* b = arena.AllocateAligned(4096, 128);
+        CHECK((reinterpret_cast<uintptr_t>(b) & 127) == 0);
+    }
+
+    TEST_CASE("Checkpoint")
+    {
+        MemoryArena arena(1024);
+        uint8_t* a = reinterpret_cast<uint8_t*>(arena.AllocateAligned(100));
+        memset(a, 0xab, 100);
+
+        const auto checkpoint = arena.GetCheckpoint();
+        void* b = arena.AllocateAligned(16);
+
+        {
+            ScopedArenaCheckpoint scope(arena);
+
+            // Spans several blocks plus a large allocation
+            for (int i = 0; i < 64; i++)
+                memset(arena.AllocateAligned(200), 0xcd, 200);
+
+            arena.AllocateAligned(10000);
+        }
+
+        CHECK(arena.AllocateAligned(16) != b);
+        arena.Rewind(checkpoint);
+        CHECK(arena.AllocateAligned(16) == b);
+
+        for (int i = 0; i < 100; i++)
+            CHECK(a[i] == 0xab);
+    }
+
+    TEST_CASE("Reset")
+    {
+        MemoryArena arena(1024);
+
+        for (int i = 0; i < 64; i++)
+            arena.AllocateAligned(200);
+
+        arena.AllocateAligned(10000);
+        CHECK(arena.TotalSize() > 10000);
+
+        // Only one block is kept
+        arena.Reset();
+        CHECK(arena.TotalSize() == 1024);
+    }
+
+    TEST_CASE("ArenaAllocator")
+    {
+        MemoryArena arena(1024);
+
+        for (int pass = 0; pass < 2; pass++)
+        {
+            // Grows past the block size, so that later reallocations are large allocations
+            SmallVector<uint32_t, ArenaAllocator> vec(arena);
+
+            for (uint32_t i = 0; i < 10000; i++)
+                vec.push_back(i);
+
+            bool valid = true;
+            for (uint32_t i = 0; i < 10000; i++)
+                valid = valid && vec[i] == i;
+
+            CHECK(valid);
+
+            // Vector's memory is released along with everything else
+            vec.free_memory();
+            arena.Reset();
+            CHECK(arena.TotalSize() == 1024);
+        }
+    }
+
+    TEST_CASE("Reserve")
+    {
+        MemoryArena arena(64 * 1024, 256 * 1024 * 1024);
+        uint8_t* prev = nullptr;
+
+        // Contiguous until reserved range is exhausted
+        for (int i = 0; i < 100; i++)
+        {
+            uint8_t* a = reinterpret_cast<uint8_t*>(arena.AllocateAligned(100'000, 16));
+            memset(a, i, 100'000);
+
+            if (prev)
+                CHECK(a == prev + 100'000);
+
+            prev = a;
+        }
+
+        CHECK(arena.TotalSize() >= 100 * 100'000);
+
+        arena.Reset();
+        CHECK(arena.TotalSize() == 64 * 1024);
+    }
+}
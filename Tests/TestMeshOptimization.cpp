@@ -0,0 +1,178 @@
+#include <Model/MeshOptimization.h>
+#include <Utility/SmallVector.h>
+#include <doctest/doctest.h>
+#include <algorithm>
+#include <array>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Core;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Util;
+using namespace ZetaRay::Model::MeshOptimization;
+
+namespace
+{
+    // Grid of n x n quads in the xz plane, with each quad's triangles in a random order
+    // so that there's something to optimize
+    void MakeGrid(uint32_t n, SmallVector<Vertex>& vertices, SmallVector<uint32_t>& indices)
+    {
+        for (uint32_t z = 0; z <= n; z++)
+        {
+            for (uint32_t x = 0; x <= n; x++)
+            {
+                Vertex v;
+                memset(&v, 0, sizeof(v));
+                v.Position = float3((float)x, 0.0f, (float)z);
+                v.TexUV = float2((float)x / n, (float)z / n);
+                vertices.push_back(v);
+            }
+        }
+
+        SmallVector<uint32_t> quads;
+        for (uint32_t i = 0; i < n * n; i++)
+            quads.push_back(i);
+
+        uint32_t state = 12345;
+        for (uint32_t i = n * n - 1; i > 0; i--)
+        {
+            state = state * 1664525u + 1013904223u;
+            std::swap(quads[i], quads[state % (i + 1)]);
+        }
+
+        for (auto q : quads)
+        {
+            const uint32_t x = q % n;
+            const uint32_t z = q / n;
+            const uint32_t v0 = z * (n + 1) + x;
+            const uint32_t v1 = v0 + 1;
+            const uint32_t v2 = v0 + n + 1;
+            const uint32_t v3 = v2 + 1;
+
+            const uint32_t quadIndices[] = { v0, v2, v1, v1, v2, v3 };
+            indices.append_range(quadIndices, quadIndices + 6);
+        }
+    }
+
+    // Triangles as sorted position triples, so that meshes can be compared regardless
+    // of vertex and triangle order
+    SmallVector<std::array<float, 9>> TriangleSet(Span<Vertex> vertices, Span<uint32_t> indices)
+    {
+        SmallVector<std::array<float, 9>> tris;
+
+        for (size_t t = 0; t < indices.size(); t += 3)
+        {
+            std::array<float, 9> tri;
+
+            for (int i = 0; i < 3; i++)
+            {
+                const float3 p = vertices[indices[t + i]].Position;
+                tri[i * 3] = p.x;
+                tri[i * 3 + 1] = p.y;
+                tri[i * 3 + 2] = p.z;
+            }
+
+            tris.push_back(tri);
+        }
+
+        std::sort(tris.begin(), tris.end());
+        return tris;
+    }
+
+    bool SameTriangles(const SmallVector<std::array<float, 9>>& lhs, const SmallVector<std::array<float, 9>>& rhs)
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+    }
+}
+
+TEST_SUITE("MeshOptimization")
+{
+    TEST_CASE("AnalyzeVertexCache")
+    {
+        // Two triangles sharing an edge -- 4 misses
+        uint32_t quad[] = { 0, 1, 2, 2, 1, 3 };
+        auto stats = AnalyzeVertexCache(quad, 4);
+        CHECK(stats.NumTransformed == 4);
+        CHECK(stats.ACMR() == 2.0f);
+        CHECK(stats.ATVR() == 1.0f);
+
+        // Vertex 0 is evicted from a cache of size 3 before it's used again
+        uint32_t tris[] = { 0, 1, 2, 3, 4, 5, 0, 1, 2 };
+        stats = AnalyzeVertexCache(tris, 6, 3);
+        CHECK(stats.NumTransformed == 9);
+
+        stats = AnalyzeVertexCache(tris, 6, 6);
+        CHECK(stats.NumTransformed == 6);
+    }
+
+    TEST_CASE("DeduplicateVertices")
+    {
+        SmallVector<Vertex> vertices;
+        SmallVector<uint32_t> indices;
+        MakeGrid(4, vertices, indices);
+        const auto original = TriangleSet(vertices, indices);
+        const size_t numOriginal = vertices.size();
+
+        // Unshare every vertex
+        SmallVector<Vertex> unshared;
+        for (uint32_t i = 0; i < indices.size(); i++)
+        {
+            unshared.push_back(vertices[indices[i]]);
+            indices[i] = i;
+        }
+
+        const uint32_t n = DeduplicateVertices(unshared, indices);
+        CHECK(n == numOriginal);
+        CHECK(SameTriangles(TriangleSet(Span(unshared.data(), n), indices), original));
+
+        for (auto idx : indices)
+            CHECK(idx < n);
+    }
+
+    TEST_CASE("OptimizeVertexFetch")
+    {
+        SmallVector<Vertex> vertices;
+        SmallVector<uint32_t> indices;
+        MakeGrid(4, vertices, indices);
+
+        // Unreferenced vertex at the end
+        vertices.push_back(vertices[0]);
+
+        const auto original = TriangleSet(vertices, indices);
+        const uint32_t n = OptimizeVertexFetch(vertices, indices);
+        CHECK(n == vertices.size() - 1);
+        CHECK(SameTriangles(TriangleSet(Span(vertices.data(), n), indices), original));
+
+        // Every vertex is first referenced after all the vertices before it
+        uint32_t next = 0;
+        bool inOrder = true;
+
+        for (auto idx : indices)
+        {
+            inOrder = inOrder && idx <= next;
+            next = std::max(next, idx + 1);
+        }
+
+        CHECK(inOrder);
+    }
+
+    TEST_CASE("Optimize")
+    {
+        SmallVector<Vertex> vertices;
+        SmallVector<uint32_t> indices;
+        MakeGrid(32, vertices, indices);
+
+        const auto original = TriangleSet(vertices, indices);
+        const auto before = AnalyzeVertexCache(indices, (uint32_t)vertices.size());
+
+        const uint32_t n = Optimize(vertices, indices);
+        const auto after = AnalyzeVertexCache(indices, n);
+
+        CHECK(n == vertices.size());
+        CHECK(SameTriangles(TriangleSet(Span(vertices.data(), n), indices), original));
+        // Random order shares little beyond the two triangles of each quad, optimized order
+        // should be below one vertex per triangle
+        CHECK(before.ACMR() > 1.5f);
+        CHECK(after.ACMR() < 1.0f);
+        CHECK(after.ATVR() < before.ATVR());
+    }
+}
@@ -0,0 +1,112 @@
+#include <Model/SceneCache.h>
+#include <doctest/doctest.h>
+
+using namespace ZetaRay::Util;
+using namespace ZetaRay::Model::SceneCache;
+
+namespace
+{
+    struct Element
+    {
+        float X;
+        float Y;
+        float Z;
+    };
+}
+
+TEST_SUITE("SceneCache")
+{
+    TEST_CASE("RoundTrip")
+    {
+        SmallVector<uint32_t> indices;
+        for (uint32_t i = 0; i < 100; i++)
+            indices.push_back(i * 3);
+
+        SmallVector<Element> elements;
+        for (int i = 0; i < 7; i++)
+            elements.push_back(Element{ .X = (float)i, .Y = i * 2.0f, .Z = i * 3.0f });
+
+        const char paths[] = "a.dds\0b/c.dds";
+        const SourceFile sourceFiles[] = { { .SizeInBytes = 100, .LastWriteTime = 5 },
+            { .SizeInBytes = 0, .LastWriteTime = 0 } };
+
+        Writer writer;
+        writer.Add(SECTION::INDICES, Span(indices));
+        writer.Add(SECTION::VERTICES, Span(elements));
+        writer.Add(SECTION::IMAGE_PATHS, Span(paths, sizeof(paths)));
+        writer.Add(SECTION::SOURCE_FILES, Span(sourceFiles));
+        auto data = writer.Finalize(123, 0xabcdef, 4096);
+
+        CHECK(data.size() % SECTION_ALIGNMENT == 0);
+
+        Reader reader;
+        REQUIRE(reader.Init(data));
+        CHECK(reader.GetHeader().SceneID == 123);
+        CHECK(reader.GetHeader().SourceHash == 0xabcdef);
+        CHECK(reader.GetHeader().SourceSizeInBytes == 4096);
+
+        auto readIndices = reader.Get<uint32_t>(SECTION::INDICES);
+        REQUIRE(readIndices);
+        REQUIRE(readIndices.value().size() == indices.size());
+        CHECK(memcmp(readIndices.value().data(), indices.data(), indices.size() * sizeof(uint32_t)) == 0);
+        CHECK(reinterpret_cast<uintptr_t>(readIndices.value().data()) % SECTION_ALIGNMENT == 0);
+
+        auto readElements = reader.Get<Element>(SECTION::VERTICES);
+        REQUIRE(readElements);
+        REQUIRE(readElements.value().size() == elements.size());
+        CHECK(readElements.value()[6].Z == 18.0f);
+        CHECK(reinterpret_cast<uintptr_t>(readElements.value().data()) % SECTION_ALIGNMENT == 0);
+
+        auto readPaths = reader.Get<char>(SECTION::IMAGE_PATHS);
+        REQUIRE(readPaths);
+        CHECK(strcmp(readPaths.value().data() + 6, "b/c.dds") == 0);
+
+        auto readSourceFiles = reader.Get<SourceFile>(SECTION::SOURCE_FILES);
+        REQUIRE(readSourceFiles);
+        REQUIRE(readSourceFiles.value().size() == 2);
+        CHECK(readSourceFiles.value()[0].SizeInBytes == 100);
+        CHECK(readSourceFiles.value()[0].LastWriteTime == 5);
+
+        // Sections that weren't added are empty
+        auto meshes = reader.Get<Element>(SECTION::MESHES);
+        REQUIRE(meshes);
+        CHECK(meshes.value().empty());
+
+        // Element size mismatch
+        CHECK(!reader.Get<uint64_t>(SECTION::INDICES));
+    }
+
+    TEST_CASE("Invalid")
+    {
+        SmallVector<uint32_t> indices;
+        indices.resize(16, 1);
+
+        Writer writer;
+        writer.Add(SECTION::INDICES, Span(indices));
+        auto data = writer.Finalize(0, 0, 0);
+
+        // Copy so that it can be corrupted
+        SmallVector<Element> storage;
+        storage.resize(data.size() / sizeof(Element) + SECTION_ALIGNMENT);
+        uint8_t* copy = reinterpret_cast<uint8_t*>(storage.data());
+        copy += SECTION_ALIGNMENT - (reinterpret_cast<uintptr_t>(copy) & (SECTION_ALIGNMENT - 1));
+        memcpy(copy, data.data(), data.size());
+
+        Reader reader;
+        CHECK(reader.Init(Span(copy, data.size())));
+        // Truncated
+        CHECK(!reader.Init(Span(copy, data.size() - SECTION_ALIGNMENT)));
+        CHECK(!reader.Init(Span(copy, sizeof(Header) - 1)));
+        // Misaligned
+        CHECK(!reader.Init(Span(copy + 4, data.size() - 4)));
+
+        // Version mismatch
+        reinterpret_cast<Header*>(copy)->Version = VERSION + 1;
+        CHECK(!reader.Init(Span(copy, data.size())));
+        reinterpret_cast<Header*>(copy)->Version = VERSION;
+
+        // Section out of bounds
+        reinterpret_cast<Header*>(copy)->Sections[(int)SECTION::INDICES].NumElements = UINT64_MAX / 2;
+        CHECK(!reader.Init(Span(copy, data.size())));
+    }
+}
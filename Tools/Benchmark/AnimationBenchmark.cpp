@@ -0,0 +1,188 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Math/Quaternion.h>
+#include <Scene/Animation.h>
+#include <Utility/RNG.h>
+#include <Utility/Utility.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Scene;
+using namespace ZetaRay::Scene::Internal;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+    static constexpr int NUM_TRACKS = 20'000;
+    static constexpr int NUM_KEYFRAMES = 32;
+    // Frames evaluated per iteration, 60 FPS
+    static constexpr int NUM_FRAMES = 30;
+    static constexpr float FRAME_TIME = 1.0f / 60.0f;
+
+    struct Track
+    {
+        uint32_t StartOffset;
+        uint32_t Length;
+        bool Loop;
+    };
+
+    // Crowd of instances, each with its own looping animation of a few seconds
+    void BuildTracks(SmallVector<Keyframe>& keyframes, SmallVector<Track>& tracks)
+    {
+        RNG rng(0x8642);
+        keyframes.resize(NUM_TRACKS * NUM_KEYFRAMES);
+        tracks.resize(NUM_TRACKS);
+
+        for (int i = 0; i < NUM_TRACKS; i++)
+        {
+            tracks[i] = Track{ .StartOffset = (uint32_t)(i * NUM_KEYFRAMES),
+                .Length = NUM_KEYFRAMES,
+                .Loop = (i % 16) != 0 };
+
+            float3 axis = float3(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f);
+            axis.normalize();
+            float t = 0.0f;
+
+            for (int k = 0; k < NUM_KEYFRAMES; k++)
+            {
+                Keyframe& key = keyframes[i * NUM_KEYFRAMES + k];
+                key.Time = t;
+                key.Transform.Scale = float3(0.9f + rng.Uniform() * 0.2f);
+                key.Transform.Rotation = storeFloat4(rotationQuaternion(axis, rng.Uniform() * TWO_PI - PI));
+                key.Transform.Translation = float3(rng.Uniform() * 10, rng.Uniform() * 10, rng.Uniform() * 10);
+
+                t += 0.05f + rng.Uniform() * 0.2f;
+            }
+        }
+    }
+
+    // Previous implementation -- binary search and interpolation one track at a time
+    void SampleSerial(float t, const SmallVector<Keyframe>& keyframes, const SmallVector<Track>& tracks,
+        MutableSpan<AffineTransformation> out)
+    {
+        for (size_t i = 0; i < tracks.size(); i++)
+        {
+            const Track& anim = tracks[i];
+            const Keyframe& kStart = keyframes[anim.StartOffset];
+            const Keyframe& kEnd = keyframes[anim.StartOffset + anim.Length - 1];
+            float tLocal = t;
+
+            if (tLocal <= kStart.Time)
+                out[i] = kStart.Transform;
+            else if (!anim.Loop && tLocal >= kEnd.Time)
+                out[i] = kEnd.Transform;
+            else
+            {
+                if (tLocal >= kEnd.Time)
+                    tLocal = kStart.Time + fmodf(tLocal - kStart.Time, kEnd.Time - kStart.Time);
+
+                auto idx = FindInterval(Span(keyframes), tLocal, [](const Keyframe& k) { return k.Time; },
+                    anim.StartOffset,
+                    anim.StartOffset + anim.Length - 2);
+
+                Check(idx != -1, "FindInterval() unexpectedly failed.");
+                Keyframe k1 = keyframes[idx];
+                Keyframe k2 = keyframes[idx + 1];
+                const float u = (tLocal - k1.Time) / (k2.Time - k1.Time);
+
+                const __m128 vScale = lerp(loadFloat3(k1.Transform.Scale), loadFloat3(k2.Transform.Scale), u);
+                const __m128 vTranslate = lerp(loadFloat3(k1.Transform.Translation),
+                    loadFloat3(k2.Transform.Translation), u);
+                const __m128 vRot = slerp(loadFloat4(k1.Transform.Rotation), loadFloat4(k2.Transform.Rotation), u);
+
+                out[i].Scale = storeFloat3(vScale);
+                out[i].Rotation = storeFloat4(vRot);
+                out[i].Translation = storeFloat3(vTranslate);
+            }
+        }
+    }
+
+    ZetaInline bool Close(const float3& a, const float3& b)
+    {
+        return fabsf(a.x - b.x) < 1e-3f && fabsf(a.y - b.y) < 1e-3f && fabsf(a.z - b.z) < 1e-3f;
+    }
+
+    // Quaternions q and -q represent the same rotation
+    ZetaInline bool Close(const float4& a, const float4& b)
+    {
+        const float d = fabsf(a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w);
+        return d > 1.0f - 1e-3f;
+    }
+}
+
+ZETA_BENCHMARK(Animation_Crowd)
+{
+    SmallVector<Keyframe> keyframes;
+    SmallVector<Track> tracks;
+    BuildTracks(keyframes, tracks);
+
+    AnimationTracks animations;
+    for (auto& track : tracks)
+    {
+        animations.Add(Span(keyframes.data() + track.StartOffset, track.Length), 0.0f,
+            track.Loop);
+    }
+
+    printf("  %d tracks, %d keyframes each, %d frames per iteration\n", NUM_TRACKS,
+        NUM_KEYFRAMES, NUM_FRAMES);
+
+    SmallVector<AffineTransformation> expected;
+    SmallVector<AffineTransformation> results;
+    expected.resize(NUM_TRACKS);
+    results.resize(NUM_TRACKS);
+
+    float t = 0.0f;
+    const double msSerial = Measure("Binary search + slerp per track", NUM_ITERATIONS,
+        [&t, &keyframes, &tracks, &expected]()
+        {
+            for (int f = 0; f < NUM_FRAMES; f++)
+            {
+                SampleSerial(t, keyframes, tracks, expected);
+                t += FRAME_TIME;
+            }
+        });
+
+    const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    const int maxNumThreads = App::GetNumWorkerThreads();
+
+    for (auto n : threadCounts)
+    {
+        if (n > maxNumThreads)
+            break;
+
+        char label[64];
+        snprintf(label, sizeof(label), "Cursors + 8-wide SoA, %d thread(s)", n);
+
+        t = 0.0f;
+        const double ms = Measure(label, NUM_ITERATIONS, [&t, &animations, &results, n]()
+            {
+                for (int f = 0; f < NUM_FRAMES; f++)
+                {
+                    animations.Sample(t, results, n);
+                    t += FRAME_TIME;
+                }
+            });
+
+        printf("      Speedup over per-track: %.2fx\n", msSerial / ms);
+    }
+
+    // Jump back and forth in time to exercise the binary search fallback as well
+    const float times[] = { 0.0f, 3.1f, 0.7f, 100.0f, 2.5f, 2.51f, 2.6f, -1.0f, 7.25f };
+
+    for (auto tt : times)
+    {
+        SampleSerial(tt, keyframes, tracks, expected);
+        animations.Sample(tt, results);
+
+        for (int i = 0; i < NUM_TRACKS; i++)
+        {
+            Check(Close(results[i].Scale, expected[i].Scale) &&
+                Close(results[i].Rotation, expected[i].Rotation) &&
+                Close(results[i].Translation, expected[i].Translation),
+                "Vectorized and per-track results don't match.");
+        }
+    }
+}
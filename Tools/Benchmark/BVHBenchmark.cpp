@@ -0,0 +1,283 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Math/BVH.h>
+#include <Math/MatrixFuncs.h>
+#include <Scene/SceneCommon.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+    static constexpr int NUM_VIEWS = 64;
+    static constexpr int NUM_RAYS = 100'000;
+
+    // Instances scattered uniformly in a 1 km^3 volume
+    void UniformInstances(size_t n, SmallVector<BVH::BVHInput>& instances)
+    {
+        RNG rng(0x1234);
+        instances.resize(n);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            const float3 center(rng.Uniform() * 1000, rng.Uniform() * 1000, rng.Uniform() * 1000);
+            const float3 extents(0.5f + rng.Uniform() * 4, 0.5f + rng.Uniform() * 4, 0.5f + rng.Uniform() * 4);
+
+            instances[i].BoundingBox = AABB(center, extents);
+            instances[i].InstanceID = i;
+        }
+    }
+
+    // Many small instances (e.g. foliage, props) around a few hundred locations on a
+    // ground plane, plus a few large ones (e.g. buildings, terrain)
+    void ClusteredInstances(size_t n, SmallVector<BVH::BVHInput>& instances)
+    {
+        static constexpr int NUM_CLUSTERS = 256;
+
+        RNG rng(0x5678);
+        instances.resize(n);
+        float3 clusters[NUM_CLUSTERS];
+
+        for (int i = 0; i < NUM_CLUSTERS; i++)
+            clusters[i] = float3(rng.Uniform() * 2000, rng.Uniform() * 20, rng.Uniform() * 2000);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            AABB box;
+
+            if (rng.Uniform() < 0.01f)
+            {
+                box.Center = float3(rng.Uniform() * 2000, rng.Uniform() * 50, rng.Uniform() * 2000);
+                box.Extents = float3(20 + rng.Uniform() * 100, 10 + rng.Uniform() * 50, 20 + rng.Uniform() * 100);
+            }
+            else
+            {
+                const float3 c = clusters[rng.UniformUintBounded(NUM_CLUSTERS)];
+                box.Center = float3(c.x + (rng.Uniform() - 0.5f) * 60, c.y + rng.Uniform() * 5,
+                    c.z + (rng.Uniform() - 0.5f) * 60);
+                box.Extents = float3(0.2f + rng.Uniform(), 0.2f + rng.Uniform() * 2, 0.2f + rng.Uniform());
+            }
+
+            instances[i].BoundingBox = box;
+            instances[i].InstanceID = i;
+        }
+    }
+
+    void Run(const char* name, SmallVector<BVH::BVHInput>& instances)
+    {
+        const int threadCounts[] = { 1, 2, 4, 8, 16 };
+        const int maxNumThreads = App::GetNumWorkerThreads();
+        auto reset = []() { App::ResetFrameBasic(); };
+
+        BVH bvh;
+        double baseline = 0.0;
+
+        printf("  %s (%zu instances)\n", name, instances.size());
+
+        for (auto n : threadCounts)
+        {
+            if (n > maxNumThreads)
+                break;
+
+            char label[64];
+            snprintf(label, sizeof(label), "Build, %d thread(s)", n);
+
+            const double ms = Measure(label, NUM_ITERATIONS, [&bvh, &instances, n]()
+                {
+                    bvh.Build(instances, n);
+                }, reset);
+
+            baseline = n == 1 ? ms : baseline;
+            printf("      Speedup: %.2fx\n", baseline / ms);
+        }
+
+        // Tree doesn't depend on the thread count
+        printf("    SAH cost: %.2f\n", bvh.ComputeSAHCost());
+    }
+}
+
+ZETA_BENCHMARK(BVH_Build)
+{
+    SmallVector<BVH::BVHInput> instances;
+
+    UniformInstances(100'000, instances);
+    Run("Uniform", instances);
+
+    ClusteredInstances(100'000, instances);
+    Run("Clustered", instances);
+
+    ClusteredInstances(500'000, instances);
+    Run("Clustered", instances);
+}
+
+ZETA_BENCHMARK(BVH_Queries)
+{
+    SmallVector<BVH::BVHInput> instances;
+    ClusteredInstances(500'000, instances);
+
+    BVH bvh;
+    bvh.Build(instances);
+
+    // Camera walks around the middle of the scene
+    SmallVector<float4x4a> viewToWorlds;
+    viewToWorlds.resize(NUM_VIEWS);
+
+    for (int i = 0; i < NUM_VIEWS; i++)
+    {
+        const float theta = i * 6.2831853f / NUM_VIEWS;
+        const v_float4x4 vM = mul(rotateY(theta), translate(1000.0f + 500.0f * cosf(theta), 10.0f,
+            1000.0f + 500.0f * sinf(theta)));
+        viewToWorlds[i] = store(vM);
+    }
+
+    const ViewFrustum frustum(0.9f, 16.0f / 9.0f, 0.1f, 1000.0f);
+    size_t numVisible = 0;
+
+    Measure("Frustum culling (500K, 64 views)", NUM_ITERATIONS, [&bvh, &viewToWorlds, &frustum, &numVisible]()
+        {
+            numVisible = 0;
+
+            for (auto& viewToWorld : viewToWorlds)
+            {
+                SmallVector<uint64_t, App::FrameAllocator> visible;
+                bvh.DoFrustumCulling(frustum, viewToWorld, visible);
+                numVisible += visible.size();
+            }
+        }, []() { App::ResetFrameBasic(); });
+
+    printf("    Visible instances per view: %zu\n", numVisible / NUM_VIEWS);
+
+    RNG rng(0x9abc);
+    SmallVector<Ray> rays;
+    rays.resize(NUM_RAYS);
+
+    for (auto& r : rays)
+    {
+        float3 dir(rng.Uniform() - 0.5f, (rng.Uniform() - 0.5f) * 0.1f, rng.Uniform() - 0.5f);
+        dir.normalize();
+        r = Ray(float3(rng.Uniform() * 2000, 10.0f, rng.Uniform() * 2000), dir);
+    }
+
+    size_t numHits = 0;
+
+    Measure("Ray casts (500K, 100K rays)", NUM_ITERATIONS, [&bvh, &rays, &numHits]()
+        {
+            numHits = 0;
+
+            for (auto& r : rays)
+                numHits += bvh.CastRay(r) != Scene::INVALID_INSTANCE;
+        });
+
+    printf("    Hit ratio: %.2f\n", (float)numHits / NUM_RAYS);
+}
+
+ZETA_BENCHMARK(BVH_Update)
+{
+    SmallVector<BVH::BVHInput> instances;
+    ClusteredInstances(500'000, instances);
+
+    BVH bvh;
+    bvh.Build(instances);
+
+    // Every 10th instance moves a little each frame
+    RNG rng(0xdef0);
+    SmallVector<BVH::BVHUpdateInput> updates;
+    updates.reserve(instances.size() / 10 + 1);
+
+    auto nextFrame = [&instances, &updates, &rng]()
+        {
+            App::ResetFrameBasic();
+            updates.clear();
+
+            for (size_t i = 0; i < instances.size(); i += 10)
+            {
+                BVH::BVHUpdateInput u;
+                u.OldBox = instances[i].BoundingBox;
+                u.NewBox = u.OldBox;
+                u.NewBox.Center.x += (rng.Uniform() - 0.5f) * 2;
+                u.NewBox.Center.z += (rng.Uniform() - 0.5f) * 2;
+                u.InstanceID = instances[i].InstanceID;
+
+                instances[i].BoundingBox = u.NewBox;
+                updates.push_back(u);
+            }
+        };
+
+    nextFrame();
+
+    Measure("Update (500K, 50K moving)", NUM_ITERATIONS * 3, [&bvh, &updates]()
+        {
+            bvh.Update(updates);
+        }, nextFrame);
+
+    printf("    SAH cost increase: %.2fx\n", bvh.GetSAHCostIncrease());
+}
+
+ZETA_BENCHMARK(BVH_RayPackets)
+{
+    static constexpr int WIDTH = 512;
+    static constexpr int HEIGHT = 256;
+
+    SmallVector<BVH::BVHInput> instances;
+    ClusteredInstances(500'000, instances);
+
+    BVH bvh;
+    bvh.Build(instances);
+
+    // Primary rays from a camera above the ground, ordered so that every packet covers 
+    // a 4x2 block of pixels
+    SmallVector<Ray> rays;
+    rays.resize(WIDTH * HEIGHT);
+    const float3 origin(1000.0f, 30.0f, 0.0f);
+    size_t r = 0;
+
+    for (int by = 0; by < HEIGHT; by += 2)
+    {
+        for (int bx = 0; bx < WIDTH; bx += 4)
+        {
+            for (int i = 0; i < BVH::RAY_PACKET_SIZE; i++)
+            {
+                const float x = (bx + (i & 3) + 0.5f) / WIDTH;
+                const float y = (by + (i >> 2) + 0.5f) / HEIGHT;
+                float3 dir(x - 0.5f, -0.25f * y, 1.0f);
+                dir.normalize();
+
+                rays[r++] = Ray(origin, dir);
+            }
+        }
+    }
+
+    SmallVector<uint64_t> hits;
+    hits.resize(rays.size());
+
+    const double single = Measure("Single rays (500K, 128K coherent rays)", NUM_ITERATIONS, [&bvh, &rays, &hits]()
+        {
+            for (size_t i = 0; i < rays.size(); i++)
+                hits[i] = bvh.CastRay(rays[i]);
+        });
+
+    const double packet = Measure("Ray packets, 1 thread", NUM_ITERATIONS, [&bvh, &rays, &hits]()
+        {
+            bvh.CastRays(rays, hits, 1);
+        });
+
+    printf("      Speedup: %.2fx\n", single / packet);
+
+    const double packetMT = Measure("Ray packets, all threads", NUM_ITERATIONS, [&bvh, &rays, &hits]()
+        {
+            bvh.CastRays(rays, hits);
+        }, []() { App::ResetFrameBasic(); });
+
+    printf("      Speedup: %.2fx\n", single / packetMT);
+
+    size_t numHits = 0;
+    for (auto h : hits)
+        numHits += h != Scene::INVALID_INSTANCE;
+
+    printf("    Hit ratio: %.2f\n", (float)numHits / rays.size());
+}
@@ -0,0 +1,135 @@
+#include "Benchmark.h"
+#include <Math/BatchConversion.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Util;
+
+// Converts the same values one at a time with the scalar constructors and with the batch
+// kernels. Sizes are in the range of the vertex count of a large mesh.
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 20;
+    static constexpr size_t NUM_VALUES = 1024 * 1024;
+
+    void ReportThroughput(const char* name, double scalarMs, double batchMs)
+    {
+        printf("    %-24s %8.1f -> %8.1f M/s (%.2fx)\n", name,
+            NUM_VALUES / (scalarMs * 1000.0), NUM_VALUES / (batchMs * 1000.0),
+            scalarMs / batchMs);
+    }
+}
+
+ZETA_BENCHMARK(BatchConversion)
+{
+    RNG rng(0x4321);
+    SmallVector<float3> vectors;
+    SmallVector<float2> values;
+    vectors.resize(NUM_VALUES);
+    values.resize(NUM_VALUES);
+
+    for (auto& v : vectors)
+    {
+        v = float3(rng.Uniform() * 2 - 1, rng.Uniform() * 2 - 1, rng.Uniform() * 2 - 1);
+        v.normalize();
+    }
+
+    for (auto& v : values)
+        v = float2(rng.Uniform() * 2 - 1, rng.Uniform() * 2 - 1);
+
+    SmallVector<oct32> encoded;
+    SmallVector<float3> decoded;
+    SmallVector<unorm2> unorms;
+    SmallVector<half2> halves2;
+    SmallVector<half3> halves3;
+    encoded.resize(NUM_VALUES);
+    decoded.resize(NUM_VALUES);
+    unorms.resize(NUM_VALUES);
+    halves2.resize(NUM_VALUES);
+    halves3.resize(NUM_VALUES);
+
+    // oct32 encode
+    const double encodeScalarMs = Measure("Float3ToOct32 (scalar)", NUM_ITERATIONS, [&]()
+        {
+            for (size_t i = 0; i < NUM_VALUES; i++)
+                encoded[i] = oct32(vectors[i]);
+
+            DoNotOptimize(encoded[NUM_VALUES - 1].v.x);
+        });
+
+    const double encodeBatchMs = Measure("Float3ToOct32 (batch)", NUM_ITERATIONS, [&]()
+        {
+            Float3ToOct32(vectors, encoded);
+            DoNotOptimize(encoded[NUM_VALUES - 1].v.x);
+        });
+
+    // oct32 decode
+    const double decodeScalarMs = Measure("Oct32ToFloat3 (scalar)", NUM_ITERATIONS, [&]()
+        {
+            for (size_t i = 0; i < NUM_VALUES; i++)
+                decoded[i] = encoded[i].decode();
+
+            DoNotOptimize(decoded[NUM_VALUES - 1].x);
+        });
+
+    const double decodeBatchMs = Measure("Oct32ToFloat3 (batch)", NUM_ITERATIONS, [&]()
+        {
+            Oct32ToFloat3(encoded, decoded);
+            DoNotOptimize(decoded[NUM_VALUES - 1].x);
+        });
+
+    // unorm2
+    const double unormScalarMs = Measure("Float2ToUNorm2 (scalar)", NUM_ITERATIONS, [&]()
+        {
+            for (size_t i = 0; i < NUM_VALUES; i++)
+                unorms[i] = unorm2::FromNormalized(values[i]);
+
+            DoNotOptimize(unorms[NUM_VALUES - 1].x);
+        });
+
+    const double unormBatchMs = Measure("Float2ToUNorm2 (batch)", NUM_ITERATIONS, [&]()
+        {
+            Float2ToUNorm2(values, unorms);
+            DoNotOptimize(unorms[NUM_VALUES - 1].x);
+        });
+
+    // half2
+    const double half2ScalarMs = Measure("Float2ToHalf2 (scalar)", NUM_ITERATIONS, [&]()
+        {
+            for (size_t i = 0; i < NUM_VALUES; i++)
+                halves2[i] = half2(values[i]);
+
+            DoNotOptimize(halves2[NUM_VALUES - 1].x);
+        });
+
+    const double half2BatchMs = Measure("Float2ToHalf2 (batch)", NUM_ITERATIONS, [&]()
+        {
+            Float2ToHalf2(values, halves2);
+            DoNotOptimize(halves2[NUM_VALUES - 1].x);
+        });
+
+    // half3
+    const double half3ScalarMs = Measure("Float3ToHalf3 (scalar)", NUM_ITERATIONS, [&]()
+        {
+            for (size_t i = 0; i < NUM_VALUES; i++)
+                halves3[i] = half3(vectors[i]);
+
+            DoNotOptimize(halves3[NUM_VALUES - 1].x);
+        });
+
+    const double half3BatchMs = Measure("Float3ToHalf3 (batch)", NUM_ITERATIONS, [&]()
+        {
+            Float3ToHalf3(vectors, halves3);
+            DoNotOptimize(halves3[NUM_VALUES - 1].x);
+        });
+
+    ReportThroughput("Float3ToOct32", encodeScalarMs, encodeBatchMs);
+    ReportThroughput("Oct32ToFloat3", decodeScalarMs, decodeBatchMs);
+    ReportThroughput("Float2ToUNorm2", unormScalarMs, unormBatchMs);
+    ReportThroughput("Float2ToHalf2", half2ScalarMs, half2BatchMs);
+    ReportThroughput("Float3ToHalf3", half3ScalarMs, half3BatchMs);
+}
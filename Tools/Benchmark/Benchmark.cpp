@@ -0,0 +1,152 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Support/TaskProfiler.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <stdio.h>
+#include <string.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::App;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    struct Entry
+    {
+        const char* Name;
+        BenchmarkFunc Func;
+    };
+
+    std::atomic_uint64_t g_numNewAllocs;
+    std::atomic_uint64_t g_numNewAllocatedBytes;
+
+    ZetaInline void CountNew(size_t size)
+    {
+        g_numNewAllocs.fetch_add(1, std::memory_order_relaxed);
+        g_numNewAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    // Function-local static, so that registrations from other translation units are
+    // safe regardless of static initialization order
+    SmallVector<Entry>& GetRegistry()
+    {
+        static SmallVector<Entry> registry;
+        return registry;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Benchmark
+//--------------------------------------------------------------------------------------
+
+Registration::Registration(const char* name, BenchmarkFunc f)
+{
+    GetRegistry().push_back(Entry{ .Name = name, .Func = f });
+}
+
+void ZetaRay::Benchmark::Report(const char* name, MutableSpan<double> samplesMs)
+{
+    if (samplesMs.empty())
+        return;
+
+    std::sort(samplesMs.begin(), samplesMs.end());
+
+    double sum = 0.0;
+    for (auto s : samplesMs)
+        sum += s;
+
+    printf("    %-48s min: %9.4f ms, median: %9.4f ms, mean: %9.4f ms (%zu runs)\n",
+        name,
+        samplesMs[0],
+        samplesMs[samplesMs.size() / 2],
+        sum / samplesMs.size(),
+        samplesMs.size());
+}
+
+AllocationCounts ZetaRay::Benchmark::GetAllocationCounts()
+{
+    const auto& sys = Support::g_systemAllocatorStats;
+
+    return AllocationCounts{
+        .NumAllocs = g_numNewAllocs.load(std::memory_order_relaxed) +
+            sys.NumAllocs.load(std::memory_order_relaxed),
+        .NumAllocatedBytes = g_numNewAllocatedBytes.load(std::memory_order_relaxed) +
+            sys.NumAllocatedBytes.load(std::memory_order_relaxed) };
+}
+
+//--------------------------------------------------------------------------------------
+// Global operator new/delete
+//--------------------------------------------------------------------------------------
+
+// Replaced so that allocations of std containers, std::thread, etc. are counted as well.
+// Array, sized and nothrow versions forward to these by default.
+void* operator new(size_t size)
+{
+    CountNew(size);
+    void* mem = malloc(size ? size : 1);
+    Check(mem, "Out of memory.");
+
+    return mem;
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    CountNew(size);
+    void* mem = _aligned_malloc(size ? size : 1, (size_t)alignment);
+    Check(mem, "Out of memory.");
+
+    return mem;
+}
+
+void operator delete(void* mem) noexcept
+{
+    free(mem);
+}
+
+void operator delete(void* mem, std::align_val_t) noexcept
+{
+    _aligned_free(mem);
+}
+
+//--------------------------------------------------------------------------------------
+// main
+//--------------------------------------------------------------------------------------
+
+// Usage: Benchmark [filter] [trace path]
+// Only benchmarks whose name contains "filter" (if given) are run. If a trace path is 
+// given, the last few thousand task executions per thread are written there as a Chrome 
+// trace.
+int main(int argc, char* argv[])
+{
+    const char* filter = argc > 1 && argv[1][0] != '\0' ? argv[1] : nullptr;
+    const char* tracePath = argc > 2 ? argv[2] : nullptr;
+
+    // Benchmarks only run on the CPU, so no D3D12 device is created
+    App::InitBasic(false);
+    printf("Number of worker threads: %d\n\n", App::GetNumWorkerThreads());
+
+    if (tracePath)
+        App::GetTaskProfiler().SetEnabled(true);
+
+    for (auto& e : GetRegistry())
+    {
+        if (filter && !strstr(e.Name, filter))
+            continue;
+
+        printf("%s\n", e.Name);
+        e.Func();
+        printf("\n");
+
+        App::ResetFrameBasic();
+    }
+
+    if (tracePath)
+        App::GetTaskProfiler().ExportChromeTrace(tracePath);
+
+    App::ShutdownBasic();
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <App/Timer.h>
+#include <Utility/Span.h>
+
+namespace ZetaRay::Benchmark
+{
+    using BenchmarkFunc = void(*)();
+
+    // Adds the given function to the list of benchmarks that are run by main()
+    struct Registration
+    {
+        Registration(const char* name, BenchmarkFunc f);
+    };
+
+    struct AllocationCounts
+    {
+        uint64_t NumAllocs;
+        uint64_t NumAllocatedBytes;
+    };
+
+    // Heap allocations from all threads so far, both through SystemAllocator and operator new
+    // (which is replaced by the benchmark executable). Allocations of a piece of code are
+    // the difference between the counts before and after it.
+    AllocationCounts GetAllocationCounts();
+
+    // Prints min/median/mean of the given samples (in milliseconds)
+    void Report(const char* name, Util::MutableSpan<double> samplesMs);
+
+    // Runs "f" for the given number of iterations (after a few warm-up runs) and reports
+    // the timings. "reset" runs after every call to "f" and isn't included in the timings.
+    template<typename F, typename R>
+    double Measure(const char* name, int numIterations, F f, R reset, int numWarmup = 2)
+    {
+        for (int i = 0; i < numWarmup; i++)
+        {
+            f();
+            reset();
+        }
+
+        Util::SmallVector<double> samples;
+        samples.resize(numIterations);
+        App::DeltaTimer timer;
+
+        for (int i = 0; i < numIterations; i++)
+        {
+            timer.Start();
+            f();
+            timer.End();
+
+            samples[i] = timer.DeltaMilli();
+            reset();
+        }
+
+        Report(name, samples);
+
+        double sum = 0.0;
+        for (auto s : samples)
+            sum += s;
+
+        return sum / numIterations;
+    }
+
+    template<typename F>
+    double Measure(const char* name, int numIterations, F f, int numWarmup = 2)
+    {
+        return Measure(name, numIterations, f, []() {}, numWarmup);
+    }
+
+    // Prevents the compiler from optimizing away the computation of "val"
+    template<typename T>
+    ZetaInline void DoNotOptimize(const T& val)
+    {
+        volatile T sink = val;
+        (void)sink;
+    }
+}
+
+#define ZETA_BENCHMARK(NAME) static void NAME(); \
+    static ZetaRay::Benchmark::Registration g_##NAME##Registration(#NAME, NAME); \
+    static void NAME()
@@ -0,0 +1,179 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Math/MatrixFuncs.h>
+#include <Math/Quaternion.h>
+#include <Scene/EmissiveUpdate.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::RT;
+using namespace ZetaRay::Scene::Internal;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+    static constexpr int NUM_INSTANCES = 4096;
+    // Moved instances per frame
+    static constexpr int NUM_UPDATES = 512;
+
+    struct EmissiveScene
+    {
+        SmallVector<EmissiveTrianglePos> InitialPos;
+        SmallVector<EmissiveTriangle> Tris;
+        SmallVector<EmissiveUpdate> Updates;
+    };
+
+    // Instances with a mix of small (e.g. lamps) and large (e.g. signs) triangle counts. Every
+    // 8th instance is moved.
+    void BuildScene(EmissiveScene& scene)
+    {
+        RNG rng(0x1357);
+
+        for (int i = 0; i < NUM_INSTANCES; i++)
+        {
+            const uint32_t numTris = (i % 16 == 0) ? 1024 + rng.UniformUintBounded(1024) :
+                3 + rng.UniformUintBounded(60);
+            const uint32_t base = (uint32_t)scene.Tris.size();
+
+            for (uint32_t t = 0; t < numTris; t++)
+            {
+                float3 v[3];
+                for (auto& vtx : v)
+                    vtx = float3(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f);
+
+                EmissiveTriangle tri(v[0], v[1], v[2], float2(0), float2(1, 0), float2(0, 1),
+                    0xffffff, 0, half(1.0f), t);
+                scene.InitialPos.push_back(EmissiveTrianglePos{ .PrimIdx = t,
+                    .Vtx0 = tri.Vtx0,
+                    .V0V1 = tri.V0V1,
+                    .V0V2 = tri.V0V2,
+                    .EdgeLengths = tri.EdgeLengths });
+                scene.Tris.push_back(tri);
+            }
+
+            if (i % (NUM_INSTANCES / NUM_UPDATES) != 0)
+                continue;
+
+            float3 axis = float3(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f);
+            axis.normalize();
+            float3 scale = float3(0.5f + rng.Uniform(), 0.5f + rng.Uniform(), 0.5f + rng.Uniform());
+            float3 tr = float3(rng.Uniform() * 100, rng.Uniform() * 10, rng.Uniform() * 100);
+            const v_float4x4 vW = affineTransformation(loadFloat3(scale),
+                rotationQuaternion(axis, rng.Uniform() * PI), loadFloat3(tr));
+
+            scene.Updates.push_back(EmissiveUpdate{ .ToWorld = float4x3(store(vW)),
+                .BaseTriOffset = base,
+                .NumTriangles = numTris,
+                .RtInstanceID = (uint32_t)i });
+        }
+    }
+
+    // Previous implementation -- one triangle at a time on a single thread
+    void TransformSerial(EmissiveScene& scene)
+    {
+        for (auto& update : scene.Updates)
+        {
+            const v_float4x4 vW = load4x3(update.ToWorld);
+
+            for (size_t t = update.BaseTriOffset; t < update.BaseTriOffset + update.NumTriangles; t++)
+            {
+                EmissiveTrianglePos& initTri = scene.InitialPos[t];
+
+                __m128 vV0;
+                __m128 vV1;
+                __m128 vV2;
+                EmissiveTriangle::DecodeVertices(initTri.Vtx0, initTri.V0V1, initTri.V0V2,
+                    initTri.EdgeLengths, vV0, vV1, vV2);
+
+                vV0 = mul(vW, vV0);
+                vV1 = mul(vW, vV1);
+                vV2 = mul(vW, vV2);
+                scene.Tris[t].StoreVertices(vV0, vV1, vV2);
+            }
+        }
+    }
+
+    // Both versions quantize the results, so compare the decoded vertices
+    bool Close(EmissiveTriangle& t1, EmissiveTriangle& t2)
+    {
+        __m128 vA[3];
+        __m128 vB[3];
+        t1.LoadVertices(vA[0], vA[1], vA[2]);
+        t2.LoadVertices(vB[0], vB[1], vB[2]);
+
+        for (int i = 0; i < 3; i++)
+        {
+            const float3 a = storeFloat3(vA[i]);
+            const float3 b = storeFloat3(vB[i]);
+            const float tol = 1e-2f * Max(1.0f, a.length());
+
+            if (fabsf(a.x - b.x) > tol || fabsf(a.y - b.y) > tol || fabsf(a.z - b.z) > tol)
+                return false;
+        }
+
+        return true;
+    }
+}
+
+ZETA_BENCHMARK(Emissive_Transform)
+{
+    EmissiveScene scene;
+    BuildScene(scene);
+
+    size_t numUpdatedTris = 0;
+    for (auto& update : scene.Updates)
+        numUpdatedTris += update.NumTriangles;
+
+    printf("  %zu emissive triangles, %zu moved instances (%zu triangles)\n", scene.Tris.size(),
+        scene.Updates.size(), numUpdatedTris);
+
+    const double msSerial = Measure("One triangle at a time, 1 thread", NUM_ITERATIONS,
+        [&scene]() { TransformSerial(scene); });
+
+    SmallVector<EmissiveTriangle> expected;
+    expected.resize(scene.Tris.size());
+    memcpy(expected.data(), scene.Tris.data(), scene.Tris.size() * sizeof(EmissiveTriangle));
+
+    const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    const int maxNumThreads = App::GetNumWorkerThreads();
+    DirtyRanges dirtyRanges;
+
+    for (auto n : threadCounts)
+    {
+        if (n > maxNumThreads)
+            break;
+
+        char label[64];
+        snprintf(label, sizeof(label), "8-wide + chunked, %d thread(s)", n);
+
+        const double ms = Measure(label, NUM_ITERATIONS, [&scene, &dirtyRanges, n]()
+            {
+                TransformEmissiveTriangles(scene.Updates, scene.InitialPos, scene.Tris, dirtyRanges, n);
+            },
+            [&dirtyRanges]()
+            {
+                dirtyRanges.clear();
+                App::ResetFrameBasic();
+            });
+
+        printf("      Speedup over one triangle at a time: %.2fx\n", msSerial / ms);
+    }
+
+    // Every moved instance should be covered by exactly one range
+    TransformEmissiveTriangles(scene.Updates, scene.InitialPos, scene.Tris, dirtyRanges);
+    auto ranges = dirtyRanges.Ranges();
+    Check(ranges.size() == scene.Updates.size(), "Ranges of non-adjacent instances shouldn't be merged.");
+
+    for (size_t i = 0; i < ranges.size(); i++)
+    {
+        Check(ranges[i].Base == scene.Updates[i].BaseTriOffset &&
+            ranges[i].Count == scene.Updates[i].NumTriangles, "Invalid dirty range.");
+    }
+
+    for (size_t t = 0; t < scene.Tris.size(); t++)
+        Check(Close(scene.Tris[t], expected[t]), "Vectorized and per-triangle results don't match.");
+}
@@ -0,0 +1,176 @@
+#include "Benchmark.h"
+#include <App/Filesystem.h>
+#include <App/Path.h>
+#include <Support/MemoryArena.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::App;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+// Reads every file in a directory of DDS textures with each of the available read paths.
+// Directory is taken from the ZETA_BENCHMARK_DDS_DIR environment variable. If it's not
+// set, synthetic files are written to a directory in the working directory instead.
+//
+// Note that after the warm-up runs files are likely in the OS file cache, so these mostly
+// measure the overhead of each path rather than the disk.
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+    static constexpr int NUM_SYNTHETIC_FILES = 64;
+    static constexpr uint32_t SYNTHETIC_FILE_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr const char* SYNTHETIC_DIR = "FileIOBenchmark";
+
+    struct FileList
+    {
+        void Add(const char* path, size_t sizeInBytes)
+        {
+            Offsets.push_back(Chars.size());
+            Chars.append_range(path, path + strlen(path) + 1);
+            TotalSizeInBytes += sizeInBytes;
+        }
+
+        // Pointers are only stable after all the paths have been added
+        void Finalize()
+        {
+            Paths.resize(Offsets.size());
+            for (size_t i = 0; i < Offsets.size(); i++)
+                Paths[i] = Chars.data() + Offsets[i];
+        }
+
+        SmallVector<char> Chars;
+        SmallVector<size_t> Offsets;
+        SmallVector<const char*> Paths;
+        size_t TotalSizeInBytes = 0;
+    };
+
+    void CreateSyntheticFiles(FileList& files)
+    {
+        Filesystem::CreateDirectoryIfNotExists(SYNTHETIC_DIR);
+
+        SmallVector<uint8_t> data;
+        data.resize(SYNTHETIC_FILE_SIZE);
+        RNG rng(0x2468);
+
+        for (auto& b : data)
+            b = (uint8_t)rng.UniformUint();
+
+        for (int i = 0; i < NUM_SYNTHETIC_FILES; i++)
+        {
+            StackStr(name, n, "tex_%d.dds", i);
+            Filesystem::Path path(SYNTHETIC_DIR);
+            path.Append(name);
+
+            Filesystem::WriteToFile(path.Get(), data.data(), SYNTHETIC_FILE_SIZE);
+            files.Add(path.Get(), SYNTHETIC_FILE_SIZE);
+        }
+    }
+
+    void ListDDSFiles(const char* directory, FileList& files)
+    {
+        Filesystem::ForEachFile(directory, [](void* param, const char* path)
+            {
+                const size_t len = strlen(path);
+                if (len < 4 || strcmp(path + len - 4, ".dds") != 0)
+                    return;
+
+                reinterpret_cast<FileList*>(param)->Add(path, Filesystem::GetFileSize(path));
+            }, &files);
+    }
+
+    void ReportThroughput(const char* name, double ms, size_t numBytes)
+    {
+        printf("    %-48s %9.1f MB/s\n", name, (numBytes / (1024.0 * 1024.0)) / (ms / 1000.0));
+    }
+}
+
+ZETA_BENCHMARK(FileIO_ReadDirectory)
+{
+    const char* dir = getenv("ZETA_BENCHMARK_DDS_DIR");
+    FileList files;
+
+    if (dir)
+        ListDDSFiles(dir, files);
+    else
+        CreateSyntheticFiles(files);
+
+    files.Finalize();
+
+    if (files.Paths.empty())
+    {
+        printf("    No DDS files found in %s, skipping...\n", dir);
+        return;
+    }
+
+    printf("    %zu files, %.1f MB\n", files.Paths.size(), files.TotalSizeInBytes / (1024.0 * 1024.0));
+
+    // Blocking read of each file, one after the other
+    const double blockingMs = Measure("LoadFromFile", NUM_ITERATIONS, [&files]()
+        {
+            SmallVector<uint8_t> data;
+            uint32_t sum = 0;
+
+            for (auto path : files.Paths)
+            {
+                Filesystem::LoadFromFile(path, data);
+                sum += data.empty() ? 0 : data[0];
+            }
+
+            DoNotOptimize(sum);
+        });
+
+    // Pages are read on first access
+    const double mappedMs = Measure("MappedFile (touching every page)", NUM_ITERATIONS, [&files]()
+        {
+            uint32_t sum = 0;
+
+            for (auto path : files.Paths)
+            {
+                Filesystem::MappedFile file;
+                if (!file.Open(path))
+                    continue;
+
+                Span<uint8_t> data = file.Data();
+                for (size_t i = 0; i < data.size(); i += PAGE_SIZE)
+                    sum += data[i];
+            }
+
+            DoNotOptimize(sum);
+        });
+
+    MemoryArena arena(64 * 1024 * 1024);
+
+    const double asyncMs = Measure("AsyncFileReader", NUM_ITERATIONS, [&files, &arena]()
+        {
+            uint32_t sum = 0;
+
+            Filesystem::AsyncFileReader reader;
+            reader.ReadAll(files.Paths, ArenaAllocator(arena),
+                [](void* param, size_t fileIdx, Span<uint8_t> data)
+                {
+                    *reinterpret_cast<uint32_t*>(param) += data.empty() ? 0 : data[0];
+                }, &sum);
+
+            DoNotOptimize(sum);
+        }, [&arena]()
+        {
+            arena.Reset();
+        });
+
+    ReportThroughput("LoadFromFile", blockingMs, files.TotalSizeInBytes);
+    ReportThroughput("MappedFile (touching every page)", mappedMs, files.TotalSizeInBytes);
+    ReportThroughput("AsyncFileReader", asyncMs, files.TotalSizeInBytes);
+
+    if (!dir)
+    {
+        for (auto path : files.Paths)
+            Filesystem::RemoveFile(path);
+    }
+}
@@ -0,0 +1,103 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Support/ParallelFor.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Support;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 200;
+    static constexpr int NUM_FLAT_TASKS = 192;
+    // Every parent task forks NUM_CHILDREN tasks from inside the worker thread
+    static constexpr int NUM_PARENTS = 16;
+    static constexpr int NUM_CHILDREN = 12;
+
+    ZetaInline void DoWork(uint32_t n)
+    {
+        float x = 1.0f;
+        for (uint32_t i = 0; i < n; i++)
+            x = x * 0.999f + 0.5f;
+
+        DoNotOptimize(x);
+    }
+
+    // Many tiny work items forked by the main thread -- helpers have to steal them
+    void RunFlat(uint32_t cost, int numThreads)
+    {
+        ParallelFor(0, NUM_FLAT_TASKS, 1, [cost](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    DoWork(cost);
+            }, numThreads);
+    }
+
+    // Work items that fork more work -- nested helpers are pushed to the worker's own deque
+    void RunNested(uint32_t cost, int numThreads)
+    {
+        ParallelFor(0, NUM_PARENTS, 1, [cost, numThreads](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    ParallelFor(0, NUM_CHILDREN, 1, [cost](size_t childBegin, size_t childEnd)
+                        {
+                            for (size_t j = childBegin; j < childEnd; j++)
+                                DoWork(cost);
+                        }, numThreads);
+
+                    DoWork(cost);
+                }
+            }, numThreads);
+    }
+
+    template<typename F>
+    void MeasureWithStats(const char* name, F f)
+    {
+        // ParallelFor() may return before all of its helper tasks have run (they find no 
+        // chunks left), flush them so that they're counted for the right run
+        auto reset = []() 
+            {
+                App::FlushWorkerThreadPool();
+                App::ResetFrameBasic(); 
+            };
+
+        // Discard whatever was accumulated before
+        App::GetAndResetWorkerStats();
+        Measure(name, NUM_ITERATIONS, f, reset);
+        const auto stats = App::GetAndResetWorkerStats();
+
+        printf("      Stolen: %u / %u tasks, worker sleeps: %u\n", stats.NumSteals,
+            stats.NumTasksExecuted, stats.NumSleeps);
+    }
+}
+
+ZETA_BENCHMARK(ThreadPool_ForkJoin)
+{
+    // Runs on the App's worker thread pool (a separate ThreadPool would give its workers
+    // the same thread indices as the App's workers, which index per-thread state that
+    // isn't synchronized). Number of threads is limited through ParallelFor's maxNumThreads.
+    const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    const int maxNumThreads = App::GetNumWorkerThreads();
+    // Roughly 0.1 us and 10 us of work per item
+    const uint32_t costs[] = { 100, 10000 };
+
+    for (auto cost : costs)
+    {
+        printf("  Work per item: %u iterations\n", cost);
+
+        for (auto numThreads : threadCounts)
+        {
+            if (numThreads > maxNumThreads)
+                continue;
+
+            char name[64];
+            snprintf(name, sizeof(name), "Flat (%d threads)", numThreads);
+            MeasureWithStats(name, [cost, numThreads]() { RunFlat(cost, numThreads); });
+
+            snprintf(name, sizeof(name), "Nested (%d threads)", numThreads);
+            MeasureWithStats(name, [cost, numThreads]() { RunNested(cost, numThreads); });
+        }
+    }
+}
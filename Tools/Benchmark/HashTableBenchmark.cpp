@@ -0,0 +1,210 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Support/ParallelFor.h>
+#include <Utility/HashTable.h>
+#include <Utility/ConcurrentHashTable.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+#include <thread>
+#include <unordered_map>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+    static constexpr int NUM_BUCKETS = 1 << 18;
+    static constexpr int NUM_INSTANCES = 50'000;
+    static constexpr int NUM_LOOKUPS = 4'000'000;
+
+    // Instance IDs are hashes of scene, node and mesh indices, so they're spread over
+    // the whole 64-bit range
+    void RandomInstanceIDs(SmallVector<uint64_t>& ids, int n, uint32_t seed)
+    {
+        RNG rng(seed);
+        ids.resize(n);
+
+        for (auto& id : ids)
+            id = (uint64_t(rng.UniformUint()) << 32) | rng.UniformUint();
+    }
+
+    // Same number of buckets, filled up to the given load factor
+    void Run(float load)
+    {
+        const int n = int(NUM_BUCKETS * load);
+        SmallVector<uint64_t> keys;
+        SmallVector<uint64_t> missingKeys;
+        RandomInstanceIDs(keys, n, 0x1357);
+        RandomInstanceIDs(missingKeys, n, 0x2468);
+
+        printf("    Load factor: %.2f (%d keys)\n", load, n);
+
+        std::unordered_map<uint64_t, uint32_t> stdMap;
+        stdMap.reserve(n);
+        const double msStdInsert = Measure("std::unordered_map, insert", NUM_ITERATIONS, [&keys, &stdMap]()
+            {
+                for (int i = 0; i < (int)keys.size(); i++)
+                    stdMap.emplace(keys[i], i);
+            }, [&stdMap]() { stdMap.clear(); });
+
+        HashTable<uint32_t> table(NUM_BUCKETS);
+        const double msInsert = Measure("HashTable, insert", NUM_ITERATIONS, [&keys, &table]()
+            {
+                for (int i = 0; i < (int)keys.size(); i++)
+                    table.try_emplace(keys[i], i);
+            }, [&table]() { table.clear(); });
+
+        printf("      Speedup over std::unordered_map: %.2fx\n", msStdInsert / msInsert);
+
+        for (int i = 0; i < n; i++)
+        {
+            stdMap.emplace(keys[i], i);
+            table.try_emplace(keys[i], i);
+        }
+
+        Assert(table.bucket_count() == NUM_BUCKETS, "Table shouldn't have grown.");
+
+        const double msStdHit = Measure("std::unordered_map, lookup (hit)", NUM_ITERATIONS, [&keys, &stdMap]()
+            {
+                uint32_t sum = 0;
+                for (auto k : keys)
+                    sum += stdMap.find(k)->second;
+
+                DoNotOptimize(sum);
+            });
+
+        const double msHit = Measure("HashTable, lookup (hit)", NUM_ITERATIONS, [&keys, &table]()
+            {
+                uint32_t sum = 0;
+                for (auto k : keys)
+                    sum += *table.find(k).value();
+
+                DoNotOptimize(sum);
+            });
+
+        printf("      Speedup over std::unordered_map: %.2fx\n", msStdHit / msHit);
+
+        const double msStdMiss = Measure("std::unordered_map, lookup (miss)", NUM_ITERATIONS, [&missingKeys, &stdMap]()
+            {
+                uint32_t numFound = 0;
+                for (auto k : missingKeys)
+                    numFound += stdMap.find(k) != stdMap.end();
+
+                DoNotOptimize(numFound);
+            });
+
+        const double msMiss = Measure("HashTable, lookup (miss)", NUM_ITERATIONS, [&missingKeys, &table]()
+            {
+                uint32_t numFound = 0;
+                for (auto k : missingKeys)
+                    numFound += (bool)table.find(k);
+
+                DoNotOptimize(numFound);
+            });
+
+        printf("      Speedup over std::unordered_map: %.2fx\n", msStdMiss / msMiss);
+    }
+
+    struct TreePos
+    {
+        uint32_t Level;
+        uint32_t Offset;
+    };
+
+    // Readers look up instance IDs from multiple threads while one thread keeps updating
+    // existing entries (e.g. tree positions shifting as new instances are added)
+    template<typename Lookup, typename Update>
+    void ReadersAndWriter(const SmallVector<uint64_t>& ids, int numReaders, Lookup lookup, Update update)
+    {
+        std::atomic_bool done = false;
+
+        std::thread writer([&ids, &done, &update]()
+            {
+                uint32_t i = 0;
+
+                while (!done.load(std::memory_order_relaxed))
+                {
+                    update(ids[i % NUM_INSTANCES], i);
+                    i++;
+                }
+            });
+
+        ParallelFor(0, NUM_LOOKUPS, 4096, [&ids, &lookup](size_t begin, size_t end)
+            {
+                uint32_t sum = 0;
+                for (size_t i = begin; i < end; i++)
+                    sum += lookup(ids[(i * 7919) % NUM_INSTANCES]);
+
+                DoNotOptimize(sum);
+            }, numReaders);
+
+        done = true;
+        writer.join();
+    }
+}
+
+ZETA_BENCHMARK(HashTable_InstanceIDs)
+{
+    Run(0.5f);
+    Run(0.85f);
+}
+
+ZETA_BENCHMARK(HashTable_Contention)
+{
+    SmallVector<uint64_t> ids;
+    RandomInstanceIDs(ids, NUM_INSTANCES, 0x1357);
+
+    HashTable<TreePos> table;
+    SRWLOCK lock = SRWLOCK_INIT;
+    ConcurrentHashTable<TreePos> concurrentTable;
+
+    for (int i = 0; i < NUM_INSTANCES; i++)
+    {
+        table.try_emplace(ids[i], TreePos{ 0, (uint32_t)i });
+        concurrentTable.try_emplace(ids[i], TreePos{ 0, (uint32_t)i });
+    }
+
+    const int threadCounts[] = { 1, 2, 4, 8, 15 };
+    const int maxNumThreads = App::GetNumWorkerThreads();
+
+    for (auto n : threadCounts)
+    {
+        if (n > maxNumThreads)
+            break;
+
+        printf("  %d reader(s), 1 writer\n", n);
+
+        const double msLocked = Measure("HashTable + SRW lock", NUM_ITERATIONS, [&ids, &table, &lock, n]()
+            {
+                ReadersAndWriter(ids, n, [&table, &lock](uint64_t id)
+                    {
+                        AcquireSRWLockShared(&lock);
+                        const uint32_t ret = table.find(id).value()->Offset;
+                        ReleaseSRWLockShared(&lock);
+
+                        return ret;
+                    }, [&table, &lock](uint64_t id, uint32_t i)
+                    {
+                        AcquireSRWLockExclusive(&lock);
+                        table.find(id).value()->Level = i;
+                        ReleaseSRWLockExclusive(&lock);
+                    });
+            });
+
+        const double msConcurrent = Measure("ConcurrentHashTable", NUM_ITERATIONS, [&ids, &concurrentTable, n]()
+            {
+                ReadersAndWriter(ids, n, [&concurrentTable](uint64_t id)
+                    {
+                        return concurrentTable.find(id).value().Offset;
+                    }, [&concurrentTable](uint64_t id, uint32_t i)
+                    {
+                        concurrentTable.modify(id, [i](TreePos& p) { p.Level = i; });
+                    });
+            });
+
+        printf("    Speedup over HashTable + SRW lock: %.2fx\n", msLocked / msConcurrent);
+    }
+}
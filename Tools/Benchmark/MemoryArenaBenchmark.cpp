@@ -0,0 +1,95 @@
+#include "Benchmark.h"
+#include <Support/MemoryArena.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+    static constexpr int NUM_ALLOCS = 1'000'000;
+    static constexpr int NUM_SCOPES = 1000;
+
+    // Sizes between 8 and 256 bytes, e.g. strings, small arrays and tree nodes
+    void RandomSizes(SmallVector<uint32_t>& sizes)
+    {
+        RNG rng(0x1357);
+        sizes.resize(NUM_ALLOCS);
+
+        for (auto& s : sizes)
+            s = 8 + rng.UniformUintBounded(249);
+    }
+
+    template<typename F>
+    void AllocateAll(const SmallVector<uint32_t>& sizes, F allocate)
+    {
+        for (auto s : sizes)
+        {
+            void* mem = allocate(s);
+            *reinterpret_cast<volatile uint8_t*>(mem) = (uint8_t)s;
+        }
+    }
+}
+
+ZETA_BENCHMARK(MemoryArena_SmallAllocs)
+{
+    SmallVector<uint32_t> sizes;
+    RandomSizes(sizes);
+
+    SmallVector<void*> ptrs;
+    ptrs.resize(NUM_ALLOCS);
+
+    const double ms = Measure("malloc (1M small allocations)", NUM_ITERATIONS, [&sizes, &ptrs]()
+        {
+            for (int i = 0; i < NUM_ALLOCS; i++)
+            {
+                ptrs[i] = malloc(sizes[i]);
+                *reinterpret_cast<volatile uint8_t*>(ptrs[i]) = (uint8_t)i;
+            }
+        }, [&ptrs]()
+        {
+            for (auto p : ptrs)
+                free(p);
+        });
+
+    MemoryArena arena(64 * 1024);
+    const double msArena = Measure("MemoryArena, 64 KB blocks", NUM_ITERATIONS, [&sizes, &arena]()
+        {
+            AllocateAll(sizes, [&arena](size_t s) { return arena.AllocateAligned(s); });
+        }, [&arena]() { arena.Reset(); });
+
+    printf("      Speedup over malloc: %.2fx\n", ms / msArena);
+
+    MemoryArena arenaVM(1024 * 1024, 4llu * 1024 * 1024 * 1024);
+    const double msArenaVM = Measure("MemoryArena, reserved 4 GB", NUM_ITERATIONS, [&sizes, &arenaVM]()
+        {
+            AllocateAll(sizes, [&arenaVM](size_t s) { return arenaVM.AllocateAligned(s); });
+        }, [&arenaVM]() { arenaVM.Reset(); });
+
+    printf("      Speedup over malloc: %.2fx\n", ms / msArenaVM);
+
+    // Allocations inside a loop body that are only needed until the next iteration
+    // (e.g. per-texture scratch memory)
+    const double msScoped = Measure("MemoryArena, 1000 scoped checkpoints", NUM_ITERATIONS, [&sizes, &arena]()
+        {
+            const int n = NUM_ALLOCS / NUM_SCOPES;
+
+            for (int i = 0; i < NUM_SCOPES; i++)
+            {
+                ScopedArenaCheckpoint checkpoint(arena);
+
+                for (int j = 0; j < n; j++)
+                {
+                    void* mem = arena.AllocateAligned(sizes[i * n + j]);
+                    *reinterpret_cast<volatile uint8_t*>(mem) = (uint8_t)j;
+                }
+            }
+        }, [&arena]() { arena.Reset(); });
+
+    printf("      Speedup over malloc: %.2fx\n", ms / msScoped);
+}
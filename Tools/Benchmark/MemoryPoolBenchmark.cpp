@@ -0,0 +1,127 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Support/ConcurrentMemoryPool.h>
+#include <Support/ParallelFor.h>
+#include <Utility/RNG.h>
+#include <Utility/SmallVector.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+    static constexpr size_t NUM_CHURN_TASKS = 64;
+    static constexpr size_t NUM_OPS_PER_TASK = 50'000;
+    static constexpr int NUM_LIVE = 256;
+    static constexpr size_t NUM_CROSS_THREAD_ALLOCS = 500'000;
+
+    // Sizes between 8 bytes and 1 KB, skewed towards small sizes
+    ZetaInline size_t RandomSize(RNG& rng)
+    {
+        return (size_t)8 << rng.UniformUintBounded(8);
+    }
+
+    // Every task keeps a window of live allocations and keeps replacing a random one
+    template<AllocatorType Allocator>
+    void Churn(Allocator allocator, int numThreads)
+    {
+        ParallelFor(0, NUM_CHURN_TASKS, 1, [&allocator](size_t begin, size_t end)
+            {
+                for (size_t t = begin; t < end; t++)
+                {
+                    RNG rng(t);
+                    void* live[NUM_LIVE];
+                    size_t sizes[NUM_LIVE];
+
+                    for (int i = 0; i < NUM_LIVE; i++)
+                    {
+                        sizes[i] = RandomSize(rng);
+                        live[i] = allocator.AllocateAligned(sizes[i], alignof(std::max_align_t));
+                    }
+
+                    for (size_t i = 0; i < NUM_OPS_PER_TASK; i++)
+                    {
+                        const uint32_t j = rng.UniformUintBounded(NUM_LIVE);
+                        allocator.FreeAligned(live[j], sizes[j], alignof(std::max_align_t));
+
+                        sizes[j] = RandomSize(rng);
+                        live[j] = allocator.AllocateAligned(sizes[j], alignof(std::max_align_t));
+                        *reinterpret_cast<volatile uint8_t*>(live[j]) = (uint8_t)i;
+                    }
+
+                    for (int i = 0; i < NUM_LIVE; i++)
+                        allocator.FreeAligned(live[i], sizes[i], alignof(std::max_align_t));
+                }
+            }, numThreads);
+    }
+
+    // Allocations are freed by (most likely) a different thread than the one that made
+    // them -- e.g. data that's produced by one task and consumed by another
+    template<AllocatorType Allocator>
+    void CrossThread(Allocator allocator, int numThreads, SmallVector<void*>& ptrs)
+    {
+        ParallelFor(0, NUM_CROSS_THREAD_ALLOCS, 1024, [&allocator, &ptrs](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                    ptrs[i] = allocator.AllocateAligned(64, alignof(std::max_align_t));
+            }, numThreads);
+
+        ParallelFor(0, NUM_CROSS_THREAD_ALLOCS, 1024, [&allocator, &ptrs](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    const size_t j = NUM_CROSS_THREAD_ALLOCS - 1 - i;
+                    allocator.FreeAligned(ptrs[j], 64, alignof(std::max_align_t));
+                }
+            }, numThreads);
+    }
+}
+
+ZETA_BENCHMARK(MemoryPool_Concurrent)
+{
+    const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    const int maxNumThreads = App::GetNumWorkerThreads();
+    auto reset = []() { App::ResetFrameBasic(); };
+
+    ConcurrentMemoryPool pool;
+    SmallVector<void*> ptrs;
+    ptrs.resize(NUM_CROSS_THREAD_ALLOCS);
+
+    for (auto n : threadCounts)
+    {
+        if (n > maxNumThreads)
+            break;
+
+        printf("  %d thread(s)\n", n);
+        double ms[4];
+
+        ms[0] = Measure("Churn, SystemAllocator", NUM_ITERATIONS, [n]()
+            {
+                Churn(SystemAllocator(), n);
+            }, reset);
+
+        ms[1] = Measure("Churn, ConcurrentMemoryPool", NUM_ITERATIONS, [&pool, n]()
+            {
+                Churn(ConcurrentPoolAllocator(pool), n);
+            }, reset);
+
+        ms[2] = Measure("Cross-thread frees, SystemAllocator", NUM_ITERATIONS, [&ptrs, n]()
+            {
+                CrossThread(SystemAllocator(), n, ptrs);
+            }, reset);
+
+        ms[3] = Measure("Cross-thread frees, ConcurrentMemoryPool", NUM_ITERATIONS, [&pool, &ptrs, n]()
+            {
+                CrossThread(ConcurrentPoolAllocator(pool), n, ptrs);
+            }, reset);
+
+        printf("    Speedup over SystemAllocator -- churn: %.2fx, cross-thread: %.2fx\n",
+            ms[0] / ms[1], ms[2] / ms[3]);
+    }
+
+    printf("  Pool size: %zu KB\n", pool.TotalSize() / 1024);
+}
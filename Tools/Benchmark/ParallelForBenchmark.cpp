@@ -0,0 +1,197 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Math/MatrixFuncs.h>
+#include <Math/VectorFuncs.h>
+#include <Support/ParallelFor.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr size_t NUM_INSTANCES = 100'000;
+    static constexpr size_t NUM_TRIANGLES = 1'000'000;
+    static constexpr int NUM_ITERATIONS = 30;
+
+    struct Triangle
+    {
+        float3 V0;
+        float3 V1;
+        float3 V2;
+    };
+
+    // Every instance has a local transform and a parent -- similar to updating the
+    // world transforms of one level of the scene graph
+    struct InstanceWorkload
+    {
+        InstanceWorkload()
+        {
+            RNG rng(0x1234);
+            Parents.resize(NUM_INSTANCES / 16);
+            LocalTransforms.resize(NUM_INSTANCES);
+            ParentIdx.resize(NUM_INSTANCES);
+            ToWorlds.resize(NUM_INSTANCES);
+
+            for (auto& M : Parents)
+                M = RandomTransform(rng);
+
+            for (size_t i = 0; i < NUM_INSTANCES; i++)
+            {
+                LocalTransforms[i] = RandomTransform(rng);
+                ParentIdx[i] = rng.UniformUintBounded((uint32_t)Parents.size());
+            }
+        }
+
+        static float4x3 RandomTransform(RNG& rng)
+        {
+            const float4a s(1.0f + rng.Uniform(), 1.0f + rng.Uniform(), 1.0f + rng.Uniform(), 0);
+            const float4a t(rng.Uniform() * 100, rng.Uniform() * 100, rng.Uniform() * 100, 1);
+            const v_float4x4 vR = rotateY(rng.Uniform() * 6.28f);
+            const v_float4x4 vM = mul(mul(scale(s), vR), translate(t));
+
+            return float4x3(store(vM));
+        }
+
+        void Run(size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const v_float4x4 vLocal = load4x3(LocalTransforms[i]);
+                const v_float4x4 vParent = load4x3(Parents[ParentIdx[i]]);
+                const v_float4x4 vW = mul(vLocal, vParent);
+
+                float4a s;
+                float4a r;
+                float4a t;
+                decomposeSRT(vW, s, r, t);
+
+                ToWorlds[i] = float4x3(store(vW));
+            }
+        }
+
+        SmallVector<float4x3> Parents;
+        SmallVector<float4x3> LocalTransforms;
+        SmallVector<uint32_t> ParentIdx;
+        SmallVector<float4x3> ToWorlds;
+    };
+
+    // Transforms triangles to world space and sums their area
+    struct TriangleWorkload
+    {
+        TriangleWorkload()
+        {
+            RNG rng(0x5678);
+            Triangles.resize(NUM_TRIANGLES);
+            Transformed.resize(NUM_TRIANGLES);
+
+            for (auto& tri : Triangles)
+            {
+                tri.V0 = float3(rng.Uniform(), rng.Uniform(), rng.Uniform());
+                tri.V1 = float3(rng.Uniform(), rng.Uniform(), rng.Uniform());
+                tri.V2 = float3(rng.Uniform(), rng.Uniform(), rng.Uniform());
+            }
+
+            W = mul(scale(2.0f, 3.0f, 4.0f), translate(1.0f, 2.0f, 3.0f));
+        }
+
+        void Transform(size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                __m128 vV0 = mul(W, _mm_insert_ps(loadFloat3(Triangles[i].V0), _mm_set1_ps(1.0f), 0x30));
+                __m128 vV1 = mul(W, _mm_insert_ps(loadFloat3(Triangles[i].V1), _mm_set1_ps(1.0f), 0x30));
+                __m128 vV2 = mul(W, _mm_insert_ps(loadFloat3(Triangles[i].V2), _mm_set1_ps(1.0f), 0x30));
+
+                Transformed[i].V0 = storeFloat3(vV0);
+                Transformed[i].V1 = storeFloat3(vV1);
+                Transformed[i].V2 = storeFloat3(vV2);
+            }
+        }
+
+        double Area(size_t begin, size_t end)
+        {
+            double sum = 0.0;
+
+            for (size_t i = begin; i < end; i++)
+            {
+                const __m128 vV0 = loadFloat3(Transformed[i].V0);
+                const __m128 vV1 = loadFloat3(Transformed[i].V1);
+                const __m128 vV2 = loadFloat3(Transformed[i].V2);
+                const __m128 vN = cross(_mm_sub_ps(vV1, vV0), _mm_sub_ps(vV2, vV0));
+
+                sum += 0.5 * _mm_cvtss_f32(length(vN));
+            }
+
+            return sum;
+        }
+
+        SmallVector<Triangle> Triangles;
+        SmallVector<Triangle> Transformed;
+        v_float4x4 W;
+    };
+}
+
+ZETA_BENCHMARK(ParallelFor_Scaling)
+{
+    const int threadCounts[] = { 1, 2, 4, 8, 16 };
+    const int maxNumThreads = App::GetNumWorkerThreads();
+    auto reset = []() { App::ResetFrameBasic(); };
+
+    InstanceWorkload instances;
+    TriangleWorkload triangles;
+    double baseline[3] = { 0.0, 0.0, 0.0 };
+
+    for (auto n : threadCounts)
+    {
+        if (n > maxNumThreads)
+            break;
+
+        printf("  %d thread(s)\n", n);
+        double ms[3];
+
+        ms[0] = Measure("Per-instance world transform (100K)", NUM_ITERATIONS, [&instances, n]()
+            {
+                ParallelFor(0, NUM_INSTANCES, 0, [&instances](size_t begin, size_t end)
+                    {
+                        instances.Run(begin, end);
+                    }, n);
+            }, reset);
+
+        ms[1] = Measure("Per-triangle transform (1M)", NUM_ITERATIONS, [&triangles, n]()
+            {
+                ParallelFor(0, NUM_TRIANGLES, 0, [&triangles](size_t begin, size_t end)
+                    {
+                        triangles.Transform(begin, end);
+                    }, n);
+            }, reset);
+
+        ms[2] = Measure("Per-triangle area sum (1M, ParallelReduce)", NUM_ITERATIONS, [&triangles, n]()
+            {
+                const double area = ParallelReduce(0, NUM_TRIANGLES, 0, 0.0,
+                    [&triangles](size_t begin, size_t end)
+                    {
+                        return triangles.Area(begin, end);
+                    },
+                    [](double a, double b)
+                    {
+                        return a + b;
+                    }, n);
+
+                DoNotOptimize(area);
+            }, reset);
+
+        if (n == 1)
+        {
+            for (int i = 0; i < 3; i++)
+                baseline[i] = ms[i];
+        }
+
+        printf("    Speedup -- instances: %.2fx, triangle transform: %.2fx, triangle area: %.2fx\n",
+            baseline[0] / ms[0], baseline[1] / ms[1], baseline[2] / ms[2]);
+    }
+}
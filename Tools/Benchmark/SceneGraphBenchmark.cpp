@@ -0,0 +1,291 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Math/Quaternion.h>
+#include <Scene/TransformPropagation.h>
+#include <Utility/HashTable.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Scene::Internal;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_ITERATIONS = 10;
+
+    struct Range
+    {
+        uint32_t Base;
+        uint32_t Count;
+    };
+
+    // Same layout as the scene graph in SceneCore
+    struct Level
+    {
+        SmallVector<uint64_t> IDs;
+        SmallVector<AffineTransformation> LocalTransforms;
+        SmallVector<float4x3> ToWorlds;
+        SmallVector<float4x3> PrevToWorlds;
+        SmallVector<Range> SubtreeRanges;
+        SmallVector<uint32_t> Parents;
+        SmallVector<uint64_t> LocalDirty;
+        SmallVector<uint64_t> WorldDirty;
+        // Instances that have been transformed directly in the past
+        SmallVector<uint64_t> HasWorldUpdate;
+    };
+
+    struct Hierarchy
+    {
+        SmallVector<Level> Levels;
+        HashTable<AffineTransformation> WorldUpdates;
+        size_t NumInstances = 0;
+    };
+
+    // "numChildren[l]" children for every instance in level l + 1
+    void BuildHierarchy(Hierarchy& h, uint32_t numRoots, Span<uint32_t> numChildren)
+    {
+        RNG rng(0x4321);
+        const float4x3 I = float4x3(store(identity()));
+
+        h.Levels.clear();
+        h.Levels.resize(numChildren.size() + 2);
+        h.WorldUpdates.clear();
+        h.NumInstances = 0;
+
+        auto& root = h.Levels[0];
+        root.ToWorlds.push_back(I);
+        root.SubtreeRanges.push_back(Range{ 0, numRoots });
+        root.WorldDirty.push_back(0);
+
+        for (size_t l = 1; l < h.Levels.size(); l++)
+        {
+            auto& parent = h.Levels[l - 1];
+            auto& curr = h.Levels[l];
+            uint32_t n = 0;
+
+            for (size_t i = 0; i < parent.SubtreeRanges.size(); i++)
+            {
+                for (uint32_t j = 0; j < parent.SubtreeRanges[i].Count; j++)
+                    curr.Parents.push_back((uint32_t)i);
+
+                n += parent.SubtreeRanges[i].Count;
+            }
+
+            const uint32_t numGrandchildren = l - 1 < numChildren.size() ? numChildren[l - 1] : 0;
+            curr.IDs.resize(n);
+            curr.LocalTransforms.resize(n);
+            curr.ToWorlds.resize(n, I);
+            curr.PrevToWorlds.resize(n, I);
+            curr.SubtreeRanges.resize(n);
+            curr.LocalDirty.resize(NumBitsetWords(n), 0);
+            curr.WorldDirty.resize(NumBitsetWords(n), 0);
+            curr.HasWorldUpdate.resize(NumBitsetWords(n), 0);
+
+            for (uint32_t i = 0; i < n; i++)
+            {
+                curr.IDs[i] = (uint64_t(rng.UniformUint()) << 32) | rng.UniformUint();
+
+                float3 axis = float3(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f);
+                axis.normalize();
+                AffineTransformation& tr = curr.LocalTransforms[i];
+                tr.Scale = float3(0.9f + rng.Uniform() * 0.2f);
+                tr.Rotation = storeFloat4(rotationQuaternion(axis, rng.Uniform() * 0.5f));
+                tr.Translation = float3(rng.Uniform() * 10, rng.Uniform() * 10, rng.Uniform() * 10);
+
+                curr.SubtreeRanges[i] = Range{ i * numGrandchildren, numGrandchildren };
+
+                // A few instances have been moved around by the user
+                if (rng.Uniform() < 0.01f)
+                {
+                    AffineTransformation u;
+                    u.Scale = float3(1.0f);
+                    u.Rotation = storeFloat4(rotationQuaternion(float3(0, 1, 0), rng.Uniform()));
+                    u.Translation = float3(rng.Uniform(), rng.Uniform(), rng.Uniform());
+
+                    h.WorldUpdates[curr.IDs[i]] = u;
+                    SetBit(curr.HasWorldUpdate, i);
+                }
+            }
+
+            h.NumInstances += n;
+        }
+    }
+
+    ZetaInline void ApplyWorldUpdate(AffineTransformation u, v_float4x4& vW)
+    {
+        float4a t;
+        float4a s;
+        v_float4x4 vR = decomposeSRT(vW, s, t);
+        float3 newTr = u.Translation + t.xyz();
+        float3 newScale = u.Scale * s.xyz();
+
+        v_float4x4 vRotUpdate = rotationMatFromQuat(loadFloat4(u.Rotation));
+        vR = mul(vR, vRotUpdate);
+
+        vW = affineTransformation(vR, newScale, newTr);
+    }
+
+    // Previous implementation -- serial walk over the dirty subtrees with a stack and
+    // previous transformations in a hash table
+    void PropagateSerial(Hierarchy& h, HashTable<float4x3>& prevToWorlds)
+    {
+        struct Entry
+        {
+            v_float4x4 W;
+            uint32_t TreeLevel;
+            uint32_t Base;
+            uint32_t Count;
+        };
+
+        SmallVector<Entry, App::FrameAllocator, 10> stack;
+        const Range roots = h.Levels[0].SubtreeRanges[0];
+        stack.push_back(Entry{ .W = identity(), .TreeLevel = 0, .Base = roots.Base, .Count = roots.Count });
+
+        while (!stack.empty())
+        {
+            Entry e = stack.back();
+            stack.pop_back();
+            auto& currLevel = h.Levels[e.TreeLevel + 1];
+
+            for (size_t j = e.Base; j < e.Base + e.Count; j++)
+            {
+                const uint64_t ID = currLevel.IDs[j];
+                AffineTransformation& local = currLevel.LocalTransforms[j];
+                v_float4x4 vLocal = affineTransformation(local.Scale, local.Rotation, local.Translation);
+                v_float4x4 vNewWorld = mul(vLocal, e.W);
+
+                if (auto updateIt = h.WorldUpdates.find(ID); updateIt)
+                    ApplyWorldUpdate(*updateIt.value(), vNewWorld);
+
+                prevToWorlds[ID] = currLevel.ToWorlds[j];
+                currLevel.ToWorlds[j] = float4x3(store(vNewWorld));
+
+                if (const auto& subtree = currLevel.SubtreeRanges[j]; subtree.Count)
+                {
+                    stack.push_back(Entry{ .W = vNewWorld,
+                        .TreeLevel = e.TreeLevel + 1,
+                        .Base = subtree.Base,
+                        .Count = subtree.Count });
+                }
+            }
+        }
+    }
+
+    void PropagateParallel(Hierarchy& h, int numThreads)
+    {
+        SmallVector<TransformLevel, App::FrameAllocator, 8> levels;
+
+        for (auto& level : h.Levels)
+        {
+            levels.push_back(TransformLevel{
+                .LocalTransforms = level.LocalTransforms,
+                .ToWorlds = level.ToWorlds,
+                .PrevToWorlds = level.PrevToWorlds,
+                .Parents = level.Parents,
+                .LocalDirty = level.LocalDirty,
+                .WorldDirty = level.WorldDirty });
+        }
+
+        PropagateWorldTransforms(levels, [&h](size_t levelIdx, size_t i, v_float4x4& vW)
+            {
+                const auto& level = h.Levels[levelIdx];
+
+                if (TestBit(level.HasWorldUpdate, i))
+                    ApplyWorldUpdate(*h.WorldUpdates.find(level.IDs[i]).value(), vW);
+            }, numThreads);
+    }
+
+    // Every root is animated, so the whole hierarchy is updated
+    void MarkRootsDirty(Hierarchy& h)
+    {
+        auto& roots = h.Levels[1];
+        memset(roots.LocalDirty.data(), 0xff, roots.LocalDirty.size() * sizeof(uint64_t));
+
+        if (const size_t rem = roots.ToWorlds.size() & 63; rem)
+            roots.LocalDirty.back() = (1llu << rem) - 1;
+
+        for (auto& level : h.Levels)
+            memset(level.WorldDirty.data(), 0, level.WorldDirty.size() * sizeof(uint64_t));
+    }
+
+    void Run(const char* name, uint32_t numRoots, Span<uint32_t> numChildren)
+    {
+        Hierarchy h;
+        BuildHierarchy(h, numRoots, numChildren);
+
+        printf("  %s (%zu instances, %zu levels)\n", name, h.NumInstances, h.Levels.size() - 1);
+
+        HashTable<float4x3> prevToWorlds(h.NumInstances);
+        const double msSerial = Measure("Serial + hash tables", NUM_ITERATIONS, [&h, &prevToWorlds]()
+            {
+                PropagateSerial(h, prevToWorlds);
+            }, []() { App::ResetFrameBasic(); });
+
+        // Results are used to validate the parallel version
+        SmallVector<SmallVector<float4x3>> expected;
+        expected.resize(h.Levels.size());
+        for (size_t l = 0; l < h.Levels.size(); l++)
+            expected[l].append_range(h.Levels[l].ToWorlds.begin(), h.Levels[l].ToWorlds.end());
+
+        const int threadCounts[] = { 1, 2, 4, 8, 16 };
+        const int maxNumThreads = App::GetNumWorkerThreads();
+
+        for (auto n : threadCounts)
+        {
+            if (n > maxNumThreads)
+                break;
+
+            char label[64];
+            snprintf(label, sizeof(label), "Level-by-level, %d thread(s)", n);
+
+            MarkRootsDirty(h);
+            const double ms = Measure(label, NUM_ITERATIONS, [&h, n]()
+                {
+                    PropagateParallel(h, n);
+                }, [&h]()
+                {
+                    MarkRootsDirty(h);
+                    App::ResetFrameBasic();
+                });
+
+            printf("      Speedup over serial: %.2fx\n", msSerial / ms);
+        }
+
+        for (size_t l = 1; l < h.Levels.size(); l++)
+        {
+            for (size_t i = 0; i < h.Levels[l].ToWorlds.size(); i++)
+            {
+                const float4x3& a = h.Levels[l].ToWorlds[i];
+                const float4x3& b = expected[l][i];
+
+                for (int r = 0; r < 4; r++)
+                {
+                    Check(fabsf(a.m[r].x - b.m[r].x) < 1e-3f && fabsf(a.m[r].y - b.m[r].y) < 1e-3f &&
+                        fabsf(a.m[r].z - b.m[r].z) < 1e-3f, "Parallel and serial results don't match.");
+                }
+            }
+        }
+    }
+}
+
+ZETA_BENCHMARK(SceneGraph_WorldTransforms)
+{
+    // Few roots with many children each (e.g. props placed under a handful of nodes)
+    uint32_t wide[] = { 64, 64 };
+    Run("Wide", 16, wide);
+
+    // Long chains (e.g. skeletons)
+    uint32_t deep[31];
+    for (auto& c : deep)
+        c = 1;
+    Run("Deep", 1024, deep);
+
+    // Binary trees
+    uint32_t balanced[14];
+    for (auto& c : balanced)
+        c = 2;
+    Run("Balanced", 4, balanced);
+}
@@ -0,0 +1,492 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Core/BufferUpload.h>
+#include <Math/BVH.h>
+#include <Math/CollisionFuncs.h>
+#include <Math/Quaternion.h>
+#include <RayTracing/RtCommon.h>
+#include <Scene/Asset.h>
+#include <Scene/SceneGraph.h>
+#include <Scene/TransformPropagation.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Core;
+using namespace ZetaRay::Math;
+using namespace ZetaRay::Model;
+using namespace ZetaRay::RT;
+using namespace ZetaRay::Scene;
+using namespace ZetaRay::Scene::Internal;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+// Runs the CPU side of a scene update (animation, scene graph, BVH, emissives and uploads)
+// on synthetic scenes, without a window or a GPU. Scenes use the same scene graph, instance
+// table and emissive buffer as SceneCore and every frame calls the same update functions
+// as SceneCore::Update() (see SceneGraph.h). GPU uploads go to a stand-in. The scene BVH
+// isn't part of SceneCore's update at the moment, so it's updated here as its own stage.
+
+namespace
+{
+    static constexpr int NUM_FRAMES = 60;
+    static constexpr int NUM_WARMUP_FRAMES = 5;
+    static constexpr float FRAME_TIME = 1.0f / 60.0f;
+    static constexpr int NUM_KEYFRAMES = 16;
+
+    // Stands in for the GpuMemory upload calls. Data is copied into a staging buffer,
+    // which is the part of an upload that's paid for on the CPU timeline.
+    struct UploadStandIn
+    {
+        // Destination offset is ignored, only the staging copy is timed
+        BufferUploader Uploader()
+        {
+            return BufferUploader{ .Func = [](void* param, const void* data, uint32_t sizeInBytes, uint32_t)
+                {
+                    reinterpret_cast<UploadStandIn*>(param)->Upload(data, sizeInBytes);
+                },
+                .Param = this };
+        }
+
+        void Upload(const void* data, size_t sizeInBytes)
+        {
+            if (Staging.size() < NumBytes + sizeInBytes)
+                Staging.resize(NumBytes + sizeInBytes);
+
+            memcpy(Staging.data() + NumBytes, data, sizeInBytes);
+            NumBytes += sizeInBytes;
+            NumUploads++;
+        }
+
+        void Reset()
+        {
+            NumBytes = 0;
+            NumUploads = 0;
+        }
+
+        SmallVector<uint8_t> Staging;
+        size_t NumBytes = 0;
+        int NumUploads = 0;
+    };
+
+    //--------------------------------------------------------------------------------------
+    // HeadlessScene
+    //--------------------------------------------------------------------------------------
+
+    enum STAGE
+    {
+        ANIMATION,
+        WORLD_TRANSFORMS,
+        BVH_UPDATE,
+        EMISSIVES,
+        UPLOAD,
+        COUNT
+    };
+
+    const char* STAGE_NAMES[STAGE::COUNT] = { "Animation", "World transforms", "BVH update",
+        "Emissive positions", "Upload" };
+
+    struct SceneDesc
+    {
+        uint32_t NumRoots;
+        // "NumChildren[l]" children for every instance in level l + 1
+        Span<uint32_t> NumChildren;
+        float AnimatedFraction;
+        float EmissiveFraction;
+        uint32_t NumTrisPerEmissive;
+    };
+
+    struct FrameStats
+    {
+        double StageMs[STAGE::COUNT];
+        double TotalMs;
+        uint64_t NumAllocs;
+        uint64_t NumAllocatedBytes;
+        size_t NumUpdatedInstances;
+        size_t NumUploadedBytes;
+    };
+
+    // SceneCore's CPU-side scene data, minus the GPU resources
+    class HeadlessScene
+    {
+    public:
+        void Build(const SceneDesc& desc);
+        void Frame(float t, int numThreads, FrameStats& stats);
+        void BuildBVH(int numThreads) { m_bvh.Build(m_bvhInputs, numThreads); }
+
+        size_t NumInstances() const { return m_instances.size(); }
+        size_t NumLevels() const { return m_sceneGraph.size() - 1; }
+        uint32_t NumTracks() const { return m_animations.NumTracks(); }
+        size_t NumEmissiveTriangles() const { return m_emissives.NumTriangles(); }
+
+    private:
+        void InitEmissives();
+        AABB WorldBox(uint32_t slot) const;
+
+        SmallVector<TreeLevel, SystemAllocator, 3> m_sceneGraph;
+        InstanceTable m_instances;
+        AnimationTracks m_animations;
+        // Instance that is animated by each track
+        SmallVector<InstanceHandle> m_animatedInstances;
+        // No instance is transformed directly, so these stay empty
+        HashTable<AffineTransformation> m_worldTransformUpdates;
+        SmallVector<uint64_t> m_hasWorldTransformUpdate;
+        EmissiveBuffer m_emissives;
+        SmallVector<EmissiveUpdate> m_emissiveUpdates;
+        // Object-space bounding box of each instance slot
+        SmallVector<AABB> m_localBoxes;
+        SmallVector<BVH::BVHInput> m_bvhInputs;
+        BVH m_bvh;
+        UploadStandIn m_uploads;
+    };
+
+    void HeadlessScene::Build(const SceneDesc& desc)
+    {
+        RNG rng(0x9753);
+        const float4x3 I = float4x3(store(identity()));
+        const uint8_t rtFlags = RT_Flags::Encode(RT_MESH_MODE::DYNAMIC_NO_REBUILD,
+            RT_AS_SUBGROUP::NON_EMISSIVE, 0, 0, true);
+        const uint8_t emissiveRtFlags = RT_Flags::Encode(RT_MESH_MODE::DYNAMIC_NO_REBUILD,
+            RT_AS_SUBGROUP::EMISSIVE, 0, 0, true);
+
+        SmallVector<EmissiveBuffer::Instance> emissiveInstances;
+        SmallVector<EmissiveTriangle> emissiveTris;
+
+        // Level 0 is just a (dummy) root
+        m_sceneGraph.resize(desc.NumChildren.size() + 2);
+        m_sceneGraph[0].m_toWorlds.push_back(I);
+
+        uint32_t numParentInstances = 1;
+
+        for (size_t l = 1; l < m_sceneGraph.size(); l++)
+        {
+            auto& parent = m_sceneGraph[l - 1];
+            auto& curr = m_sceneGraph[l];
+            const uint32_t numChildren = l == 1 ? desc.NumRoots : desc.NumChildren[l - 2];
+            const uint32_t n = numParentInstances * numChildren;
+
+            parent.m_subtreeRanges.resize(numParentInstances);
+            for (uint32_t p = 0; p < numParentInstances; p++)
+                parent.m_subtreeRanges[p] = Range(p * numChildren, numChildren);
+
+            curr.m_IDs.resize(n);
+            curr.m_localTransforms.resize(n);
+            curr.m_toWorlds.resize(n, I);
+            curr.m_prevToWorlds.resize(n, I);
+            curr.m_meshIDs.resize(n, 0);
+            curr.m_rtFlags.resize(n, rtFlags);
+            curr.m_rtASInfo.resize(n, RT_AS_Info{ .GeometryIndex = 0, .InstanceID = 0 });
+            curr.m_slots.resize(n);
+            curr.m_parents.resize(n);
+            // Everything is dirty at first, so world transformations are computed by the
+            // first update
+            curr.m_localDirty.resize(NumBitsetWords(n), UINT64_MAX);
+
+            for (uint32_t i = 0; i < n; i++)
+            {
+                const uint64_t id = ((uint64_t)l << 32 | i) * 0x9e3779b97f4a7c15llu;
+                const InstanceHandle h = m_instances.Add(id, TreePos{ .Level = (uint32_t)l, .Offset = i });
+
+                curr.m_IDs[i] = id;
+                curr.m_parents[i] = i / numChildren;
+                curr.m_slots[i] = h.Index;
+                curr.m_rtASInfo[i].InstanceID = h.Index;
+
+                float3 axis = float3(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f);
+                axis.normalize();
+                AffineTransformation& tr = curr.m_localTransforms[i];
+                tr.Scale = float3(0.9f + rng.Uniform() * 0.2f);
+                tr.Rotation = storeFloat4(rotationQuaternion(axis, rng.Uniform() * 0.5f));
+                tr.Translation = l == 1 ? float3(rng.Uniform() * 500, 0, rng.Uniform() * 500) :
+                    float3(rng.Uniform() * 4, rng.Uniform() * 4, rng.Uniform() * 4);
+
+                const float3 extents = float3(0.25f + rng.Uniform(), 0.25f + rng.Uniform(),
+                    0.25f + rng.Uniform());
+                m_localBoxes.push_back(AABB(float3(0), extents));
+
+                // Looping keyframe animation of a few seconds
+                if (rng.Uniform() < desc.AnimatedFraction)
+                {
+                    Keyframe keyframes[NUM_KEYFRAMES];
+                    float time = 0.0f;
+
+                    for (auto& k : keyframes)
+                    {
+                        k.Time = time;
+                        k.Transform = tr;
+                        k.Transform.Rotation = storeFloat4(rotationQuaternion(axis, rng.Uniform() * TWO_PI - PI));
+                        k.Transform.Translation += float3(rng.Uniform(), rng.Uniform(), rng.Uniform());
+
+                        time += 0.1f + rng.Uniform() * 0.3f;
+                    }
+
+                    m_animations.Add(keyframes, rng.Uniform(), true);
+                    m_animatedInstances.push_back(h);
+                }
+
+                if (rng.Uniform() < desc.EmissiveFraction)
+                {
+                    curr.m_rtFlags[i] = emissiveRtFlags;
+                    emissiveInstances.push_back(EmissiveBuffer::Instance{ .InstanceID = id,
+                        .BaseTriOffset = (uint32_t)emissiveTris.size(),
+                        .NumTriangles = desc.NumTrisPerEmissive,
+                        .MaterialIdx = 0 });
+
+                    for (uint32_t t = 0; t < desc.NumTrisPerEmissive; t++)
+                    {
+                        float3 v[3];
+                        for (auto& vtx : v)
+                            vtx = float3(rng.Uniform() - 0.5f, rng.Uniform() - 0.5f, rng.Uniform() - 0.5f) * extents;
+
+                        emissiveTris.push_back(EmissiveTriangle(v[0], v[1], v[2], float2(0), float2(1, 0),
+                            float2(0, 1), 0xffffff, 0, half(1.0f), t));
+                    }
+                }
+            }
+
+            numParentInstances = n;
+        }
+
+        m_sceneGraph.back().m_subtreeRanges.resize(numParentInstances, Range(0, 0));
+        m_hasWorldTransformUpdate.resize(NumBitsetWords(m_instances.size()), 0);
+        m_emissives.AddBatch(ZetaMove(emissiveInstances), ZetaMove(emissiveTris));
+
+        // Initial world transformations
+        ResizeDirtyBitsets(m_sceneGraph);
+        RecomputeWorldTransforms(m_sceneGraph, m_hasWorldTransformUpdate, m_worldTransformUpdates);
+
+        SmallVector<uint32_t, App::FrameAllocator> updated;
+        CollectUpdatedInstances(m_sceneGraph, m_emissives, updated, m_emissiveUpdates);
+        InitEmissives();
+
+        m_bvhInputs.resize(m_instances.size());
+
+        for (uint32_t slot = 0; slot < m_instances.size(); slot++)
+        {
+            m_bvhInputs[slot].BoundingBox = WorldBox(slot);
+            m_bvhInputs[slot].InstanceID = slot;
+        }
+
+        BuildBVH(0);
+    }
+
+    // Same as the first emissive update in SceneCore::Update()
+    void HeadlessScene::InitEmissives()
+    {
+        auto emissives = m_emissives.Instances();
+        auto tris = m_emissives.Triagnles();
+        auto triInitialPos = m_emissives.InitialTriPositions();
+
+        for (const auto& e : emissives)
+        {
+            const TreePos p = m_instances.PosFromID(e.InstanceID).value();
+            const auto& level = m_sceneGraph[p.Level];
+
+            InitEmissiveTriangles(level.m_toWorlds[p.Offset], level.m_rtASInfo[p.Offset].GeometryIndex,
+                level.m_rtASInfo[p.Offset].InstanceID,
+                MutableSpan(tris.data() + e.BaseTriOffset, e.NumTriangles),
+                MutableSpan(triInitialPos.data() + e.BaseTriOffset, e.NumTriangles));
+        }
+    }
+
+    AABB HeadlessScene::WorldBox(uint32_t slot) const
+    {
+        const TreePos p = m_instances.Pos(slot);
+        const v_float4x4 vW = load4x3(m_sceneGraph[p.Level].m_toWorlds[p.Offset]);
+
+        return store(transform(vW, v_AABB(m_localBoxes[slot])));
+    }
+
+    void HeadlessScene::Frame(float t, int numThreads, FrameStats& stats)
+    {
+        const AllocationCounts allocsBefore = GetAllocationCounts();
+        App::DeltaTimer timer;
+        App::DeltaTimer frameTimer;
+        frameTimer.Start();
+
+        // Animation
+        timer.Start();
+        ResizeDirtyBitsets(m_sceneGraph);
+
+        if (m_animations.NumTracks())
+        {
+            ApplyAnimations(m_animations, t, m_animatedInstances, m_instances, m_sceneGraph,
+                numThreads);
+        }
+        timer.End();
+        stats.StageMs[STAGE::ANIMATION] = timer.DeltaMilli();
+
+        // World transforms
+        timer.Start();
+        RecomputeWorldTransforms(m_sceneGraph, m_hasWorldTransformUpdate, m_worldTransformUpdates,
+            numThreads);
+
+        SmallVector<uint32_t, App::FrameAllocator> updated;
+        m_emissiveUpdates.clear();
+        CollectUpdatedInstances(m_sceneGraph, m_emissives, updated, m_emissiveUpdates);
+        timer.End();
+        stats.StageMs[STAGE::WORLD_TRANSFORMS] = timer.DeltaMilli();
+
+        // BVH update
+        timer.Start();
+        if (m_bvh.IsBuilt())
+        {
+            SmallVector<BVH::BVHUpdateInput, App::FrameAllocator> bvhUpdates;
+            bvhUpdates.resize(updated.size());
+
+            for (size_t i = 0; i < updated.size(); i++)
+            {
+                const uint32_t slot = updated[i];
+
+                bvhUpdates[i].OldBox = m_bvhInputs[slot].BoundingBox;
+                bvhUpdates[i].NewBox = WorldBox(slot);
+                bvhUpdates[i].InstanceID = slot;
+                m_bvhInputs[slot].BoundingBox = bvhUpdates[i].NewBox;
+            }
+
+            m_bvh.Update(bvhUpdates);
+        }
+        timer.End();
+        stats.StageMs[STAGE::BVH_UPDATE] = timer.DeltaMilli();
+
+        // Emissive positions, same as SceneCore::UpdateEmissivePositions()
+        timer.Start();
+        if (!m_emissiveUpdates.empty())
+            m_emissives.UpdateTriPositions(m_emissiveUpdates, numThreads);
+        timer.End();
+        stats.StageMs[STAGE::EMISSIVES] = timer.DeltaMilli();
+
+        // Upload -- modified emissive triangles and world transformations of the updated
+        // instances (TLAS instance descriptors)
+        timer.Start();
+        m_uploads.Reset();
+        m_emissives.UploadModified(m_uploads.Uploader());
+
+        SmallVector<float4x3, App::FrameAllocator> instanceData;
+        instanceData.resize(updated.size());
+
+        for (size_t i = 0; i < updated.size(); i++)
+        {
+            const TreePos p = m_instances.Pos(updated[i]);
+            instanceData[i] = m_sceneGraph[p.Level].m_toWorlds[p.Offset];
+        }
+
+        if (!instanceData.empty())
+            m_uploads.Upload(instanceData.data(), instanceData.size() * sizeof(float4x3));
+        timer.End();
+        stats.StageMs[STAGE::UPLOAD] = timer.DeltaMilli();
+
+        frameTimer.End();
+        const AllocationCounts allocsAfter = GetAllocationCounts();
+
+        stats.TotalMs = frameTimer.DeltaMilli();
+        stats.NumAllocs = allocsAfter.NumAllocs - allocsBefore.NumAllocs;
+        stats.NumAllocatedBytes = allocsAfter.NumAllocatedBytes - allocsBefore.NumAllocatedBytes;
+        stats.NumUpdatedInstances = updated.size();
+        stats.NumUploadedBytes = m_uploads.NumBytes;
+    }
+
+    void Run(const char* name, const SceneDesc& desc)
+    {
+        HeadlessScene scene;
+        scene.Build(desc);
+        App::ResetFrameBasic();
+
+        printf("  %s (%zu instances, %zu levels, %u animation tracks, %zu emissive triangles)\n",
+            name, scene.NumInstances(), scene.NumLevels(), scene.NumTracks(), scene.NumEmissiveTriangles());
+
+        const int threadCounts[] = { 1, 2, 4, 8, 16 };
+        const int maxNumThreads = App::GetNumWorkerThreads();
+        double msFrameOneThread = 0.0;
+        float t = 0.0f;
+
+        for (auto n : threadCounts)
+        {
+            if (n > maxNumThreads)
+                break;
+
+            printf("    %d thread(s)\n", n);
+
+            Measure("  BVH build", 5, [&scene, n]() { scene.BuildBVH(n); }, []() { App::ResetFrameBasic(); });
+
+            SmallVector<double> samples[STAGE::COUNT];
+            SmallVector<double> frameSamples;
+            uint64_t numAllocs = 0;
+            uint64_t numAllocatedBytes = 0;
+            size_t numUpdated = 0;
+            size_t numUploadedBytes = 0;
+
+            for (int f = 0; f < NUM_WARMUP_FRAMES + NUM_FRAMES; f++)
+            {
+                FrameStats stats;
+                scene.Frame(t, n, stats);
+                App::ResetFrameBasic();
+                t += FRAME_TIME;
+
+                // Every animated instance (and its subtree) moves every frame
+                Check(stats.NumUpdatedInstances >= scene.NumTracks(),
+                    "Only %zu instances were updated, expected at least %u.",
+                    stats.NumUpdatedInstances, scene.NumTracks());
+
+                if (f < NUM_WARMUP_FRAMES)
+                    continue;
+
+                for (int s = 0; s < STAGE::COUNT; s++)
+                    samples[s].push_back(stats.StageMs[s]);
+
+                frameSamples.push_back(stats.TotalMs);
+                numAllocs += stats.NumAllocs;
+                numAllocatedBytes += stats.NumAllocatedBytes;
+                numUpdated += stats.NumUpdatedInstances;
+                numUploadedBytes += stats.NumUploadedBytes;
+            }
+
+            char label[64];
+
+            for (int s = 0; s < STAGE::COUNT; s++)
+            {
+                snprintf(label, sizeof(label), "  %s", STAGE_NAMES[s]);
+                Report(label, samples[s]);
+            }
+
+            Report("  Frame", frameSamples);
+
+            double sum = 0.0;
+            for (auto ms : frameSamples)
+                sum += ms;
+
+            const double msFrame = sum / NUM_FRAMES;
+            msFrameOneThread = n == 1 ? msFrame : msFrameOneThread;
+
+            printf("      Per frame: %zu updated instances, %.1f KB uploaded, %.1f allocations (%.1f KB)\n",
+                numUpdated / NUM_FRAMES,
+                numUploadedBytes / (1024.0 * NUM_FRAMES),
+                double(numAllocs) / NUM_FRAMES,
+                numAllocatedBytes / (1024.0 * NUM_FRAMES));
+
+            if (n > 1)
+                printf("      Speedup over 1 thread: %.2fx\n", msFrameOneThread / msFrame);
+        }
+    }
+}
+
+ZETA_BENCHMARK(SceneUpdate_Headless)
+{
+    // Crowd -- many independent animated characters, each with a few attached props
+    uint32_t crowd[] = { 4 };
+    Run("Crowd", SceneDesc{ .NumRoots = 8192,
+        .NumChildren = crowd,
+        .AnimatedFraction = 0.5f,
+        .EmissiveFraction = 0.02f,
+        .NumTrisPerEmissive = 64 });
+
+    // City block -- a few animated parents (e.g. vehicles, doors) over mostly static children
+    uint32_t city[] = { 16, 8 };
+    Run("City", SceneDesc{ .NumRoots = 512,
+        .NumChildren = city,
+        .AnimatedFraction = 0.02f,
+        .EmissiveFraction = 0.05f,
+        .NumTrisPerEmissive = 256 });
+}
@@ -0,0 +1,190 @@
+#include "Benchmark.h"
+#include <App/App.h>
+#include <Support/Task.h>
+#include <Utility/RNG.h>
+#include <stdio.h>
+
+using namespace ZetaRay;
+using namespace ZetaRay::Benchmark;
+using namespace ZetaRay::Support;
+using namespace ZetaRay::Util;
+
+namespace
+{
+    static constexpr int NUM_TASK_SETS = 8;
+    // More than TaskSet::MAX_NUM_TASKS_BITMASK, so that the general sorting path is used
+    static constexpr int NUM_TASKS_PER_SET = 96;
+    static constexpr int NUM_TASKS = NUM_TASK_SETS * NUM_TASKS_PER_SET;
+    static constexpr int NUM_ITERATIONS = 50;
+
+    // Random DAG made up of a chain of TaskSets. Inside each TaskSet, edges go from lower
+    // to higher indices (so index order is a valid topological order). Consecutive TaskSets
+    // are connected in the same way as TaskSet::ConnectTo(), i.e. from every leaf of the
+    // former to every root of the latter.
+    struct RandomDAG
+    {
+        RandomDAG(float edgeProbability, uint64_t seed)
+        {
+            RNG rng(seed);
+
+            for (int s = 0; s < NUM_TASK_SETS; s++)
+            {
+                const int base = s * NUM_TASKS_PER_SET;
+
+                for (int i = 0; i < NUM_TASKS_PER_SET; i++)
+                {
+                    // Roughly 1-20 us of work per task
+                    Cost[base + i] = 1000 + rng.UniformUintBounded(20000);
+
+                    for (int j = 0; j < i; j++)
+                    {
+                        if (rng.Uniform() < edgeProbability)
+                        {
+                            // Successors are indices inside the TaskSet
+                            Successors[base + j].push_back(i);
+                            Predecessors[base + i].push_back(base + j);
+                        }
+                    }
+                }
+
+                if (s == 0)
+                    continue;
+
+                // Connect the leaves of previous TaskSet to roots of the current one
+                const int prevBase = base - NUM_TASKS_PER_SET;
+
+                for (int i = 0; i < NUM_TASKS_PER_SET; i++)
+                {
+                    if (!Predecessors[base + i].empty())
+                        continue;
+
+                    for (int j = 0; j < NUM_TASKS_PER_SET; j++)
+                    {
+                        if (Successors[prevBase + j].empty())
+                            Predecessors[base + i].push_back(prevBase + j);
+                    }
+                }
+            }
+        }
+
+        uint32_t Cost[NUM_TASKS];
+        SmallVector<int, Support::SystemAllocator, 4> Successors[NUM_TASKS];
+        SmallVector<int, Support::SystemAllocator, 4> Predecessors[NUM_TASKS];
+        std::atomic_bool Done[NUM_TASKS];
+    };
+
+    ZetaInline void DoWork(uint32_t n)
+    {
+        float x = 1.0f;
+        for (uint32_t i = 0; i < n; i++)
+            x = x * 0.999f + 0.5f;
+
+        DoNotOptimize(x);
+    }
+
+    // Tasks are inserted into the queue once all their dependencies have finished
+    void RunReadyQueue(RandomDAG& dag)
+    {
+        TaskSet ts[NUM_TASK_SETS];
+
+        for (int s = 0; s < NUM_TASK_SETS; s++)
+        {
+            const int base = s * NUM_TASKS_PER_SET;
+
+            for (int i = 0; i < NUM_TASKS_PER_SET; i++)
+            {
+                const int node = base + i;
+                ts[s].EmplaceTask("Node", [&dag, node]()
+                    {
+                        DoWork(dag.Cost[node]);
+                    });
+            }
+
+            for (int i = 0; i < NUM_TASKS_PER_SET; i++)
+            {
+                for (auto j : dag.Successors[base + i])
+                    ts[s].AddOutgoingEdge(i, j);
+            }
+
+            ts[s].Sort();
+        }
+
+        for (int s = 0; s < NUM_TASK_SETS - 1; s++)
+            ts[s].ConnectTo(ts[s + 1]);
+
+        // All TaskSets need to be finalized before any of them is submitted
+        for (int s = 0; s < NUM_TASK_SETS; s++)
+            ts[s].Finalize();
+
+        for (int s = 0; s < NUM_TASK_SETS; s++)
+            App::Submit(ZetaMove(ts[s]));
+
+        App::FlushWorkerThreadPool();
+    }
+
+    // Emulates the scheduling where every task is inserted into the queue upfront (in
+    // topological order) and workers block until the task's dependencies have finished.
+    // Requires at least one worker besides the main thread -- the main thread pops the
+    // newest task, which would wait forever on a predecessor that nobody else can run. 
+    // Workers steal the oldest tasks, so the oldest unfinished task always has all its 
+    // dependencies either finished or running.
+    void RunBlocking(RandomDAG& dag)
+    {
+        for (int i = 0; i < NUM_TASKS; i++)
+            dag.Done[i].store(false, std::memory_order_relaxed);
+
+        for (int node = 0; node < NUM_TASKS; node++)
+        {
+            Task t("Node", TASK_PRIORITY::NORMAL, [&dag, node]()
+                {
+                    for (auto pred : dag.Predecessors[node])
+                        dag.Done[pred].wait(false, std::memory_order_acquire);
+
+                    DoWork(dag.Cost[node]);
+
+                    dag.Done[node].store(true, std::memory_order_release);
+                    dag.Done[node].notify_all();
+                });
+
+            App::Submit(ZetaMove(t));
+        }
+
+        App::FlushWorkerThreadPool();
+    }
+
+    void RunSerial(RandomDAG& dag)
+    {
+        for (int i = 0; i < NUM_TASKS; i++)
+            DoWork(dag.Cost[i]);
+    }
+}
+
+ZETA_BENCHMARK(ThreadPool_RandomDAG)
+{
+    const float edgeProbabilities[] = { 0.05f, 0.2f, 0.5f };
+    auto reset = []() { App::ResetFrameBasic(); };
+
+    uint64_t seed = 0x5f3759df;
+
+    for (auto p : edgeProbabilities)
+    {
+        RandomDAG dag(p, seed++);
+        printf("  %d tasks, edge probability: %.2f\n", NUM_TASKS, p);
+
+        const double serial = Measure("Serial", NUM_ITERATIONS, [&dag]() { RunSerial(dag); });
+        const double readyQueue = Measure("ReadyQueue", NUM_ITERATIONS, [&dag]() { RunReadyQueue(dag); }, reset);
+
+        if (App::GetNumWorkerThreads() < 2)
+        {
+            printf("    Skipping Blocking -- needs at least one worker thread besides the main thread\n");
+            printf("    Speedup over serial -- ready queue: %.2fx\n", serial / readyQueue);
+
+            continue;
+        }
+
+        const double blocking = Measure("Blocking", NUM_ITERATIONS, [&dag]() { RunBlocking(dag); }, reset);
+
+        printf("    Speedup over serial -- blocking: %.2fx, ready queue: %.2fx\n",
+            serial / blocking, serial / readyQueue);
+    }
+}